@@ -1,4 +1,7 @@
+#include <algorithm>
 #include <cmath>
+#include <list>
+#include <memory>
 #include "rt_math.h"
 #include "EdgePreservingDecomposition.h"
 #ifdef _OPENMP
@@ -6,6 +9,7 @@
 #endif
 #include "sleef.c"
 #include "opthelper.h"
+#include "../rtgui/threadutils.h"
 #define pow_F(a,b) (xexpf(b*xlogf(a)))
 
 #define DIAGONALS 5
@@ -163,11 +167,6 @@ float *SparseConjugateGradient(void Ax(float *Product, float *x, void *Pass), fl
 
     }
 
-    if(iterate == MaximumIterates)
-        if(iterate != n && RMSResidual != 0.0f) {
-            printf("Warning: MaximumIterates (%u) reached in SparseConjugateGradient.\n", MaximumIterates);
-        }
-
     if(ax != b) {
         delete[] ax;
     }
@@ -662,7 +661,281 @@ void MultiDiagonalSymmetricMatrix::CholeskyBackSolve(float* RESTRICT x, float* R
     }
 }
 
-EdgePreservingDecomposition::EdgePreservingDecomposition(int width, int height) : a0(nullptr) , a_1(nullptr), a_w(nullptr), a_w_1(nullptr), a_w1(nullptr)
+namespace
+{
+
+//Weight of a fine point at offset Offset from the fine position of a coarse point in the bilinear interpolation.
+inline float InterpolationWeight(int Offset)
+{
+    return Offset == 0 ? 1.0f : (Offset == 1 || Offset == -1) ? 0.5f : 0.0f;
+}
+
+//Row (x, y) of the matrix of a grid as a 3 x 3 stencil, zero toward neighbours outside the grid.
+template<typename G>
+inline void StencilRow(const G &g, int x, int y, float Row[3][3])
+{
+    const int w = g.w, i = x + w * y;
+    const bool Left = x > 0, Right = x < w - 1, Up = y > 0, Down = y < g.h - 1;
+
+    Row[0][0] = Up && Left ? g.a_w_1[i - w - 1] : 0.0f;
+    Row[0][1] = Up ? g.a_w[i - w] : 0.0f;
+    Row[0][2] = Up && Right ? g.a_w1[i - w + 1] : 0.0f;
+    Row[1][0] = Left ? g.a_1[i - 1] : 0.0f;
+    Row[1][1] = g.a0[i];
+    Row[1][2] = Right ? g.a_1[i] : 0.0f;
+    Row[2][0] = Down && Left ? g.a_w1[i] : 0.0f;
+    Row[2][1] = Down ? g.a_w[i] : 0.0f;
+    Row[2][2] = Down && Right ? g.a_w_1[i] : 0.0f;
+}
+
+//Off diagonal part of row (x, y) of the matrix of a grid, times u.
+template<typename G>
+inline float NeighbourProduct(const G &g, const float *u, int x, int y)
+{
+    const int w = g.w, i = x + w * y;
+
+    if(x > 0 && x < w - 1 && y > 0 && y < g.h - 1) {
+        return g.a_1[i - 1] * u[i - 1] + g.a_1[i] * u[i + 1]
+               + g.a_w[i - w] * u[i - w] + g.a_w[i] * u[i + w]
+               + g.a_w_1[i - w - 1] * u[i - w - 1] + g.a_w_1[i] * u[i + w + 1]
+               + g.a_w1[i - w + 1] * u[i - w + 1] + g.a_w1[i] * u[i + w - 1];
+    }
+
+    float Sum = 0.0f;
+
+    if(x > 0) {
+        Sum += g.a_1[i - 1] * u[i - 1];
+    }
+
+    if(x < w - 1) {
+        Sum += g.a_1[i] * u[i + 1];
+    }
+
+    if(y > 0) {
+        Sum += g.a_w[i - w] * u[i - w];
+
+        if(x > 0) {
+            Sum += g.a_w_1[i - w - 1] * u[i - w - 1];
+        }
+
+        if(x < w - 1) {
+            Sum += g.a_w1[i - w + 1] * u[i - w + 1];
+        }
+    }
+
+    if(y < g.h - 1) {
+        Sum += g.a_w[i] * u[i + w];
+
+        if(x > 0) {
+            Sum += g.a_w1[i] * u[i + w - 1];
+        }
+
+        if(x < w - 1) {
+            Sum += g.a_w_1[i] * u[i + w + 1];
+        }
+    }
+
+    return Sum;
+}
+
+}
+
+//Grids smaller than this on either side aren't coarsened any further, but solved by sweeps.
+#define MULTIGRID_COARSEST 8
+#define MULTIGRID_COARSEST_SWEEPS 8
+//Grids with fewer points than this aren't worth the threads.
+#define MULTIGRID_PARALLEL 4096
+
+MultigridPreconditioner::MultigridPreconditioner(MultiDiagonalSymmetricMatrix *A, int w, int h) : A(A)
+{
+    int Levels = 1;
+
+    for(int gw = w, gh = h; gw >= MULTIGRID_COARSEST && gh >= MULTIGRID_COARSEST; gw = gw / 2 + 1, gh = gh / 2 + 1) {
+        Levels++;
+    }
+
+    Grids.resize(Levels);
+
+    Grid &Finest = Grids[0];
+    Finest.w = w;
+    Finest.h = h;
+    Finest.n = w * h;
+    Finest.a0    = A->Diagonals[0];
+    Finest.a_1   = A->Diagonals[1];
+    Finest.a_w1  = A->Diagonals[2];
+    Finest.a_w   = A->Diagonals[3];
+    Finest.a_w_1 = A->Diagonals[4];
+    Finest.r.resize(Finest.n);
+
+    for(int l = 1; l < Levels; l++) {
+        //The coarse points are the even fine points, plus one past the edge when the fine size is even.
+        Grid &g = Grids[l];
+        g.w = Grids[l - 1].w / 2 + 1;
+        g.h = Grids[l - 1].h / 2 + 1;
+        g.n = g.w * g.h;
+        g.Storage.resize(5 * g.n);
+        g.a0    = &g.Storage[0];
+        g.a_1   = &g.Storage[g.n];
+        g.a_w1  = &g.Storage[2 * g.n];
+        g.a_w   = &g.Storage[3 * g.n];
+        g.a_w_1 = &g.Storage[4 * g.n];
+        g.u.resize(g.n);
+        g.b.resize(g.n);
+        g.r.resize(g.n);
+        Coarsen(Grids[l - 1], g);
+    }
+}
+
+void MultigridPreconditioner::Coarsen(const Grid &Fine, Grid &Coarse)
+{
+    //Offsets of the coarse neighbours stored for each coarse point, in the order a0, a_1, a_w1, a_w, a_w_1.
+    const int ox[5] = {0, 1, -1, 0, 1};
+    const int oy[5] = {0, 0, 1, 1, 1};
+
+    //(Pt A P)[I][J] = sum over the fine points i near I and their neighbours j near J of P[i][I] A[i][j] P[j][J]. Row I of Pt A is
+    //gathered first, it spans the 5 x 5 fine points around I, then multiplied by the columns of P. Each thread writes its own rows.
+#ifdef _OPENMP
+    #pragma omp parallel for if(Coarse.n > MULTIGRID_PARALLEL)
+#endif
+
+    for(int Y = 0; Y < Coarse.h; Y++)
+        for(int X = 0; X < Coarse.w; X++) {
+            float PtA[5][5] = {};
+
+            for(int ey = -1; ey <= 1; ey++)
+                for(int ex = -1; ex <= 1; ex++) {
+                    const int xi = 2 * X + ex, yi = 2 * Y + ey;
+
+                    if(xi < 0 || xi >= Fine.w || yi < 0 || yi >= Fine.h) {
+                        continue;
+                    }
+
+                    float Row[3][3];
+                    StencilRow(Fine, xi, yi, Row);
+                    const float pI = InterpolationWeight(ex) * InterpolationWeight(ey);
+
+                    for(int dy = 0; dy < 3; dy++)
+                        for(int dx = 0; dx < 3; dx++) {
+                            PtA[ey + dy + 1][ex + dx + 1] += pI * Row[dy][dx];
+                        }
+                }
+
+            float Sum[5];
+
+            for(int k = 0; k < 5; k++) {
+                Sum[k] = 0.0f;
+
+                for(int v = std::max(2 * oy[k] - 1, -2); v <= std::min(2 * oy[k] + 1, 2); v++)
+                    for(int u = std::max(2 * ox[k] - 1, -2); u <= std::min(2 * ox[k] + 1, 2); u++) {
+                        Sum[k] += PtA[v + 2][u + 2] * InterpolationWeight(u - 2 * ox[k]) * InterpolationWeight(v - 2 * oy[k]);
+                    }
+            }
+
+            //Entries toward coarse points outside the grid stay zero.
+            const int I = X + Coarse.w * Y;
+            const bool Right = X < Coarse.w - 1, Left = X > 0, Down = Y < Coarse.h - 1;
+            Coarse.a0[I] = Sum[0];
+            Coarse.a_1[I] = Right ? Sum[1] : 0.0f;
+            Coarse.a_w1[I] = Down && Left ? Sum[2] : 0.0f;
+            Coarse.a_w[I] = Down ? Sum[3] : 0.0f;
+            Coarse.a_w_1[I] = Down && Right ? Sum[4] : 0.0f;
+        }
+}
+
+void MultigridPreconditioner::Smooth(Grid &g, float *u, const float *b, bool Backward)
+{
+    //Color c holds the points with (y & 1, x & 1) = (c >> 1, c & 1), which only touch points of other colors.
+    for(int k = 0; k < 4; k++) {
+        const int c = Backward ? 3 - k : k;
+#ifdef _OPENMP
+        #pragma omp parallel for if(g.n > MULTIGRID_PARALLEL)
+#endif
+
+        for(int y = c >> 1; y < g.h; y += 2)
+            for(int x = c & 1; x < g.w; x += 2) {
+                const int i = x + g.w * y;
+                u[i] = (b[i] - NeighbourProduct(g, u, x, y)) / g.a0[i];
+            }
+    }
+}
+
+void MultigridPreconditioner::Cycle(size_t Level, float *u, const float *b)
+{
+    Grid &g = Grids[Level];
+
+    memset(u, 0, g.n * sizeof(float));
+
+    if(Level == Grids.size() - 1) {
+        for(int i = 0; i < MULTIGRID_COARSEST_SWEEPS; i++) {
+            Smooth(g, u, b, false);
+            Smooth(g, u, b, true);
+        }
+
+        return;
+    }
+
+    Smooth(g, u, b, false);
+
+    //Residual, restricted to the coarser grid with the transpose of the interpolation.
+    float *r = g.r.data();
+    Grid &c = Grids[Level + 1];
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+#ifdef _OPENMP
+        #pragma omp for
+#endif
+
+        for(int y = 0; y < g.h; y++)
+            for(int x = 0; x < g.w; x++) {
+                const int i = x + g.w * y;
+                r[i] = b[i] - g.a0[i] * u[i] - NeighbourProduct(g, u, x, y);
+            }
+
+#ifdef _OPENMP
+        #pragma omp for
+#endif
+
+        for(int Y = 0; Y < c.h; Y++)
+            for(int X = 0; X < c.w; X++) {
+                float Sum = 0.0f;
+
+                for(int y = std::max(2 * Y - 1, 0); y <= std::min(2 * Y + 1, g.h - 1); y++)
+                    for(int x = std::max(2 * X - 1, 0); x <= std::min(2 * X + 1, g.w - 1); x++) {
+                        Sum += InterpolationWeight(x - 2 * X) * InterpolationWeight(y - 2 * Y) * r[x + g.w * y];
+                    }
+
+                c.b[X + c.w * Y] = Sum;
+            }
+    }
+
+    Cycle(Level + 1, c.u.data(), c.b.data());
+
+    //Interpolate the coarse correction.
+    const float *uc = c.u.data();
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+
+    for(int y = 0; y < g.h; y++) {
+        const float *Row0 = uc + (y >> 1) * c.w, *Row1 = (y & 1) ? Row0 + c.w : Row0;
+
+        for(int x = 0; x < g.w; x++) {
+            const int X0 = x >> 1, X1 = X0 + (x & 1);
+            u[x + g.w * y] += 0.25f * (Row0[X0] + Row0[X1] + Row1[X0] + Row1[X1]);
+        }
+    }
+
+    Smooth(g, u, b, true);
+}
+
+void MultigridPreconditioner::VCycle(float *Product, float *x)
+{
+    Cycle(0, Product, x);
+}
+
+EdgePreservingDecomposition::EdgePreservingDecomposition(int width, int height, const rtengine::CancellationToken& cancellation, bool KeepBlurs) : cancellation(cancellation), KeepBlurs(KeepBlurs), a0(nullptr) , a_1(nullptr), a_w(nullptr), a_w_1(nullptr), a_w1(nullptr)
 {
     w = width;
     h = height;
@@ -694,11 +967,11 @@ EdgePreservingDecomposition::~EdgePreservingDecomposition()
     delete A;
 }
 
-SSEFUNCTION float *EdgePreservingDecomposition::CreateBlur(float *Source, float Scale, float EdgeStopping, int Iterates, float *Blur, bool UseBlurForEdgeStop)
+SSEFUNCTION float *EdgePreservingDecomposition::CreateBlur(float *Source, float Scale, float EdgeStopping, int Iterates, float *Blur, bool UseBlurForEdgeStop, bool WarmStart, float RMSResidual)
 {
 
     if(Blur == nullptr)
-        UseBlurForEdgeStop = false, //Use source if there's no supplied Blur.
+        UseBlurForEdgeStop = WarmStart = false, //Use source if there's no supplied Blur.
         Blur = new float[n];
 
     if(Scale == 0.0f) {
@@ -712,6 +985,8 @@ SSEFUNCTION float *EdgePreservingDecomposition::CreateBlur(float *Source, float
 
     if(UseBlurForEdgeStop) {
         a = new float[n], g = Blur;
+    } else if(WarmStart) {
+        a = new float[n], g = Source;
     } else {
         a = Blur, g = Source;
     }
@@ -839,25 +1114,18 @@ SSEFUNCTION float *EdgePreservingDecomposition::CreateBlur(float *Source, float
         }
     }
 
-    if(UseBlurForEdgeStop) {
+    if(UseBlurForEdgeStop || WarmStart) {
         delete[] a;
     }
 
-    //Solve & return.
-    bool success = A->CreateIncompleteCholeskyFactorization(1); //Fill-in of 1 seems to work really good. More doesn't really help and less hurts (slightly).
-
-    if(!success) {
-        fprintf(stderr, "Error: Tonemapping has failed.\n");
-        memset(Blur, 0, sizeof(float)*n);  // On failure, set the blur to zero.  This is subsequently exponentiated in CompressDynamicRange.
-        return Blur;
-    }
-
-    if(!UseBlurForEdgeStop) {
+    //Solve & return. The multigrid preconditioner replaced the incomplete Cholesky factorization with fill-in of 1, whose back solve
+    //runs on one thread and which leaves most of the error of big blurs after a few iterates.
+    if(!UseBlurForEdgeStop && !WarmStart) {
         memcpy(Blur, Source, n * sizeof(float));
     }
 
-    SparseConjugateGradient(A->PassThroughVectorProduct, Source, n, false, Blur, 0.0f, (void *)A, Iterates, A->PassThroughCholeskyBackSolve);
-    A->KillIncompleteCholeskyFactorization();
+    MultigridPreconditioner Multigrid(A, w, h);
+    SparseConjugateGradient(Multigrid.PassThroughVectorProduct, Source, n, false, Blur, RMSResidual, (void *)&Multigrid, Iterates, Multigrid.PassThroughVCycle);
     return Blur;
 }
 
@@ -878,13 +1146,162 @@ float *EdgePreservingDecomposition::CreateIteratedBlur(float *Source, float Scal
     //Iteratively improve the blur.
     Reweightings++;
 
-    for(int i = 0; i < Reweightings; i++) {
+    for(int i = 0; i < Reweightings && !cancellation.isCancelled(); i++) {
         CreateBlur(Source, Scale, EdgeStopping, Iterates, Blur, true);
     }
 
     return Blur;
 }
 
+namespace
+{
+
+//A blur kept by CompressDynamicRange, with what it was made from.
+struct KeptBlur {
+    int w, h;
+    float Scale, EdgeStopping;
+    int Iterates, Reweightings;
+    double SourceMean;
+    float RMSResidual;
+    std::vector<float> Source, Blur;
+};
+
+//The preview and each detail window have their own size, so keep a few, most recently used first.
+#define KEPT_BLURS 4
+//Deviation from a pure shift, in log luminance, up to which a kept blur is reused as the initial guess. A gamma change leaves a
+//little, from the pixels darker than the eps of CompressDynamicRange, another image content gives tenths.
+#define KEPT_BLUR_MAX_DEVIATION 0.01
+MyMutex KeptBlursMutex;
+std::list<std::shared_ptr<const KeptBlur>> KeptBlurs;
+
+double Mean(const float *x, int n)
+{
+    double Sum = 0.0;
+#ifdef _OPENMP
+    #pragma omp parallel for reduction(+:Sum)
+#endif
+
+    for(int ii = 0; ii < n; ii++) {
+        Sum += x[ii];
+    }
+
+    return Sum / n;
+}
+
+//Root mean square of Source - Kept - Shift, zero when Source is Kept shifted by a constant.
+double ShiftDeviationRMS(const float *Source, const float *Kept, float Shift, int n)
+{
+    double Sum = 0.0;
+#ifdef _OPENMP
+    #pragma omp parallel for reduction(+:Sum)
+#endif
+
+    for(int ii = 0; ii < n; ii++) {
+        const double Deviation = Source[ii] - Kept[ii] - Shift;
+        Sum += Deviation * Deviation;
+    }
+
+    return sqrt(Sum / n);
+}
+
+//Root mean square of b - A x.
+float ResidualRMS(MultiDiagonalSymmetricMatrix *A, float *b, float *x, int n)
+{
+    float *Ax = new float[n];
+    A->VectorProduct(Ax, x);
+    double Sum = 0.0;
+#ifdef _OPENMP
+    #pragma omp parallel for reduction(+:Sum)
+#endif
+
+    for(int ii = 0; ii < n; ii++) {
+        Sum += (b[ii] - Ax[ii]) * (b[ii] - Ax[ii]);
+    }
+
+    delete[] Ax;
+    return sqrt(Sum / n);
+}
+
+}
+
+float *EdgePreservingDecomposition::CreateKeptBlur(float *Source, float Scale, float EdgeStopping, int Iterates, int Reweightings)
+{
+    std::shared_ptr<const KeptBlur> Kept;
+
+    {
+        MyMutex::MyLock lock(KeptBlursMutex);
+
+        for(auto it = KeptBlurs.begin(); it != KeptBlurs.end(); ++it) {
+            if((*it)->w == w && (*it)->h == h) {
+                Kept = *it;
+                KeptBlurs.erase(it);
+                KeptBlurs.push_front(Kept);
+                break;
+            }
+        }
+    }
+
+    float *Blur = new float[n];
+
+    //Only the strength or the detail changed: the blur is the same.
+    if(Kept && Kept->Scale == Scale && Kept->EdgeStopping == EdgeStopping && Kept->Iterates == Iterates && Kept->Reweightings == Reweightings
+            && !memcmp(Kept->Source.data(), Source, n * sizeof(float))) {
+        memcpy(Blur, Kept->Blur.data(), n * sizeof(float));
+        return Blur;
+    }
+
+    const double SourceMean = Mean(Source, n);
+
+    //The matrix only sees differences of Source, and a constant added to Source adds to its blur as is, so the gamma, which
+    //scales the luminance before the logarithm, just shifts the solution. Anything else, e.g. another crop of the same size,
+    //starts cold: from an unrelated blur the capped iterates could end further from the solution than from Source.
+    const float Shift = SourceMean - (Kept ? Kept->SourceMean : 0.0);
+
+    if(Kept && Reweightings == 0 && Kept->Scale == Scale && Kept->EdgeStopping == EdgeStopping && Kept->Iterates == Iterates
+            && ShiftDeviationRMS(Source, Kept->Source.data(), Shift, n) < KEPT_BLUR_MAX_DEVIATION) {
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+
+        for(int ii = 0; ii < n; ii++) {
+            Blur[ii] = Kept->Blur[ii] + Shift;
+        }
+
+        //Stop once as close to the solution as the kept blur was, the preview then matches the output made without it.
+        const float RMSResidual = Kept->RMSResidual;
+        Kept.reset();
+        CreateBlur(Source, Scale, EdgeStopping, Iterates, Blur, false, true, RMSResidual);
+    } else {
+        Kept.reset();
+        CreateIteratedBlur(Source, Scale, EdgeStopping, Iterates, Reweightings, Blur);
+    }
+
+    if(cancellation.isCancelled()) {
+        return Blur;
+    }
+
+    //A holds the matrix of the last solve, unless there was none.
+    const float RMSResidual = Scale == 0.0f ? 0.0f : ResidualRMS(A, Source, Blur, n);
+    std::shared_ptr<KeptBlur> NewBlur(new KeptBlur {w, h, Scale, EdgeStopping, Iterates, Reweightings, SourceMean, RMSResidual, std::vector<float>(Source, Source + n), std::vector<float>(Blur, Blur + n)});
+
+    MyMutex::MyLock lock(KeptBlursMutex);
+
+    for(auto it = KeptBlurs.begin(); it != KeptBlurs.end(); ++it) {
+        if((*it)->w == w && (*it)->h == h) {
+            KeptBlurs.erase(it);
+            break;
+        }
+    }
+
+    KeptBlurs.push_front(NewBlur);
+
+    if(KeptBlurs.size() > KEPT_BLURS) {
+        KeptBlurs.pop_back();
+    }
+
+    return Blur;
+}
+
 SSEFUNCTION void EdgePreservingDecomposition::CompressDynamicRange(float *Source, float Scale, float EdgeStopping, float CompressionExponent, float DetailBoost, int Iterates, int Reweightings)
 {
     if(w < 300 && h < 300) { // set number of Reweightings to zero for small images (thumbnails). We could try to find a better solution here.
@@ -926,7 +1343,12 @@ SSEFUNCTION void EdgePreservingDecomposition::CompressDynamicRange(float *Source
 #endif
 
     //Blur. Also setup memory for Compressed (we can just use u since each element of u is used in one calculation).
-    float *u = CreateIteratedBlur(Source, Scale, EdgeStopping, Iterates, Reweightings);
+    float *u = KeepBlurs ? CreateKeptBlur(Source, Scale, EdgeStopping, Iterates, Reweightings) : CreateIteratedBlur(Source, Scale, EdgeStopping, Iterates, Reweightings);
+
+    if(cancellation.isCancelled()) {
+        delete[] u;
+        return;
+    }
 
     //Apply compression, detail boost, unlogging. Compression is done on the logged data and detail boost on unlogged.
     float temp;
@@ -67,7 +67,9 @@ ben_s or nonbasketless. Enjoy!
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <vector>
 
+#include "cancellation.h"
 #include "opthelper.h"
 #include "noncopyable.h"
 
@@ -134,16 +136,66 @@ public:
 
 };
 
+/* Multigrid approximation of the inverse of the matrices EdgePreservingDecomposition makes, for use as the preconditioner of
+SparseConjugateGradient. The matrix must have the diagonals with start rows 0, 1, w - 1, w and w + 1 of a 9 point stencil on a
+w x h grid. Each coarser grid has half the resolution, and its matrix is the Galerkin product Pt A P with the bilinear
+interpolation P, so that the weak couplings across edges carry over to it. One V-cycle smooths with a Gauss-Seidel sweep in
+4 colors on the way down and the reverse sweep on the way up, which makes it symmetric positive definite as conjugate gradient
+wants. Points of the same color don't touch, so unlike the incomplete Cholesky back solve all of it runs in parallel, and
+the error shrinks at all scales at once, big blurs included. */
+class MultigridPreconditioner :
+    public rtengine::NonCopyable
+{
+public:
+    //The coarse grids are made from the current content of A, which must not change afterwards.
+    MultigridPreconditioner(MultiDiagonalSymmetricMatrix *A, int w, int h);
+
+    //Approximately solves A Product = x with one V-cycle.
+    void VCycle(float *Product, float *x);
+
+    //For SparseConjugateGradient, with this class as the pass through variable.
+    static void PassThroughVectorProduct(float *Product, float *x, void *Pass)
+    {
+        (static_cast<MultigridPreconditioner *>(Pass))->A->VectorProduct(Product, x);
+    };
+    static void PassThroughVCycle(float *Product, float *x, void *Pass)
+    {
+        (static_cast<MultigridPreconditioner *>(Pass))->VCycle(Product, x);
+    };
+
+private:
+    //One grid: its matrix in the layout of the diagonals of A, a0 being the main diagonal and a_1, a_w1, a_w, a_w_1 the ones
+    //starting at rows 1, w - 1, w, w + 1. The finest grid points into A, the coarser ones own their storage.
+    struct Grid {
+        int w, h, n;
+        float *a0, *a_1, *a_w1, *a_w, *a_w_1;
+        std::vector<float> Storage;
+        std::vector<float> u, b, r;    //Solution, right hand side and residual of the coarser grids, and residual of the finest.
+    };
+
+    void Coarsen(const Grid &Fine, Grid &Coarse);
+    void Smooth(Grid &g, float *u, const float *b, bool Backward);
+    void Cycle(size_t Level, float *u, const float *b);
+
+    MultiDiagonalSymmetricMatrix *A;
+    std::vector<Grid> Grids;
+};
+
 class EdgePreservingDecomposition :
     public rtengine::NonCopyable
 {
 public:
-    EdgePreservingDecomposition(int width, int height);
+    //Once 'cancellation' is cancelled, the blurs stop reweighting and CompressDynamicRange leaves Source as it is.
+    //With KeepBlurs, CompressDynamicRange keeps its last blur for each image size: the same Source blurred the same way again
+    //gets it back without solving, and the same Source shifted in log luminance (another gamma) starts the solution from it.
+    EdgePreservingDecomposition(int width, int height, const rtengine::CancellationToken& cancellation = rtengine::CancellationToken(), bool KeepBlurs = false);
     ~EdgePreservingDecomposition();
 
     //Create an edge preserving blur of Source. Will create and return, or fill into Blur if not NULL. In place not ok.
     //If UseBlurForEdgeStop is true, supplied not NULL Blur is used to calculate the edge stopping function instead of Source.
-    float *CreateBlur(float *Source, float Scale, float EdgeStopping, int Iterates, float *Blur = nullptr, bool UseBlurForEdgeStop = false);
+    //If WarmStart is true, supplied not NULL Blur is the initial guess of the solution instead of Source, which it also is with UseBlurForEdgeStop.
+    //The iterates stop early once the residual is below RMSResidual.
+    float *CreateBlur(float *Source, float Scale, float EdgeStopping, int Iterates, float *Blur = nullptr, bool UseBlurForEdgeStop = false, bool WarmStart = false, float RMSResidual = 0.0f);
 
     //Iterates CreateBlur such that the smoothness term approaches a specific norm via iteratively reweighted least squares. In place not ok.
     float *CreateIteratedBlur(float *Source, float Scale, float EdgeStopping, int Iterates, int Reweightings, float *Blur = nullptr);
@@ -155,8 +207,13 @@ public:
     void CompressDynamicRange(float *Source, float Scale = 1.0f, float EdgeStopping = 1.4f, float CompressionExponent = 0.8f, float DetailBoost = 0.1f, int Iterates = 20, int Reweightings = 0);
 
 private:
+    //CreateIteratedBlur, through the blurs kept by the previous calls.
+    float *CreateKeptBlur(float *Source, float Scale, float EdgeStopping, int Iterates, int Reweightings);
+
     MultiDiagonalSymmetricMatrix *A;    //The equations are simple enough to not mandate a matrix class, but fast solution NEEDS a complicated preconditioner.
     int w, h, n;
+    rtengine::CancellationToken cancellation;
+    bool KeepBlurs;
 
     //Convenient access to the data in A.
     float * RESTRICT a0, * RESTRICT a_1, * RESTRICT a_w, * RESTRICT a_w_1, * RESTRICT a_w1;
@@ -37,7 +37,9 @@
 #include "opthelper.h"
 #include "cplx_wavelet_dec.h"
 #include "median.h"
+#include "medianfilter.h"
 #include "iccstore.h"
+#include "fftwplancache.h"
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -74,6 +76,17 @@ extern const Settings* settings;
 
 void ImProcFunctions::Median_Denoise(float **src, float **dst, const int width, const int height, const Median medianType, const int iterations, const int numThreads, float **buffer)
 {
+    if (medianType == Median::TYPE_15X15 || medianType == Median::TYPE_25X25) {
+        // too large for the sorting networks, the histogram based filter costs the same for any window and handles the borders itself
+        const int radius = medianType == Median::TYPE_15X15 ? 7 : 12;
+
+        for (int iteration = 0; iteration < iterations; ++iteration) {
+            medianFilter(iteration == 0 ? src : dst, dst, width, height, radius, numThreads);
+        }
+
+        return;
+    }
+
     int border = 1;
 
     switch (medianType) {
@@ -102,6 +115,11 @@ void ImProcFunctions::Median_Denoise(float **src, float **dst, const int width,
             border = 4;
             break;
         }
+
+        case Median::TYPE_15X15:
+        case Median::TYPE_25X25: {
+            break;
+        }
     }
 
     float **allocBuffer = nullptr;
@@ -342,6 +360,12 @@ void ImProcFunctions::Median_Denoise(float **src, float **dst, const int width,
 
                     break;
                 }
+
+                case Median::TYPE_15X15:
+                case Median::TYPE_25X25: {
+                    // handled by medianFilter() above
+                    break;
+                }
             }
 
             for (; j < width; ++j) {
@@ -699,27 +723,24 @@ SSEFUNCTION void ImProcFunctions::RGB_denoise(int kall, Imagefloat * src, Imagef
             // calculate min size of numblox_W.
             int min_numblox_W = ceil((static_cast<float>((MIN(imwidth, ((numtiles_W - 1) * tileWskip) + tilewidth)) - ((numtiles_W - 1) * tileWskip))) / (offset)) + 2 * blkrad;
 
-            // these are needed only for creation of the plans and will be freed before entering the parallel loop
+            // the plans are owned by the plan cache and kept for the next calls
             fftwf_plan plan_forward_blox[2];
             fftwf_plan plan_backward_blox[2];
 
             if (denoiseLuminance) {
-                float *Lbloxtmp  = reinterpret_cast<float*>( fftwf_malloc(max_numblox_W * TS * TS * sizeof (float)));
-                float *fLbloxtmp = reinterpret_cast<float*>( fftwf_malloc(max_numblox_W * TS * TS * sizeof (float)));
-
                 int nfwd[2] = {TS, TS};
 
                 //for DCT:
                 fftw_r2r_kind fwdkind[2] = {FFTW_REDFT10, FFTW_REDFT10};
                 fftw_r2r_kind bwdkind[2] = {FFTW_REDFT01, FFTW_REDFT01};
 
-                // Creating the plans with FFTW_MEASURE instead of FFTW_ESTIMATE speeds up the execute a bit
-                plan_forward_blox[0]  = fftwf_plan_many_r2r(2, nfwd, max_numblox_W, Lbloxtmp, nullptr, 1, TS * TS, fLbloxtmp, nullptr, 1, TS * TS, fwdkind, FFTW_MEASURE || FFTW_DESTROY_INPUT  );
-                plan_backward_blox[0] = fftwf_plan_many_r2r(2, nfwd, max_numblox_W, fLbloxtmp, nullptr, 1, TS * TS, Lbloxtmp, nullptr, 1, TS * TS, bwdkind, FFTW_MEASURE || FFTW_DESTROY_INPUT  );
-                plan_forward_blox[1]  = fftwf_plan_many_r2r(2, nfwd, min_numblox_W, Lbloxtmp, nullptr, 1, TS * TS, fLbloxtmp, nullptr, 1, TS * TS, fwdkind, FFTW_MEASURE || FFTW_DESTROY_INPUT  );
-                plan_backward_blox[1] = fftwf_plan_many_r2r(2, nfwd, min_numblox_W, fLbloxtmp, nullptr, 1, TS * TS, Lbloxtmp, nullptr, 1, TS * TS, bwdkind, FFTW_MEASURE || FFTW_DESTROY_INPUT  );
-                fftwf_free (Lbloxtmp);
-                fftwf_free (fLbloxtmp);
+                // The plans are created with FFTW_MEASURE instead of FFTW_ESTIMATE, which speeds up the execute a bit.
+                // Measuring is expensive, but it is done only once per geometry thanks to the cache and the saved wisdom
+                FftwPlanCache& fftwPlans = FftwPlanCache::getInstance();
+                plan_forward_blox[0]  = fftwPlans.getManyR2r(2, nfwd, max_numblox_W, fwdkind);
+                plan_backward_blox[0] = fftwPlans.getManyR2r(2, nfwd, max_numblox_W, bwdkind);
+                plan_forward_blox[1]  = fftwPlans.getManyR2r(2, nfwd, min_numblox_W, fwdkind);
+                plan_backward_blox[1] = fftwPlans.getManyR2r(2, nfwd, min_numblox_W, bwdkind);
             }
 
 #ifndef _OPENMP
@@ -803,6 +824,11 @@ SSEFUNCTION void ImProcFunctions::RGB_denoise(int kall, Imagefloat * src, Imagef
 
                 for (int tiletop = 0; tiletop < imheight; tiletop += tileHskip) {
                     for (int tileleft = 0; tileleft < imwidth ; tileleft += tileWskip) {
+                        if (isCancelled()) {
+                            // the result won't be used, skip the remaining tiles
+                            continue;
+                        }
+
                         //printf("titop=%d tileft=%d\n",tiletop/tileHskip, tileleft/tileWskip);
                         pos = (tiletop / tileHskip) * numtiles_W + tileleft / tileWskip ;
                         int tileright = MIN(imwidth, tileleft + tilewidth);
@@ -1097,7 +1123,7 @@ SSEFUNCTION void ImProcFunctions::RGB_denoise(int kall, Imagefloat * src, Imagef
                             levwav = min(maxlev2, levwav);
 
                             //  if (settings->verbose) printf("levwavelet=%i  noisevarA=%f noisevarB=%f \n",levwav, noisevarab_r, noisevarab_b);
-                            Ldecomp = new wavelet_decomposition (labdn->L[0], labdn->W, labdn->H, levwav, 1, 1, max(1, denoiseNestedLevels));
+                            Ldecomp = decomposeWavelet(labdn->L[0], labdn->W, labdn->H, levwav, 1, 1, max(1, denoiseNestedLevels));
 
                             if (Ldecomp->memoryAllocationFailed) {
                                 memoryAllocationFailed = true;
@@ -1134,7 +1160,7 @@ SSEFUNCTION void ImProcFunctions::RGB_denoise(int kall, Imagefloat * src, Imagef
                             float chmaxresid = 0.f;
                             float chmaxresidtemp = 0.f;
 
-                            adecomp = new wavelet_decomposition (labdn->a[0], labdn->W, labdn->H, levwav, 1, 1, max(1, denoiseNestedLevels));
+                            adecomp = decomposeWavelet(labdn->a[0], labdn->W, labdn->H, levwav, 1, 1, max(1, denoiseNestedLevels));
 
                             if (adecomp->memoryAllocationFailed) {
                                 memoryAllocationFailed = true;
@@ -1171,7 +1197,7 @@ SSEFUNCTION void ImProcFunctions::RGB_denoise(int kall, Imagefloat * src, Imagef
                             delete adecomp;
 
                             if (!memoryAllocationFailed) {
-                                wavelet_decomposition* bdecomp = new wavelet_decomposition (labdn->b[0], labdn->W, labdn->H, levwav, 1, 1, max(1, denoiseNestedLevels));
+                                wavelet_decomposition* bdecomp = decomposeWavelet(labdn->b[0], labdn->W, labdn->H, levwav, 1, 1, max(1, denoiseNestedLevels));
 
                                 if (bdecomp->memoryAllocationFailed) {
                                     memoryAllocationFailed = true;
@@ -1308,6 +1334,20 @@ SSEFUNCTION void ImProcFunctions::RGB_denoise(int kall, Imagefloat * src, Imagef
                                         medianTypeL = Median::TYPE_5X5_SOFT;
                                         medianTypeAB = Median::TYPE_9X9;
                                     }
+                                } else if (dnparams.medmethod == "1515") {
+                                    if (metchoice != 4) {
+                                        medianTypeL = medianTypeAB = Median::TYPE_15X15;
+                                    } else {
+                                        medianTypeL = Median::TYPE_5X5_STRONG;
+                                        medianTypeAB = Median::TYPE_15X15;
+                                    }
+                                } else if (dnparams.medmethod == "2525") {
+                                    if (metchoice != 4) {
+                                        medianTypeL = medianTypeAB = Median::TYPE_25X25;
+                                    } else {
+                                        medianTypeL = Median::TYPE_7X7;
+                                        medianTypeAB = Median::TYPE_25X25;
+                                    }
                                 }
 
                                 if (metchoice == 1 || metchoice == 2 || metchoice == 4) {
@@ -1381,6 +1421,9 @@ SSEFUNCTION void ImProcFunctions::RGB_denoise(int kall, Imagefloat * src, Imagef
 #endif
 
                                     for (int vblk = 0; vblk < numblox_H; ++vblk) {
+                                        if (isCancelled()) {
+                                            continue;
+                                        }
 
                                         int top = (vblk - blkrad) * offset;
                                         float * datarow = pBuf + blkrad * offset;
@@ -1725,15 +1768,6 @@ SSEFUNCTION void ImProcFunctions::RGB_denoise(int kall, Imagefloat * src, Imagef
                     }
                 }
             }
-
-            if (denoiseLuminance) {
-                // destroy the plans
-                fftwf_destroy_plan(plan_forward_blox[0]);
-                fftwf_destroy_plan(plan_backward_blox[0]);
-                fftwf_destroy_plan(plan_forward_blox[1]);
-                fftwf_destroy_plan(plan_backward_blox[1]);
-                fftwf_cleanup();
-            }
         } while(memoryAllocationFailed && numTries < 2 && (options.rgbDenoiseThreadLimit == 0) && !ponder);
 
         if (memoryAllocationFailed) {
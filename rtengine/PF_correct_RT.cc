@@ -43,7 +43,7 @@ namespace rtengine
 {
 extern const Settings* settings;
 
-SSEFUNCTION void ImProcFunctions::PF_correct_RT(LabImage * src, LabImage * dst, double radius, int thresh)
+SSEFUNCTION void ImProcFunctions::PF_correct_RT(LabImage * src, LabImage * dst, double radius, int thresh, float globalChromave)
 {
     const int halfwin = ceil(2 * radius) + 1;
 
@@ -125,6 +125,12 @@ SSEFUNCTION void ImProcFunctions::PF_correct_RT(LabImage * src, LabImage * dst,
     }
 
     chromave /= (height * width);
+
+    if (globalChromave >= 0.f) {
+        // src is only a band of the image, use the average of the whole image (see defringeChromaSum)
+        chromave = globalChromave;
+    }
+
     float threshfactor = SQR(thresh / 33.f) * chromave * 5.0f;
 
 
@@ -285,6 +291,62 @@ SSEFUNCTION void ImProcFunctions::PF_correct_RT(LabImage * src, LabImage * dst,
     free(fringe);
 }
 
+// Sum of the (hue modulated) chromaticity deviation which PF_correct_RT averages over the image,
+// computed on rows [firstRow, lastRow[ of lab. Used to defringe an image band by band.
+double ImProcFunctions::defringeChromaSum (LabImage* lab, int firstRow, int lastRow)
+{
+    const int width = lab->W, height = lab->H;
+    const double radius = params->defringe.radius;
+
+    FlatCurve* chCurve = nullptr;
+
+    if (params->defringe.huecurve.size() && FlatCurveType(params->defringe.huecurve.at(0)) > FCT_Linear) {
+        chCurve = new FlatCurve(params->defringe.huecurve);
+    }
+
+    LabImage tmp1(width, height);
+
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+        gaussianBlur (lab->a, tmp1.a, width, height, radius);
+        gaussianBlur (lab->b, tmp1.b, width, height, radius);
+    }
+
+    double chromaSum = 0.0;
+
+#ifdef _OPENMP
+    #pragma omp parallel for reduction(+:chromaSum)
+#endif
+
+    for (int i = firstRow; i < lastRow; i++) {
+        float rowSum = 0.f;
+
+        for (int j = 0; j < width; j++) {
+            float chromaChfactor = 1.0f;
+
+            if (chCurve) {
+                float chparam = float((chCurve->getVal(Color::huelab_to_huehsv2(xatan2f(lab->b[i][j], lab->a[i][j]))) - 0.5f) * 2.0f);
+
+                if (chparam > 0.f) {
+                    chparam /= 2.f;
+                }
+
+                chromaChfactor = 1.0f + chparam;
+            }
+
+            rowSum += SQR(chromaChfactor * (lab->a[i][j] - tmp1.a[i][j])) + SQR(chromaChfactor * (lab->b[i][j] - tmp1.b[i][j]));
+        }
+
+        chromaSum += rowSum;
+    }
+
+    delete chCurve;
+
+    return chromaSum;
+}
+
 SSEFUNCTION void ImProcFunctions::PF_correct_RTcam(CieImage * src, CieImage * dst, double radius, int thresh)
 {
     const int halfwin = ceil(2 * radius) + 1;
@@ -181,6 +181,11 @@ SSEFUNCTION void RawImageSource::amaze_demosaic_RT(int winx, int winy, int winw,
 
         for (int top = winy - 16; top < winy + height; top += ts - 32) {
             for (int left = winx - 16; left < winx + width; left += ts - 32) {
+                if (isCancelled()) {
+                    // the result won't be used, skip the remaining tiles
+                    continue;
+                }
+
                 memset(&nyquist[3 * tsh], 0, sizeof(unsigned char) * (ts - 6) * tsh);
                 //location of tile bottom edge
                 int bottom = min(top + ts, winy + height + 16);
@@ -25,11 +25,23 @@
 #include "alignedbuffer.h"
 #include "rt_math.h"
 #include "opthelper.h"
+#include "widekernels.h"
 
 
 namespace rtengine
 {
 
+// the runtime dispatched vertical pass only exists for float destinations
+template<class A> inline bool boxblurVerticalWide (const float* temp, A** dst, int rady, int W, int H)
+{
+    return false;
+}
+
+inline bool boxblurVerticalWide (const float* temp, float** dst, int rady, int W, int H)
+{
+    return widekernels::boxblurVertical(temp, dst, rady, W, H);
+}
+
 // classical filtering if the support window is small:
 
 template<class T, class A> void boxblur (T** src, A** dst, int radx, int rady, int W, int H)
@@ -188,12 +200,14 @@ template<class T, class A> SSEFUNCTION void boxblur (T** src, A** dst, T* buffer
         vfloat  leninitv = F2V( (float)(rady + 1));
         vfloat  onev = F2V( 1.f );
         vfloat  tempv, temp1v, lenv, lenp1v, lenm1v, rlenv;
+        // the loop below only runs if there is no wider variant for this cpu
+        const int sseEnd = boxblurVerticalWide(temp, dst, rady, W, H) ? 0 : W - 7;
 
 #ifdef _OPENMP
         #pragma omp for
 #endif
 
-        for (int col = 0; col < W - 7; col += 8) {
+        for (int col = 0; col < sseEnd; col += 8) {
             lenv = leninitv;
             tempv = LVFU(temp[0 * W + col]);
             temp1v = LVFU(temp[0 * W + col + 4]);
@@ -135,6 +135,19 @@ public:
         mutex.unlock();
     }
 
+    // Discards the least recently used entries for as long as the
+    // condition holds, e.g. to keep the values within a byte budget
+    // the hook accounts for
+    template<typename Condition>
+    void evictWhile(Condition condition)
+    {
+        mutex.lock();
+        while (!lru_list.empty() && condition()) {
+            discard();
+        }
+        mutex.unlock();
+    }
+
     void clear()
     {
         mutex.lock();
@@ -715,6 +715,13 @@ CameraConstantsStore::~CameraConstantsStore()
 }
 
 void CameraConstantsStore::init(Glib::ustring baseDir, Glib::ustring userSettingsDir)
+{
+    // camconst.json is only parsed when the first raw file needs it
+    this->baseDir = baseDir;
+    this->userSettingsDir = userSettingsDir;
+}
+
+void CameraConstantsStore::parse_camera_constants_files()
 {
     parse_camera_constants_file(Glib::build_filename(baseDir, "camconst.json"));
 
@@ -735,6 +742,8 @@ CameraConstantsStore::getInstance()
 CameraConst *
 CameraConstantsStore::get(const char make[], const char model[])
 {
+    std::call_once(parsed, &CameraConstantsStore::parse_camera_constants_files, this);
+
     Glib::ustring key(make);
     key += " ";
     key += model;
@@ -6,6 +6,7 @@
 
 #include <glibmm.h>
 #include <map>
+#include <mutex>
 
 namespace rtengine
 {
@@ -49,9 +50,13 @@ class CameraConstantsStore
 {
 private:
     std::map<Glib::ustring, CameraConst *> mCameraConstants;
+    Glib::ustring baseDir;
+    Glib::ustring userSettingsDir;
+    std::once_flag parsed;
 
     CameraConstantsStore();
     bool parse_camera_constants_file(Glib::ustring filename);
+    void parse_camera_constants_files();
 
 public:
     ~CameraConstantsStore();
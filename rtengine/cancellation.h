@@ -0,0 +1,76 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <atomic>
+
+#include "noncopyable.h"
+
+namespace rtengine
+{
+
+class CancellationSource;
+
+/**
+ * @brief Tells a running computation that its result isn't wanted anymore
+ *
+ * Tokens are cheap to copy and to poll, so that the processing functions can check them once per row
+ * or per tile, even inside OpenMP loops. A default constructed token is never cancelled.
+ */
+class CancellationToken
+{
+public:
+    CancellationToken () : source(nullptr), generation(0) {}
+
+    bool isCancelled () const
+    {
+        return source && source->load(std::memory_order_relaxed) != generation;
+    }
+
+private:
+    friend class CancellationSource;
+
+    CancellationToken (const std::atomic<unsigned int>* source, unsigned int generation) : source(source), generation(generation) {}
+
+    const std::atomic<unsigned int>* source;
+    unsigned int generation;
+};
+
+/**
+ * @brief Hands out tokens, and cancels all of those handed out so far at once
+ */
+class CancellationSource :
+    public NonCopyable
+{
+public:
+    CancellationSource () : generation(0) {}
+
+    CancellationToken getToken () const
+    {
+        return CancellationToken(&generation, generation);
+    }
+
+    void cancel ()
+    {
+        ++generation;
+    }
+
+private:
+    std::atomic<unsigned int> generation;
+};
+
+}
@@ -17,6 +17,8 @@
 *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <mutex>
+
 #include "rtengine.h"
 #include "color.h"
 #include "iccmatrices.h"
@@ -343,11 +345,6 @@ void Color::init ()
             igammatab_24_17[i] = 65535.0 * igamma24_17 (i / 65535.0);
         }
 
-#ifdef _OPENMP
-        #pragma omp section
-#endif
-        initMunsell();
-
 #ifdef _OPENMP
         #pragma omp section
 #endif
@@ -2752,6 +2749,8 @@ SSEFUNCTION  void Color::LabGamutMunsell(float *labL, float *laba, float *labb,
  */
 void Color::MunsellLch (float lum, float hue, float chrom, float memChprov, float &correction, int zone, float &lbe, bool &correctL)
 {
+    static std::once_flag munsellInitialized;
+    std::call_once(munsellInitialized, initMunsell);
 
     int x = int(memChprov);
     int y = int(chrom);
@@ -90,7 +90,8 @@ private:
     static LUTf  _75GY30, _75GY40, _75GY50, _75GY60, _75GY70, _75GY80;
     static LUTf  _5GY30, _5GY40, _5GY50, _5GY60, _5GY70, _5GY80;
 
-    // Separated from init() to keep the code clear
+    // Separated from init() to keep the code clear; only MunsellLch() reads these tables,
+    // so they are built on its first call
     static void initMunsell ();
     static double hue2rgb(double p, double q, double t);
     static float hue2rgbfloat(float p, float q, float t);
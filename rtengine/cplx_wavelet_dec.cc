@@ -18,11 +18,56 @@
  *  2012 Emil Martinec <ejmartin@uchicago.edu>
  */
 
+#include <cstring>
+#include <new>
+
 #include "cplx_wavelet_dec.h"
 
 namespace rtengine
 {
 
+wavelet_decomposition::wavelet_decomposition(const wavelet_decomposition& other, int numThreads)
+    : coeff0(nullptr), memoryAllocationFailed(false), lvltot(other.lvltot), subsamp(other.subsamp), numThreads(numThreads), m_w(other.m_w), m_h(other.m_h),
+      wavfilt_len(other.wavfilt_len), wavfilt_offset(other.wavfilt_offset), wavfilt_anal(new float[2 * other.wavfilt_len]), wavfilt_synth(new float[2 * other.wavfilt_len])
+{
+    memcpy(wavfilt_anal, other.wavfilt_anal, 2 * wavfilt_len * sizeof(float));
+    memcpy(wavfilt_synth, other.wavfilt_synth, 2 * wavfilt_len * sizeof(float));
+
+    for(int i = 0; i <= lvltot; i++) {
+        wavelet_decomp[i] = nullptr;
+    }
+
+    coeff0 = new (std::nothrow) float[coeff0_size()];
+
+    if(coeff0 == nullptr) {
+        memoryAllocationFailed = true;
+        return;
+    }
+
+    memcpy(coeff0, other.coeff0, coeff0_size() * sizeof(float));
+
+    for(int i = 0; i <= lvltot; i++) {
+        wavelet_decomp[i] = new wavelet_level<internal_type>(*other.wavelet_decomp[i], numThreads);
+
+        if(wavelet_decomp[i]->memoryAllocationFailed) {
+            memoryAllocationFailed = true;
+        }
+    }
+}
+
+std::size_t wavelet_decomposition::memory_size() const
+{
+    std::size_t size = coeff0_size() * sizeof(float);
+
+    for(int i = 0; i <= lvltot; i++) {
+        if(wavelet_decomp[i] != nullptr) {
+            size += std::size_t(3) * level_W(i) * level_H(i) * sizeof(internal_type);
+        }
+    }
+
+    return size;
+}
+
 wavelet_decomposition::~wavelet_decomposition()
 {
     for(int i = 0; i <= lvltot; i++) {
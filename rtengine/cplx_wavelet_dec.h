@@ -55,6 +55,13 @@ private:
 
     wavelet_level<internal_type> * wavelet_decomp[maxlevels];
 
+    wavelet_decomposition(const wavelet_decomposition& other, int numThreads);
+
+    std::size_t coeff0_size() const
+    {
+        return std::size_t(m_w / 2 + 1) * (m_h / 2 + 1);
+    }
+
 public:
 
     template<typename E>
@@ -62,6 +69,15 @@ public:
 
     ~wavelet_decomposition();
 
+    // deep copy of a decomposition which has not been reconstructed yet (reconstruct() consumes the coefficients)
+    wavelet_decomposition* clone(int numThreads) const
+    {
+        return new wavelet_decomposition(*this, numThreads);
+    }
+
+    // memory held by the coefficients, in bytes
+    std::size_t memory_size() const;
+
     internal_type ** level_coeffs(int level) const
     {
         return wavelet_decomp[level]->subbands();
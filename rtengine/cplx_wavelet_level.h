@@ -23,6 +23,7 @@
 #define CPLX_WAVELET_LEVEL_H_INCLUDED
 
 #include <cstddef>
+#include <cstring>
 #include "rt_math.h"
 #include "opthelper.h"
 #include "stdio.h"
@@ -112,6 +113,19 @@ public:
 
     }
 
+    // copy of the coefficients of another level, used by wavelet_decomposition::clone()
+    wavelet_level(const wavelet_level& other, int numThreads)
+        : lvl(other.lvl), subsamp_out(other.subsamp_out), numThreads(numThreads), skip(other.skip), bigBlockOfMemory(true), memoryAllocationFailed(false), wavcoeffs(nullptr), m_w(other.m_w), m_h(other.m_h), m_w2(other.m_w2), m_h2(other.m_h2)
+    {
+        wavcoeffs = create((m_w2) * (m_h2));
+
+        if(!memoryAllocationFailed) {
+            for(int j = 1; j < 4; j++) {
+                memcpy(wavcoeffs[j], other.wavcoeffs[j], (m_w2) * (m_h2) * sizeof(T));
+            }
+        }
+    }
+
     ~wavelet_level()
     {
         destroy(wavcoeffs);
@@ -0,0 +1,86 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+
+#include "cpufeatures.h"
+
+namespace
+{
+
+rtengine::SimdLevel detectSimdLevel()
+{
+    rtengine::SimdLevel level = rtengine::SimdLevel::SCALAR;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("sse2")) {
+        level = rtengine::SimdLevel::SSE2;
+
+        // __builtin_cpu_supports() also checks that the OS saves the wide registers
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            level = rtengine::SimdLevel::AVX2;
+
+            if (__builtin_cpu_supports("avx512f")) {
+                level = rtengine::SimdLevel::AVX512;
+            }
+        }
+    }
+
+#endif
+
+    const char* const limit = std::getenv("RT_SIMD_LEVEL");
+
+    if (limit) {
+        for (rtengine::SimdLevel candidate : {rtengine::SimdLevel::SCALAR, rtengine::SimdLevel::SSE2, rtengine::SimdLevel::AVX2}) {
+            if (!strcmp(limit, rtengine::getSimdLevelName(candidate)) && candidate < level) {
+                level = candidate;
+            }
+        }
+    }
+
+    return level;
+}
+
+}
+
+rtengine::SimdLevel rtengine::getSimdLevel()
+{
+    static const SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+const char* rtengine::getSimdLevelName(SimdLevel level)
+{
+    switch (level) {
+        case SimdLevel::SCALAR:
+            return "scalar";
+
+        case SimdLevel::SSE2:
+            return "sse2";
+
+        case SimdLevel::AVX2:
+            return "avx2";
+
+        case SimdLevel::AVX512:
+            return "avx512";
+    }
+
+    return "unknown";
+}
@@ -0,0 +1,40 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+namespace rtengine
+{
+
+enum class SimdLevel {
+    SCALAR,
+    SSE2,
+    AVX2,   // AVX2 with FMA
+    AVX512  // AVX-512 foundation
+};
+
+/**
+ * @brief Widest vector extension usable by the runtime dispatched kernels
+ *
+ * Detected once through cpuid, so that a build targeting generic x86 still takes the wide paths on
+ * recent CPUs. The RT_SIMD_LEVEL environment variable ("scalar", "sse2", "avx2" or "avx512") lowers
+ * the detected level, which is useful to compare the code paths.
+ */
+SimdLevel getSimdLevel();
+
+const char* getSimdLevelName(SimdLevel level);
+
+}
@@ -21,6 +21,7 @@
 #include <memory>
 #include <cmath>
 #include <cstring>
+#include <mutex>
 #include <glib.h>
 #include <glib/gstdio.h>
 #ifdef _OPENMP
@@ -2129,6 +2130,9 @@ void PerceptualToneCurve::init()
 
 void PerceptualToneCurve::initApplyState(PerceptualToneCurveState & state, Glib::ustring workingSpace) const
 {
+    // the shared ciecam02 state and chroma scaling curve are built by the first curve being applied
+    static std::once_flag initialized;
+    std::call_once(initialized, init);
 
     // Get the curve's contrast value, and convert to a chroma scaling
     const float contrast_value = calculateToneCurveContrastValue();
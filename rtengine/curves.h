@@ -878,8 +878,8 @@ private:
     static float find_tc_slope_fun(float k, void *arg);
     static float get_curve_val(float x, float range[2], float lut[], size_t lut_size);
     float calculateToneCurveContrastValue() const;
-public:
     static void init();
+public:
     void initApplyState(PerceptualToneCurveState & state, Glib::ustring workingSpace) const;
     void Apply(float& r, float& g, float& b, PerceptualToneCurveState & state) const;
 };
@@ -17,6 +17,8 @@
 *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <cstring>
 
@@ -26,6 +28,8 @@
 #include "rawimagesource.h"
 #include "improcfun.h"
 #include "rt_math.h"
+#include "lut3d.h"
+#include "profileindex.h"
 
 using namespace rtengine;
 using namespace rtexif;
@@ -378,6 +382,10 @@ double xyCoordToTemperature(const std::array<double, 2>& white_xy)
 
 }
 
+// Nodes per axis of the table baked by DCPProfile::getStep2Lut(). The axes are sampled uniformly in
+// sqrt(value / 65535), which puts more nodes in the shadows, where the tone curve is the steepest
+constexpr int step2LutLevels = 65;
+
 struct DCPProfile::ApplyState::Data {
     float pro_photo[3][3];
     float work[3][3];
@@ -385,6 +393,7 @@ struct DCPProfile::ApplyState::Data {
     bool use_tone_curve;
     bool apply_look_table;
     float bl_scale;
+    std::shared_ptr<const std::vector<float>> lut;
 };
 
 DCPProfile::ApplyState::ApplyState() :
@@ -1112,6 +1121,8 @@ void DCPProfile::setStep2ApplyState(const Glib::ustring& working_space, bool use
         as_out.data->bl_scale = powf(2, baseline_exposure_offset);
     }
 
+    as_out.data->lut = getStep2Lut(as_out.data->apply_look_table, as_out.data->use_tone_curve);
+
     if (working_space == "ProPhoto") {
         as_out.data->already_pro_photo = true;
     } else {
@@ -1142,7 +1153,6 @@ void DCPProfile::step2ApplyTile(float* rc, float* gc, float* bc, int width, int
 {
 
 #define FCLIP(a) ((a)>0.0?((a)<65535.5?(a):65535.5):0.0)
-#define CLIP01(a) ((a)>0?((a)<1?(a):1):0)
 
     float exp_scale = as_in.data->bl_scale;
 
@@ -1159,6 +1169,12 @@ void DCPProfile::step2ApplyTile(float* rc, float* gc, float* bc, int width, int
             }
         }
     } else {
+        constexpr int max_node = step2LutLevels - 1;
+        constexpr int stride_r = 3 * step2LutLevels * step2LutLevels;
+        constexpr int stride_g = 3 * step2LutLevels;
+        constexpr int stride_b = 3;
+        const float* const nodes = as_in.data->lut->data();
+
         for (int y = 0; y < height; y++) {
             for (int x = 0; x < width; x++) {
                 float r = rc[y * tile_width + x];
@@ -1186,27 +1202,13 @@ void DCPProfile::step2ApplyTile(float* rc, float* gc, float* bc, int width, int
                 newg = FCLIP(newg);
                 newb = FCLIP(newb);
 
-                if (as_in.data->apply_look_table) {
-                    float h, s, v;
-                    Color::rgb2hsvdcp(newr, newg, newb, h, s, v);
-
-                    hsdApply(look_info, look_table, h, s, v);
-                    s = CLIP01(s);
-                    v = CLIP01(v);
-
-                    // RT range correction
-                    if (h < 0.0f) {
-                        h += 6.0f;
-                    } else if (h >= 6.0f) {
-                        h -= 6.0f;
-                    }
-
-                    Color::hsv2rgbdcp( h, s, v, newr, newg, newb);
-                }
-
-                if (as_in.data->use_tone_curve) {
-                    tone_curve.Apply(newr, newg, newb);
-                }
+                const float fr = std::min(std::sqrt(newr * (1.f / 65535.f)), 1.f) * max_node;
+                const float fg = std::min(std::sqrt(newg * (1.f / 65535.f)), 1.f) * max_node;
+                const float fb = std::min(std::sqrt(newb * (1.f / 65535.f)), 1.f) * max_node;
+                const int ir = std::min(static_cast<int>(fr), max_node - 1);
+                const int ig = std::min(static_cast<int>(fg), max_node - 1);
+                const int ib = std::min(static_cast<int>(fb), max_node - 1);
+                lut3dInterpolate(nodes + ir * stride_r + ig * stride_g + ib * stride_b, stride_r, stride_g, stride_b, fr - ir, fg - ig, fb - ib, newr, newg, newb);
 
                 if (as_in.data->already_pro_photo) {
                     rc[y * tile_width + x] = newr;
@@ -1222,6 +1224,76 @@ void DCPProfile::step2ApplyTile(float* rc, float* gc, float* bc, int width, int
     }
 }
 
+void DCPProfile::step2ApplyPixel(bool apply_look_table, bool use_tone_curve, float& r, float& g, float& b) const
+{
+#define CLIP01(a) ((a)>0?((a)<1?(a):1):0)
+
+    if (apply_look_table) {
+        float h, s, v;
+        Color::rgb2hsvdcp(r, g, b, h, s, v);
+
+        hsdApply(look_info, look_table, h, s, v);
+        s = CLIP01(s);
+        v = CLIP01(v);
+
+        // RT range correction
+        if (h < 0.0f) {
+            h += 6.0f;
+        } else if (h >= 6.0f) {
+            h -= 6.0f;
+        }
+
+        Color::hsv2rgbdcp( h, s, v, r, g, b);
+    }
+
+    if (use_tone_curve) {
+        tone_curve.Apply(r, g, b);
+    }
+}
+
+std::shared_ptr<const std::vector<float>> DCPProfile::getStep2Lut(bool apply_look_table, bool use_tone_curve)
+{
+    if (!apply_look_table && !use_tone_curve) {
+        return nullptr;
+    }
+
+    MyMutex::MyLock lock(step2_lut_mutex);
+
+    std::shared_ptr<const std::vector<float>>& lut = step2_luts[apply_look_table + 2 * use_tone_curve - 1];
+
+    if (!lut) {
+        // The look table and the tone curve only depend on the clipped ProPhoto values, so they are
+        // sampled once per profile; the exposure scale and the working space matrices stay outside
+        constexpr int max_node = step2LutLevels - 1;
+        std::vector<float> nodes(3 * step2LutLevels * step2LutLevels * step2LutLevels);
+        float values[step2LutLevels];
+
+        for (int i = 0; i < step2LutLevels; ++i) {
+            values[i] = 65535.f * SQR(static_cast<float>(i) / max_node);
+        }
+
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+
+        for (int i = 0; i < step2LutLevels; ++i) {
+            for (int j = 0; j < step2LutLevels; ++j) {
+                for (int k = 0; k < step2LutLevels; ++k) {
+                    float* const node = &nodes[3 * ((i * step2LutLevels + j) * step2LutLevels + k)];
+                    node[0] = values[i];
+                    node[1] = values[j];
+                    node[2] = values[k];
+                    step2ApplyPixel(apply_look_table, use_tone_curve, node[0], node[1], node[2]);
+                }
+            }
+        }
+
+        lut = std::make_shared<const std::vector<float>>(std::move(nodes));
+    }
+
+    return lut;
+}
+
 DCPProfile::Matrix DCPProfile::findXyztoCamera(const std::array<double, 2>& white_xy, int preferred_illuminant) const
 {
     bool has_col_1 = has_color_matrix_1;
@@ -1722,49 +1794,10 @@ void DCPStore::init(const Glib::ustring& rt_profile_dir, bool loadAll)
         return;
     }
 
-    if (!rt_profile_dir.empty()) {
-        std::deque<Glib::ustring> dirs = {
-            rt_profile_dir
-        };
-
-        while (!dirs.empty()) {
-            // Process directory
-            Glib::ustring dirname = dirs.back();
-            dirs.pop_back();
-
-            std::unique_ptr<Glib::Dir> dir;
-
-            try {
-                if (!Glib::file_test(dirname, Glib::FILE_TEST_IS_DIR)) {
-                    return;
-                }
-
-                dir.reset(new Glib::Dir(dirname));
-            } catch (Glib::Exception& exception) {
-                return;
-            }
-
-            for (const Glib::ustring& sname : *dir) {
-                const Glib::ustring fname = Glib::build_filename(dirname, sname);
-
-                if (!Glib::file_test(fname, Glib::FILE_TEST_IS_DIR)) {
-                    // File
-                    const auto lastdot = sname.rfind('.');
-
-                    if (
-                        lastdot != Glib::ustring::npos
-                        && lastdot <= sname.size() - 4
-                        && !sname.casefold().compare(lastdot, 4, ".dcp")
-                    ) {
-                        const Glib::ustring cam_short_name = sname.substr(0, lastdot).uppercase();
-                        file_std_profiles[cam_short_name] = fname; // They will be loaded and cached on demand
-                    }
-                } else {
-                    // Directory
-                    dirs.push_front(fname);
-                }
-            }
-        }
+    // They will be loaded and cached on demand
+    for (const auto& entry : ProfileIndex::list(rt_profile_dir, {"dcp"}, true, false)) {
+        const Glib::ustring cam_short_name = entry.fileName.substr(0, entry.fileName.size() - 4).uppercase();
+        file_std_profiles[cam_short_name] = entry.path;
     }
 }
 
@@ -121,6 +121,8 @@ private:
     Matrix makeXyzCam(const ColorTemp& white_balance, const Triple& pre_mul, const Matrix& cam_wb_matrix, int preferred_illuminant) const;
     std::vector<HsbModify> makeHueSatMap(const ColorTemp& white_balance, int preferred_illuminant) const;
     void hsdApply(const HsdTableInfo& table_info, const std::vector<HsbModify>& table_base, float& h, float& s, float& v) const;
+    void step2ApplyPixel(bool apply_look_table, bool use_tone_curve, float& r, float& g, float& b) const;
+    std::shared_ptr<const std::vector<float>> getStep2Lut(bool apply_look_table, bool use_tone_curve);
 
     Matrix color_matrix_1;
     Matrix color_matrix_2;
@@ -146,6 +148,10 @@ private:
     short light_source_2;
 
     AdobeToneCurve tone_curve;
+
+    // Look table and tone curve baked by getStep2Lut(), indexed by apply_look_table + 2 * use_tone_curve - 1
+    MyMutex step2_lut_mutex;
+    std::shared_ptr<const std::vector<float>> step2_luts[3];
 };
 
 class DCPStore final :
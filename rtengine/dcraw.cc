@@ -258,6 +258,16 @@ void CLASS merror (void *ptr, const char *where)
 }
 
 void CLASS derror()
+{
+  derror (ifp);
+}
+
+/*RT reports the position of the file the caller reads, the parallel decoders each have their own */
+void CLASS derror (IMFILE *ifp)
+{
+#ifdef _OPENMP
+#pragma omp critical(dcraw_derror)
+#endif
 {
   if (!data_error) {
     fprintf (stderr, "%s: ", ifname);
@@ -271,6 +281,7 @@ void CLASS derror()
 #endif
   }
   data_error++;
+}
 /*RT Issue 2467  longjmp (failure, 1);*/
 }
 
@@ -627,6 +638,14 @@ inline unsigned CLASS getbithuff_t::operator() (int nbits, ushort *huff)
 	1111111		0xff
  */
 ushort * CLASS make_decoder_ref (const uchar **source)
+{
+  ushort *huff = make_decoder_alloc (source);
+  merror (huff, "make_decoder()");
+  return huff;
+}
+
+/*RT returns 0 when out of memory instead of jumping to failure, which can't be done from the parallel decoders */
+ushort * CLASS make_decoder_alloc (const uchar **source)
 {
   int max, len, h, i, j;
   const uchar *count;
@@ -635,7 +654,7 @@ ushort * CLASS make_decoder_ref (const uchar **source)
   count = (*source += 16) - 17;
   for (max=16; max && !count[max]; max--);
   huff = (ushort *) calloc (1 + (1 << max), sizeof *huff);
-  merror (huff, "make_decoder()");
+  if (!huff) return 0;
   huff[0] = max;
   for (h=len=1; len <= max; len++)
     for (i=0; i < count[len]; i++, ++*source)
@@ -798,6 +817,17 @@ struct jhead {
 };
 
 int CLASS ljpeg_start (struct jhead *jh, int info_only)
+{
+  const int ret = ljpeg_start (jh, info_only, ifp);
+  if (ret < 0) merror (0, "ljpeg_start()");
+  if (!ret) return 0;
+  if (!info_only) zero_after_ff = 1;
+  return 1;
+}
+
+/*RT the ifp and getbithuff parameters of the reentrant versions below shadow the members.
+     This one returns -1 when out of memory, the caller has to report it. */
+int CLASS ljpeg_start (struct jhead *jh, int info_only, IMFILE *ifp)
 {
   ushort c, tag, len;
   uchar data[0x10000];
@@ -827,7 +857,10 @@ int CLASS ljpeg_start (struct jhead *jh, int info_only)
       case 0xffc4:
 	if (info_only) break;
 	for (dp = data; dp < data+len && !((c = *dp++) & -20); )
-	  jh->free[c] = jh->huff[c] = make_decoder_ref (&dp);
+	  if (!(jh->free[c] = jh->huff[c] = make_decoder_alloc (&dp))) {
+	    ljpeg_end (jh);
+	    return -1;
+	  }
 	break;
       case 0xffda:
 	jh->psv = data[1+data[0]*2];
@@ -850,8 +883,11 @@ int CLASS ljpeg_start (struct jhead *jh, int info_only)
     FORC(jh->sraw) jh->huff[1+c] = jh->huff[0];
   }
   jh->row = (ushort *) calloc (2 * jh->wide*jh->clrs, 4);
-  merror (jh->row, "ljpeg_start()");
-  return zero_after_ff = 1;
+  if (!jh->row) {
+    ljpeg_end (jh);
+    return -1;
+  }
+  return 1;
 }
 
 void CLASS ljpeg_end (struct jhead *jh)
@@ -862,6 +898,11 @@ void CLASS ljpeg_end (struct jhead *jh)
 }
 
 inline int CLASS ljpeg_diff (ushort *huff)
+{
+  return ljpeg_diff (huff, getbithuff);
+}
+
+inline int CLASS ljpeg_diff (ushort *huff, getbithuff_t &getbithuff)
 {
   int len, diff;
 
@@ -875,6 +916,11 @@ inline int CLASS ljpeg_diff (ushort *huff)
 }
 
 ushort * CLASS ljpeg_row (int jrow, struct jhead *jh)
+{
+  return ljpeg_row (jrow, jh, ifp, getbithuff);
+}
+
+ushort * CLASS ljpeg_row (int jrow, struct jhead *jh, IMFILE *ifp, getbithuff_t &getbithuff)
 {
   int col, c, diff, pred, spred=0;
   ushort mark=0, *row[3];
@@ -891,7 +937,7 @@ ushort * CLASS ljpeg_row (int jrow, struct jhead *jh)
   FORC3 row[c] = (jh->row + ((jrow & 1) + 1) * (jh->wide*jh->clrs*((jrow+c) & 1)));
   for (col=0; col < jh->wide; col++)
     FORC(jh->clrs) {
-      diff = ljpeg_diff (jh->huff[c]);
+      diff = ljpeg_diff (jh->huff[c], getbithuff);
       if (jh->sraw && c <= jh->sraw && (col | c))
 		    pred = spred;
       else if (col) pred = row[0][-jh->clrs];
@@ -905,13 +951,73 @@ ushort * CLASS ljpeg_row (int jrow, struct jhead *jh)
 	case 7: pred = (pred + row[1][0]) >> 1;				break;
 	default: pred = 0;
       }
-      if (UNLIKELY((**row = pred + diff) >> jh->bits)) derror();
+      if (UNLIKELY((**row = pred + diff) >> jh->bits)) derror (ifp);
       if (c <= jh->sraw) spred = **row;
       row[0]++; row[1]++;
     }
   return row[2];
 }
 
+/*RT
+   Restart intervals made of whole rows and predicted from the left neighbour
+   only (psv 1) don't depend on each other. A pre-scan of the entropy coded
+   data for the restart markers gives their starts, so that they can be
+   decoded in parallel into jimage. Returns false if the stream can't be split.
+ */
+bool CLASS ljpeg_decode_restarts (struct jhead *jh, std::vector<ushort> &jimage)
+{
+  if (jh->restart <= 0 || jh->restart == INT_MAX || jh->restart % jh->wide || jh->psv != 1)
+    return false;
+  const int rows = jh->restart / jh->wide;
+  const int intervals = (jh->high + rows - 1) / rows;
+  if (intervals < 2)
+    return false;
+
+  std::vector<int> starts (intervals);
+  starts[0] = ftell (ifp);
+  const uchar *data = fdata (0, ifp);
+  int found = 1;
+  for (int pos = starts[0]; found < intervals && pos < ifp->size - 1; pos++)
+    if (data[pos] == 0xff) {
+      const uchar marker = data[pos+1];
+      if (marker >= 0xd0 && marker <= 0xd7)
+	starts[found++] = ++pos + 1;
+      else if (marker == 0xd9)
+	break;
+      else if (!marker)
+	pos++;
+    }
+  if (found < intervals)
+    return false;
+
+  const int jwide = jh->wide * jh->clrs;
+  jimage.resize ((size_t) jh->high * jwide);
+  bool success = true;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int i = 0; i < intervals; i++) {
+    IMFILE file = *ifp;
+    file.plistener = nullptr;
+    IMFILE *fp = &file;
+    unsigned zero = 1;
+    getbithuff_t bits (this, fp, zero);
+    struct jhead tjh = *jh;
+    tjh.row = (ushort *) calloc (2 * jwide, 4);
+    if (!tjh.row) {
+      success = false;
+      continue;
+    }
+    fseek (fp, starts[i], SEEK_SET);
+    for (int jrow = i * rows; jrow < std::min ((i+1) * rows, jh->high); jrow++)
+      memcpy (&jimage[(size_t) jrow * jwide], ljpeg_row (jrow, &tjh, fp, bits), jwide * sizeof (ushort));
+    free (tjh.row);
+  }
+
+  return success;
+}
+
 void CLASS lossless_jpeg_load_raw()
 {
   struct jhead jh;
@@ -919,29 +1025,12 @@ void CLASS lossless_jpeg_load_raw()
 
   if (!ljpeg_start (&jh, 0)) return;
   int jwide = jh.wide * jh.clrs;
-  ushort *rp[2];
-  rp[0] = ljpeg_row (0, &jh);
 
-  for (int jrow=0; jrow < jh.high; jrow++) {
-#ifdef _OPENMP
-#pragma omp parallel sections
-#endif
-{
-#ifdef _OPENMP
-    #pragma omp section
-#endif
-    {
-        if(jrow < jh.high - 1)
-            rp[(jrow + 1)&1] = ljpeg_row (jrow + 1, &jh);
-    }
-#ifdef _OPENMP
-     #pragma omp section
-#endif
-    {
+  auto copy_row = [&] (const ushort *rp, int jrow) {
     if (load_flags & 1)
       row = jrow & 1 ? height-1-jrow/2 : jrow/2;
     for (int jcol=0; jcol < jwide; jcol++) {
-      int val = curve[*rp[jrow&1]++];
+      int val = curve[*rp++];
       if (cr2_slice[0]) {
 	int jidx = jrow*jwide + jcol;
 	int i = jidx / (cr2_slice[1]*raw_height);
@@ -958,6 +1047,36 @@ void CLASS lossless_jpeg_load_raw()
       if (++col >= raw_width)
 	col = (row++,0);
     }
+  };
+
+  std::vector<ushort> jimage;
+  if (ljpeg_decode_restarts (&jh, jimage)) {
+    for (int jrow=0; jrow < jh.high; jrow++)
+      copy_row (&jimage[(size_t) jrow * jwide], jrow);
+    ljpeg_end (&jh);
+    return;
+  }
+
+  ushort *rp[2];
+  rp[0] = ljpeg_row (0, &jh);
+
+  for (int jrow=0; jrow < jh.high; jrow++) {
+#ifdef _OPENMP
+#pragma omp parallel sections
+#endif
+{
+#ifdef _OPENMP
+    #pragma omp section
+#endif
+    {
+        if(jrow < jh.high - 1)
+            rp[(jrow + 1)&1] = ljpeg_row (jrow + 1, &jh);
+    }
+#ifdef _OPENMP
+     #pragma omp section
+#endif
+    {
+      copy_row (rp[jrow&1], jrow);
     }
 }
   }
@@ -1055,20 +1174,28 @@ void CLASS adobe_copy_pixel (unsigned row, unsigned col, ushort **rp)
 }
 
 void CLASS ljpeg_idct (struct jhead *jh)
+{
+  ljpeg_idct (jh, getbithuff);
+}
+
+void CLASS ljpeg_idct (struct jhead *jh, getbithuff_t &getbithuff)
 {
   int c, i, j, len, skip, coef;
   float work[3][8][8];
-  static float cs[106] = { 0 };
+  /*RT initialized once, ljpeg_idct is called from the parallel tile decoder */
+  static const struct cs_table {
+    float v[106];
+    cs_table() { for (int c=0; c < 106; c++) v[c] = cos((c & 31)*rtengine::RT_PI/16)/2; }
+  } cs_init;
+  const float *cs = cs_init.v;
   static const uchar zigzag[80] =
   {  0, 1, 8,16, 9, 2, 3,10,17,24,32,25,18,11, 4, 5,12,19,26,33,
     40,48,41,34,27,20,13, 6, 7,14,21,28,35,42,49,56,57,50,43,36,
     29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,
     47,55,62,63,63,63,63,63,63,63,63,63,63,63,63,63,63,63,63,63 };
 
-  if (!cs[0])
-    FORC(106) cs[c] = cos((c & 31)*rtengine::RT_PI/16)/2;
   memset (work, 0, sizeof work);
-  work[0][0][0] = jh->vpred[0] += ljpeg_diff (jh->huff[0]) * jh->quant[0];
+  work[0][0][0] = jh->vpred[0] += ljpeg_diff (jh->huff[0], getbithuff) * jh->quant[0];
   for (i=1; i < 64; i++ ) {
     len = gethuff (jh->huff[16]);
     i += skip = len >> 4;
@@ -1092,48 +1219,90 @@ void CLASS ljpeg_idct (struct jhead *jh)
 
 void CLASS lossless_dng_load_raw()
 {
-  unsigned save, trow=0, tcol=0, jwide, jrow, jcol, row, col, i, j;
-  struct jhead jh;
-  ushort *rp;
+  unsigned trow=0, tcol=0;
 
+  if (tile_length == INT_MAX) {
+    zero_after_ff = 1;
+    if (!lossless_dng_load_tile (trow, tcol, ifp, getbithuff))
+      merror (0, "lossless_dng_load_raw()");
+    return;
+  }
+
+  /*RT the tiles are independent lossless JPEG streams, decode them in parallel */
+  std::vector<unsigned> offsets, trows, tcols;
   while (trow < raw_height) {
-    save = ftell(ifp);
-    if (tile_length < INT_MAX)
-      fseek (ifp, get4(), SEEK_SET);
-    if (!ljpeg_start (&jh, 0)) break;
-    jwide = jh.wide;
-    if (filters) jwide *= jh.clrs;
-    jwide /= MIN (is_raw, tiff_samples);
-    switch (jh.algo) {
-      case 0xc1:
-	jh.vpred[0] = 16384;
-	getbits(-1);
-	for (jrow=0; jrow+7 < jh.high; jrow += 8) {
-	  for (jcol=0; jcol+7 < jh.wide; jcol += 8) {
-	    ljpeg_idct (&jh);
-	    rp = jh.idct;
-	    row = trow + jcol/tile_width + jrow*2;
-	    col = tcol + jcol%tile_width;
-	    for (i=0; i < 16; i+=2)
-	      for (j=0; j < 8; j++)
-		adobe_copy_pixel (row+i, col+j, &rp);
-	  }
-	}
-	break;
-      case 0xc3:
-	for (row=col=jrow=0; jrow < jh.high; jrow++) {
-	  rp = ljpeg_row (jrow, &jh);
-	  for (jcol=0; jcol < jwide; jcol++) {
-	    adobe_copy_pixel (trow+row, tcol+col, &rp);
-	    if (++col >= tile_width || col >= raw_width)
-	      row += 1 + (col = 0);
-	  }
-	}    }
-    fseek (ifp, save+4, SEEK_SET);
+    offsets.push_back (get4());
+    trows.push_back (trow);
+    tcols.push_back (tcol);
     if ((tcol += tile_width) >= raw_width)
       trow += tile_length + (tcol = 0);
-    ljpeg_end (&jh);
   }
+
+  /*RT merror() can't jump out of the parallel loop, the failures are reported once it is over */
+  int failures = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (size_t t = 0; t < offsets.size(); t++) {
+    IMFILE file = *ifp;
+    file.plistener = nullptr;
+    IMFILE *fp = &file;
+    unsigned zero = 1;
+    getbithuff_t bits (this, fp, zero);
+    fseek (fp, offsets[t], SEEK_SET);
+    if (!lossless_dng_load_tile (trows[t], tcols[t], fp, bits)) {
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+      failures++;
+    }
+  }
+
+  if (failures)
+    merror (0, "lossless_dng_load_raw()");
+}
+
+/*RT returns false when out of memory, tiles with invalid data are skipped */
+bool CLASS lossless_dng_load_tile (unsigned trow, unsigned tcol, IMFILE *ifp, getbithuff_t &getbithuff)
+{
+  unsigned jwide, jrow, jcol, row, col, i, j;
+  struct jhead jh;
+  ushort *rp;
+
+  const int started = ljpeg_start (&jh, 0, ifp);
+  if (started <= 0) return started == 0;
+  jwide = jh.wide;
+  if (filters) jwide *= jh.clrs;
+  jwide /= MIN (is_raw, tiff_samples);
+  switch (jh.algo) {
+    case 0xc1:
+      jh.vpred[0] = 16384;
+      getbits(-1);
+      for (jrow=0; jrow+7 < jh.high; jrow += 8) {
+	for (jcol=0; jcol+7 < jh.wide; jcol += 8) {
+	  ljpeg_idct (&jh, getbithuff);
+	  rp = jh.idct;
+	  row = trow + jcol/tile_width + jrow*2;
+	  col = tcol + jcol%tile_width;
+	  for (i=0; i < 16; i+=2)
+	    for (j=0; j < 8; j++)
+	      adobe_copy_pixel (row+i, col+j, &rp);
+	}
+      }
+      break;
+    case 0xc3:
+      for (row=col=jrow=0; jrow < jh.high; jrow++) {
+	rp = ljpeg_row (jrow, &jh, ifp, getbithuff);
+	for (jcol=0; jcol < jwide; jcol++) {
+	  adobe_copy_pixel (trow+row, tcol+col, &rp);
+	  if (++col >= tile_width || col >= raw_width)
+	    row += 1 + (col = 0);
+	}
+      }
+  }
+  ljpeg_end (&jh);
+  return true;
 }
 
 void CLASS packed_dng_load_raw()
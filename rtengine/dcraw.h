@@ -22,6 +22,7 @@
 
 #include "myfile.h"
 #include <csetjmp>
+#include <vector>
 
 
 class DCraw
@@ -215,6 +216,7 @@ protected:
 int fcol (int row, int col);
 void merror (void *ptr, const char *where);
 void derror();
+void derror (IMFILE *ifp);
 ushort sget2 (uchar *s);
 ushort get2();
 unsigned sget4 (uchar *s);
@@ -243,7 +245,7 @@ public:
 
 private:
    void derror(){
-	   parent->derror();
+	   parent->derror(ifp);
    }
    DCraw *parent;
    unsigned bitbuf;
@@ -254,6 +256,7 @@ private:
 getbithuff_t getbithuff;
 
 ushort * make_decoder_ref (const uchar **source);
+ushort * make_decoder_alloc (const uchar **source);
 ushort * make_decoder (const uchar *source);
 void crw_init_tables (unsigned table, ushort *huff[2]);
 int canon_has_lowbits();
@@ -264,11 +267,18 @@ int ljpeg_diff (ushort *huff);
 ushort * ljpeg_row (int jrow, struct jhead *jh);
 void lossless_jpeg_load_raw();
 void ljpeg_idct (struct jhead *jh);
+// reentrant versions reading from their own file position and bit reader, for the parallel decoders
+int ljpeg_start (struct jhead *jh, int info_only, IMFILE *ifp);
+int ljpeg_diff (ushort *huff, getbithuff_t &getbithuff);
+ushort * ljpeg_row (int jrow, struct jhead *jh, IMFILE *ifp, getbithuff_t &getbithuff);
+void ljpeg_idct (struct jhead *jh, getbithuff_t &getbithuff);
+bool ljpeg_decode_restarts (struct jhead *jh, std::vector<ushort> &jimage);
 
 
 void canon_sraw_load_raw();
 void adobe_copy_pixel (unsigned row, unsigned col, ushort **rp);
 void lossless_dng_load_raw();
+bool lossless_dng_load_tile (unsigned trow, unsigned tcol, IMFILE *ifp, getbithuff_t &getbithuff);
 void packed_dng_load_raw();
 void deflate_dng_load_raw();
 void init_fuji_compr(struct fuji_compressed_params* info);
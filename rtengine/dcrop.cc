@@ -19,6 +19,7 @@
  */
 #include "dcrop.h"
 #include "curves.h"
+#include "idlerender.h"
 #include "mytime.h"
 #include "refreshmap.h"
 #include "rt_math.h"
@@ -40,7 +41,7 @@ namespace rtengine
 
 extern const Settings* settings;
 
-Crop::Crop (ImProcCoordinator* parent, EditDataProvider *editDataProvider, bool isDetailWindow)
+Crop::Crop (ImProcCoordinator* parent, EditDataProvider *editDataProvider, bool isDetailWindow, bool isIdleRender)
     : PipetteBuffer(editDataProvider), origCrop(nullptr), laboCrop(nullptr), labnCrop(nullptr),
       cropImg(nullptr), cbuf_real(nullptr), cshmap(nullptr), transCrop(nullptr), cieCrop(nullptr), cbuffer(nullptr),
       updating(false), newUpdatePending(false), skip(10),
@@ -49,9 +50,11 @@ Crop::Crop (ImProcCoordinator* parent, EditDataProvider *editDataProvider, bool
       rqcropx(0), rqcropy(0), rqcropw(-1), rqcroph(-1),
       borderRequested(32), upperBorder(0), leftBorder(0),
       cropAllocated(false),
-      cropImageListener(nullptr), parent(parent), isDetailWindow(isDetailWindow)
+      cropImageListener(nullptr), parent(parent), isDetailWindow(isDetailWindow), isIdleRender(isIdleRender), staleBuffers(false)
 {
-    parent->crops.push_back (this);
+    if (!isIdleRender) {
+        parent->crops.push_back (this);
+    }
 }
 
 Crop::~Crop ()
@@ -121,6 +124,17 @@ void Crop::setEditSubscriber(EditSubscriber* newSubscriber)
     // If oldSubscriber == NULL && newSubscriber != NULL && newSubscriber->getEditingType() == ET_PIPETTE-> the image will be allocated when necessary
 }
 
+bool Crop::isCancelled()
+{
+    if (parent->ipf.isCancelled() || (isIdleRender && parent->idleRender.isCancelled())) {
+        // the buffers hold partial results, the next update has to do everything
+        staleBuffers = true;
+        return true;
+    }
+
+    return false;
+}
+
 bool Crop::hasListener()
 {
     MyMutex::MyLock cropLock(cropMutex);
@@ -131,6 +145,12 @@ void Crop::update (int todo)
 {
     MyMutex::MyLock cropLock(cropMutex);
 
+    // the demosaic of the preview was abandoned halfway, the crop waits for the update which redoes it
+    if (parent->demosaicCancelled) {
+        staleBuffers = true;
+        return;
+    }
+
     ProcParams& params = parent->params;
 //       CropGUIListener* cropgl;
 
@@ -155,10 +175,31 @@ void Crop::update (int todo)
     }
 
     // it something has been reallocated, all processing steps have to be performed
-    if (needsinitupdate || (todo & M_HIGHQUAL)) {
+    if (needsinitupdate || staleBuffers || (todo & M_HIGHQUAL)) {
         todo = ALL;
     }
 
+    staleBuffers = false;
+
+    // a full update of a 1:1 window may be served by the region rendered while the user was idle,
+    // after which the buffers don't match the window and the next update has to do everything
+    if (todo == ALL && skip == 1 && cropImageListener && !isIdleRender && getCurrEditID() == EUID_None) {
+        Image8* final = new Image8 (min(rqcropw, cropImg->getWidth() - leftBorder), min(rqcroph, cropImg->getHeight() - upperBorder));
+        Image8* finaltrue = new Image8 (final->getWidth(), final->getHeight());
+        staleBuffers = parent->idleRender.fetch (cropx + leftBorder, cropy + upperBorder, final, finaltrue);
+
+        if (staleBuffers) {
+            cropImageListener->setDetailedCrop (final, finaltrue, params.icm, params.crop, rqcropx, rqcropy, rqcropw, rqcroph, skip);
+        }
+
+        delete final;
+        delete finaltrue;
+
+        if (staleBuffers) {
+            return;
+        }
+    }
+
     // Tells to the ImProcFunctions' tool what is the preview scale, which may lead to some simplifications
     parent->ipf.setScale (skip);
 
@@ -686,6 +727,10 @@ void Crop::update (int todo)
 
     }
 
+    if (isCancelled()) {
+        return;
+    }
+
     // has to be called after setCropSizes! Tools prior to this point can't handle the Edit mechanism, but that shouldn't be a problem.
     createBuffer(cropw, croph);
 
@@ -726,6 +771,10 @@ void Crop::update (int todo)
 
     }
 
+    if (isCancelled()) {
+        return;
+    }
+
     // blurmap for shadow & highlights
     if ((todo & M_BLURMAP) && params.sh.enabled) {
         double radius = sqrt (double(skips(parent->fw, skip) * skips(parent->fw, skip) + skips(parent->fh, skip) * skips(parent->fh, skip))) / 2.0;
@@ -772,6 +821,10 @@ void Crop::update (int todo)
                              parent->bwAutoR, parent->bwAutoG, parent->bwAutoB, dcpProf, as, histToneCurve);
     }
 
+    if (isCancelled()) {
+        return;
+    }
+
     /*xref=000;yref=000;
     if (colortest && cropw>115 && croph>115)
     for(int j=1;j<5;j++){
@@ -975,6 +1028,10 @@ void Crop::update (int todo)
         }
     }
 
+    if (isCancelled()) {
+        return;
+    }
+
     // all pipette buffer processing should be finished now
     PipetteBuffer::setReady();
 
@@ -1319,7 +1376,8 @@ bool Crop::tryUpdate()
  */
 void Crop::fullUpdate ()
 {
-
+    // the updater thread may be rendering while the user is idle, which has to stop before it can be joined
+    parent->idleRender.suspend ();
     parent->updaterThreadStart.lock ();
 
     if (parent->updaterRunning && parent->thread) {
@@ -1348,6 +1406,12 @@ void Crop::fullUpdate ()
     }
 
     parent->updaterThreadStart.unlock ();
+    parent->idleRender.resume ();
+
+    // get the updater thread to render around the new window once the user stops moving it
+    if (IdleRender::isEnabled()) {
+        parent->startProcessing (M_VOID);
+    }
 }
 
 int Crop::get_skip()
@@ -1356,6 +1420,22 @@ int Crop::get_skip()
     return skip;
 }
 
+bool Crop::getViewport (int& x, int& y, int& w, int& h, int& skip)
+{
+    MyMutex::MyLock lock(cropMutex);
+
+    if (isDetailWindow || !cropImageListener || rqcropw <= 0 || rqcroph <= 0) {
+        return false;
+    }
+
+    x = rqcropx;
+    y = rqcropy;
+    w = rqcropw;
+    h = rqcroph;
+    skip = this->skip;
+    return true;
+}
+
 int Crop::getLeftBorder()
 {
     MyMutex::MyLock lock(cropMutex);
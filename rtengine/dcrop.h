@@ -68,12 +68,15 @@ protected:
     MyMutex cropMutex;
     ImProcCoordinator* const parent;
     const bool isDetailWindow;
+    const bool isIdleRender;                /// crop of the IdleRender, not registered in the parent
+    bool staleBuffers;                      /// the last update was served by the IdleRender, the buffers don't hold its data
     EditUniqueID getCurrEditID();
+    bool isCancelled();                     /// marks the buffers stale when true
     bool setCropSizes (int cropX, int cropY, int cropW, int cropH, int skip, bool internal);
     void freeAll ();
 
 public:
-    Crop             (ImProcCoordinator* parent, EditDataProvider *editDataProvider, bool isDetailWindow);
+    Crop             (ImProcCoordinator* parent, EditDataProvider *editDataProvider, bool isDetailWindow, bool isIdleRender = false);
     virtual ~Crop    ();
 
     void setEditSubscriber(EditSubscriber* newSubscriber);
@@ -94,6 +97,8 @@ public:
     void setListener    (DetailedCropListener* il);
     void destroy        ();
     int get_skip();
+    /// Returns the requested area and skip of the main crop window, false for other crops
+    bool getViewport (int& x, int& y, int& w, int& h, int& skip);
     int getLeftBorder();
     int getUpperBorder();
 };
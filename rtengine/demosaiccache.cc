@@ -0,0 +1,313 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include <giomm.h>
+#include <glib/gstdio.h>
+
+#include "demosaiccache.h"
+#include "../rtgui/options.h"
+
+namespace
+{
+
+// v2 stores the planes as 32 bit floats, so that a hit gives back exactly what demosaic() computed
+const char cacheMagic[8] = {'R', 'T', 'D', 'M', 'C', 'v', '2', '\0'};
+const char* const cacheExtension = ".rtdm";
+
+// at most one entry waits while another one is written, further ones are dropped
+constexpr int maxPendingWrites = 2;
+
+void copyPlane (int width, int height, const array2D<float>& plane, float* dest)
+{
+    for (int i = 0; i < height; ++i) {
+        memcpy(dest + std::size_t(i) * width, plane[i], width * sizeof(float));
+    }
+}
+
+bool readPlane (FILE* file, int width, int height, array2D<float>& plane)
+{
+    plane(width, height);
+
+    for (int i = 0; i < height; ++i) {
+        if (fread(plane[i], sizeof(float), width, file) != static_cast<std::size_t>(width)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}
+
+rtengine::DemosaicCache& rtengine::DemosaicCache::getInstance()
+{
+    static DemosaicCache instance;
+    return instance;
+}
+
+rtengine::DemosaicCache::DemosaicCache() :
+    initialized(false),
+    destroying(false),
+    maxBytes(0),
+    totalBytes(0),
+    pendingWrites(0),
+    hook(*this),
+    entries(std::numeric_limits<unsigned long>::max(), &hook),
+    writer(nullptr)
+{
+}
+
+rtengine::DemosaicCache::~DemosaicCache()
+{
+    // finish the pending writes, their entries may still have to displace older ones
+    if (writer) {
+        writer->shutdown();
+        delete writer;
+    }
+
+    // the cache discards all its entries when destroyed, the files have to survive that
+    destroying = true;
+}
+
+bool rtengine::DemosaicCache::isEnabled()
+{
+    MyMutex::MyLock lock(mutex);
+    init();
+    return maxBytes > 0;
+}
+
+std::string rtengine::DemosaicCache::getKey (const Glib::ustring& fileName, const std::string& inputs)
+{
+    try {
+        const auto info = Gio::File::create_for_path(fileName)->query_info("standard::size,time::modified");
+
+        if (info) {
+            const Glib::TimeVal mtime = info->modification_time();
+            const auto identifier = Glib::ustring::compose("%1|%2|%3.%4|", fileName, info->get_size(), mtime.tv_sec, mtime.tv_usec) + inputs;
+            return Glib::Checksum::compute_checksum(Glib::Checksum::CHECKSUM_MD5, identifier);
+        }
+    } catch (Glib::Exception&) {}
+
+    return {};
+}
+
+bool rtengine::DemosaicCache::load (const std::string& key, int width, int height, array2D<float>& red, array2D<float>& green, array2D<float>& blue)
+{
+    {
+        MyMutex::MyLock lock(mutex);
+        init();
+
+        std::size_t size;
+
+        if (!maxBytes || !entries.get(key, size)) {
+            return false;
+        }
+    }
+
+    const Glib::ustring fileName = getFileName(key);
+    FILE* const file = g_fopen(fileName.c_str(), "rb");
+
+    if (!file) {
+        MyMutex::MyLock lock(mutex);
+        entries.remove(key);
+        return false;
+    }
+
+    char magic[sizeof(cacheMagic)];
+    std::int32_t dimensions[2];
+
+    bool ok = fread(magic, sizeof(magic), 1, file) == 1
+              && !memcmp(magic, cacheMagic, sizeof(magic))
+              && fread(dimensions, sizeof(dimensions), 1, file) == 1
+              && dimensions[0] == width && dimensions[1] == height
+              && readPlane(file, width, height, red)
+              && readPlane(file, width, height, green)
+              && readPlane(file, width, height, blue);
+
+    fclose(file);
+
+    if (ok) {
+        // keep the LRU order for the next sessions
+        g_utime(fileName.c_str(), nullptr);
+    } else {
+        MyMutex::MyLock lock(mutex);
+        entries.remove(key);
+    }
+
+    return ok;
+}
+
+void rtengine::DemosaicCache::store (const std::string& key, int width, int height, const array2D<float>& red, const array2D<float>& green, const array2D<float>& blue)
+{
+    const std::size_t size = sizeof(cacheMagic) + 2 * sizeof(std::int32_t) + std::size_t(width) * height * 3 * sizeof(float);
+
+    {
+        MyMutex::MyLock lock(mutex);
+        init();
+
+        if (size > maxBytes || pendingWrites >= maxPendingWrites) {
+            return;
+        }
+
+        ++pendingWrites;
+
+        if (!writer) {
+            writer = new Glib::ThreadPool(1, false);
+        }
+    }
+
+    // the planes are copied, so that the processing goes on while they are written
+    const std::size_t planeSize = std::size_t(width) * height;
+    const std::shared_ptr<std::vector<float>> planes = std::make_shared<std::vector<float>>(3 * planeSize);
+    copyPlane(width, height, red, planes->data());
+    copyPlane(width, height, green, planes->data() + planeSize);
+    copyPlane(width, height, blue, planes->data() + 2 * planeSize);
+
+    writer->push(sigc::bind(sigc::mem_fun(*this, &DemosaicCache::write), key, width, height, planes));
+}
+
+void rtengine::DemosaicCache::write (const std::string& key, int width, int height, const std::shared_ptr<std::vector<float>>& planes)
+{
+    const std::size_t size = sizeof(cacheMagic) + 2 * sizeof(std::int32_t) + planes->size() * sizeof(float);
+
+    // write to a temporary file first, so that a concurrent or interrupted write never leaves a truncated entry
+    const Glib::ustring fileName = getFileName(key);
+    const Glib::ustring tempName = fileName + ".tmp";
+    FILE* const file = g_fopen(tempName.c_str(), "wb");
+    bool ok = file != nullptr;
+
+    if (file) {
+        const std::int32_t dimensions[2] = {width, height};
+
+        ok = fwrite(cacheMagic, sizeof(cacheMagic), 1, file) == 1
+             && fwrite(dimensions, sizeof(dimensions), 1, file) == 1
+             && fwrite(planes->data(), sizeof(float), planes->size(), file) == planes->size();
+
+        ok = !fclose(file) && ok;
+
+        if (!ok || g_rename(tempName.c_str(), fileName.c_str())) {
+            g_remove(tempName.c_str());
+            ok = false;
+        }
+    }
+
+    MyMutex::MyLock lock(mutex);
+    --pendingWrites;
+
+    if (ok) {
+        add(key, size);
+    }
+}
+
+void rtengine::DemosaicCache::init ()
+{
+    if (initialized) {
+        return;
+    }
+
+    initialized = true;
+
+    if (options.demosaicCacheSize <= 0) {
+        return;
+    }
+
+    directory = Glib::build_filename(options.cacheBaseDir, "demosaic");
+
+    if (g_mkdir_with_parents(directory.c_str(), 0755)) {
+        return;
+    }
+
+    maxBytes = std::size_t(options.demosaicCacheSize) << 20;
+
+    // register the entries of the previous sessions, least recently used first
+    using FileEntry = std::pair<Glib::TimeVal, std::pair<std::string, std::size_t>>;
+    std::vector<FileEntry> files;
+
+    try {
+        auto enumerator = Gio::File::create_for_path(directory)->enumerate_children("standard::name,standard::size,time::modified");
+
+        while (auto file = enumerator->next_file()) {
+            const std::string name = file->get_name();
+
+            if (name.size() > strlen(cacheExtension) && name.compare(name.size() - strlen(cacheExtension), std::string::npos, cacheExtension) == 0) {
+                files.emplace_back(file->modification_time(), std::make_pair(name.substr(0, name.size() - strlen(cacheExtension)), file->get_size()));
+            } else {
+                // leftover of an interrupted write
+                g_remove(Glib::build_filename(directory, name).c_str());
+            }
+        }
+    } catch (Glib::Exception&) {}
+
+    std::sort(files.begin(), files.end(), [](const FileEntry& lhs, const FileEntry& rhs) {
+        return lhs.first < rhs.first;
+    });
+
+    for (const auto& file : files) {
+        add(file.second.first, file.second.second);
+    }
+}
+
+void rtengine::DemosaicCache::add (const std::string& key, std::size_t size)
+{
+    entries.set(key, size);
+    totalBytes += size;
+
+    // the hook takes the sizes of the discarded entries off the total
+    entries.evictWhile([this]() {
+        return totalBytes > maxBytes;
+    });
+}
+
+Glib::ustring rtengine::DemosaicCache::getFileName (const std::string& key) const
+{
+    return Glib::build_filename(directory, key + cacheExtension);
+}
+
+rtengine::DemosaicCache::Hook::Hook (DemosaicCache& parent) :
+    parent(parent)
+{
+}
+
+void rtengine::DemosaicCache::Hook::onDiscard (const std::string& key, const std::size_t& size)
+{
+    parent.totalBytes -= size;
+
+    if (!parent.destroying) {
+        g_remove(parent.getFileName(key).c_str());
+    }
+}
+
+void rtengine::DemosaicCache::Hook::onDisplace (const std::string& key, const std::size_t& size)
+{
+    // the entry has been rewritten, its new size is accounted for by add()
+    parent.totalBytes -= size;
+}
+
+void rtengine::DemosaicCache::Hook::onRemove (const std::string& key, const std::size_t& size)
+{
+    parent.totalBytes -= size;
+    g_remove(parent.getFileName(key).c_str());
+}
+
+void rtengine::DemosaicCache::Hook::onDestroy ()
+{
+}
@@ -0,0 +1,99 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glibmm.h>
+
+#include "array2D.h"
+#include "cache.h"
+#include "noncopyable.h"
+
+namespace rtengine
+{
+
+/**
+ * @brief Persistent on-disk cache of demosaiced raw data
+ *
+ * Entries hold the red, green and blue planes produced by RawImageSource::demosaic(), stored as
+ * 32 bit floats so that a hit is bit-identical to the demosaicing it replaces. They are keyed by the
+ * identity of the raw file (name, size and modification time) and by everything which goes into
+ * preprocess() and demosaic(). The files are written by a thread of their own, from a copy of the
+ * planes.
+ *
+ * The total size of the cache is capped by options.demosaicCacheSize (in MiB, 0 disables the cache),
+ * the least recently used entries being removed first. The LRU order survives restarts through the
+ * modification time of the cache files.
+ */
+class DemosaicCache final :
+    public NonCopyable
+{
+public:
+    static DemosaicCache& getInstance();
+
+    ~DemosaicCache();
+
+    bool isEnabled();
+
+    /// Returns the key of an entry, or an empty string if the file can't be identified
+    static std::string getKey (const Glib::ustring& fileName, const std::string& inputs);
+
+    bool load (const std::string& key, int width, int height, array2D<float>& red, array2D<float>& green, array2D<float>& blue);
+    /// Copies the planes and returns, the entry is available once written
+    void store (const std::string& key, int width, int height, const array2D<float>& red, const array2D<float>& green, const array2D<float>& blue);
+
+private:
+    class Hook final :
+        public Cache<std::string, std::size_t>::Hook
+    {
+    public:
+        explicit Hook (DemosaicCache& parent);
+
+        void onDiscard (const std::string& key, const std::size_t& size) override;
+        void onDisplace (const std::string& key, const std::size_t& size) override;
+        void onRemove (const std::string& key, const std::size_t& size) override;
+        void onDestroy () override;
+
+    private:
+        DemosaicCache& parent;
+    };
+
+    DemosaicCache();
+
+    void init ();
+    void write (const std::string& key, int width, int height, const std::shared_ptr<std::vector<float>>& planes);
+    void add (const std::string& key, std::size_t size);
+    Glib::ustring getFileName (const std::string& key) const;
+
+    MyMutex mutex;
+    bool initialized;
+    bool destroying;
+    Glib::ustring directory;
+    std::size_t maxBytes;
+    std::size_t totalBytes;
+    int pendingWrites;
+
+    Hook hook;
+    Cache<std::string, std::size_t> entries;
+    Glib::ThreadPool* writer;
+};
+
+}
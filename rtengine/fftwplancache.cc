@@ -0,0 +1,132 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdlib>
+
+#include <glibmm.h>
+#include <glib/gstdio.h>
+
+#include "fftwplancache.h"
+#include "../rtgui/options.h"
+
+namespace
+{
+
+Glib::ustring getWisdomFileName ()
+{
+    return Glib::build_filename(options.cacheBaseDir, "fftwf_wisdom");
+}
+
+}
+
+rtengine::FftwPlanCache& rtengine::FftwPlanCache::getInstance()
+{
+    static FftwPlanCache instance;
+    return instance;
+}
+
+rtengine::FftwPlanCache::FftwPlanCache() :
+    wisdomLoaded(false)
+{
+}
+
+rtengine::FftwPlanCache::~FftwPlanCache()
+{
+    MyMutex::MyLock lock(mutex);
+
+    for (const auto& plan : plans) {
+        fftwf_destroy_plan(plan.second);
+    }
+}
+
+fftwf_plan rtengine::FftwPlanCache::getManyR2r (int rank, const int* n, int howmany, const fftw_r2r_kind* kind)
+{
+    std::vector<int> key {rank, howmany};
+    int dist = 1;
+
+    for (int i = 0; i < rank; ++i) {
+        key.push_back(n[i]);
+        key.push_back(kind[i]);
+        dist *= n[i];
+    }
+
+    MyMutex::MyLock lock(mutex);
+
+    const auto cached = plans.find(key);
+
+    if (cached != plans.end()) {
+        return cached->second;
+    }
+
+    if (!wisdomLoaded) {
+        loadWisdom();
+    }
+
+    // the arrays are only needed for the planning, FFTW_MEASURE overwrites them anyway
+    float* in = reinterpret_cast<float*>(fftwf_malloc(howmany * dist * sizeof(float)));
+    float* out = reinterpret_cast<float*>(fftwf_malloc(howmany * dist * sizeof(float)));
+
+    const fftwf_plan plan = fftwf_plan_many_r2r(rank, n, howmany, in, nullptr, 1, dist, out, nullptr, 1, dist, kind, FFTW_MEASURE | FFTW_DESTROY_INPUT);
+
+    fftwf_free(in);
+    fftwf_free(out);
+
+    if (plan) {
+        plans[key] = plan;
+        saveWisdom();
+    }
+
+    return plan;
+}
+
+void rtengine::FftwPlanCache::loadWisdom ()
+{
+    wisdomLoaded = true;
+
+    try {
+        savedWisdom = Glib::file_get_contents(getWisdomFileName());
+    } catch (Glib::Exception&) {
+        return;
+    }
+
+    // wisdom of another FFTW version or of another machine is rejected as a whole, and then replaced at the next save
+    if (!fftwf_import_wisdom_from_string(savedWisdom.c_str())) {
+        savedWisdom.clear();
+    }
+}
+
+void rtengine::FftwPlanCache::saveWisdom ()
+{
+    char* const wisdom = fftwf_export_wisdom_to_string();
+
+    if (!wisdom) {
+        return;
+    }
+
+    // plans obtained from the loaded wisdom don't add anything
+    if (savedWisdom != wisdom) {
+        const Glib::ustring fileName = getWisdomFileName();
+
+        g_mkdir_with_parents(Glib::path_get_dirname(fileName).c_str(), 0777);
+
+        // written to a temporary file and renamed, so that concurrent sessions never read a partial file
+        if (g_file_set_contents(fileName.c_str(), wisdom, -1, nullptr)) {
+            savedWisdom = wisdom;
+        }
+    }
+
+    free(wisdom);
+}
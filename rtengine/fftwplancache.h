@@ -0,0 +1,68 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fftw3.h>
+
+#include "noncopyable.h"
+#include "../rtgui/threadutils.h"
+
+namespace rtengine
+{
+
+/**
+ * @brief Process wide cache of the FFTW plans
+ *
+ * Planning with FFTW_MEASURE times several algorithms on the actual sizes, which can cost more than
+ * the transforms of a preview update. Plans are therefore created once per geometry and kept until
+ * the end of the session, and the wisdom gathered while planning is saved in the cache directory,
+ * so that the next sessions get the same plans without measuring again.
+ *
+ * The FFTW planner isn't thread safe, all planning goes through the lock of this class. Executing
+ * a plan with the new-array functions (fftwf_execute_r2r() and friends) from several threads at once
+ * is safe, provided the arrays are allocated by fftwf_malloc() like the ones the plans are made with.
+ * The plans are owned by the cache and must not be destroyed by the callers.
+ */
+class FftwPlanCache final :
+    public NonCopyable
+{
+public:
+    static FftwPlanCache& getInstance();
+
+    ~FftwPlanCache();
+
+    /// Same as fftwf_plan_many_r2r() with FFTW_MEASURE | FFTW_DESTROY_INPUT for 'howmany' contiguous
+    /// transforms of unit stride, out of place
+    fftwf_plan getManyR2r (int rank, const int* n, int howmany, const fftw_r2r_kind* kind);
+
+private:
+    FftwPlanCache();
+
+    void loadWisdom ();
+    void saveWisdom ();
+
+    MyMutex mutex;
+    bool wisdomLoaded;
+    std::string savedWisdom;
+    std::map<std::vector<int>, fftwf_plan> plans;
+};
+
+}
@@ -21,6 +21,7 @@
 #include <cstdlib>
 #include "opthelper.h"
 #include "boxblur.h"
+#include "widekernels.h"
 
 namespace
 {
@@ -59,6 +60,24 @@ template<class T> void calculateYvVFactors( const T sigma, T &b1, T &b2, T &b3,
 
 }
 
+#ifdef __SSE2__
+rtengine::widekernels::RecursiveGaussCoefficients wideCoefficients(double B, double b1, double b2, double b3, const double M[3][3])
+{
+    rtengine::widekernels::RecursiveGaussCoefficients coeffs;
+    coeffs.B = B;
+    coeffs.b1 = b1;
+    coeffs.b2 = b2;
+    coeffs.b3 = b3;
+
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++) {
+            coeffs.M[i][j] = M[i][j];
+        }
+
+    return coeffs;
+}
+#endif
+
 // classical filtering if the support window is small and src != dst
 template<class T> void gauss3x3 (T** RESTRICT src, T** RESTRICT dst, const int W, const int H, const T c0, const T c1, const T c2, const T b0, const T b1)
 {
@@ -325,6 +344,11 @@ template<class T> SSEFUNCTION void gaussHorizontalSse (T** src, T** dst, const i
             M[i][j] /= (1.0 + b1 - b2 + b3) * (1.0 - b1 - b2 - b3);
         }
 
+    // 8 or 16 rows at once if the cpu supports it
+    if (rtengine::widekernels::gaussHorizontal(src, dst, W, H, wideCoefficients(B, b1, b2, b3, M))) {
+        return;
+    }
+
     vfloat Rv;
     vfloat Tv, Tm2v, Tm3v;
     vfloat Bv, b1v, b2v, b3v;
@@ -485,6 +509,11 @@ template<class T> SSEFUNCTION void gaussVerticalSse (T** src, T** dst, const int
             M[i][j] /= (1.0 + b1 - b2 + b3) * (1.0 - b1 - b2 - b3);
         }
 
+    // 8 or 16 columns at once if the cpu supports it
+    if (rtengine::widekernels::gaussVertical(src, dst, W, H, wideCoefficients(B, b1, b2, b3, M))) {
+        return;
+    }
+
     float tmp[H][8] ALIGNED16;
     vfloat Rv;
     vfloat Tv, Tm2v, Tm3v;
@@ -0,0 +1,225 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <vector>
+
+#include "histogramengine.h"
+
+#include "image8.h"
+#include "labimage.h"
+#include "opthelper.h"
+#include "rt_math.h"
+#include "sleef.c"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+
+void initBins (LUTu& bins, const LUTu* hist)
+{
+    if (hist && *hist) {
+        bins (hist->getSize());
+        bins.clear();
+    }
+}
+
+// Fills 'idx' with the bins of the L values of a row
+void binsOfL (const float* L, int width, float scale, int upper, int* idx)
+{
+    int j = 0;
+#ifdef __SSE2__
+    const vfloat scalev = F2V (scale);
+    const vfloat zerov = F2V (0.f);
+    const vfloat upperv = F2V (upper);
+
+    for (; j < width - 3; j += 4) {
+        const vfloat binv = vmaxf (zerov, vminf (upperv, LVFU (L[j]) * scalev));
+        _mm_storeu_si128 (reinterpret_cast<__m128i*> (&idx[j]), _mm_cvttps_epi32 (binv));
+    }
+
+#endif
+
+    for (; j < width; ++j) {
+        idx[j] = rtengine::LIM<float> (L[j] * scale, 0.f, upper);
+    }
+}
+
+// Fills 'idx' with the bins of the chroma values of a row
+void binsOfChroma (const float* a, const float* b, int width, float scale, int upper, int* idx)
+{
+    int j = 0;
+#ifdef __SSE2__
+    const vfloat scalev = F2V (scale);
+    const vfloat upperv = F2V (upper);
+
+    for (; j < width - 3; j += 4) {
+        const vfloat av = LVFU (a[j]);
+        const vfloat bv = LVFU (b[j]);
+        const vfloat binv = vminf (upperv, vsqrtf (av * av + bv * bv) * scalev);
+        _mm_storeu_si128 (reinterpret_cast<__m128i*> (&idx[j]), _mm_cvttps_epi32 (binv));
+    }
+
+#endif
+
+    for (; j < width; ++j) {
+        idx[j] = std::min<float> (sqrtf (rtengine::SQR (a[j]) + rtengine::SQR (b[j])) * scale, upper);
+    }
+}
+
+}
+
+namespace rtengine
+{
+
+HistogramEngine::Accumulator::Accumulator (LUTu& target, int shift) :
+    target (target),
+    shift (shift)
+{
+    initBins (bins, &target);
+}
+
+void HistogramEngine::Accumulator::merge ()
+{
+    if (!bins) {
+        return;
+    }
+
+#ifdef _OPENMP
+    #pragma omp critical(histogramEngineMerge)
+#endif
+    target += bins;
+}
+
+HistogramEngine::HistogramEngine () :
+    histL (nullptr),
+    histChroma (nullptr),
+    histRgb {nullptr, nullptr, nullptr},
+    scaleL (1.f),
+    scaleChroma (1.f)
+{
+}
+
+void HistogramEngine::requestL (LUTu& hist, float maxValue)
+{
+    histL = &hist;
+    scaleL = hist.getSize() / maxValue;
+}
+
+void HistogramEngine::requestChroma (LUTu& hist, float maxValue)
+{
+    histChroma = &hist;
+    scaleChroma = hist.getSize() / maxValue;
+}
+
+void HistogramEngine::requestRgb (LUTu& red, LUTu& green, LUTu& blue)
+{
+    histRgb[0] = &red;
+    histRgb[1] = &green;
+    histRgb[2] = &blue;
+}
+
+void HistogramEngine::compute (const LabImage* lab, const Image8* rgb, int x1, int y1, int x2, int y2, bool multiThread) const
+{
+    const bool doL = histL && *histL && lab;
+    const bool doChroma = histChroma && *histChroma && lab;
+    const bool doRgb = histRgb[0] && *histRgb[0] && rgb;
+
+    for (LUTu* hist : {histL, histChroma, histRgb[0], histRgb[1], histRgb[2]}) {
+        if (hist) {
+            hist->clear();
+        }
+    }
+
+    const int width = x2 - x1;
+
+    if (width <= 0 || y2 <= y1 || !(doL || doChroma || doRgb)) {
+        return;
+    }
+
+    const int upperL = histL ? histL->getUpperBound() : 0;
+    const int upperChroma = histChroma ? histChroma->getUpperBound() : 0;
+
+#ifdef _OPENMP
+    #pragma omp parallel if (multiThread)
+#endif
+    {
+        LUTu binsL, binsChroma, binsRgb[3];
+        initBins (binsL, doL ? histL : nullptr);
+        initBins (binsChroma, doChroma ? histChroma : nullptr);
+
+        for (int c = 0; c < 3; ++c) {
+            initBins (binsRgb[c], doRgb ? histRgb[c] : nullptr);
+        }
+
+        std::vector<int> idx (width);
+
+#ifdef _OPENMP
+        #pragma omp for schedule(dynamic, 16) nowait
+#endif
+
+        for (int i = y1; i < y2; ++i) {
+            if (doL) {
+                binsOfL (lab->L[i] + x1, width, scaleL, upperL, idx.data());
+
+                for (int j = 0; j < width; ++j) {
+                    ++binsL[idx[j]];
+                }
+            }
+
+            if (doChroma) {
+                binsOfChroma (lab->a[i] + x1, lab->b[i] + x1, width, scaleChroma, upperChroma, idx.data());
+
+                for (int j = 0; j < width; ++j) {
+                    ++binsChroma[idx[j]];
+                }
+            }
+
+            if (doRgb) {
+                const unsigned char* row = rgb->data + (i * rgb->getWidth() + x1) * 3;
+
+                for (int j = 0; j < width; ++j, row += 3) {
+                    ++binsRgb[0][row[0]];
+                    ++binsRgb[1][row[1]];
+                    ++binsRgb[2][row[2]];
+                }
+            }
+        }
+
+#ifdef _OPENMP
+        #pragma omp critical(histogramEngineMerge)
+#endif
+        {
+            if (doL) {
+                *histL += binsL;
+            }
+
+            if (doChroma) {
+                *histChroma += binsChroma;
+            }
+
+            if (doRgb) {
+                for (int c = 0; c < 3; ++c) {
+                    *histRgb[c] += binsRgb[c];
+                }
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,88 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "LUT.h"
+#include "noncopyable.h"
+
+namespace rtengine
+{
+
+class Image8;
+class LabImage;
+
+/*
+ * Computes any requested set of histograms of a Lab image and its 8 bit RGB
+ * rendering in one data-parallel pass. Every thread counts into its own bins,
+ * which are summed into the target LUTs at the end of the pass.
+ */
+class HistogramEngine final :
+    public NonCopyable
+{
+public:
+    /*
+     * Thread private bins for operators which count pixels while they process them.
+     * Create one per thread inside the parallel region, count with add() and call
+     * merge() once the thread is done. Values are mapped to bins by (value >> shift).
+     */
+    class Accumulator final :
+        public NonCopyable
+    {
+    public:
+        explicit Accumulator (LUTu& target, int shift = 0);
+
+        explicit operator bool () const
+        {
+            return static_cast<bool> (bins);
+        }
+
+        void add (int value)
+        {
+            ++bins[value >> shift];
+        }
+
+        // Adds the bins to the target; safe to call concurrently from several threads
+        void merge ();
+
+    private:
+        LUTu& target;
+        LUTu bins;
+        const int shift;
+    };
+
+    HistogramEngine ();
+
+    // L histogram, 'maxValue' is mapped to the size of 'hist'
+    void requestL (LUTu& hist, float maxValue = 32768.f);
+    // sqrt(a^2 + b^2) histogram, 'maxValue' is mapped to the size of 'hist'
+    void requestChroma (LUTu& hist, float maxValue = 48000.f);
+    // Histograms of the channels of an 8 bit RGB image, all of size 256
+    void requestRgb (LUTu& red, LUTu& green, LUTu& blue);
+
+    // Clears the requested histograms and fills them from the rectangle [x1, x2[ x [y1, y2[.
+    // 'lab' may be null if no Lab histogram was requested, 'rgb' if no RGB histogram was.
+    void compute (const LabImage* lab, const Image8* rgb, int x1, int y1, int x2, int y2, bool multiThread = true) const;
+
+private:
+    LUTu* histL;
+    LUTu* histChroma;
+    LUTu* histRgb[3];
+    float scaleL;
+    float scaleChroma;
+};
+
+}
@@ -16,6 +16,7 @@
  *  You should have received a copy of the GNU General Public License
  *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <algorithm>
 #include <cstring>
 
 #include <glibmm.h>
@@ -31,6 +32,7 @@
 
 #include "iccmatrices.h"
 #include "procparams.h"
+#include "profileindex.h"
 
 #include "../rtgui/options.h"
 #include "../rtgui/threadutils.h"
@@ -45,66 +47,43 @@ extern const Settings* settings;
 namespace
 {
 
-// Not recursive
-void loadProfiles(
+// Not recursive; the profiles are only listed here and loaded by getProfile() on first use
+void listProfiles(
     const Glib::ustring& dirName,
-    std::map<Glib::ustring, cmsHPROFILE>* profiles,
-    std::map<Glib::ustring, rtengine::ProfileContent>* profileContents,
-    std::map<Glib::ustring, Glib::ustring>* profileNames,
-    bool nameUpper
+    std::map<Glib::ustring, rtengine::ProfileIndex::Entry>& profiles,
+    bool nameUpper,
+    bool iccOnly
 )
 {
-    if (dirName.empty()) {
-        return;
-    }
-
-    try {
-        Glib::Dir dir(dirName);
-
-        for (Glib::DirIterator entry = dir.begin(); entry != dir.end(); ++entry) {
-            const Glib::ustring fileName = *entry;
-
-            if (fileName.size() < 4) {
-                continue;
-            }
-
-            const Glib::ustring extension = rtengine::getFileExtension(fileName);
-
-            if (extension != "icc" && extension != "icm") {
-                continue;
-            }
-
-            const Glib::ustring filePath = Glib::build_filename(dirName, fileName);
-
-            if (!Glib::file_test(filePath, Glib::FILE_TEST_IS_REGULAR)) {
-                continue;
-            }
+    for (const auto& entry : rtengine::ProfileIndex::list(dirName, {"icc", "icm"}, false, iccOnly)) {
+        if (iccOnly && !entry.deviceClass) {
+            continue;
+        }
 
-            Glib::ustring name = fileName.substr(0, fileName.size() - 4);
+        Glib::ustring name = entry.fileName.substr(0, entry.fileName.size() - 4);
 
-            if (nameUpper) {
-                name = name.uppercase();
-            }
+        if (nameUpper) {
+            name = name.uppercase();
+        }
 
-            if (profiles) {
-                const rtengine::ProfileContent content(filePath);
-                const cmsHPROFILE profile = content.toProfile();
+        profiles.emplace(name, entry);
+    }
+}
 
-                if (profile) {
-                    profiles->emplace(name, profile);
+bool isProfileOfType(rtengine::ICCStore::ProfileType type, cmsUInt32Number deviceClass, cmsUInt32Number colorSpace)
+{
+    switch (type) {
+        case rtengine::ICCStore::ProfileType::MONITOR:
+            return deviceClass == cmsSigDisplayClass && colorSpace == cmsSigRgbData;
 
-                    if (profileContents) {
-                        profileContents->emplace(name, content);
-                    }
-                }
-            }
+        case rtengine::ICCStore::ProfileType::PRINTER:
+            return deviceClass == cmsSigOutputClass;
 
-            if (profileNames) {
-                profileNames->emplace(name, filePath);
-            }
-        }
-    } catch (Glib::Exception&) {
+        case rtengine::ICCStore::ProfileType::OUTPUT:
+            return (deviceClass == cmsSigDisplayClass || deviceClass == cmsSigOutputClass) && colorSpace == cmsSigRgbData;
     }
+
+    return false;
 }
 
 // Version dedicated to single profile load when loadAll==false (cli version "-q" mode)
@@ -318,9 +297,10 @@ public:
         userICCDir = usrICCDir;
         fileProfiles.clear();
         fileProfileContents.clear();
+        fileProfileEntries.clear();
         if (loadAll) {
-            loadProfiles(profilesDir, &fileProfiles, &fileProfileContents, nullptr, false);
-            loadProfiles(userICCDir, &fileProfiles, &fileProfileContents, nullptr, false);
+            listProfiles(profilesDir, fileProfileEntries, false, true);
+            listProfiles(userICCDir, fileProfileEntries, false, true);
         }
 
         // Input profiles
@@ -329,7 +309,12 @@ public:
         fileStdProfiles.clear();
         fileStdProfilesFileNames.clear();
         if (loadAll) {
-            loadProfiles(stdProfilesDir, nullptr, nullptr, &fileStdProfilesFileNames, true);
+            std::map<Glib::ustring, ProfileIndex::Entry> stdProfiles;
+            listProfiles(stdProfilesDir, stdProfiles, true, false);
+
+            for (const auto& profile : stdProfiles) {
+                fileStdProfilesFileNames.emplace(profile.first, profile.second.path);
+            }
         }
 
         defaultMonitorProfile = settings->monitorProfile;
@@ -380,7 +365,7 @@ public:
     bool outputProfileExist(const Glib::ustring& name) const
     {
         MyMutex::MyLock lock(mutex);
-        return fileProfiles.find(name) != fileProfiles.end();
+        return fileProfiles.find(name) != fileProfiles.end() || fileProfileEntries.find(name) != fileProfileEntries.end();
     }
 
     cmsHPROFILE getProfile(const Glib::ustring& name)
@@ -393,6 +378,20 @@ public:
             return r->second;
         }
 
+        const EntryMap::const_iterator e = fileProfileEntries.find(name);
+
+        if (e != fileProfileEntries.end()) {
+            const ProfileContent content(e->second.path);
+            const cmsHPROFILE profile = content.toProfile();
+
+            if (profile) {
+                fileProfiles.emplace(name, profile);
+                fileProfileContents.emplace(name, content);
+            }
+
+            return profile;
+        }
+
         if (!name.compare(0, 5, "file:")) {
             const ProfileContent content(name.substr(5));
             const cmsHPROFILE profile = content.toProfile();
@@ -488,39 +487,36 @@ public:
 
         MyMutex::MyLock lock(mutex);
 
-        for (const auto profile : fileProfiles) {
+        // listed profiles are matched on their header, so that they don't have to be loaded
+        for (const auto& entry : fileProfileEntries) {
+            if (isProfileOfType(type, entry.second.deviceClass, entry.second.colorSpace)) {
+                res.push_back(entry.first);
+            }
+        }
+
+        for (const auto& profile : fileProfiles) {
             if (
-               (
-                   type==ICCStore::ProfileType::MONITOR
-                   && cmsGetDeviceClass(profile.second) == cmsSigDisplayClass
-                   && cmsGetColorSpace(profile.second) == cmsSigRgbData
-               )
-               ||(
-                   type==ICCStore::ProfileType::PRINTER
-                   && cmsGetDeviceClass(profile.second) == cmsSigOutputClass
-               )
-               ||(
-                   type==ICCStore::ProfileType::OUTPUT
-                   && (cmsGetDeviceClass(profile.second) == cmsSigDisplayClass || cmsGetDeviceClass(profile.second) == cmsSigOutputClass)
-                   && cmsGetColorSpace(profile.second) == cmsSigRgbData
-               )
+                fileProfileEntries.find(profile.first) == fileProfileEntries.end()
+                && isProfileOfType(type, cmsGetDeviceClass(profile.second), cmsGetColorSpace(profile.second))
             ) {
                 res.push_back(profile.first);
             }
         }
 
+        std::sort(res.begin(), res.end());
+
         return res;
     }
 
     std::vector<Glib::ustring> getProfilesFromDir(const Glib::ustring& dirName) const
     {
         std::vector<Glib::ustring> res;
-        ProfileMap profiles;
+        EntryMap profiles;
 
         MyMutex::MyLock lock(mutex);
 
-        loadProfiles(profilesDir, &profiles, nullptr, nullptr, false);
-        loadProfiles(dirName, &profiles, nullptr, nullptr, false);
+        listProfiles(profilesDir, profiles, false, true);
+        listProfiles(dirName, profiles, false, true);
 
         for (const auto& profile : profiles) {
             res.push_back(profile.first);
@@ -580,6 +576,7 @@ private:
     using MatrixMap = std::map<Glib::ustring, TMatrix>;
     using ContentMap = std::map<Glib::ustring, ProfileContent>;
     using NameMap = std::map<Glib::ustring, Glib::ustring>;
+    using EntryMap = std::map<Glib::ustring, ProfileIndex::Entry>;
 
     ProfileMap wProfiles;
     ProfileMap wProfilesGamma;
@@ -591,6 +588,7 @@ private:
     Glib::ustring userICCDir;
     ProfileMap fileProfiles;
     ContentMap fileProfileContents;
+    EntryMap fileProfileEntries; // listed but not necessarily loaded yet
 
     //These contain standard profiles from RT. Keys are all in uppercase.
     Glib::ustring stdProfilesDir;
@@ -0,0 +1,316 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstring>
+
+#include "idlerender.h"
+
+#include "dcrop.h"
+#include "image8.h"
+#include "improccoordinator.h"
+#include "../rtgui/options.h"
+
+namespace
+{
+
+constexpr unsigned int maxStates = 4;
+constexpr unsigned long maxRegions = 2; // a region of a full HD window takes about 40 MiB
+
+}
+
+namespace rtengine
+{
+
+// Everything the rendering of a region depends on
+struct IdleRender::State {
+    unsigned int id;
+    procparams::ProcParams params;
+    Glib::ustring monitorProfile;
+    RenderingIntent monitorIntent;
+    bool softProof;
+    bool gamutCheck;
+    int fullWidth;
+    int fullHeight;
+};
+
+IdleRender::IdleRender (ImProcCoordinator* parent) :
+    parent (parent),
+    generation (0),
+    suspended (0),
+    runToken (0),
+    lastStateId (0),
+    renderStateId (0),
+    regions (maxRegions)
+{
+}
+
+IdleRender::~IdleRender ()
+{
+}
+
+bool IdleRender::isEnabled ()
+{
+    return options.idleRenderDelay > 0;
+}
+
+unsigned int IdleRender::arm ()
+{
+    return generation;
+}
+
+void IdleRender::cancel ()
+{
+    Glib::Threads::Mutex::Lock lock (waitMutex);
+    ++generation;
+    cancellation.cancel ();
+    waitCond.broadcast();
+}
+
+void IdleRender::suspend ()
+{
+    Glib::Threads::Mutex::Lock lock (waitMutex);
+    ++suspended;
+    cancellation.cancel ();
+    waitCond.broadcast();
+}
+
+void IdleRender::resume ()
+{
+    --suspended;
+}
+
+bool IdleRender::isCancelled () const
+{
+    return generation != runToken || suspended > 0;
+}
+
+unsigned int IdleRender::getStateId (bool add)
+{
+    MyMutex::MyLock lock (stateMutex);
+
+    for (const auto& state : states) {
+        if (
+            state->fullWidth == parent->fullw
+            && state->fullHeight == parent->fullh
+            && state->monitorProfile == parent->monitorProfile
+            && state->monitorIntent == parent->monitorIntent
+            && state->softProof == parent->softProof
+            && state->gamutCheck == parent->gamutCheck
+            && state->params == parent->params
+        ) {
+            return state->id;
+        }
+    }
+
+    if (!add) {
+        return 0;
+    }
+
+    // regions of dropped states are not reachable anymore and leave the cache with time
+    if (states.size() >= maxStates) {
+        states.pop_front();
+    }
+
+    states.emplace_back (new State {++lastStateId, parent->params, parent->monitorProfile, parent->monitorIntent, parent->softProof, parent->gamutCheck, parent->fullw, parent->fullh});
+    return lastStateId;
+}
+
+void IdleRender::run (unsigned int token)
+{
+    if (!isEnabled() || parent->destroying) {
+        return;
+    }
+
+    {
+        Glib::Threads::Mutex::Lock lock (waitMutex);
+        const gint64 endTime = g_get_monotonic_time() + options.idleRenderDelay * G_TIME_SPAN_MILLISECOND;
+
+        while (generation == token && suspended == 0) {
+            if (!waitCond.wait_until (waitMutex, endTime)) {
+                break;
+            }
+        }
+
+        runToken = token;
+    }
+
+    if (isCancelled()) {
+        return;
+    }
+
+    MyMutex::MyLock processingLock (parent->mProcessing);
+
+    // find the area shown by the main crop window
+    int x, y, w, h, skip;
+
+    const auto findViewport = [this, &x, &y, &w, &h, &skip] () {
+        for (const auto cropWindow : parent->crops) {
+            if (cropWindow->getViewport (x, y, w, h, skip)) {
+                return parent->fullw > 0 && parent->fullh > 0;
+            }
+        }
+
+        return false;
+    };
+
+    if (!findViewport()) {
+        return;
+    }
+
+    // 1:1 crops work on the high quality demosaic, which the preview skips when it doesn't need it
+    if (options.prevdemo == PD_Fast && (!parent->highDetailPreprocessComputed || !parent->highDetailRawComputed)) {
+        // updatePreviewImage takes mProcessing itself
+        processingLock.release ();
+        const int redo = parent->updatePreviewImage (M_HIGHQUAL);
+
+        if (redo) {
+            // new parameters came in meanwhile, the preview has to be completed with them
+            MyMutex::MyLock lock (parent->paramsUpdateMutex);
+            parent->changeSinceLast |= redo;
+            return;
+        }
+
+        if (isCancelled()) {
+            return;
+        }
+
+        processingLock.acquire ();
+
+        // the preview or the crop windows may have changed while the lock was released
+        if (!parent->highDetailPreprocessComputed || !parent->highDetailRawComputed || !findViewport()) {
+            return;
+        }
+    }
+
+    // the same window at 100%, clipped by the image, and the region around it
+    const int centerX = x + w / 2;
+    const int centerY = y + h / 2;
+    const int halfWidth = w / (2 * skip);
+    const int halfHeight = h / (2 * skip);
+    const int viewLeft = std::max (centerX - halfWidth, 0);
+    const int viewTop = std::max (centerY - halfHeight, 0);
+    const int viewRight = std::min (centerX + halfWidth, parent->fullw);
+    const int viewBottom = std::min (centerY + halfHeight, parent->fullh);
+    const int left = std::max (centerX - halfWidth - margin, 0);
+    const int top = std::max (centerY - halfHeight - margin, 0);
+    const int right = std::min (centerX + halfWidth + margin, parent->fullw);
+    const int bottom = std::min (centerY + halfHeight + margin, parent->fullh);
+
+    if (viewRight <= viewLeft || viewBottom <= viewTop) {
+        return;
+    }
+
+    renderStateId = getStateId (true);
+
+    // the user may only have scrolled within the region rendered last time
+    std::shared_ptr<const Region> cached;
+
+    if (regions.get (renderStateId, cached) && cached->contains (viewLeft, viewTop, viewRight - viewLeft, viewBottom - viewTop)) {
+        return;
+    }
+
+    // the tools poll the token of the ImProcFunctions, which is ours until the rendering is over;
+    // it is restored before mProcessing is released, i.e. before anything else can use them
+    struct TokenSwap {
+        ImProcFunctions& ipf;
+        const CancellationToken previous;
+
+        TokenSwap (ImProcFunctions& ipf, const CancellationToken& token) : ipf (ipf), previous (ipf.getCancellationToken())
+        {
+            ipf.setCancellationToken (token);
+        }
+
+        ~TokenSwap ()
+        {
+            ipf.setCancellationToken (previous);
+        }
+    } tokenSwap (parent->ipf, cancellation.getToken());
+
+    // cancel() may have come in before the token was taken
+    if (isCancelled()) {
+        return;
+    }
+
+    if (!crop) {
+        crop.reset (new Crop (parent, nullptr, true, true));
+        crop->setListener (this);
+    }
+
+    crop->setWindow (left, top, right - left, bottom - top, 1);
+    crop->update (ALL);
+}
+
+bool IdleRender::Region::contains (int x, int y, int width, int height) const
+{
+    return x >= this->x && y >= this->y && x + width <= this->x + this->width && y + height <= this->y + this->height;
+}
+
+bool IdleRender::fetch (int x, int y, Image8* img, Image8* imgtrue)
+{
+    if (!isEnabled()) {
+        return false;
+    }
+
+    const unsigned int stateId = getStateId (false);
+
+    if (!stateId) {
+        return false;
+    }
+
+    const int width = img->getWidth();
+    const int height = img->getHeight();
+    std::shared_ptr<const Region> region;
+
+    // the neighbourhood based tools give other results near the border of another region, which is why
+    // the area isn't assembled from several regions
+    if (!regions.get (stateId, region) || !region->contains (x, y, width, height)) {
+        return false;
+    }
+
+    for (int i = 0; i < height; ++i) {
+        const std::size_t offset = 3 * (static_cast<std::size_t> (y + i - region->y) * region->width + x - region->x);
+
+        std::memcpy (img->data + 3 * static_cast<std::size_t> (i) * width, region->rgb.data() + offset, 3 * width);
+        std::memcpy (imgtrue->data + 3 * static_cast<std::size_t> (i) * width, region->rgbTrue.data() + offset, 3 * width);
+    }
+
+    return true;
+}
+
+void IdleRender::setDetailedCrop (IImage8* img, IImage8* imgtrue, procparams::ColorManagementParams cmp,
+                                  procparams::CropParams cp, int cx, int cy, int cw, int ch, int skip)
+{
+    if (isCancelled()) {
+        return;
+    }
+
+    std::shared_ptr<Region> region (new Region);
+    region->x = cx;
+    region->y = cy;
+    region->width = img->getWidth();
+    region->height = img->getHeight();
+    const std::size_t size = 3 * static_cast<std::size_t> (region->width) * region->height;
+    const unsigned char* const data = static_cast<Image8*> (img)->data;
+    const unsigned char* const dataTrue = static_cast<Image8*> (imgtrue)->data;
+    region->rgb.assign (data, data + size);
+    region->rgbTrue.assign (dataTrue, dataTrue + size);
+
+    // replaces the region rendered around an earlier viewport
+    regions.set (renderStateId, region);
+}
+
+}
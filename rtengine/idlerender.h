@@ -0,0 +1,116 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <glibmm/threads.h>
+
+#include "cache.h"
+#include "cancellation.h"
+#include "noncopyable.h"
+#include "rtengine.h"
+
+namespace rtengine
+{
+
+class Crop;
+class Image8;
+class ImProcCoordinator;
+
+/**
+ * @brief Speculative 1:1 rendering of the visible area while the user is idle
+ *
+ * Once the parameters have been stable for options.idleRenderDelay ms, the updater thread of the
+ * ImProcCoordinator renders the area shown by the main crop window as it would appear at 100%,
+ * plus a margin around it, as a single region through a crop of its own, so that the tools working
+ * on a neighbourhood see the same surroundings everywhere. One region is cached per set of
+ * processing parameters and monitor settings, and a later 1:1 crop update lying wholly inside it is
+ * served without running the pipeline. Rendering stops as soon as new parameters come in or a crop
+ * window needs the updater thread, also from within the tools that poll the cancellation token.
+ */
+class IdleRender final :
+    public DetailedCropListener,
+    public NonCopyable
+{
+public:
+    static constexpr int margin = 512;
+
+    explicit IdleRender (ImProcCoordinator* parent);
+    ~IdleRender ();
+
+    static bool isEnabled ();
+
+    /// Returns the token to pass to run(); to be called under the parameters lock, with no pending change
+    unsigned int arm ();
+    /// Stops the current or next run() as soon as possible
+    void cancel ();
+    /// Keeps run() from rendering until the matching resume()
+    void suspend ();
+    void resume ();
+    /// Polled by the idle crop between its processing steps
+    bool isCancelled () const;
+
+    /// Waits for the idle delay, then renders the region around the visible area; called by the updater thread
+    void run (unsigned int token);
+
+    /// Copies the [x, x + img->width[ x [y, y + img->height[ area rendered at 1:1 for the current state
+    /// of the coordinator into 'img' and 'imgtrue', if all of it lies in the cached region
+    bool fetch (int x, int y, Image8* img, Image8* imgtrue);
+
+    void setDetailedCrop (IImage8* img, IImage8* imgtrue, procparams::ColorManagementParams cmp,
+                          procparams::CropParams cp, int cx, int cy, int cw, int ch, int skip) override;
+
+private:
+    struct State;
+
+    struct Region {
+        int x;
+        int y;
+        int width;
+        int height;
+        std::vector<unsigned char> rgb;
+        std::vector<unsigned char> rgbTrue;
+
+        bool contains (int x, int y, int width, int height) const;
+    };
+
+    /// Returns the id of the state matching the coordinator, or 0 if there is none and 'add' is false
+    unsigned int getStateId (bool add);
+
+    ImProcCoordinator* const parent;
+
+    Glib::Threads::Mutex waitMutex;
+    Glib::Threads::Cond waitCond;
+    std::atomic<unsigned int> generation;
+    std::atomic<int> suspended;
+    unsigned int runToken;
+    CancellationSource cancellation; // handed to the tools of the pipeline while rendering
+
+    MyMutex stateMutex;
+    std::deque<std::unique_ptr<State>> states;
+    unsigned int lastStateId;
+    unsigned int renderStateId;
+
+    Cache<unsigned int, std::shared_ptr<const Region>> regions; // by state id
+    std::unique_ptr<Crop> crop;
+};
+
+}
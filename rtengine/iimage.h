@@ -20,6 +20,8 @@
 #define _IIMAGE_
 
 #include <glibmm.h>
+#include <cstring>
+#include <string>
 #include <vector>
 #include "rt_math.h"
 #include "alignedbuffer.h"
@@ -82,6 +84,9 @@ public:
     void readData  (FILE *fh) {}
     // Write a raw dump of the data
     void writeData (FILE *fh) {}
+    // Same as above, from and to a memory buffer
+    void readData  (const char*& data) {}
+    void writeData (std::string& data) {}
 
     virtual void normalizeInt (int srcMinVal, int srcMaxVal) {};
     virtual void normalizeFloat (float srcMinVal, float srcMaxVal) {};
@@ -581,6 +586,20 @@ public:
         }
     }
 
+    void readData   (const char*& data)
+    {
+        for (int i = 0; i < height; i++, data += width * sizeof(T)) {
+            memcpy (v(i), data, width * sizeof(T));
+        }
+    }
+
+    void writeData  (std::string& data)
+    {
+        for (int i = 0; i < height; i++) {
+            data.append (reinterpret_cast<const char*>(v(i)), width * sizeof(T));
+        }
+    }
+
 };
 
 
@@ -1163,6 +1182,36 @@ public:
         }
     }
 
+    void readData   (const char*& data)
+    {
+        for (int i = 0; i < height; i++, data += width * sizeof(T)) {
+            memcpy (r(i), data, width * sizeof(T));
+        }
+
+        for (int i = 0; i < height; i++, data += width * sizeof(T)) {
+            memcpy (g(i), data, width * sizeof(T));
+        }
+
+        for (int i = 0; i < height; i++, data += width * sizeof(T)) {
+            memcpy (b(i), data, width * sizeof(T));
+        }
+    }
+
+    void writeData  (std::string& data)
+    {
+        for (int i = 0; i < height; i++) {
+            data.append (reinterpret_cast<const char*>(r(i)), width * sizeof(T));
+        }
+
+        for (int i = 0; i < height; i++) {
+            data.append (reinterpret_cast<const char*>(g(i)), width * sizeof(T));
+        }
+
+        for (int i = 0; i < height; i++) {
+            data.append (reinterpret_cast<const char*>(b(i)), width * sizeof(T));
+        }
+    }
+
 };
 
 // --------------------------------------------------------------------
@@ -1723,6 +1772,20 @@ public:
         }
     }
 
+    void readData   (const char*& data)
+    {
+        for (int i = 0; i < height; i++, data += 3 * width * sizeof(T)) {
+            memcpy (r(i), data, 3 * width * sizeof(T));
+        }
+    }
+
+    void writeData  (std::string& data)
+    {
+        for (int i = 0; i < height; i++) {
+            data.append (reinterpret_cast<const char*>(r(i)), 3 * width * sizeof(T));
+        }
+    }
+
 };
 
 // --------------------------------------------------------------------
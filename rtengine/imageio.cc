@@ -21,9 +21,13 @@
 #include <glib/gstdio.h>
 #include <tiff.h>
 #include <tiffio.h>
+#include <algorithm>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <fcntl.h>
+#include <vector>
+#include <zlib.h>
 #include <libiptcdata/iptc-jpeg.h>
 #include "rt_math.h"
 #include "../rtgui/options.h"
@@ -41,6 +45,9 @@
 #include "color.h"
 
 #include "jpeg.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std;
 using namespace rtengine;
@@ -49,6 +56,64 @@ using namespace rtengine::procparams;
 namespace
 {
 
+// Uncompressed size of a deflated TIFF strip; large enough for deflate to reach its usual ratio,
+// small enough to give every thread several strips to work on
+constexpr int deflateStripSize = 1 << 20;
+
+// Applies the PNG filter which gives the smallest sum of absolute values to 'row', the way libpng does
+// by default, and writes the filter type and the filtered bytes to 'out'. 'prior' is null for the first row.
+void filterPNGRow (const unsigned char* row, const unsigned char* prior, int rowlen, int bpp, unsigned char* out, std::vector<unsigned char>& candidate)
+{
+    candidate.resize (rowlen);
+    unsigned long bestSum = 0;
+
+    for (int type = 0; type < 5; ++type) {
+        unsigned char* const dest = type ? candidate.data() : out + 1;
+        unsigned long sum = 0;
+
+        for (int i = 0; i < rowlen; ++i) {
+            const int a = i >= bpp ? row[i - bpp] : 0;
+            const int b = prior ? prior[i] : 0;
+            const int c = prior && i >= bpp ? prior[i - bpp] : 0;
+            int predictor = 0;
+
+            switch (type) {
+                case 1: // sub
+                    predictor = a;
+                    break;
+
+                case 2: // up
+                    predictor = b;
+                    break;
+
+                case 3: // average
+                    predictor = (a + b) >> 1;
+                    break;
+
+                case 4: { // paeth
+                    const int pa = std::abs (b - c);
+                    const int pb = std::abs (a - c);
+                    const int pc = std::abs (a + b - 2 * c);
+                    predictor = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+                    break;
+                }
+            }
+
+            dest[i] = row[i] - predictor;
+            sum += dest[i] < 128 ? dest[i] : 256 - dest[i];
+        }
+
+        if (!type) {
+            out[0] = 0;
+            bestSum = sum;
+        } else if (sum < bestSum) {
+            out[0] = type;
+            bestSum = sum;
+            std::copy (candidate.begin(), candidate.end(), out + 1);
+        }
+    }
+}
+
 // Opens a file for binary writing and request exclusive lock (cases were you need "wb" mode plus locking)
 FILE* g_fopen_withBinaryAndLock(const Glib::ustring& fname)
 {
@@ -958,37 +1023,177 @@ int ImageIO::savePNG  (Glib::ustring fname, int compression, volatile int bps)
                  PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_BASE);
 
 
-    int rowlen = width * 3 * bps / 8;
-    unsigned char *row = new unsigned char [rowlen];
+    const int rowlen = width * 3 * bps / 8;
+    const int bpp = 3 * bps / 8;
 
     png_write_info(png, info);
 
-    for (int i = 0; i < height; i++) {
-        getScanline (i, row, bps);
+    // libpng filters and deflates the rows on one thread. Instead, the image is cut into blocks of rows
+    // which are filtered and deflated in parallel, a batch at a time, as pigz does: each block ends with a
+    // sync flush (the last one finishes the stream) and is primed with the end of the previous one, so that
+    // the blocks concatenate to a single zlib stream, written here as one IDAT chunk per block.
+    const int rowsPerBlock = std::max(1, std::min(height, deflateStripSize / (rowlen + 1)));
+    const int blockCount = (height + rowsPerBlock - 1) / rowsPerBlock;
+#ifdef _OPENMP
+    const int batchSize = 2 * omp_get_max_threads();
+#else
+    const int batchSize = 1;
+#endif
+    constexpr uInt windowSize = 1 << 15;
+    std::vector<std::vector<Bytef>> filtered (batchSize);
+    std::vector<std::vector<Bytef>> blocks (batchSize);
+    std::vector<uLong> blockSizes (batchSize);
+    std::vector<uLong> blockAdlers (batchSize);
+    std::vector<Bytef> window; // end of the last block of the previous batch
+    uLong adler = adler32 (0, nullptr, 0);
+    bool deflateOk = true;
+    png_byte idatName[5] = {'I', 'D', 'A', 'T', '\0'};
+    png_byte iendName[5] = {'I', 'E', 'N', 'D', '\0'};
+
+    for (int firstBlock = 0; firstBlock < blockCount && deflateOk; firstBlock += batchSize) {
+        const int lastBlock = std::min(firstBlock + batchSize, blockCount);
+
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic)
+#endif
+
+        for (int block = firstBlock; block < lastBlock; ++block) {
+            const int firstRow = block * rowsPerBlock;
+            const int rows = std::min(rowsPerBlock, height - firstRow);
+            std::vector<unsigned char> raw (2 * static_cast<std::size_t>(rowlen));
+            std::vector<unsigned char> candidate;
+            std::vector<Bytef>& data = filtered[block - firstBlock];
+            data.resize (static_cast<std::size_t>(rows) * (rowlen + 1));
 
-        if (bps == 16) {
-            // convert to network byte order
+            const auto readRow = [this, rowlen, bps] (int row, unsigned char* dest) {
+                getScanline (row, dest, bps);
+
+                if (bps == 16) {
+                    // convert to network byte order
 #if __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
-            for (int j = 0; j < width * 6; j += 2) {
-                unsigned char tmp = row[j];
-                row[j] = row[j + 1];
-                row[j + 1] = tmp;
+                    for (int j = 0; j < rowlen; j += 2) {
+                        std::swap (dest[j], dest[j + 1]);
+                    }
+
+#endif
+                }
+            };
+
+            // the filters look at the row above, which may belong to the previous block
+            unsigned char* current = raw.data();
+            unsigned char* prior = nullptr;
+
+            if (firstRow > 0) {
+                prior = raw.data() + rowlen;
+                readRow (firstRow - 1, prior);
+            }
+
+            for (int row = 0; row < rows; ++row) {
+                readRow (firstRow + row, current);
+                filterPNGRow (current, prior, rowlen, bpp, data.data() + static_cast<std::size_t>(row) * (rowlen + 1), candidate);
+                std::swap (current, prior);
+
+                if (!current) {
+                    current = raw.data() + rowlen;
+                }
             }
+        }
 
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic)
 #endif
+
+        for (int block = firstBlock; block < lastBlock; ++block) {
+            const std::vector<Bytef>& data = filtered[block - firstBlock];
+            const std::vector<Bytef>& previous = block == firstBlock ? window : filtered[block - firstBlock - 1];
+            const bool last = block == blockCount - 1;
+            std::vector<Bytef>& out = blocks[block - firstBlock];
+            uLong& outSize = blockSizes[block - firstBlock];
+            z_stream stream;
+            stream.zalloc = Z_NULL;
+            stream.zfree = Z_NULL;
+            stream.opaque = Z_NULL;
+            outSize = 0;
+
+            // raw deflate, the zlib header and checksum are added when writing
+            if (deflateInit2 (&stream, compression, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                continue;
+            }
+
+            if (!previous.empty()) {
+                const uInt dictionarySize = std::min<uInt>(windowSize, previous.size());
+                deflateSetDictionary (&stream, previous.data() + previous.size() - dictionarySize, dictionarySize);
+            }
+
+            // room for the zlib header before the first block and the checksum after the last one
+            const uLong bound = deflateBound (&stream, data.size()) + 16;
+            out.resize (2 + bound + 4);
+            stream.next_in = const_cast<Bytef*>(data.data());
+            stream.avail_in = data.size();
+            stream.next_out = out.data() + 2;
+            stream.avail_out = bound;
+
+            if (deflate (&stream, last ? Z_FINISH : Z_SYNC_FLUSH) == (last ? Z_STREAM_END : Z_OK) && !stream.avail_in && stream.avail_out) {
+                outSize = bound - stream.avail_out;
+            }
+
+            deflateEnd (&stream);
+            blockAdlers[block - firstBlock] = adler32 (adler32 (0, nullptr, 0), data.data(), data.size());
         }
 
-        png_write_row (png, (png_byte*)row);
+        for (int block = firstBlock; block < lastBlock; ++block) {
+            std::vector<Bytef>& out = blocks[block - firstBlock];
+            const uLong size = blockSizes[block - firstBlock];
+            const std::vector<Bytef>& data = filtered[block - firstBlock];
 
-        if (pl && !(i % 100)) {
-            pl->setProgress ((double)(i + 1) / height);
+            if (!size) {
+                deflateOk = false;
+                break;
+            }
+
+            adler = adler32_combine (adler, blockAdlers[block - firstBlock], data.size());
+            Bytef* begin = out.data() + 2;
+            Bytef* end = begin + size;
+
+            if (block == 0) {
+                // 32K window, deflate, with the level hint of the zlib header
+                const int level = compression < 0 ? 6 : compression;
+                const int flags = (level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6;
+                *--begin = flags + 31 - (0x7800 + flags) % 31;
+                *--begin = 0x78;
+            }
+
+            if (block == blockCount - 1) {
+                *end++ = adler >> 24;
+                *end++ = adler >> 16;
+                *end++ = adler >> 8;
+                *end++ = adler;
+            }
+
+            png_write_chunk (png, idatName, begin, end - begin);
+        }
+
+        if (lastBlock < blockCount) {
+            const std::vector<Bytef>& tail = filtered[lastBlock - firstBlock - 1];
+            window.assign (tail.end() - std::min<std::size_t>(windowSize, tail.size()), tail.end());
+        }
+
+        if (pl) {
+            pl->setProgress ((double)lastBlock / blockCount);
         }
     }
 
-    png_write_end(png, info);
+    if (!deflateOk) {
+        png_destroy_write_struct (&png, &info);
+        fclose (file);
+        g_remove (fname.c_str());
+        return IMIO_CANNOTWRITEFILE;
+    }
+
+    // png_write_end() would complain about the IDAT chunks it didn't write itself
+    png_write_chunk (png, iendName, nullptr, 0);
     png_destroy_write_struct(&png, &info);
 
-    delete [] row;
     fclose (file);
 
     if (pl) {
@@ -1138,9 +1343,16 @@ int ImageIO::saveJPEG (Glib::ustring fname, int quality, int subSamp)
         write_icc_profile (&cinfo, (JOCTET*)profileData, profileLength);
     }
 
-    // write image data
-    int rowlen = width * 3;
-    unsigned char *row = new unsigned char [rowlen];
+    // write image data; the entropy coding of libjpeg is a single stream (and optimize_coding needs all of
+    // it), so only the conversion of the scanlines is done in parallel, a batch of rows at a time
+    const int rowlen = width * 3;
+    const int batchRows = 64;
+    unsigned char *row = new unsigned char [rowlen * batchRows];
+    JSAMPROW rows[batchRows];
+
+    for (int i = 0; i < batchRows; ++i) {
+        rows[i] = row + i * rowlen;
+    }
 
     /* To avoid memory leaks we establish a new setjmp return context for my_error_exit to use. */
 #if defined( WIN32 ) && defined( __x86_64__ )
@@ -1161,18 +1373,32 @@ int ImageIO::saveJPEG (Glib::ustring fname, int quality, int subSamp)
     }
 
     while (cinfo.next_scanline < cinfo.image_height) {
+        const int firstRow = cinfo.next_scanline;
+        const int count = std::min<int>(batchRows, cinfo.image_height - firstRow);
 
-        getScanline (cinfo.next_scanline, row, 8);
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
 
-        if (jpeg_write_scanlines (&cinfo, &row, 1) < 1) {
-            jpeg_destroy_compress (&cinfo);
-            delete [] row;
-            fclose (file);
-            g_remove (fname.c_str());
-            return IMIO_CANNOTWRITEFILE;
+        for (int i = 0; i < count; ++i) {
+            getScanline (firstRow + i, rows[i], 8);
         }
 
-        if (pl && !(cinfo.next_scanline % 100)) {
+        for (int written = 0; written < count;) {
+            const int lines = jpeg_write_scanlines (&cinfo, rows + written, count - written);
+
+            if (lines < 1) {
+                jpeg_destroy_compress (&cinfo);
+                delete [] row;
+                fclose (file);
+                g_remove (fname.c_str());
+                return IMIO_CANNOTWRITEFILE;
+            }
+
+            written += lines;
+        }
+
+        if (pl) {
             pl->setProgress ((double)(cinfo.next_scanline) / cinfo.image_height);
         }
     }
@@ -1354,7 +1580,8 @@ int ImageIO::saveTIFF (Glib::ustring fname, int bps, bool uncompressed)
         TIFFSetField (out, TIFFTAG_IMAGELENGTH, height);
         TIFFSetField (out, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
         TIFFSetField (out, TIFFTAG_SAMPLESPERPIXEL, 3);
-        TIFFSetField (out, TIFFTAG_ROWSPERSTRIP, height);
+        const int rowsPerStrip = uncompressed ? height : std::max(1, std::min(height, deflateStripSize / lineWidth));
+        TIFFSetField (out, TIFFTAG_ROWSPERSTRIP, rowsPerStrip);
         TIFFSetField (out, TIFFTAG_BITSPERSAMPLE, bps);
         TIFFSetField (out, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
         TIFFSetField (out, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
@@ -1369,17 +1596,79 @@ int ImageIO::saveTIFF (Glib::ustring fname, int bps, bool uncompressed)
             TIFFSetField (out, TIFFTAG_ICCPROFILE, profileLength, profileData);
         }
 
-        for (int row = 0; row < height; row++) {
-            getScanline (row, linebuffer, bps);
+        if (uncompressed) {
+            for (int row = 0; row < height; row++) {
+                getScanline (row, linebuffer, bps);
 
-            if (TIFFWriteScanline (out, linebuffer, row, 0) < 0) {
-                TIFFClose (out);
-                delete [] linebuffer;
-                return IMIO_CANNOTWRITEFILE;
+                if (TIFFWriteScanline (out, linebuffer, row, 0) < 0) {
+                    TIFFClose (out);
+                    delete [] linebuffer;
+                    return IMIO_CANNOTWRITEFILE;
+                }
+
+                if (pl && !(row % 100)) {
+                    pl->setProgress ((double)(row + 1) / height);
+                }
             }
+        } else {
+            // libtiff's deflate codec compresses the whole image on one thread. Instead, the strips are
+            // filled and deflated in parallel, a batch at a time, and handed to libtiff as raw strips in
+            // file order. Raw strips bypass libtiff's byte swapping, so that is done here as well.
+            const bool swab = bps > 8 && TIFFIsByteSwapped (out);
+            const int stripCount = (height + rowsPerStrip - 1) / rowsPerStrip;
+#ifdef _OPENMP
+            const int batchSize = 2 * omp_get_max_threads();
+#else
+            const int batchSize = 1;
+#endif
+            std::vector<std::vector<Bytef>> blocks (batchSize);
+            std::vector<uLongf> blockSizes (batchSize);
+
+            for (int firstStrip = 0; firstStrip < stripCount && writeOk; firstStrip += batchSize) {
+                const int lastStrip = std::min(firstStrip + batchSize, stripCount);
+
+#ifdef _OPENMP
+                #pragma omp parallel for schedule(dynamic)
+#endif
+
+                for (int strip = firstStrip; strip < lastStrip; ++strip) {
+                    const int firstRow = strip * rowsPerStrip;
+                    const int rows = std::min(rowsPerStrip, height - firstRow);
+                    const uLong rawSize = static_cast<uLong>(rows) * lineWidth;
+                    std::vector<Bytef> raw (rawSize);
+
+                    for (int row = 0; row < rows; ++row) {
+                        getScanline (firstRow + row, raw.data() + row * lineWidth, bps);
+                    }
+
+                    if (swab && bps == 16) {
+                        TIFFSwabArrayOfShort (reinterpret_cast<uint16_t*>(raw.data()), rawSize / 2);
+                    } else if (swab && bps == 32) {
+                        TIFFSwabArrayOfLong (reinterpret_cast<uint32_t*>(raw.data()), rawSize / 4);
+                    }
+
+                    std::vector<Bytef>& block = blocks[strip - firstStrip];
+                    uLongf& blockSize = blockSizes[strip - firstStrip];
+                    blockSize = compressBound (rawSize);
+                    block.resize (blockSize);
+
+                    if (compress2 (block.data(), &blockSize, raw.data(), rawSize, Z_DEFAULT_COMPRESSION) != Z_OK) {
+                        blockSize = 0;
+                    }
+                }
+
+                for (int strip = firstStrip; strip < lastStrip; ++strip) {
+                    const uLongf blockSize = blockSizes[strip - firstStrip];
 
-            if (pl && !(row % 100)) {
-                pl->setProgress ((double)(row + 1) / height);
+                    if (!blockSize || TIFFWriteRawStrip (out, strip, blocks[strip - firstStrip].data(), blockSize) < 0) {
+                        writeOk = false;
+                        break;
+                    }
+                }
+
+                if (pl) {
+                    pl->setProgress ((double)lastStrip / stripCount);
+                }
             }
         }
 
@@ -22,6 +22,7 @@
 #include <glibmm.h>
 #include <vector>
 #include "rtengine.h"
+#include "cancellation.h"
 #include "colortemp.h"
 #include "procparams.h"
 #include "coord2d.h"
@@ -60,6 +61,7 @@ protected:
     ImageData* idata;
     ImageMatrices imatrices;
     double dirpyrdenoiseExpComp;
+    CancellationToken cancellation;
 
 public:
     ImageSource () : references (1), redAWBMul(-1.), greenAWBMul(-1.), blueAWBMul(-1.),
@@ -117,6 +119,16 @@ public:
 
     virtual void        setProgressListener (ProgressListener* pl) {}
 
+    // demosaic and retinex stop early and leave garbage once this token is cancelled
+    void        setCancellationToken (const CancellationToken& token)
+    {
+        cancellation = token;
+    }
+    bool        isCancelled () const
+    {
+        return cancellation.isCancelled();
+    }
+
     void        increaseRef ()
     {
         references++;
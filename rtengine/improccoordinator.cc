@@ -23,7 +23,9 @@
 #include "../rtgui/ppversion.h"
 #include "colortemp.h"
 #include "improcfun.h"
+#include "histogramengine.h"
 #include "iccstore.h"
+#include "pipelineprofiler.h"
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -35,7 +37,7 @@ extern const Settings* settings;
 ImProcCoordinator::ImProcCoordinator ()
     : orig_prev(nullptr), oprevi(nullptr), oprevl(nullptr), nprevl(nullptr), previmg(nullptr), workimg(nullptr),
       ncie(nullptr), imgsrc(nullptr), shmap(nullptr), lastAwbEqual(0.), lastAwbTempBias(0.0), ipf(&params, true), monitorIntent(RI_RELATIVE),
-      softProof(false), gamutCheck(false), scale(10), highDetailPreprocessComputed(false), highDetailRawComputed(false),
+      softProof(false), gamutCheck(false), scale(10), highDetailPreprocessComputed(false), highDetailRawComputed(false), demosaicCancelled(false),
       allocated(false), bwAutoR(-9000.f), bwAutoG(-9000.f), bwAutoB(-9000.f), CAMMean(NAN),
 
       hltonecurve(65536),
@@ -90,8 +92,13 @@ ImProcCoordinator::ImProcCoordinator ()
       pW(-1), pH(-1),
       plistener(nullptr), imageListener(nullptr), aeListener(nullptr), acListener(nullptr), abwListener(nullptr), awbListener(nullptr), frameCountListener(nullptr), imageTypeListener(nullptr), actListener(nullptr), adnListener(nullptr), awavListener(nullptr), dehaListener(nullptr), hListener(nullptr),
       resultValid(false), lastOutputProfile("BADFOOD"), lastOutputIntent(RI__COUNT), lastOutputBPC(false), thread(nullptr), changeSinceLast(0), updaterRunning(false), destroying(false), utili(false), autili(false),
-      butili(false), ccutili(false), cclutili(false), clcutili(false), opautili(false), wavcontlutili(false), colourToningSatLimit(0.f), colourToningSatLimitOpacity(0.f)
-{}
+      butili(false), ccutili(false), cclutili(false), clcutili(false), opautili(false), wavcontlutili(false), colourToningSatLimit(0.f), colourToningSatLimitOpacity(0.f),
+      idleRender(this)
+{
+    // the wavelet tools redo their decompositions and the tone mapping its blur at each update of the preview or of the detail windows
+    ipf.setCacheWavelets(true);
+    ipf.setKeepToneMapBlurs(true);
+}
 
 void ImProcCoordinator::assign (ImageSource* imgsrc)
 {
@@ -102,6 +109,7 @@ ImProcCoordinator::~ImProcCoordinator ()
 {
 
     destroying = true;
+    idleRender.suspend ();
     updaterThreadStart.lock ();
 
     if (updaterRunning && thread) {
@@ -131,10 +139,11 @@ DetailedCrop* ImProcCoordinator::createCrop  (::EditDataProvider *editDataProvid
 
 // todo: bitmask containing desired actions, taken from changesSinceLast
 // cropCall: calling crop, used to prevent self-updates  ...doesn't seem to be used
-void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
+int ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
 {
 
     MyMutex::MyLock processingLock(mProcessing);
+    PipelineProfiler::Stage totalStage("preview", "total");
     int numofphases = 14;
     int readyphase = 0;
 
@@ -192,7 +201,9 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
     if ( (todo & M_PREPROC) || (!highDetailPreprocessComputed && highDetailNeeded)) {
         imgsrc->setCurrentFrame(params.raw.bayersensor.imageNum);
 
+        PipelineProfiler::Stage preprocessStage("preview", "preprocess");
         imgsrc->preprocess( rp, params.lensProf, params.coarse );
+        preprocessStage.stop();
         imgsrc->getRAWHistogram( histRedRaw, histGreenRaw, histBlueRaw );
 
         if (highDetailNeeded) {
@@ -220,6 +231,7 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
 
     if (   (todo & M_RAW)
             || (!highDetailRawComputed && highDetailNeeded)
+            || demosaicCancelled
             || ( params.toneCurve.hrenabled && params.toneCurve.method != "Color" && imgsrc->IsrgbSourceModified())
             || (!params.toneCurve.hrenabled && params.toneCurve.method == "Color" && imgsrc->IsrgbSourceModified())) {
 
@@ -231,7 +243,17 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
             }
         }
 
+        PipelineProfiler::Stage demosaicStage("preview", "demosaic");
         imgsrc->demosaic( rp);//enabled demosaic
+        demosaicStage.stop();
+
+        demosaicCancelled = imgsrc->isCancelled();
+
+        if (demosaicCancelled) {
+            highDetailRawComputed = false;
+            return todo | M_RAW;
+        }
+
         // if a demosaic happened we should also call getimage later, so we need to set the M_INIT flag
         todo |= M_INIT;
 
@@ -250,6 +272,7 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
     }
 
     if ((todo & (M_RETINEX | M_INIT)) && params.retinex.enabled) {
+        PipelineProfiler::Stage retinexStage("preview", "retinex");
         bool dehacontlutili = false;
         bool mapcontlutili = false;
         bool useHsl = false;
@@ -260,6 +283,10 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
         float minCD, maxCD, mini, maxi, Tmean, Tsigma, Tmin, Tmax;
         imgsrc->retinex( params.icm, params.retinex,  params.toneCurve, cdcurve, mapcurve, dehatransmissionCurve, dehagaintransmissionCurve, conversionBuffer, dehacontlutili, mapcontlutili, useHsl, minCD, maxCD, mini, maxi, Tmean, Tsigma, Tmin, Tmax, histLRETI);//enabled Retinex
 
+        if (imgsrc->isCancelled()) {
+            return todo | M_RETINEX;
+        }
+
         if(dehaListener) {
             dehaListener->minmaxChanged(maxCD, minCD, mini, maxi, Tmean, Tsigma, Tmin, Tmax);
         }
@@ -332,7 +359,9 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
         // Tells to the ImProcFunctions' tools what is the preview scale, which may lead to some simplifications
         ipf.setScale (scale);
 
+        PipelineProfiler::Stage rawToRgbStage("preview", "raw to rgb");
         imgsrc->getImage (currWB, tr, orig_prev, pp, params.toneCurve, params.icm, params.raw);
+        rawToRgbStage.stop();
         denoiseInfoStore.valid = false;
         //ColorTemp::CAT02 (orig_prev, &params) ;
         //   printf("orig_prevW=%d\n  scale=%d",orig_prev->width, scale);
@@ -394,6 +423,7 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
     }
 
     if ((needstransform || ((todo & (M_TRANSFORM | M_RGBCURVE))  && params.dirpyrequalizer.cbdlMethod == "bef" && params.dirpyrequalizer.enabled && !params.colorappearance.enabled)) ) {
+        PipelineProfiler::Stage transformStage("preview", "transform");
         if(!oprevi || oprevi == orig_prev)
             oprevi = new Imagefloat (pW, pH);
         if (needstransform)
@@ -554,8 +584,10 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
             DCPProfile::ApplyState as;
             DCPProfile *dcpProf = imgsrc->getDCP(params.icm, currWB, as);
 
+            PipelineProfiler::Stage rgbProcStage("preview", "rgbProc");
             ipf.rgbProc (oprevi, oprevl, nullptr, hltonecurve, shtonecurve, tonecurve, shmap, params.toneCurve.saturation,
                          rCurve, gCurve, bCurve, colourToningSatLimit , colourToningSatLimitOpacity, ctColorCurve, ctOpacityCurve, opautili, clToningcurve, cl2Toningcurve, customToneCurve1, customToneCurve2, beforeToneCurveBW, afterToneCurveBW, rrm, ggm, bbm, bwAutoR, bwAutoG, bwAutoB, params.toneCurve.expcomp, params.toneCurve.hlcompr, params.toneCurve.hlcomprthresh, dcpProf, as, histToneCurve);
+            rgbProcStage.stop();
 
             if(params.blackwhite.enabled && params.blackwhite.autoc && abwListener) {
                 if (settings->verbose) {
@@ -583,34 +615,15 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
 
     readyphase++;
 
+    if (ipf.isCancelled()) {
+        return todo;
+    }
+
     if (todo & (M_LUMACURVE | M_CROP)) {
         LUTu lhist16(32768);
-        lhist16.clear();
-#ifdef _OPENMP
-        const int numThreads = min(max(pW * pH / (int)lhist16.getSize(), 1), omp_get_max_threads());
-        #pragma omp parallel num_threads(numThreads) if(numThreads>1)
-#endif
-        {
-            LUTu lhist16thr(lhist16.getSize());
-            lhist16thr.clear();
-#ifdef _OPENMP
-            #pragma omp for nowait
-#endif
-
-            for (int x = 0; x < pH; x++)
-                for (int y = 0; y < pW; y++) {
-                    int pos = (int)(oprevl->L[x][y]);
-                    lhist16thr[pos]++;
-                }
-
-#ifdef _OPENMP
-            #pragma omp critical
-#endif
-            lhist16 += lhist16thr;
-        }
-#ifdef _OPENMP
-            static_cast<void>(numThreads); // to silence cppcheck warning
-#endif
+        HistogramEngine histograms;
+        histograms.requestL(lhist16, lhist16.getSize());
+        histograms.compute(oprevl, nullptr, 0, 0, pW, pH);
         CurveFactory::complexLCurve (params.labCurve.brightness, params.labCurve.contrast, params.labCurve.lcurve, lhist16, lumacurve, histLCurve, scale == 1 ? 1 : 16, utili);
     }
 
@@ -629,6 +642,7 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
         //   ipf.MSR(nprevl, nprevl->W, nprevl->H, 1);
         histCCurve.clear();
         histLCurve.clear();
+        PipelineProfiler::Stage labOpsStage("preview", "lab ops");
         ipf.chromiLuminanceCurve (nullptr, pW, nprevl, nprevl, chroma_acurve, chroma_bcurve, satcurve, lhskcurve, clcurve, lumacurve, utili, autili, butili, ccutili, cclutili, clcutili, histCCurve, histLCurve);
         ipf.vibrance(nprevl);
 
@@ -636,6 +650,8 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
             ipf.EPDToneMap(nprevl, 5, scale);
         }
 
+        labOpsStage.stop();
+
         // for all treatments Defringe, Sharpening, Contrast detail , Microcontrast they are activated if "CIECAM" function are disabled
         readyphase++;
 
@@ -702,6 +718,7 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
             int kall = 0;
             progress ("Wavelet...", 100 * readyphase / numofphases);
             //  ipf.ip_wavelet(nprevl, nprevl, kall, WaveParams, wavCLVCurve, waOpacityCurveRG, waOpacityCurveBY, scale);
+            PipelineProfiler::Stage waveletStage("preview", "wavelet");
             ipf.ip_wavelet(nprevl, nprevl, kall, WaveParams, wavCLVCurve, waOpacityCurveRG, waOpacityCurveBY, waOpacityCurveW, waOpacityCurveWL, wavclCurve, wavcontlutili, scale);
 
         }
@@ -766,7 +783,9 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
             CAMBrightCurveJ.dirty = true;
             CAMBrightCurveQ.dirty = true;
 
+            PipelineProfiler::Stage ciecamStage("preview", "ciecam");
             ipf.ciecam_02float (ncie, float(adap), begh, endh, pW, 2, nprevl, &params, customColCurve1, customColCurve2, customColCurve3, histLCAM, histCCAM, CAMBrightCurveJ, CAMBrightCurveQ, CAMMean, 5, 1, execsharp, d, scale, 1);
+            ciecamStage.stop();
 
             if(params.colorappearance.autodegree && acListener && params.colorappearance.enabled) {
                 acListener->autoCamChanged(100.*(double)d);
@@ -795,6 +814,10 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
         }
     }
 
+    if (ipf.isCancelled()) {
+        return todo | M_LUMINANCE;
+    }
+
     // Update the monitor color transform if necessary
     if ((todo & M_MONITOR) || (lastOutputProfile!=params.icm.output) || lastOutputIntent!=params.icm.outputIntent || lastOutputBPC!=params.icm.outputBPC) {
         lastOutputProfile = params.icm.output;
@@ -813,6 +836,7 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
 
     if ((todo != CROP && todo != MINUPDATE) || (todo & M_MONITOR)) {
         MyMutex::MyLock prevImgLock(previmg->getMutex());
+        PipelineProfiler::Stage outputStage("preview", "output conversion");
 
         try {
             // Computing the preview image, i.e. converting from WCS->Monitor color space (soft-proofing disabled) or WCS->Printer profile->Monitor color space (soft-proofing enabled)
@@ -823,7 +847,7 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
             workimg = ipf.lab2rgb (nprevl, 0, 0, pW, pH, params.icm);
         } catch(char * str) {
             progress ("Error converting file...", 0);
-            return;
+            return 0;
         }
     }
 
@@ -844,10 +868,13 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall)
     readyphase++;
 
     if (hListener) {
+        PipelineProfiler::Stage histogramStage("preview", "histograms");
         updateLRGBHistograms ();
+        histogramStage.stop();
         hListener->histogramChanged (histRed, histGreen, histBlue, histLuma, histToneCurve, histLCurve, histCCurve, /*histCLurve, histLLCurve,*/ histLCAM, histCCAM, histRedRaw, histGreenRaw, histBlueRaw, histChroma, histLRETI);
     }
 
+    return 0;
 }
 
 
@@ -975,51 +1002,11 @@ void ImProcCoordinator::updateLRGBHistograms ()
     int x1, y1, x2, y2;
     params.crop.mapToResized(pW, pH, scale, x1, x2, y1, y2);
 
-    #pragma omp parallel sections
-    {
-        #pragma omp section
-        {
-            histChroma.clear();
-
-            for (int i = y1; i < y2; i++)
-                for (int j = x1; j < x2; j++)
-                {
-                    histChroma[(int)(sqrtf(SQR(nprevl->a[i][j]) + SQR(nprevl->b[i][j])) / 188.f)]++; //188 = 48000/256
-                }
-        }
-        #pragma omp section
-        {
-            histLuma.clear();
-
-            for (int i = y1; i < y2; i++)
-                for (int j = x1; j < x2; j++)
-                {
-                    histLuma[(int)(nprevl->L[i][j] / 128.f)]++;
-                }
-        }
-        #pragma omp section
-        {
-            histRed.clear();
-            histGreen.clear();
-            histBlue.clear();
-
-            for (int i = y1; i < y2; i++)
-            {
-                int ofs = (i * pW + x1) * 3;
-
-                for (int j = x1; j < x2; j++) {
-                    int r = workimg->data[ofs++];
-                    int g = workimg->data[ofs++];
-                    int b = workimg->data[ofs++];
-
-                    histRed[r]++;
-                    histGreen[g]++;
-                    histBlue[b]++;
-                }
-            }
-        }
-    }
-
+    HistogramEngine histograms;
+    histograms.requestL (histLuma);
+    histograms.requestChroma (histChroma);
+    histograms.requestRgb (histRed, histGreen, histBlue);
+    histograms.compute (nprevl, workimg, x1, y1, x2, y2);
 }
 
 void ImProcCoordinator::progress (Glib::ustring str, int pr)
@@ -1274,6 +1261,7 @@ void ImProcCoordinator::saveInputICCReference (const Glib::ustring& fname, bool
 void ImProcCoordinator::stopProcessing ()
 {
 
+    idleRender.suspend ();
     updaterThreadStart.lock ();
 
     if (updaterRunning && thread) {
@@ -1282,6 +1270,7 @@ void ImProcCoordinator::stopProcessing ()
     }
 
     updaterThreadStart.unlock ();
+    idleRender.resume ();
 }
 
 void ImProcCoordinator::startProcessing ()
@@ -1308,6 +1297,12 @@ void ImProcCoordinator::startProcessing(int changeCode)
 {
     paramsUpdateMutex.lock();
     changeSinceLast |= changeCode;
+    idleRender.cancel ();
+
+    if (changeCode & (M_VOID - 1)) {
+        cancellation.cancel ();
+    }
+
     paramsUpdateMutex.unlock();
 
     startProcessing ();
@@ -1315,32 +1310,58 @@ void ImProcCoordinator::startProcessing(int changeCode)
 
 void ImProcCoordinator::process ()
 {
-    if (plistener) {
-        plistener->setProgressState (true);
-    }
+    bool pending;
 
-    paramsUpdateMutex.lock ();
+    do {
+        if (plistener) {
+            plistener->setProgressState (true);
+        }
 
-    while (changeSinceLast) {
-        params = nextParams;
-        int change = changeSinceLast;
-        changeSinceLast = 0;
+        paramsUpdateMutex.lock ();
+
+        while (changeSinceLast) {
+            params = nextParams;
+            int change = changeSinceLast;
+            changeSinceLast = 0;
+            // the processing of these parameters is abandoned as soon as newer ones come in
+            const CancellationToken token = cancellation.getToken ();
+            paramsUpdateMutex.unlock ();
+
+            {
+                // like the idle render, so that no pipeline running under mProcessing sees the token change
+                MyMutex::MyLock processingLock (mProcessing);
+                ipf.setCancellationToken (token);
+                imgsrc->setCancellationToken (token);
+            }
+
+            int redo = 0;
+
+            // M_VOID means no update, and is a bit higher that the rest
+            if (change & (M_VOID - 1)) {
+                redo = updatePreviewImage (change);
+            }
+
+            paramsUpdateMutex.lock ();
+            changeSinceLast |= redo;
+        }
+
+        const unsigned int idleToken = idleRender.arm ();
         paramsUpdateMutex.unlock ();
 
-        // M_VOID means no update, and is a bit higher that the rest
-        if (change & (M_VOID - 1)) {
-            updatePreviewImage (change);
+        if (plistener) {
+            plistener->setProgressState (false);
         }
 
+        // the thread stays alive while the user is idle, to render the visible area at 1:1;
+        // changes coming in meanwhile are processed here, as startProcessing() won't start a new thread
+        idleRender.run (idleToken);
+
         paramsUpdateMutex.lock ();
-    }
+        pending = changeSinceLast;
+        paramsUpdateMutex.unlock ();
+    } while (pending && !destroying);
 
-    paramsUpdateMutex.unlock ();
     updaterRunning = false;
-
-    if (plistener) {
-        plistener->setProgressState (false);
-    }
 }
 
 ProcParams* ImProcCoordinator::beginUpdateParams ()
@@ -1358,6 +1379,11 @@ void ImProcCoordinator::endUpdateParams (ProcEvent change)
 void ImProcCoordinator::endUpdateParams (int changeFlags)
 {
     changeSinceLast |= changeFlags;
+    idleRender.cancel ();
+
+    if (changeFlags & (M_VOID - 1)) {
+        cancellation.cancel ();
+    }
 
     paramsUpdateMutex.unlock ();
     startProcessing ();
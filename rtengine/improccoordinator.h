@@ -26,6 +26,7 @@
 #include "imagesource.h"
 #include "procevents.h"
 #include "dcrop.h"
+#include "idlerender.h"
 #include "LUT.h"
 #include "../rtgui/threadutils.h"
 
@@ -51,6 +52,7 @@ class ImProcCoordinator : public StagedImageProcessor
 {
 
     friend class Crop;
+    friend class IdleRender;
 
 protected:
     Imagefloat *orig_prev;
@@ -81,6 +83,7 @@ protected:
     int scale;
     bool highDetailPreprocessComputed;
     bool highDetailRawComputed;
+    bool demosaicCancelled; // the planes of imgsrc hold a partial demosaic, which nothing may read
     bool allocated;
 
     void freeAll ();
@@ -179,7 +182,8 @@ protected:
     void reallocAll ();
     void updateLRGBHistograms ();
     void setScale (int prevscale);
-    void updatePreviewImage (int todo, Crop* cropCall = nullptr);
+    // returns 0, or the steps to do again when the processing has been cancelled by a parameter change
+    int updatePreviewImage (int todo, Crop* cropCall = nullptr);
 
     MyMutex mProcessing;
     ProcParams params;
@@ -198,6 +202,7 @@ protected:
     int  changeSinceLast;
     bool updaterRunning;
     ProcParams nextParams;
+    CancellationSource cancellation;
     bool destroying;
     bool utili;
     bool autili;
@@ -364,6 +369,8 @@ public:
 
     } denoiseInfoStore;
 
+private:
+    IdleRender idleRender; // last, its crop uses the other members when destroyed
 };
 }
 #endif
@@ -25,6 +25,7 @@
 
 #include "rtengine.h"
 #include "improcfun.h"
+#include "histogramengine.h"
 #include "curves.h"
 #include "mytime.h"
 #include "iccstore.h"
@@ -39,6 +40,8 @@
 #include "EdgePreservingDecomposition.h"
 #include "improccoordinator.h"
 #include "clutstore.h"
+#include "labtransform.h"
+#include "waveletcache.h"
 #include "ciecam02.h"
 //#define BENCHMARK
 #include "StopWatch.h"
@@ -68,6 +71,40 @@ void ImProcFunctions::setScale (double iscale)
     scale = iscale;
 }
 
+void ImProcFunctions::setCancellationToken (const CancellationToken& token)
+{
+    cancellation = token;
+}
+
+const CancellationToken& ImProcFunctions::getCancellationToken () const
+{
+    return cancellation;
+}
+
+bool ImProcFunctions::isCancelled () const
+{
+    return cancellation.isCancelled();
+}
+
+void ImProcFunctions::setCacheWavelets (bool cache)
+{
+    cacheWavelets = cache;
+}
+
+void ImProcFunctions::setKeepToneMapBlurs (bool keep)
+{
+    keepToneMapBlurs = keep;
+}
+
+wavelet_decomposition* ImProcFunctions::decomposeWavelet (float* src, int width, int height, int maxlvl, int subsampling, int skipcrop, int numThreads, int Daub4Len)
+{
+    if (cacheWavelets) {
+        return WaveletCache::getInstance().decompose(src, width, height, maxlvl, subsampling, skipcrop, numThreads, Daub4Len);
+    }
+
+    return new wavelet_decomposition(src, width, height, maxlvl, subsampling, skipcrop, numThreads, Daub4Len);
+}
+
 void ImProcFunctions::updateColorProfiles (const Glib::ustring& monitorProfile, RenderingIntent monitorIntent, bool softProof, bool gamutCheck)
 {
     // set up monitor transform
@@ -76,6 +113,7 @@ void ImProcFunctions::updateColorProfiles (const Glib::ustring& monitorProfile,
     }
 
     monitorTransform = nullptr;
+    monitorLabTransform.reset();
 
     cmsHPROFILE monitor = nullptr;
 
@@ -129,13 +167,7 @@ void ImProcFunctions::updateColorProfiles (const Glib::ustring& monitorProfile,
         }
 
         if (!softProofCreated) {
-            flags = cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE;
-
-            if (settings->monitorBPC) {
-                flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
-            }
-
-            monitorTransform = cmsCreateTransform (iprof, TYPE_Lab_FLT, monitor, TYPE_RGB_8, monitorIntent, flags);
+            monitorLabTransform = LabTransform::get (monitor, LabTransform::getProfileId (monitorProfile, monitor), monitorIntent, settings->monitorBPC, 8);
         }
 
         cmsCloseProfile (iprof);
@@ -3316,12 +3348,7 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
 
         float out_rgbx[4 * TS] ALIGNED16; // Line buffer for CLUT
 
-        LUTu histToneCurveThr;
-
-        if (toneCurveHistSize > 0) {
-            histToneCurveThr (toneCurveHistSize);
-            histToneCurveThr.clear();
-        }
+        HistogramEngine::Accumulator histToneCurveThr (histToneCurve, histToneCurveCompression);
 
 #ifdef _OPENMP
         #pragma omp for schedule(dynamic) collapse(2)
@@ -3474,7 +3501,7 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
 
                         if (histToneCurveThr) {
                             int y = CLIP<int> (lumimulf[0] * Color::gamma2curve[rtemp[ti * TS + tj]] + lumimulf[1] * Color::gamma2curve[gtemp[ti * TS + tj]] + lumimulf[2] * Color::gamma2curve[btemp[ti * TS + tj]]);
-                            histToneCurveThr[y >> histToneCurveCompression]++;
+                            histToneCurveThr.add (y);
                         }
                     }
                 }
@@ -4413,14 +4440,7 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, PipetteBuffer
             free (editWhateverBuffer);
         }
 
-#ifdef _OPENMP
-        #pragma omp critical
-        {
-            if (toneCurveHistSize > 0) {
-                histToneCurve += histToneCurveThr;
-            }
-        }
-#endif // _OPENMP
+        histToneCurveThr.merge();
     }
 
     // starting a new tile processing with a 'reduction' clause for the auto mixer computing
@@ -5666,7 +5686,9 @@ SSEFUNCTION void ImProcFunctions::chromiLuminanceCurve (PipetteBuffer *pipetteBu
         float HHBuffer[W] ALIGNED16;
         float CCBuffer[W] ALIGNED16;
 #endif
-        #pragma omp for schedule(dynamic, 16)
+        HistogramEngine::Accumulator hist16Cladthr (hist16Clad);
+        HistogramEngine::Accumulator hist16Lladthr (hist16Llad);
+        #pragma omp for schedule(dynamic, 16) nowait
 
         for (int i = 0; i < H; i++) {
             if (avoidColorShift)
@@ -6046,7 +6068,7 @@ SSEFUNCTION void ImProcFunctions::chromiLuminanceCurve (PipetteBuffer *pipetteBu
                 //update histogram C
                 if (pW != 1) { //only with improccoordinator
                     int posp = (int)sqrt (atmp * atmp + btmp * btmp);
-                    hist16Clad[posp]++;
+                    hist16Cladthr.add (posp);
                 }
 
                 if (editPipette && editID == EUID_Lab_LCCurve) {
@@ -6102,7 +6124,7 @@ SSEFUNCTION void ImProcFunctions::chromiLuminanceCurve (PipetteBuffer *pipetteBu
                 //update histo LC
                 if (pW != 1) { //only with improccoordinator
                     int posl = Lprov1 * 327.68f;
-                    hist16Llad[posl]++;
+                    hist16Lladthr.add (posl);
                 }
 
                 Chprov1 = sqrt (SQR (atmp) + SQR (btmp)) / 327.68f;
@@ -6187,6 +6209,9 @@ SSEFUNCTION void ImProcFunctions::chromiLuminanceCurve (PipetteBuffer *pipetteBu
                 }
             }
         }
+
+        hist16Cladthr.merge();
+        hist16Lladthr.merge();
     } // end of parallelization
 
     if (pW != 1) { //only with improccoordinator
@@ -6327,13 +6352,13 @@ void ImProcFunctions::impulsedenoisecam (CieImage* ncie, float **buffers[3])
     }
 }
 
-void ImProcFunctions::defringe (LabImage* lab)
+void ImProcFunctions::defringe (LabImage* lab, float chromave)
 {
 
     if (params->defringe.enabled && lab->W >= 8 && lab->H >= 8)
 
     {
-        PF_correct_RT (lab, lab, params->defringe.radius, params->defringe.threshold);
+        PF_correct_RT (lab, lab, params->defringe.radius, params->defringe.threshold, chromave);
     }
 }
 
@@ -6415,7 +6440,7 @@ void ImProcFunctions::EPDToneMapCIE (CieImage *ncie, float a_w, float c_, float
         Qpro = maxQ;
     }
 
-    EdgePreservingDecomposition epd (Wid, Hei);
+    EdgePreservingDecomposition epd (Wid, Hei, cancellation, keepToneMapBlurs);
 
     #pragma omp parallel for
 
@@ -6519,7 +6544,7 @@ void ImProcFunctions::EPDToneMap (LabImage *lab, unsigned int Iterates, int skip
     float *a = lab->a[0];
     float *b = lab->b[0];
     size_t N = lab->W * lab->H;
-    EdgePreservingDecomposition epd (lab->W, lab->H);
+    EdgePreservingDecomposition epd (lab->W, lab->H, cancellation, keepToneMapBlurs);
 
     //Due to the taking of logarithms, L must be nonnegative. Further, scale to 0 to 1 using nominal range of L, 0 to 15 bit.
     float minL = FLT_MAX;
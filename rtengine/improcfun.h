@@ -19,6 +19,9 @@
 #ifndef _IMPROCFUN_H_
 #define _IMPROCFUN_H_
 
+#include <memory>
+
+#include "cancellation.h"
 #include "imagefloat.h"
 #include "image16.h"
 #include "image8.h"
@@ -38,6 +41,8 @@
 namespace rtengine
 {
 
+class LabTransform;
+
 using namespace procparams;
 
 class ImProcFunctions
@@ -45,12 +50,18 @@ class ImProcFunctions
 
 
     cmsHTRANSFORM monitorTransform;
+    std::shared_ptr<const LabTransform> monitorLabTransform; // used instead of monitorTransform when not soft-proofing
     cmsHTRANSFORM lab2outputTransform;
     cmsHTRANSFORM output2monitorTransform;
 
     const ProcParams* params;
     double scale;
     bool multiThread;
+    bool cacheWavelets;
+    bool keepToneMapBlurs;
+    CancellationToken cancellation;
+
+    wavelet_decomposition* decomposeWavelet (float* src, int width, int height, int maxlvl, int subsampling, int skipcrop, int numThreads, int Daub4Len = 6);
 
     void calcVignettingParams(int oW, int oH, const VignettingParams& vignetting, double &w2, double &h2, double& maxRadius, double &v, double &b, double &mul);
 
@@ -190,16 +201,26 @@ public:
         TYPE_5X5_SOFT,
         TYPE_5X5_STRONG,
         TYPE_7X7,
-        TYPE_9X9
+        TYPE_9X9,
+        TYPE_15X15,
+        TYPE_25X25
     };
 
     double lumimul[3];
 
     ImProcFunctions       (const ProcParams* iparams, bool imultiThread = true)
-        : monitorTransform(nullptr), lab2outputTransform(nullptr), output2monitorTransform(nullptr), params(iparams), scale(1), multiThread(imultiThread), lumimul{} {}
+        : monitorTransform(nullptr), lab2outputTransform(nullptr), output2monitorTransform(nullptr), params(iparams), scale(1), multiThread(imultiThread), cacheWavelets(false), keepToneMapBlurs(false), lumimul{} {}
     ~ImProcFunctions      ();
 
     void setScale         (double iscale);
+    /// The long running tools poll this token and skip their remaining work once it is cancelled
+    void setCancellationToken (const CancellationToken& token);
+    const CancellationToken& getCancellationToken () const;
+    bool isCancelled      () const;
+    /// Keeps the wavelet decompositions of the wavelet tools, for the interactive pipelines where they are redone with other settings
+    void setCacheWavelets (bool cache);
+    /// Keeps the blurs of the tone mapping, which only depend on the image and on the scale and edge stopping settings, for the same pipelines
+    void setKeepToneMapBlurs (bool keep);
 
     bool needsTransform   ();
     bool needsPCVignetting ();
@@ -333,12 +354,13 @@ public:
     void dirpyr_channel      (float ** data_fine, float ** data_coarse, int width, int height, int level, int scale);
     void idirpyr_eq_channel  (float ** data_coarse, float ** data_fine, float ** buffer, int width, int height, int level, float multi[6], const double dirpyrThreshold, float ** l_a_h, float ** l_b_c, const double skinprot, const bool gamutlab, float b_l, float t_l, float t_r, float b_r,  int choice);
     void idirpyr_eq_channelcam  (float ** data_coarse, float ** data_fine, float ** buffer, int width, int height, int level, float multi[6], const double dirpyrThreshold, float ** l_a_h, float ** l_b_c, const double skinprot, float b_l, float t_l, float t_r);
-    void defringe       (LabImage* lab);
+    void defringe       (LabImage* lab, float chromave = -1.f);
+    double defringeChromaSum (LabImage* lab, int firstRow, int lastRow);
     void defringecam    (CieImage* ncie);
     void badpixcam      (CieImage* ncie, double rad, int thr, int mode, float b_l, float t_l, float t_r, float b_r, float skinprot, float chrom, int hotbad);
     void badpixlab      (LabImage* lab, double rad, int thr, int mode, float b_l, float t_l, float t_r, float b_r, float skinprot, float chrom);
 
-    void PF_correct_RT    (LabImage * src, LabImage * dst, double radius, int thresh);
+    void PF_correct_RT    (LabImage * src, LabImage * dst, double radius, int thresh, float globalChromave = -1.f);
     void PF_correct_RTcam (CieImage * src, CieImage * dst, double radius, int thresh);
     void Badpixelscam(CieImage * src, CieImage * dst, double radius, int thresh, int mode,  float b_l, float t_l, float t_r, float b_r, float skinprot, float chrom, int hotbad);
     void BadpixelsLab(LabImage * src, LabImage * dst, double radius, int thresh, int mode, float b_l, float t_l, float t_r, float b_r, float skinprot, float chrom);
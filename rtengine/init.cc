@@ -29,6 +29,8 @@
 #include "ffmanager.h"
 #include "rtthumbnail.h"
 #include "profilestore.h"
+#include "cpufeatures.h"
+#include "pipelineprofiler.h"
 #include "../rtgui/threadutils.h"
 
 namespace rtengine
@@ -48,12 +50,15 @@ int init (const Settings* s, Glib::ustring baseDir, Glib::ustring userSettingsDi
     CameraConstantsStore::getInstance ()->init (baseDir, userSettingsDir);
     ProcParams::init ();
     Color::init ();
-    PerceptualToneCurve::init ();
-    RawImageSource::init ();
     delete lcmsMutex;
     lcmsMutex = new MyMutex;
     dfm.init( s->darkFramesPath );
     ffm.init( s->flatFieldsPath );
+
+    if (s->verbose) {
+        printf("Runtime dispatched vector kernels: %s\n", getSimdLevelName(getSimdLevel()));
+    }
+
     return 0;
 }
 
@@ -63,6 +68,7 @@ void cleanup ()
     ProcParams::cleanup ();
     Color::cleanup ();
     RawImageSource::cleanup ();
+    PipelineProfiler::getInstance().flush();
 }
 
 StagedImageProcessor* StagedImageProcessor::create (InitialImage* initialImage)
@@ -16,16 +16,21 @@
  *  You should have received a copy of the GNU General Public License
  *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <algorithm>
+#include <cstring>
+
 #include "rtengine.h"
 #include "improcfun.h"
 #include <glibmm.h>
 #include "iccstore.h"
 #include "iccmatrices.h"
+#include "labtransform.h"
 #include "../rtgui/options.h"
 #include "settings.h"
 #include "curves.h"
 #include "alignedbuffer.h"
 #include "color.h"
+#include "widekernels.h"
 
 namespace rtengine
 {
@@ -36,11 +41,25 @@ extern const Settings* settings;
 //         Crop::update                           (rtengine/dcrop.cc)
 //         Thumbnail::processImage                (rtengine/rtthumbnail.cc)
 //
-// If monitorTransform, divide by 327.68 then apply monitorTransform (which can integrate soft-proofing)
+// If monitorLabTransform, apply it
+// else if monitorTransform, divide by 327.68 then apply monitorTransform (which integrates soft-proofing)
 // otherwise divide by 327.68, convert to xyz and apply the sRGB transform, before converting with gamma2curve
 void ImProcFunctions::lab2monitorRgb (LabImage* lab, Image8* image)
 {
-    if (monitorTransform) {
+    if (monitorLabTransform) {
+
+        const int W = lab->W;
+        const int H = lab->H;
+        unsigned char * data = image->data;
+
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic,16)
+#endif
+
+        for (int i = 0; i < H; i++) {
+            monitorLabTransform->toRgb8 (lab->L[i], lab->a[i], lab->b[i], data + i * 3 * W, W);
+        }
+    } else if (monitorTransform) {
 
         int W = lab->W;
         int H = lab->H;
@@ -83,31 +102,41 @@ void ImProcFunctions::lab2monitorRgb (LabImage* lab, Image8* image)
         unsigned char * data = image->data;
 
 #ifdef _OPENMP
-        #pragma omp parallel for schedule(dynamic,16) if (multiThread)
+        #pragma omp parallel if (multiThread)
 #endif
+        {
+            AlignedBuffer<float> xyzBuffer(3 * W);
+            float* const rx = xyzBuffer.data;
+            float* const ry = rx + W;
+            float* const rz = ry + W;
 
-        for (int i = 0; i < H; ++i) {
-            float* rL = lab->L[i];
-            float* ra = lab->a[i];
-            float* rb = lab->b[i];
-            int ix = i * 3 * W;
-
-            float R, G, B;
-            float x_, y_, z_;
+#ifdef _OPENMP
+            #pragma omp for schedule(dynamic,16)
+#endif
 
-            for (int j = 0; j < W; ++j) {
+            for (int i = 0; i < H; ++i) {
+                float* rL = lab->L[i];
+                float* ra = lab->a[i];
+                float* rb = lab->b[i];
+                int ix = i * 3 * W;
 
-                //float L1=rL[j],a1=ra[j],b1=rb[j];//for testing
+                float R, G, B;
 
-                Color::Lab2XYZ(rL[j], ra[j], rb[j], x_, y_, z_ );
+                // the Lab to xyz part is vectorized for the whole row when the cpu allows it
+                if (!widekernels::lab2XYZ(rL, ra, rb, rx, ry, rz, W)) {
+                    for (int j = 0; j < W; ++j) {
+                        Color::Lab2XYZ(rL[j], ra[j], rb[j], rx[j], ry[j], rz[j]);
+                    }
+                }
 
-                Color::xyz2srgb(x_, y_, z_, R, G, B);
+                for (int j = 0; j < W; ++j) {
+                    Color::xyz2srgb(rx[j], ry[j], rz[j], R, G, B);
 
-                /* copy RGB */
-                //int R1=((int)gamma2curve[(R)])
-                data[ix++] = uint16ToUint8Rounded(Color::gamma2curve[R]);
-                data[ix++] = uint16ToUint8Rounded(Color::gamma2curve[G]);
-                data[ix++] = uint16ToUint8Rounded(Color::gamma2curve[B]);
+                    /* copy RGB */
+                    data[ix++] = uint16ToUint8Rounded(Color::gamma2curve[R]);
+                    data[ix++] = uint16ToUint8Rounded(Color::gamma2curve[G]);
+                    data[ix++] = uint16ToUint8Rounded(Color::gamma2curve[B]);
+                }
             }
         }
     }
@@ -167,49 +196,67 @@ Image8* ImProcFunctions::lab2rgb (LabImage* lab, int cx, int cy, int cw, int ch,
             oprofG = ICCStore::makeStdGammaProfile(oprof);
         }
 
-        cmsUInt32Number flags = cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE;
-        if (icm.outputBPC) {
-            flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
-        }
+        // the standard gamma profile is rebuilt from the named one on each call, so it is identified by it
         lcmsMutex->lock ();
-        cmsHPROFILE LabIProf  = cmsCreateLab4Profile(nullptr);
-        cmsHTRANSFORM hTransform = cmsCreateTransform (LabIProf, TYPE_Lab_DBL, oprofG, TYPE_RGB_8, icm.outputIntent, flags);  // NOCACHE is important for thread safety
-        cmsCloseProfile(LabIProf);
+        const std::shared_ptr<const LabTransform> transform = LabTransform::get (oprofG, LabTransform::getProfileId (profile, oprof, standard_gamma ? "stdgamma" : ""), icm.outputIntent, icm.outputBPC, 8);
         lcmsMutex->unlock ();
 
         unsigned char *data = image->data;
 
-        // cmsDoTransform is relatively expensive
+        if (transform) {
 #ifdef _OPENMP
-        #pragma omp parallel
+            #pragma omp parallel for schedule(dynamic,16)
 #endif
-        {
-            AlignedBuffer<double> pBuf(3 * cw);
-            double *buffer = pBuf.data;
-            int condition = cy + ch;
 
+            for (int i = cy; i < cy + ch; i++) {
+                transform->toRgb8 (lab->L[i] + cx, lab->a[i] + cx, lab->b[i] + cx, data + (i - cy) * 3 * cw, cw);
+            }
+        } else {
+            cmsUInt32Number flags = cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE;
+            if (icm.outputBPC) {
+                flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
+            }
+            lcmsMutex->lock ();
+            cmsHPROFILE LabIProf  = cmsCreateLab4Profile(nullptr);
+            cmsHTRANSFORM hTransform = cmsCreateTransform (LabIProf, TYPE_Lab_DBL, oprofG, TYPE_RGB_8, icm.outputIntent, flags);  // NOCACHE is important for thread safety
+            cmsCloseProfile(LabIProf);
+            lcmsMutex->unlock ();
+
+            if (hTransform) {
+                // cmsDoTransform is relatively expensive
 #ifdef _OPENMP
-            #pragma omp for firstprivate(lab) schedule(dynamic,16)
+                #pragma omp parallel
 #endif
+                {
+                    AlignedBuffer<double> pBuf(3 * cw);
+                    double *buffer = pBuf.data;
 
-            for (int i = cy; i < condition; i++) {
-                const int ix = i * 3 * cw;
-                int iy = 0;
-                float* rL = lab->L[i];
-                float* ra = lab->a[i];
-                float* rb = lab->b[i];
-
-                for (int j = cx; j < cx + cw; j++) {
-                    buffer[iy++] = rL[j] / 327.68f;
-                    buffer[iy++] = ra[j] / 327.68f;
-                    buffer[iy++] = rb[j] / 327.68f;
-                }
+#ifdef _OPENMP
+                    #pragma omp for schedule(dynamic,16)
+#endif
 
-                cmsDoTransform (hTransform, buffer, data + ix, cw);
+                    for (int i = cy; i < cy + ch; i++) {
+                        int iy = 0;
+                        float* rL = lab->L[i];
+                        float* ra = lab->a[i];
+                        float* rb = lab->b[i];
+
+                        for (int j = cx; j < cx + cw; j++) {
+                            buffer[iy++] = rL[j] / 327.68f;
+                            buffer[iy++] = ra[j] / 327.68f;
+                            buffer[iy++] = rb[j] / 327.68f;
+                        }
+
+                        cmsDoTransform (hTransform, buffer, data + (i - cy) * 3 * cw, cw);
+                    }
+                } // End of parallelization
+
+                cmsDeleteTransform(hTransform);
+            } else {
+                // make the failure visible rather than returning garbage
+                memset (data, 0, static_cast<size_t>(3) * cw * ch);
             }
-        } // End of parallelization
-
-        cmsDeleteTransform(hTransform);
+        }
 
         if (oprofG != oprof) {
             cmsCloseProfile(oprofG);
@@ -294,17 +341,42 @@ Image16* ImProcFunctions::lab2rgb16 (LabImage* lab, int cx, int cy, int cw, int
     }
 
     if (oprof) {
-        cmsUInt32Number flags = cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE;
-        if (icm.outputBPC) {
-            flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
-        }
+        // the custom gamma profiles are created for this call only, and aren't worth caching
         lcmsMutex->lock ();
-        cmsHPROFILE iprof = cmsCreateLab4Profile(nullptr);
-        cmsHTRANSFORM hTransform = cmsCreateTransform (iprof, TYPE_Lab_FLT, oprof, TYPE_RGB_16, icm.outputIntent, flags);
+        const std::shared_ptr<const LabTransform> transform = LabTransform::get (oprof, ga ? std::string() : LabTransform::getProfileId (icm.output, oprof), icm.outputIntent, icm.outputBPC, 16);
         lcmsMutex->unlock ();
 
-        image->ExecCMSTransform(hTransform, *lab, cx, cy);
-        cmsDeleteTransform(hTransform);
+        if (transform) {
+#ifdef _OPENMP
+            #pragma omp parallel for schedule(dynamic,16)
+#endif
+
+            for (int i = cy; i < cy + ch; i++) {
+                transform->toRgb16 (lab->L[i] + cx, lab->a[i] + cx, lab->b[i] + cx, image->r(i - cy), image->g(i - cy), image->b(i - cy), cw);
+            }
+        } else {
+            cmsUInt32Number flags = cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE;
+            if (icm.outputBPC) {
+                flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
+            }
+            lcmsMutex->lock ();
+            cmsHPROFILE iprof = cmsCreateLab4Profile(nullptr);
+            cmsHTRANSFORM hTransform = cmsCreateTransform (iprof, TYPE_Lab_FLT, oprof, TYPE_RGB_16, icm.outputIntent, flags);
+            cmsCloseProfile(iprof);
+            lcmsMutex->unlock ();
+
+            if (hTransform) {
+                image->ExecCMSTransform(hTransform, *lab, cx, cy);
+                cmsDeleteTransform(hTransform);
+            } else {
+                // make the failure visible rather than returning garbage
+                for (int i = 0; i < ch; i++) {
+                    std::fill (image->r(i), image->r(i) + cw, 0);
+                    std::fill (image->g(i), image->g(i) + cw, 0);
+                    std::fill (image->b(i), image->b(i) + cw, 0);
+                }
+            }
+        }
     } else {
 #ifdef _OPENMP
         #pragma omp parallel for schedule(dynamic,16) if (multiThread)
@@ -17,8 +17,13 @@
  *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <vector>
+
 #include "improcfun.h"
+#include "array2D.h"
+#include "noncopyable.h"
 #include "rt_math.h"
+#include "settings.h"
 #include "sleef.c"
 #include "opthelper.h"
 //#define PROFILE
@@ -31,6 +36,8 @@
 namespace rtengine
 {
 
+extern const Settings* settings;
+
 static inline float Lanc (float x, float a)
 {
     if (x * x < 1e-6f) {
@@ -43,286 +50,304 @@ static inline float Lanc (float x, float a)
     }
 }
 
-void ImProcFunctions::Lanczos (const Image16* src, Image16* dst, float scale)
+namespace
 {
 
+// Lanczos weights of the destination pixels along one axis, computed once per resize. Each destination
+// pixel uses 'support' consecutive source pixels from 'start', the ones outside of the kernel having a
+// weight of 0, so that all the pixels go through the same (vectorized) loop.
+class LanczosWeights :
+    public NonCopyable
+{
+public:
+    LanczosWeights (int srcSize, int dstSize, float scale);
+
+    int support;
+    std::vector<int> start;
+    std::vector<float> weights; // 'support' values per destination pixel
+};
+
+LanczosWeights::LanczosWeights (int srcSize, int dstSize, float scale) :
+    start (dstSize)
+{
     const float delta = 1.0f / scale;
     const float a = 3.0f;
     const float sc = min (scale, 1.0f);
-    const int support = static_cast<int> (2.0f * a / sc) + 1;
 
-    #pragma omp parallel
-    {
-        // storage for precomputed parameters for horisontal interpolation
-        float * wwh = new float[support * dst->getWidth()];
-        int * jj0 = new int[dst->getWidth()];
-        int * jj1 = new int[dst->getWidth()];
+    support = min (static_cast<int> (2.0f * a / sc) + 1, srcSize);
 
-        // temporal storage for vertically-interpolated row of pixels
-        float * lr = new float[src->getWidth()];
-        float * lg = new float[src->getWidth()];
-        float * lb = new float[src->getWidth()];
+    // a multiple of 4 for the SSE loops, when the image is large enough
+    if ((support + 3) / 4 * 4 <= srcSize) {
+        support = (support + 3) / 4 * 4;
+    }
 
-        // Phase 1: precompute coefficients for horisontal interpolation
+    weights.assign (static_cast<size_t> (dstSize) * support, 0.0f);
 
-        for (int j = 0; j < dst->getWidth(); j++) {
+    for (int j = 0; j < dstSize; j++) {
 
-            // x coord of the center of pixel on src image
-            float x0 = (static_cast<float> (j) + 0.5f) * delta - 0.5f;
+        // coord of the center of the pixel on the src image
+        const float x0 = (static_cast<float> (j) + 0.5f) * delta - 0.5f;
 
-            // weights for interpolation in horisontal direction
-            float * w = wwh + j * support;
+        const int first = max (0, static_cast<int> (floorf (x0 - a / sc)) + 1);
+        const int last = min (srcSize, static_cast<int> (floorf (x0 + a / sc)) + 1);
 
-            // sum of weights used for normalization
-            float ws = 0.0f;
+        // the window is shifted inwards at the borders of the image
+        start[j] = min (first, srcSize - support);
 
-            jj0[j] = max (0, static_cast<int> (floorf (x0 - a / sc)) + 1);
-            jj1[j] = min (src->getWidth(), static_cast<int> (floorf (x0 + a / sc)) + 1);
+        float * w = &weights[static_cast<size_t> (j) * support];
 
-            // calculate weights
-            for (int jj = jj0[j]; jj < jj1[j]; jj++) {
-                int k = jj - jj0[j];
-                float z = sc * (x0 - static_cast<float> (jj));
-                w[k] = Lanc (z, a);
-                ws += w[k];
-            }
+        // sum of weights used for normalization
+        float ws = 0.0f;
 
-            // normalize weights
-            for (int k = 0; k < support; k++) {
-                w[k] /= ws;
-            }
+        for (int jj = first; jj < last; jj++) {
+            const int k = jj - start[j];
+            w[k] = Lanc (sc * (x0 - static_cast<float> (jj)), a);
+            ws += w[k];
         }
 
-        // Phase 2: do actual interpolation
-        #pragma omp for
-
-        for (int i = 0; i < dst->getHeight(); i++) {
-
-            // y coord of the center of pixel on src image
-            float y0 = (static_cast<float> (i) + 0.5f) * delta - 0.5f;
-
-            // weights for interpolation in y direction
-            float w[support];
+        for (int k = 0; k < support; k++) {
+            w[k] /= ws;
+        }
+    }
+}
 
-            // sum of weights used for normalization
-            float ws = 0.0f;
+// Columns processed at once by the vertical pass, so that the accumulated rows stay in the L1 cache
+constexpr int verticalBlock = 1024;
 
-            int ii0 = max (0, static_cast<int> (floorf (y0 - a / sc)) + 1);
-            int ii1 = min (src->getHeight(), static_cast<int> (floorf (y0 + a / sc)) + 1);
+// Weighted sum of the rows [top, top + support[ of the three planes of 'src', into 'dst'
+template<typename T>
+inline void verticalPass (const T* const* const src[3], int width, int top, const float* w, int support, float* const dst[3])
+{
+    for (int jb = 0; jb < width; jb += verticalBlock) {
+        const int je = min (jb + verticalBlock, width);
 
-            // calculate weights for vertical interpolation
-            for (int ii = ii0; ii < ii1; ii++) {
-                int k = ii - ii0;
-                float z = sc * (y0 - static_cast<float> (ii));
-                w[k] = Lanc (z, a);
-                ws += w[k];
-            }
+        for (int c = 0; c < 3; c++) {
+            const T* const* const plane = src[c];
+            float* const out = dst[c];
 
-            // normalize weights
-            for (int k = 0; k < support; k++) {
-                w[k] /= ws;
+            for (int j = jb; j < je; j++) {
+                out[j] = w[0] * plane[top][j];
             }
 
-            // Do vertical interpolation. Store results.
-            for (int j = 0; j < src->getWidth(); j++) {
-
-                float r = 0.0f, g = 0.0f, b = 0.0f;
-
-                for (int ii = ii0; ii < ii1; ii++) {
-                    int k = ii - ii0;
-
-                    r += w[k] * src->r (ii, j);
-                    g += w[k] * src->g (ii, j);
-                    b += w[k] * src->b (ii, j);
+            for (int k = 1; k < support; k++) {
+                if (w[k] == 0.0f) {
+                    continue;
                 }
 
-                lr[j] = r;
-                lg[j] = g;
-                lb[j] = b;
-            }
-
-            // Do horizontal interpolation
-            for (int j = 0; j < dst->getWidth(); j++) {
+                const T* const in = plane[top + k];
 
-                float * wh = wwh + support * j;
-
-                float r = 0.0f, g = 0.0f, b = 0.0f;
-
-                for (int jj = jj0[j]; jj < jj1[j]; jj++) {
-                    int k = jj - jj0[j];
-
-                    r += wh[k] * lr[jj];
-                    g += wh[k] * lg[jj];
-                    b += wh[k] * lb[jj];
+                for (int j = jb; j < je; j++) {
+                    out[j] += w[k] * in[j];
                 }
-
-                dst->r (i, j) = CLIP (static_cast<int> (r));
-                dst->g (i, j) = CLIP (static_cast<int> (g));
-                dst->b (i, j) = CLIP (static_cast<int> (b));
             }
         }
-
-        delete[] wwh;
-        delete[] jj0;
-        delete[] jj1;
-        delete[] lr;
-        delete[] lg;
-        delete[] lb;
     }
 }
 
-
-SSEFUNCTION void ImProcFunctions::Lanczos (const LabImage* src, LabImage* dst, float scale)
+#ifdef __SSE2__
+template<>
+inline void verticalPass (const float* const* const src[3], int width, int top, const float* w, int support, float* const dst[3])
 {
-    const float delta = 1.0f / scale;
-    const float a = 3.0f;
-    const float sc = min (scale, 1.0f);
-    const int support = static_cast<int> (2.0f * a / sc) + 1;
-
-    // storage for precomputed parameters for horizontal interpolation
-    float * wwh = new float[support * dst->W];
-    int * jj0 = new int[dst->W];
-    int * jj1 = new int[dst->W];
+    for (int jb = 0; jb < width; jb += verticalBlock) {
+        const int je = min (jb + verticalBlock, width);
 
-    // Phase 1: precompute coefficients for horizontal interpolation
-    for (int j = 0; j < dst->W; j++) {
+        for (int c = 0; c < 3; c++) {
+            const float* const* const plane = src[c];
+            float* const out = dst[c];
+            const vfloat w0v = F2V (w[0]);
+            int j;
 
-        // x coord of the center of pixel on src image
-        float x0 = (static_cast<float> (j) + 0.5f) * delta - 0.5f;
+            for (j = jb; j < je - 3; j += 4) {
+                STVFU (out[j], w0v * LVFU (plane[top][j]));
+            }
 
-        // weights for interpolation in horizontal direction
-        float * w = wwh + j * support;
+            for (; j < je; j++) {
+                out[j] = w[0] * plane[top][j];
+            }
 
-        // sum of weights used for normalization
-        float ws = 0.0f;
+            for (int k = 1; k < support; k++) {
+                if (w[k] == 0.0f) {
+                    continue;
+                }
 
-        jj0[j] = max (0, static_cast<int> (floorf (x0 - a / sc)) + 1);
-        jj1[j] = min (src->W, static_cast<int> (floorf (x0 + a / sc)) + 1);
+                const float* const in = plane[top + k];
+                const vfloat wkv = F2V (w[k]);
 
-        // calculate weights
-        for (int jj = jj0[j]; jj < jj1[j]; jj++) {
-            int k = jj - jj0[j];
-            float z = sc * (x0 - static_cast<float> (jj));
-            w[k] = Lanc (z, a);
-            ws += w[k];
-        }
+                for (j = jb; j < je - 3; j += 4) {
+                    STVFU (out[j], LVFU (out[j]) + wkv * LVFU (in[j]));
+                }
 
-        // normalize weights
-        for (int k = 0; k < support; k++) {
-            w[k] /= ws;
+                for (; j < je; j++) {
+                    out[j] += w[k] * in[j];
+                }
+            }
         }
     }
+}
+#endif
+
+// Separable Lanczos resampling of the three planes of 'src', a srcW x srcH image; the destination
+// pixels are handed over to 'store (i, j, x, y, z)'
+template<typename T, typename Store>
+void lanczosPlanes (const T* const* const src[3], int srcW, int srcH, int dstW, int dstH, float scale, bool multiThread, Store store)
+{
+    const LanczosWeights horizontal (srcW, dstW, scale);
+    const LanczosWeights vertical (srcH, dstH, scale);
+    const int hSupport = horizontal.support;
 
 #ifdef _OPENMP
-    #pragma omp parallel
+    #pragma omp parallel if (multiThread)
 #endif
     {
         // temporal storage for vertically-interpolated row of pixels
-        float * lL = new float[src->W];
-        float * la = new float[src->W];
-        float * lb = new float[src->W];
-        // weights for interpolation in y direction
-        float w[support] ALIGNED64;
+        std::vector<float> rows (3 * static_cast<size_t> (srcW));
+        float* const row[3] = {rows.data(), rows.data() + srcW, rows.data() + 2 * srcW};
 
-        // Phase 2: do actual interpolation
 #ifdef _OPENMP
         #pragma omp for
 #endif
 
-        for (int i = 0; i < dst->H; i++) {
-            // y coord of the center of pixel on src image
-            float y0 = (static_cast<float> (i) + 0.5f) * delta - 0.5f;
+        for (int i = 0; i < dstH; i++) {
+            verticalPass (src, srcW, vertical.start[i], &vertical.weights[static_cast<size_t> (i) * vertical.support], vertical.support, row);
 
-            // sum of weights used for normalization
-            float ws = 0.0f;
-
-            int ii0 = max (0, static_cast<int> (floorf (y0 - a / sc)) + 1);
-            int ii1 = min (src->H, static_cast<int> (floorf (y0 + a / sc)) + 1);
-
-            // calculate weights for vertical interpolation
-            for (int ii = ii0; ii < ii1; ii++) {
-                int k = ii - ii0;
-                float z = sc * (y0 - static_cast<float> (ii));
-                w[k] = Lanc (z, a);
-                ws += w[k];
-            }
+            // horizontal interpolation, the three planes sharing the loads of the weights
+            for (int j = 0; j < dstW; j++) {
+                const float* const wh = &horizontal.weights[static_cast<size_t> (j) * hSupport];
+                const int left = horizontal.start[j];
+                float x = 0.0f, y = 0.0f, z = 0.0f;
+                int k = 0;
+#ifdef __SSE2__
+                vfloat xv = _mm_setzero_ps();
+                vfloat yv = _mm_setzero_ps();
+                vfloat zv = _mm_setzero_ps();
+
+                for (; k < hSupport - 3; k += 4) {
+                    const vfloat wv = LVFU (wh[k]);
+                    xv += wv * LVFU (row[0][left + k]);
+                    yv += wv * LVFU (row[1][left + k]);
+                    zv += wv * LVFU (row[2][left + k]);
+                }
 
-            // normalize weights
-            for (int k = 0; k < support; k++) {
-                w[k] /= ws;
-            }
+                x = vhadd (xv);
+                y = vhadd (yv);
+                z = vhadd (zv);
+#endif
 
-            // Do vertical interpolation. Store results.
-#ifdef __SSE2__
-            int j;
-            __m128 Lv, av, bv, wkv;
-
-            for (j = 0; j < src->W - 3; j += 4) {
-                Lv = _mm_setzero_ps();
-                av = _mm_setzero_ps();
-                bv = _mm_setzero_ps();
-
-                for (int ii = ii0; ii < ii1; ii++) {
-                    int k = ii - ii0;
-                    wkv = _mm_set1_ps (w[k]);
-                    Lv += wkv * LVFU (src->L[ii][j]);
-                    av += wkv * LVFU (src->a[ii][j]);
-                    bv += wkv * LVFU (src->b[ii][j]);
+                for (; k < hSupport; k++) {
+                    x += wh[k] * row[0][left + k];
+                    y += wh[k] * row[1][left + k];
+                    z += wh[k] * row[2][left + k];
                 }
 
-                STVF (lL[j], Lv);
-                STVF (la[j], av);
-                STVF (lb[j], bv);
+                store (i, j, x, y, z);
             }
+        }
+    }
+}
 
-#else
-            int j = 0;
-#endif
+// Averages the factor x factor blocks of the three planes of 'src' into 'dst', whose size is rounded up
+template<typename T>
+void boxDownscale (const T* const* const src[3], int srcW, int srcH, int factor, float** const dst[3], bool multiThread)
+{
+    const int dstW = (srcW + factor - 1) / factor;
+    const int dstH = (srcH + factor - 1) / factor;
 
-            for (; j < src->W; j++) {
-                float L = 0.0f, a = 0.0f, b = 0.0f;
+#ifdef _OPENMP
+    #pragma omp parallel for if (multiThread)
+#endif
 
-                for (int ii = ii0; ii < ii1; ii++) {
-                    int k = ii - ii0;
+    for (int i = 0; i < dstH; i++) {
+        const int top = i * factor;
+        const int bottom = min (top + factor, srcH);
 
-                    L += w[k] * src->L[ii][j];
-                    a += w[k] * src->a[ii][j];
-                    b += w[k] * src->b[ii][j];
-                }
+        for (int c = 0; c < 3; c++) {
+            float* const out = dst[c][i];
 
-                lL[j] = L;
-                la[j] = a;
-                lb[j] = b;
+            for (int j = 0; j < dstW; j++) {
+                out[j] = 0.0f;
             }
 
-            // Do horizontal interpolation
-            for (int j = 0; j < dst->W; j++) {
-
-                float * wh = wwh + support * j;
+            for (int ii = top; ii < bottom; ii++) {
+                const T* const in = src[c][ii];
 
-                float L = 0.0f, a = 0.0f, b = 0.0f;
+                for (int j = 0; j < dstW; j++) {
+                    const int right = min ((j + 1) * factor, srcW);
+                    float sum = 0.0f;
 
-                for (int jj = jj0[j]; jj < jj1[j]; jj++) {
-                    int k = jj - jj0[j];
+                    for (int jj = j * factor; jj < right; jj++) {
+                        sum += in[jj];
+                    }
 
-                    L += wh[k] * lL[jj];
-                    a += wh[k] * la[jj];
-                    b += wh[k] * lb[jj];
+                    out[j] += sum;
                 }
+            }
 
-                dst->L[i][j] = L;
-                dst->a[i][j] = a;
-                dst->b[i][j] = b;
+            for (int j = 0; j < dstW; j++) {
+                out[j] /= (bottom - top) * (min ((j + 1) * factor, srcW) - j * factor);
             }
         }
+    }
+}
 
-        delete[] lL;
-        delete[] la;
-        delete[] lb;
+// Factor of the box filter applied before the Lanczos filter, 1 if none
+int boxPrefilterFactor (float scale)
+{
+    if (settings->resizeBoxPrefilter <= 0 || scale * settings->resizeBoxPrefilter > 1.0f) {
+        return 1;
     }
-    delete[] jj0;
-    delete[] jj1;
-    delete[] wwh;
+
+    // leave a downscale by 2 to 4 to the Lanczos filter, for its sharpness
+    return max (1, static_cast<int> (1.0f / (2.0f * scale)));
+}
+
+template<typename T, typename Store>
+void resample (const T* const* const src[3], int srcW, int srcH, int dstW, int dstH, float scale, bool multiThread, Store store)
+{
+    const int factor = boxPrefilterFactor (scale);
+
+    if (factor == 1) {
+        lanczosPlanes (src, srcW, srcH, dstW, dstH, scale, multiThread, store);
+        return;
+    }
+
+    // the center of the box k is at (k + 0.5) * factor - 0.5 on the src image, so the box image
+    // is mapped on the destination by scale * factor
+    const int boxW = (srcW + factor - 1) / factor;
+    const int boxH = (srcH + factor - 1) / factor;
+    array2D<float> x (boxW, boxH), y (boxW, boxH), z (boxW, boxH);
+    float** const box[3] = {x, y, z};
+
+    boxDownscale (src, srcW, srcH, factor, box, multiThread);
+
+    const float* const* const boxPlanes[3] = {box[0], box[1], box[2]};
+    lanczosPlanes (boxPlanes, boxW, boxH, dstW, dstH, scale * factor, multiThread, store);
+}
+
+}
+
+void ImProcFunctions::Lanczos (const Image16* src, Image16* dst, float scale)
+{
+    const unsigned short* const* const planes[3] = {src->r.ptrs, src->g.ptrs, src->b.ptrs};
+
+    resample (planes, src->getWidth(), src->getHeight(), dst->getWidth(), dst->getHeight(), scale, multiThread,
+    [dst] (int i, int j, float r, float g, float b) {
+        dst->r (i, j) = CLIP (static_cast<int> (r));
+        dst->g (i, j) = CLIP (static_cast<int> (g));
+        dst->b (i, j) = CLIP (static_cast<int> (b));
+    });
+}
+
+
+SSEFUNCTION void ImProcFunctions::Lanczos (const LabImage* src, LabImage* dst, float scale)
+{
+    const float* const* const planes[3] = {src->L, src->a, src->b};
+
+    resample (planes, src->W, src->H, dst->W, dst->H, scale, multiThread,
+    [dst] (int i, int j, float L, float a, float b) {
+        dst->L[i][j] = L;
+        dst->a[i][j] = a;
+        dst->b[i][j] = b;
+    });
 }
 
 float ImProcFunctions::resizeScale (const ProcParams* params, int fw, int fh, int &imw, int &imh)
@@ -397,7 +397,7 @@ void RawImageSource::MSR(float** luminance, float** originalLuminance, float **e
 
             float *buffer = new float[W_L * H_L];;
 
-            for ( int scale = scal - 1; scale >= 0; scale-- ) {
+            for ( int scale = scal - 1; scale >= 0 && !isCancelled(); scale-- ) {
 #ifdef _OPENMP
                 #pragma omp parallel
 #endif
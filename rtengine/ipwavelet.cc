@@ -694,6 +694,11 @@ SSEFUNCTION void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int
 
         for (int tiletop = 0; tiletop < imheight; tiletop += tileHskip) {
             for (int tileleft = 0; tileleft < imwidth ; tileleft += tileWskip) {
+                if (isCancelled()) {
+                    // the result won't be used, skip the remaining tiles
+                    continue;
+                }
+
                 int tileright = MIN(imwidth, tileleft + tilewidth);
                 int tilebottom = MIN(imheight, tiletop + tileheight);
                 int width  = tileright - tileleft;
@@ -863,9 +868,9 @@ SSEFUNCTION void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int
                 //      if(levwavL < 3) levwavL=3;//to allow edge  => I always allocate 3 (4) levels..because if user select wavelet it is to do something !!
                 //  }
                 if(levwavL > 0) {
-                    wavelet_decomposition* Ldecomp = new wavelet_decomposition (labco->data, labco->W, labco->H, levwavL, 1, skip, max(1, wavNestedLevels), DaubLen );
+                    wavelet_decomposition* Ldecomp = decomposeWavelet(labco->data, labco->W, labco->H, levwavL, 1, skip, max(1, wavNestedLevels), DaubLen);
 
-                    if(!Ldecomp->memoryAllocationFailed) {
+                    if(!Ldecomp->memoryAllocationFailed && !isCancelled()) {
 
                         float madL[8][3];
 #ifdef _RT_NESTED_OPENMP
@@ -977,9 +982,9 @@ SSEFUNCTION void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int
 
                     //printf("Levwava after: %d\n",levwava);
                     if(levwava > 0) {
-                        wavelet_decomposition* adecomp = new wavelet_decomposition (labco->data + datalen, labco->W, labco->H, levwava, 1, skip, max(1, wavNestedLevels), DaubLen );
+                        wavelet_decomposition* adecomp = decomposeWavelet(labco->data + datalen, labco->W, labco->H, levwava, 1, skip, max(1, wavNestedLevels), DaubLen);
 
-                        if(!adecomp->memoryAllocationFailed) {
+                        if(!adecomp->memoryAllocationFailed && !isCancelled()) {
                             WaveletcontAllAB(labco, varhue, varchro, *adecomp, waOpacityCurveW, cp, true);
                             adecomp->reconstruct(labco->data + datalen, cp.strength);
                         }
@@ -998,9 +1003,9 @@ SSEFUNCTION void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int
 
                     //  printf("Levwavb after: %d\n",levwavb);
                     if(levwavb > 0) {
-                        wavelet_decomposition* bdecomp = new wavelet_decomposition (labco->data + 2 * datalen, labco->W, labco->H, levwavb, 1, skip, max(1, wavNestedLevels), DaubLen );
+                        wavelet_decomposition* bdecomp = decomposeWavelet(labco->data + 2 * datalen, labco->W, labco->H, levwavb, 1, skip, max(1, wavNestedLevels), DaubLen);
 
-                        if(!bdecomp->memoryAllocationFailed) {
+                        if(!bdecomp->memoryAllocationFailed && !isCancelled()) {
                             WaveletcontAllAB(labco, varhue, varchro, *bdecomp, waOpacityCurveW, cp, false);
                             bdecomp->reconstruct(labco->data + 2 * datalen, cp.strength);
                         }
@@ -1019,10 +1024,10 @@ SSEFUNCTION void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int
 
                     //  printf("Levwavab after: %d\n",levwavab);
                     if(levwavab > 0) {
-                        wavelet_decomposition* adecomp = new wavelet_decomposition (labco->data + datalen, labco->W, labco->H, levwavab, 1, skip, max(1, wavNestedLevels), DaubLen );
-                        wavelet_decomposition* bdecomp = new wavelet_decomposition (labco->data + 2 * datalen, labco->W, labco->H, levwavab, 1, skip, max(1, wavNestedLevels), DaubLen );
+                        wavelet_decomposition* adecomp = decomposeWavelet(labco->data + datalen, labco->W, labco->H, levwavab, 1, skip, max(1, wavNestedLevels), DaubLen);
+                        wavelet_decomposition* bdecomp = decomposeWavelet(labco->data + 2 * datalen, labco->W, labco->H, levwavab, 1, skip, max(1, wavNestedLevels), DaubLen);
 
-                        if(!adecomp->memoryAllocationFailed && !bdecomp->memoryAllocationFailed) {
+                        if(!adecomp->memoryAllocationFailed && !bdecomp->memoryAllocationFailed && !isCancelled()) {
                             WaveletcontAllAB(labco, varhue, varchro, *adecomp, waOpacityCurveW, cp, true);
                             WaveletcontAllAB(labco, varhue, varchro, *bdecomp, waOpacityCurveW, cp, false);
                             WaveletAandBAllAB(labco, varhue, varchro, *adecomp, *bdecomp, cp, waOpacityCurveW, hhCurve, hhutili );
@@ -1623,7 +1628,7 @@ void ImProcFunctions::EPDToneMapResid(float * WavCoeffs_L0,  unsigned int Iterat
     float sca = params->epd.scale;
     float gamm = params->wavelet.gamma;
     float rew = params->epd.reweightingIterates;
-    EdgePreservingDecomposition epd2(W_L, H_L);
+    EdgePreservingDecomposition epd2(W_L, H_L, cancellation);
     cp.TMmeth = 2; //default after testing
 
     if(cp.TMmeth == 1) {
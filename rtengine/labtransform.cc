@@ -0,0 +1,373 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "labtransform.h"
+
+#include "cache.h"
+#include "color.h"
+#include "lut3d.h"
+#include "widekernels.h"
+
+namespace
+{
+
+constexpr float blackTolerance = 1e-4f;
+
+bool invert33 (const double (&m)[3][3], double (&inv)[3][3])
+{
+    const double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+                     - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+                     + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+
+    if (std::fabs (det) < 1e-12) {
+        return false;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            // cofactor of m[j][i], giving the transposed adjugate
+            const int i1 = (j + 1) % 3, i2 = (j + 2) % 3;
+            const int j1 = (i + 1) % 3, j2 = (i + 2) % 3;
+            inv[i][j] = (m[i1][j1] * m[i2][j2] - m[i1][j2] * m[i2][j1]) / det;
+        }
+    }
+
+    return true;
+}
+
+// Whether black point compensation between Lab and oprof is a no-op; lcms also forces it on
+// for the perceptual and saturation intents of v4 profiles, so this is checked whatever bpc says
+bool hasNullBlackPoints (cmsHPROFILE oprof, cmsUInt32Number intent)
+{
+    cmsHPROFILE labProfile = cmsCreateLab4Profile (nullptr);
+    cmsCIEXYZ inBlack, outBlack;
+    cmsDetectBlackPoint (&inBlack, labProfile, intent, 0);
+    cmsDetectDestinationBlackPoint (&outBlack, oprof, intent, 0);
+    cmsCloseProfile (labProfile);
+
+    return inBlack.Y < blackTolerance && outBlack.Y < blackTolerance;
+}
+
+}
+
+namespace rtengine
+{
+
+std::shared_ptr<const LabTransform> LabTransform::get (cmsHPROFILE oprof, const std::string& profileId, cmsUInt32Number intent, bool bpc, int bps)
+{
+    static Cache<std::string, std::shared_ptr<const LabTransform>> cache (16);
+
+    if (!oprof || (bps != 8 && bps != 16)) {
+        return nullptr;
+    }
+
+    const std::string key = profileId.empty() ? std::string() : profileId + ':' + std::to_string (intent) + ':' + (bpc ? '1' : '0') + ':' + std::to_string (bps);
+    std::shared_ptr<const LabTransform> result;
+
+    if (!key.empty() && cache.get (key, result)) {
+        return result;
+    }
+
+    // NOCACHE is important for thread safety
+    cmsUInt32Number flags = cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE;
+
+    if (bpc) {
+        flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
+    }
+
+    std::unique_ptr<LabTransform> transform (new LabTransform (bps));
+
+    if (!transform->compileMatrixShaper (oprof, intent)
+            && !(bps == 8 && transform->compileLut (oprof, intent, flags))
+            && !transform->compileLcms (oprof, intent, flags)) {
+        return nullptr;
+    }
+
+    result = std::move (transform);
+
+    if (!key.empty()) {
+        cache.insert (key, result);
+    }
+
+    return result;
+}
+
+std::string LabTransform::getProfileId (const std::string& name, cmsHPROFILE profile, const char* variant)
+{
+    char handle[32];
+    std::snprintf (handle, sizeof (handle), ":%p:", static_cast<void*> (profile));
+    return name + handle + variant;
+}
+
+LabTransform::LabTransform (int bps) :
+    kind (Kind::LCMS),
+    bps (bps),
+    xyz2rgb{},
+    hTransform (nullptr)
+{
+}
+
+LabTransform::~LabTransform ()
+{
+    if (hTransform) {
+        cmsDeleteTransform (hTransform);
+    }
+}
+
+LabTransform::Kind LabTransform::getKind () const
+{
+    return kind;
+}
+
+int LabTransform::getBPS () const
+{
+    return bps;
+}
+
+bool LabTransform::compileMatrixShaper (cmsHPROFILE oprof, cmsUInt32Number intent)
+{
+    if (cmsGetColorSpace (oprof) != cmsSigRgbData || !cmsIsMatrixShaper (oprof) || intent == INTENT_ABSOLUTE_COLORIMETRIC || !hasNullBlackPoints (oprof, intent)) {
+        return false;
+    }
+
+    const cmsTagSignature colorantTags[3] = {cmsSigRedColorantTag, cmsSigGreenColorantTag, cmsSigBlueColorantTag};
+    const cmsTagSignature trcTags[3] = {cmsSigRedTRCTag, cmsSigGreenTRCTag, cmsSigBlueTRCTag};
+
+    double rgb2xyz[3][3];
+
+    for (int c = 0; c < 3; ++c) {
+        const cmsCIEXYZ* const colorant = static_cast<const cmsCIEXYZ*> (cmsReadTag (oprof, colorantTags[c]));
+
+        if (!colorant) {
+            return false;
+        }
+
+        rgb2xyz[0][c] = colorant->X;
+        rgb2xyz[1][c] = colorant->Y;
+        rgb2xyz[2][c] = colorant->Z;
+    }
+
+    double inverse[3][3];
+
+    if (!invert33 (rgb2xyz, inverse)) {
+        return false;
+    }
+
+    for (int c = 0; c < 3; ++c) {
+        const cmsToneCurve* const curve = static_cast<const cmsToneCurve*> (cmsReadTag (oprof, trcTags[c]));
+
+        if (!curve) {
+            return false;
+        }
+
+        // lcms builds its own output shaper the same way
+        cmsToneCurve* const inverseCurve = cmsReverseToneCurve (curve);
+
+        if (!inverseCurve) {
+            return false;
+        }
+
+        // Indexing by the square root of the linear value keeps enough samples in the shadows,
+        // where gamma curves are steepest, for linear interpolation to stay well below 16 bit precision
+        trc[c] (65536, LUT_CLIP_BELOW | LUT_CLIP_ABOVE);
+
+        for (int i = 0; i < 65536; ++i) {
+            const float t = i / 65535.f;
+            trc[c][i] = cmsEvalToneCurveFloat (inverseCurve, t * t);
+        }
+
+        cmsFreeToneCurve (inverseCurve);
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            xyz2rgb[i][j] = inverse[i][j] / 65535.0;
+        }
+    }
+
+    kind = Kind::MATRIX_SHAPER;
+    return true;
+}
+
+bool LabTransform::compileLut (cmsHPROFILE oprof, cmsUInt32Number intent, cmsUInt32Number flags)
+{
+    if (cmsGetColorSpace (oprof) != cmsSigRgbData) {
+        return false;
+    }
+
+    cmsHPROFILE labProfile = cmsCreateLab4Profile (nullptr);
+    cmsHTRANSFORM sampler = cmsCreateTransform (labProfile, TYPE_Lab_FLT, oprof, TYPE_RGB_FLT, intent, flags);
+    cmsCloseProfile (labProfile);
+
+    if (!sampler) {
+        return false;
+    }
+
+    constexpr int nodeCount = lutLevels * lutLevels * lutLevels;
+    lut.reset (new float[3 * nodeCount]);
+
+    for (int l = 0, node = 0; l < lutLevels; ++l) {
+        for (int a = 0; a < lutLevels; ++a) {
+            for (int b = 0; b < lutLevels; ++b, ++node) {
+                lut[3 * node] = 100.f * l / (lutLevels - 1);
+                lut[3 * node + 1] = 256.f * a / (lutLevels - 1) - 128.f;
+                lut[3 * node + 2] = 256.f * b / (lutLevels - 1) - 128.f;
+            }
+        }
+    }
+
+    cmsDoTransform (sampler, lut.get(), lut.get(), nodeCount);
+    cmsDeleteTransform (sampler);
+
+    kind = Kind::LUT_3D;
+    return true;
+}
+
+bool LabTransform::compileLcms (cmsHPROFILE oprof, cmsUInt32Number intent, cmsUInt32Number flags)
+{
+    cmsHPROFILE labProfile = cmsCreateLab4Profile (nullptr);
+    hTransform = cmsCreateTransform (labProfile, TYPE_Lab_FLT, oprof, bps == 8 ? TYPE_RGB_8 : TYPE_RGB_16, intent, flags);
+    cmsCloseProfile (labProfile);
+
+    kind = Kind::LCMS;
+    return hTransform != nullptr;
+}
+
+void LabTransform::convertChunk (const float* L, const float* a, const float* b, float* red, float* green, float* blue, int n) const
+{
+    if (kind == Kind::MATRIX_SHAPER) {
+        // the Lab to xyz part is vectorized for the whole chunk when the cpu allows it
+        if (!widekernels::lab2XYZ (L, a, b, red, green, blue, n)) {
+            for (int j = 0; j < n; ++j) {
+                Color::Lab2XYZ (L[j], a[j], b[j], red[j], green[j], blue[j]);
+            }
+        }
+
+        for (int j = 0; j < n; ++j) {
+            const float x = red[j];
+            const float y = green[j];
+            const float z = blue[j];
+            red[j] = std::sqrt (std::max (xyz2rgb[0][0] * x + xyz2rgb[0][1] * y + xyz2rgb[0][2] * z, 0.f));
+            green[j] = std::sqrt (std::max (xyz2rgb[1][0] * x + xyz2rgb[1][1] * y + xyz2rgb[1][2] * z, 0.f));
+            blue[j] = std::sqrt (std::max (xyz2rgb[2][0] * x + xyz2rgb[2][1] * y + xyz2rgb[2][2] * z, 0.f));
+        }
+
+        for (int j = 0; j < n; ++j) {
+            red[j] = trc[0][red[j] * 65535.f];
+            green[j] = trc[1][green[j] * 65535.f];
+            blue[j] = trc[2][blue[j] * 65535.f];
+        }
+    } else {
+        constexpr int maxNode = lutLevels - 1;
+        constexpr int strideL = 3 * lutLevels * lutLevels;
+        constexpr int strideA = 3 * lutLevels;
+        constexpr int strideB = 3;
+        const float* const nodes = lut.get();
+
+        for (int j = 0; j < n; ++j) {
+            const float fl = std::min (std::max (L[j] * (maxNode / 32768.f), 0.f), static_cast<float> (maxNode));
+            const float fa = std::min (std::max ((a[j] / 327.68f + 128.f) * (maxNode / 256.f), 0.f), static_cast<float> (maxNode));
+            const float fb = std::min (std::max ((b[j] / 327.68f + 128.f) * (maxNode / 256.f), 0.f), static_cast<float> (maxNode));
+            const int il = std::min (static_cast<int> (fl), maxNode - 1);
+            const int ia = std::min (static_cast<int> (fa), maxNode - 1);
+            const int ib = std::min (static_cast<int> (fb), maxNode - 1);
+
+            lut3dInterpolate (nodes + il * strideL + ia * strideA + ib * strideB, strideL, strideA, strideB, fl - il, fa - ia, fb - ib, red[j], green[j], blue[j]);
+        }
+    }
+}
+
+void LabTransform::toRgb8 (const float* L, const float* a, const float* b, unsigned char* rgb, int n) const
+{
+    if (kind == Kind::LCMS) {
+        float buffer[3 * chunkSize];
+
+        for (int i = 0; i < n; i += chunkSize) {
+            const int count = std::min (chunkSize, n - i);
+
+            for (int j = 0; j < count; ++j) {
+                buffer[3 * j] = L[i + j] / 327.68f;
+                buffer[3 * j + 1] = a[i + j] / 327.68f;
+                buffer[3 * j + 2] = b[i + j] / 327.68f;
+            }
+
+            cmsDoTransform (hTransform, buffer, rgb + 3 * i, count);
+        }
+
+        return;
+    }
+
+    float red[chunkSize], green[chunkSize], blue[chunkSize];
+
+    for (int i = 0; i < n; i += chunkSize) {
+        const int count = std::min (chunkSize, n - i);
+        convertChunk (L + i, a + i, b + i, red, green, blue, count);
+        unsigned char* const dst = rgb + 3 * i;
+
+        for (int j = 0; j < count; ++j) {
+            dst[3 * j] = 255.f * std::min (std::max (red[j], 0.f), 1.f) + 0.5f;
+            dst[3 * j + 1] = 255.f * std::min (std::max (green[j], 0.f), 1.f) + 0.5f;
+            dst[3 * j + 2] = 255.f * std::min (std::max (blue[j], 0.f), 1.f) + 0.5f;
+        }
+    }
+}
+
+void LabTransform::toRgb16 (const float* L, const float* a, const float* b, unsigned short* red, unsigned short* green, unsigned short* blue, int n) const
+{
+    if (kind == Kind::LCMS) {
+        float buffer[3 * chunkSize];
+        unsigned short rgb[3 * chunkSize];
+
+        for (int i = 0; i < n; i += chunkSize) {
+            const int count = std::min (chunkSize, n - i);
+
+            for (int j = 0; j < count; ++j) {
+                buffer[3 * j] = L[i + j] / 327.68f;
+                buffer[3 * j + 1] = a[i + j] / 327.68f;
+                buffer[3 * j + 2] = b[i + j] / 327.68f;
+            }
+
+            cmsDoTransform (hTransform, buffer, rgb, count);
+
+            for (int j = 0; j < count; ++j) {
+                red[i + j] = rgb[3 * j];
+                green[i + j] = rgb[3 * j + 1];
+                blue[i + j] = rgb[3 * j + 2];
+            }
+        }
+
+        return;
+    }
+
+    float fr[chunkSize], fg[chunkSize], fb[chunkSize];
+
+    for (int i = 0; i < n; i += chunkSize) {
+        const int count = std::min (chunkSize, n - i);
+        convertChunk (L + i, a + i, b + i, fr, fg, fb, count);
+
+        for (int j = 0; j < count; ++j) {
+            red[i + j] = 65535.f * std::min (std::max (fr[j], 0.f), 1.f) + 0.5f;
+            green[i + j] = 65535.f * std::min (std::max (fg[j], 0.f), 1.f) + 0.5f;
+            blue[i + j] = 65535.f * std::min (std::max (fb[j], 0.f), 1.f) + 0.5f;
+        }
+    }
+}
+
+}
@@ -0,0 +1,98 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <lcms2.h>
+
+#include "LUT.h"
+#include "noncopyable.h"
+
+namespace rtengine
+{
+
+/**
+ * @brief Conversion of LabImage rows to an RGB output profile
+ *
+ * The transform is compiled from the output profile when it is created:
+ *  - matrix/TRC profiles become a matrix applied to XYZ followed by a lookup of the inverse TRC,
+ *  - for 8 bit output, other RGB profiles are baked into a 3D LUT sampled by lcms and read back
+ *    with tetrahedral interpolation,
+ *  - everything else (absolute colorimetric intent, black point compensation with a non zero
+ *    black, 16 bit output through a LUT profile) is handed to lcms.
+ *
+ * Compiled transforms are shared through a small cache keyed by an identifier of the profile given by
+ * the caller (its ICCStore name and handle, plus how it was derived for profiles rebuilt on each call),
+ * the intent, the BPC flag and the output depth.
+ */
+class LabTransform final :
+    public NonCopyable
+{
+public:
+    enum class Kind {
+        MATRIX_SHAPER,
+        LUT_3D,
+        LCMS
+    };
+
+    /// Returns the transform from Lab to oprof, or nullptr if lcms can't create it. The caller must hold lcmsMutex.
+    /// profileId identifies oprof for the cache, see getProfileId(); an empty one bypasses the cache.
+    static std::shared_ptr<const LabTransform> get (cmsHPROFILE oprof, const std::string& profileId, cmsUInt32Number intent, bool bpc, int bps);
+
+    /// Identifier of a profile of ICCStore, which keeps its profiles loaded; variant tells apart the profiles derived from it
+    static std::string getProfileId (const std::string& name, cmsHPROFILE profile, const char* variant = "");
+
+    ~LabTransform ();
+
+    Kind getKind () const;
+    int getBPS () const;
+
+    /// Converts n pixels, in the 0..32768 scale of LabImage, to interleaved RGB (bps == 8 only)
+    void toRgb8 (const float* L, const float* a, const float* b, unsigned char* rgb, int n) const;
+    /// Converts n pixels, in the 0..32768 scale of LabImage, to planar RGB (bps == 16 only)
+    void toRgb16 (const float* L, const float* a, const float* b, unsigned short* red, unsigned short* green, unsigned short* blue, int n) const;
+
+private:
+    static constexpr int lutLevels = 33;
+    static constexpr int chunkSize = 256;
+
+    explicit LabTransform (int bps);
+
+    bool compileMatrixShaper (cmsHPROFILE oprof, cmsUInt32Number intent);
+    bool compileLut (cmsHPROFILE oprof, cmsUInt32Number intent, cmsUInt32Number flags);
+    bool compileLcms (cmsHPROFILE oprof, cmsUInt32Number intent, cmsUInt32Number flags);
+
+    // Converts n <= chunkSize pixels to RGB in the 0..1 range, not clipped (compiled kinds only)
+    void convertChunk (const float* L, const float* a, const float* b, float* red, float* green, float* blue, int n) const;
+
+    Kind kind;
+    int bps;
+
+    // MATRIX_SHAPER: XYZ (0..65535) to linear RGB, and the inverse TRC indexed by 65535 * sqrt(linear)
+    float xyz2rgb[3][3];
+    LUTf trc[3];
+
+    // LUT_3D: lutLevels^3 RGB nodes, L being the slowest varying axis
+    std::unique_ptr<float[]> lut;
+
+    // LCMS
+    cmsHTRANSFORM hTransform;
+};
+
+}
@@ -0,0 +1,92 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+namespace rtengine
+{
+
+/**
+ * @brief Tetrahedral interpolation in a 3D table of RGB triplets
+ *
+ * base points to the node at the origin of the cell, s0, s1 and s2 are the distances (in floats)
+ * to the next node along each axis and d0, d1 and d2 the position in the cell, in [0, 1].
+ * The main diagonal of the cell is an edge of every tetrahedron, so neutral inputs of a table
+ * sampled along equal axes stay neutral.
+ */
+inline void lut3dInterpolate(const float* base, int s0, int s1, int s2, float d0, float d1, float d2, float& r, float& g, float& b)
+{
+    // walk from the origin to the opposite corner along the axes sorted by decreasing position
+    int o1, o2;
+    float w0, w1, w2, w3;
+
+    if (d0 >= d1) {
+        if (d1 >= d2) {
+            o1 = s0;
+            o2 = s0 + s1;
+            w0 = 1.f - d0;
+            w1 = d0 - d1;
+            w2 = d1 - d2;
+            w3 = d2;
+        } else if (d0 >= d2) {
+            o1 = s0;
+            o2 = s0 + s2;
+            w0 = 1.f - d0;
+            w1 = d0 - d2;
+            w2 = d2 - d1;
+            w3 = d1;
+        } else {
+            o1 = s2;
+            o2 = s0 + s2;
+            w0 = 1.f - d2;
+            w1 = d2 - d0;
+            w2 = d0 - d1;
+            w3 = d1;
+        }
+    } else {
+        if (d0 >= d2) {
+            o1 = s1;
+            o2 = s0 + s1;
+            w0 = 1.f - d1;
+            w1 = d1 - d0;
+            w2 = d0 - d2;
+            w3 = d2;
+        } else if (d1 >= d2) {
+            o1 = s1;
+            o2 = s1 + s2;
+            w0 = 1.f - d1;
+            w1 = d1 - d2;
+            w2 = d2 - d0;
+            w3 = d0;
+        } else {
+            o1 = s2;
+            o2 = s1 + s2;
+            w0 = 1.f - d2;
+            w1 = d2 - d1;
+            w2 = d1 - d0;
+            w3 = d0;
+        }
+    }
+
+    const float* const p1 = base + o1;
+    const float* const p2 = base + o2;
+    const float* const p3 = base + s0 + s1 + s2;
+    r = w0 * base[0] + w1 * p1[0] + w2 * p2[0] + w3 * p3[0];
+    g = w0 * base[1] + w1 * p1[1] + w2 * p2[1] + w3 * p3[1];
+    b = w0 * base[2] + w1 * p1[2] + w2 * p2[2] + w3 * p3[2];
+}
+
+}
@@ -0,0 +1,271 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "medianfilter.h"
+#include "rt_math.h"
+
+namespace
+{
+
+constexpr int fineBins = 64;                     // fine bins per coarse bin
+constexpr int coarseBins = 64;
+constexpr int levels = coarseBins * fineBins;
+constexpr int coarseShift = 6;                   // level >> coarseShift is the coarse bin
+
+constexpr int tileSize = 256;
+constexpr int maxRadius = 127;                   // the window counts fit in 16 bits
+
+/*
+ * Column histograms of the virtual columns [left - radius, right + radius[ of a tile, and
+ * the histogram of the current window.
+ */
+struct Histograms {
+    explicit Histograms (int radius) :
+        stride(tileSize + 2 * radius),
+        coarse(stride * coarseBins),
+        fine(stride * levels)
+    {
+    }
+
+    // The fine bins are grouped by coarse bin first, so that the same fine bins of neighbouring columns,
+    // which the window adds and removes, are next to each other
+    std::uint16_t* getFine (int column, int coarseBin)
+    {
+        return fine.data() + (coarseBin * stride + column) * fineBins;
+    }
+
+    const int stride;
+    std::vector<std::uint16_t> coarse;
+    std::vector<std::uint16_t> fine;
+
+    std::uint16_t windowCoarse[coarseBins];  // at most 255^2 values, see maxRadius
+    std::uint16_t windowFine[levels];
+    int fineColumn[coarseBins]; // the fine bins of a coarse bin are those of the window starting at this column
+};
+
+void filterTile (const std::vector<std::uint16_t>& quantized, float** dst, int width, int height, int radius, int left, int top, int right, int bottom, float minValue, float binWidth, Histograms& hist)
+{
+    const int columns = right - left + 2 * radius;
+    const int diameter = 2 * radius + 1;
+    const std::int32_t rank = (diameter * diameter) / 2; // number of values below the median
+
+    std::vector<int> sourceColumn(columns);
+
+    for (int c = 0; c < columns; ++c) {
+        sourceColumn[c] = rtengine::LIM(left - radius + c, 0, width - 1);
+    }
+
+    std::fill(hist.coarse.begin(), hist.coarse.begin() + columns * coarseBins, 0);
+    std::fill(hist.fine.begin(), hist.fine.end(), 0);
+
+    // column histograms of the window of the first row
+    for (int row = top - radius; row <= top + radius; ++row) {
+        const std::uint16_t* const source = quantized.data() + static_cast<std::size_t>(rtengine::LIM(row, 0, height - 1)) * width;
+
+        for (int c = 0; c < columns; ++c) {
+            const int level = source[sourceColumn[c]];
+            ++hist.coarse[c * coarseBins + (level >> coarseShift)];
+            ++hist.getFine(c, level >> coarseShift)[level & (fineBins - 1)];
+        }
+    }
+
+    for (int row = top; row < bottom; ++row) {
+        if (row > top) {
+            // slide the column histograms down by one row
+            const int removed = rtengine::LIM(row - radius - 1, 0, height - 1);
+            const int added = rtengine::LIM(row + radius, 0, height - 1);
+
+            if (removed != added) {
+                const std::uint16_t* const removedRow = quantized.data() + static_cast<std::size_t>(removed) * width;
+                const std::uint16_t* const addedRow = quantized.data() + static_cast<std::size_t>(added) * width;
+
+                for (int c = 0; c < columns; ++c) {
+                    const int removedLevel = removedRow[sourceColumn[c]];
+                    const int addedLevel = addedRow[sourceColumn[c]];
+                    --hist.coarse[c * coarseBins + (removedLevel >> coarseShift)];
+                    --hist.getFine(c, removedLevel >> coarseShift)[removedLevel & (fineBins - 1)];
+                    ++hist.coarse[c * coarseBins + (addedLevel >> coarseShift)];
+                    ++hist.getFine(c, addedLevel >> coarseShift)[addedLevel & (fineBins - 1)];
+                }
+            }
+        }
+
+        // the window of the first pixel of the row is made of the columns [0, diameter[
+        std::fill(hist.windowCoarse, hist.windowCoarse + coarseBins, 0);
+
+        for (int c = 0; c < diameter; ++c) {
+            const std::uint16_t* const column = hist.coarse.data() + c * coarseBins;
+
+            for (int k = 0; k < coarseBins; ++k) {
+                hist.windowCoarse[k] += column[k];
+            }
+        }
+
+        std::fill(hist.fineColumn, hist.fineColumn + coarseBins, -1);
+
+        for (int x = 0; x < right - left; ++x) {
+            if (x > 0) {
+                const std::uint16_t* const removed = hist.coarse.data() + (x - 1) * coarseBins;
+                const std::uint16_t* const added = hist.coarse.data() + (x + 2 * radius) * coarseBins;
+
+                for (int k = 0; k < coarseBins; ++k) {
+                    hist.windowCoarse[k] += added[k] - removed[k];
+                }
+            }
+
+            // coarse bin of the median
+            std::int32_t count = 0;
+            int k = 0;
+
+            while (count + hist.windowCoarse[k] <= rank) {
+                count += hist.windowCoarse[k];
+                ++k;
+            }
+
+            // the fine bins of a coarse bin are only brought up to date when the median falls into it,
+            // by sliding them when that's cheaper than summing the columns of the window again
+            std::uint16_t* const windowFine = hist.windowFine + k * fineBins;
+            const int lastColumn = hist.fineColumn[k];
+
+            if (lastColumn < 0 || x - lastColumn > radius) {
+                std::fill(windowFine, windowFine + fineBins, 0);
+
+                for (int c = x; c < x + diameter; ++c) {
+                    const std::uint16_t* const column = hist.getFine(c, k);
+
+                    for (int f = 0; f < fineBins; ++f) {
+                        windowFine[f] += column[f];
+                    }
+                }
+            } else {
+                for (int c = lastColumn + 1; c <= x; ++c) {
+                    const std::uint16_t* const removed = hist.getFine(c - 1, k);
+                    const std::uint16_t* const added = hist.getFine(c + 2 * radius, k);
+
+                    for (int f = 0; f < fineBins; ++f) {
+                        windowFine[f] += added[f] - removed[f];
+                    }
+                }
+            }
+
+            hist.fineColumn[k] = x;
+
+            int f = 0;
+
+            while (count + windowFine[f] <= rank) {
+                count += windowFine[f];
+                ++f;
+            }
+
+            dst[row][left + x] = minValue + (k * fineBins + f + 0.5f) * binWidth;
+        }
+    }
+}
+
+}
+
+namespace rtengine
+{
+
+void medianFilter (float** src, float** dst, int width, int height, int radius, int numThreads)
+{
+    float minValue = src[0][0];
+    float maxValue = src[0][0];
+
+#ifdef _OPENMP
+    #pragma omp parallel num_threads(numThreads) if (numThreads > 1)
+#endif
+    {
+        float minThr = minValue;
+        float maxThr = maxValue;
+
+#ifdef _OPENMP
+        #pragma omp for nowait
+#endif
+
+        for (int i = 0; i < height; ++i) {
+            for (int j = 0; j < width; ++j) {
+                minThr = std::min(minThr, src[i][j]);
+                maxThr = std::max(maxThr, src[i][j]);
+            }
+        }
+
+#ifdef _OPENMP
+        #pragma omp critical
+#endif
+        {
+            minValue = std::min(minValue, minThr);
+            maxValue = std::max(maxValue, maxThr);
+        }
+    }
+
+    radius = std::min(radius, maxRadius);
+
+    if (radius < 1 || !(maxValue > minValue)) {
+        // nothing to filter
+        if (src != dst) {
+            for (int i = 0; i < height; ++i) {
+                std::copy(src[i], src[i] + width, dst[i]);
+            }
+        }
+
+        return;
+    }
+
+    // the tiles read the quantized copy only, so that dst may be src
+    const float scale = levels / (maxValue - minValue);
+    std::vector<std::uint16_t> quantized(static_cast<std::size_t>(width) * height);
+
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(numThreads) if (numThreads > 1)
+#endif
+
+    for (int i = 0; i < height; ++i) {
+        std::uint16_t* const row = quantized.data() + static_cast<std::size_t>(i) * width;
+
+        for (int j = 0; j < width; ++j) {
+            row[j] = std::min(static_cast<int>((src[i][j] - minValue) * scale), levels - 1);
+        }
+    }
+
+    const int tilesW = (width + tileSize - 1) / tileSize;
+    const int tilesH = (height + tileSize - 1) / tileSize;
+
+#ifdef _OPENMP
+    #pragma omp parallel num_threads(numThreads) if (numThreads > 1)
+#endif
+    {
+        Histograms hist(radius);
+
+#ifdef _OPENMP
+        #pragma omp for schedule(dynamic) collapse(2)
+#endif
+
+        for (int tileY = 0; tileY < tilesH; ++tileY) {
+            for (int tileX = 0; tileX < tilesW; ++tileX) {
+                const int left = tileX * tileSize;
+                const int top = tileY * tileSize;
+                filterTile(quantized, dst, width, height, radius, left, top, std::min(left + tileSize, width), std::min(top + tileSize, height), minValue, 1.f / scale, hist);
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,37 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+namespace rtengine
+{
+
+/*
+ * Median of the (2 * radius + 1)^2 square around each pixel, for the windows too large for the
+ * sorting networks of median.h.
+ *
+ * Based on "Median Filtering in Constant Time" (S. Perreault, P. Hebert, 2007): one histogram per
+ * column is slid down the image and the window histogram is slid along the row by adding and
+ * removing whole column histograms, so that the cost per pixel doesn't depend on the radius.
+ * The values are quantized to 4096 levels spanning the range of 'src', counted in two level
+ * (64 coarse x 64 fine bins) histograms; the result is the center of the median bin, within
+ * 1/8192 of the range of the exact median. Pixels outside the image replicate the nearest edge.
+ *
+ * The radius is limited to 127. The image is processed in tiles, in parallel. 'src' and 'dst' may be the same.
+ */
+void medianFilter (float** src, float** dst, int width, int height, int radius, int numThreads);
+
+}
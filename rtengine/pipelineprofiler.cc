@@ -0,0 +1,371 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#ifdef WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <glib/gstdio.h>
+
+#include "pipelineprofiler.h"
+
+namespace
+{
+
+// innermost running stage of each thread
+thread_local rtengine::PipelineProfiler::Stage* currentStage = nullptr;
+
+}
+
+rtengine::PipelineProfiler::Stage::Stage (const char* pipeline, const char* name) :
+    pipeline(pipeline),
+    name(name),
+    running(PipelineProfiler::getInstance().isEnabled()),
+    parent(nullptr),
+    depth(0),
+    wallStart(0),
+    cpuStart(0),
+    rssStart(0),
+    childWallTime(0),
+    childCpuTime(0),
+    threads(1)
+{
+    if (running) {
+        parent = currentStage;
+        depth = parent ? parent->depth + 1 : 0;
+        currentStage = this;
+#ifdef _OPENMP
+        threads = omp_get_max_threads();
+#endif
+        rssStart = getRss();
+        cpuStart = getCpuTime();
+        wallStart = getWallTime();
+    }
+}
+
+rtengine::PipelineProfiler::Stage::~Stage ()
+{
+    stop();
+}
+
+void rtengine::PipelineProfiler::Stage::stop ()
+{
+    if (!running) {
+        return;
+    }
+
+    running = false;
+
+    const std::int64_t wallEnd = getWallTime();
+    const std::int64_t cpuEnd = getCpuTime();
+
+    Record record;
+    record.pipeline = pipeline;
+    record.name = name;
+    record.thread = 0;
+    record.depth = depth;
+    record.wallStart = wallStart;
+    record.wallTime = wallEnd - wallStart;
+    record.cpuTime = cpuEnd - cpuStart;
+    record.selfWallTime = record.wallTime - childWallTime;
+    record.selfCpuTime = record.cpuTime - childCpuTime;
+    record.threads = threads;
+    record.rssDelta = getRss() - rssStart;
+    record.peakRss = getPeakRss();
+
+    // a stage stopped before the end of its scope gives the thread back to its parent
+    if (currentStage == this) {
+        currentStage = parent;
+    }
+
+    if (parent) {
+        parent->childWallTime += record.wallTime;
+        parent->childCpuTime += record.cpuTime;
+    }
+
+    PipelineProfiler::getInstance().add(record);
+}
+
+rtengine::PipelineProfiler& rtengine::PipelineProfiler::getInstance()
+{
+    static PipelineProfiler instance;
+    return instance;
+}
+
+rtengine::PipelineProfiler::PipelineProfiler() :
+    enabled(false),
+    format(Format::JSON),
+    origin(getWallTime()),
+    droppedRecords(0),
+    dirty(false)
+{
+    const char* const file = std::getenv("RT_PROFILE");
+
+    if (file && *file) {
+        const char* const formatName = std::getenv("RT_PROFILE_FORMAT");
+        enable(file, formatName && !strcmp(formatName, "chrome") ? Format::CHROME_TRACE : Format::JSON);
+    }
+}
+
+rtengine::PipelineProfiler::~PipelineProfiler()
+{
+    flush();
+}
+
+void rtengine::PipelineProfiler::enable (const Glib::ustring& fileName, Format format)
+{
+    MyMutex::MyLock lock(mutex);
+
+    this->fileName = fileName;
+    this->format = format;
+    enabled = true;
+}
+
+void rtengine::PipelineProfiler::flush ()
+{
+    MyMutex::MyLock lock(mutex);
+
+    if (!enabled || !dirty) {
+        return;
+    }
+
+    std::ostringstream stream;
+
+    if (format == Format::CHROME_TRACE) {
+        writeChromeTrace(stream);
+    } else {
+        writeJson(stream);
+    }
+
+    FILE* const file = g_fopen(fileName.c_str(), "wb");
+
+    if (!file) {
+        fprintf(stderr, "Pipeline profiler: can't write \"%s\"\n", fileName.c_str());
+        return;
+    }
+
+    const std::string contents = stream.str();
+    fwrite(contents.data(), 1, contents.size(), file);
+    fclose(file);
+
+    dirty = false;
+}
+
+void rtengine::PipelineProfiler::add (const Record& record)
+{
+    MyMutex::MyLock lock(mutex);
+
+    // small stable thread numbers read better than addresses in the output
+    Glib::Threads::Thread* const self = Glib::Threads::Thread::self();
+    const auto thread = std::find(threadIds.begin(), threadIds.end(), self);
+
+    records.push_back(record);
+    records.back().thread = thread - threadIds.begin();
+    records.back().wallStart -= origin;
+
+    if (thread == threadIds.end()) {
+        threadIds.push_back(self);
+    }
+
+    // a long session keeps the most recent stages only
+    if (records.size() > maxRecords) {
+        records.pop_front();
+        ++droppedRecords;
+    }
+
+    dirty = true;
+}
+
+void rtengine::PipelineProfiler::writeJson (std::ostream& stream) const
+{
+    stream << "{\n  \"stages\": [";
+
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        const Record& record = records[i];
+        stream << (i ? ",\n" : "\n")
+               << "    {\"pipeline\": \"" << record.pipeline << "\", \"stage\": \"" << record.name << "\", \"thread\": " << record.thread
+               << ", \"depth\": " << record.depth << ", \"start_us\": " << record.wallStart << ", \"wall_us\": " << record.wallTime
+               << ", \"cpu_us\": " << record.cpuTime << ", \"self_wall_us\": " << record.selfWallTime << ", \"self_cpu_us\": " << record.selfCpuTime
+               << ", \"threads\": " << record.threads << ", \"rss_delta_bytes\": " << record.rssDelta
+               << ", \"peak_rss_bytes\": " << record.peakRss << "}";
+    }
+
+    // totals per stage, in order of first appearance; the wall and CPU times include the nested
+    // stages, the self times don't and add up to the time of the outermost stages
+    struct Total {
+        unsigned int count;
+        std::int64_t wallTime;
+        std::int64_t cpuTime;
+        std::int64_t selfWallTime;
+        std::int64_t selfCpuTime;
+    };
+
+    std::vector<std::pair<std::string, std::string>> order;
+    std::map<std::pair<std::string, std::string>, Total> totals;
+
+    for (const auto& record : records) {
+        const auto key = std::make_pair(std::string(record.pipeline), std::string(record.name));
+        auto& total = totals[key];
+
+        if (!total.count) {
+            order.push_back(key);
+        }
+
+        ++total.count;
+        total.wallTime += record.wallTime;
+        total.cpuTime += record.cpuTime;
+        total.selfWallTime += record.selfWallTime;
+        total.selfCpuTime += record.selfCpuTime;
+    }
+
+    stream << "\n  ],\n  \"summary\": [";
+
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        const Total& total = totals[order[i]];
+        stream << (i ? ",\n" : "\n")
+               << "    {\"pipeline\": \"" << order[i].first << "\", \"stage\": \"" << order[i].second << "\", \"count\": " << total.count
+               << ", \"wall_us\": " << total.wallTime << ", \"cpu_us\": " << total.cpuTime
+               << ", \"self_wall_us\": " << total.selfWallTime << ", \"self_cpu_us\": " << total.selfCpuTime << "}";
+    }
+
+    stream << "\n  ],\n  \"dropped\": " << droppedRecords << "\n}\n";
+}
+
+void rtengine::PipelineProfiler::writeChromeTrace (std::ostream& stream) const
+{
+    stream << "{\"traceEvents\": [";
+
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        const Record& record = records[i];
+        stream << (i ? ",\n" : "\n")
+               << "  {\"name\": \"" << record.name << "\", \"cat\": \"" << record.pipeline << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << record.thread
+               << ", \"ts\": " << record.wallStart << ", \"dur\": " << record.wallTime
+               << ", \"args\": {\"cpu_us\": " << record.cpuTime << ", \"self_cpu_us\": " << record.selfCpuTime << ", \"threads\": " << record.threads
+               << ", \"rss_delta_bytes\": " << record.rssDelta << ", \"peak_rss_bytes\": " << record.peakRss << "}}";
+    }
+
+    stream << "\n], \"displayTimeUnit\": \"ms\"}\n";
+}
+
+std::int64_t rtengine::PipelineProfiler::getWallTime ()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::int64_t rtengine::PipelineProfiler::getCpuTime ()
+{
+#ifdef WIN32
+    FILETIME creation, exit, kernel, user;
+
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+
+    // 100 ns units
+    const auto toInt = [](const FILETIME& time) {
+        return (static_cast<std::int64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    };
+    return (toInt(kernel) + toInt(user)) / 10;
+#else
+    rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage)) {
+        return 0;
+    }
+
+    return static_cast<std::int64_t>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+}
+
+std::int64_t rtengine::PipelineProfiler::getRss ()
+{
+#ifdef WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+
+    return counters.WorkingSetSize;
+#elif defined __APPLE__
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS) {
+        return 0;
+    }
+
+    return info.resident_size;
+#else
+    // the second field of statm is the resident size in pages, not available on the BSDs without procfs
+    std::ifstream statm("/proc/self/statm");
+    std::int64_t size = 0;
+    std::int64_t resident = 0;
+
+    if (!(statm >> size >> resident)) {
+        return 0;
+    }
+
+    return resident * sysconf(_SC_PAGESIZE);
+#endif
+}
+
+std::uint64_t rtengine::PipelineProfiler::getPeakRss ()
+{
+#ifdef WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage)) {
+        return 0;
+    }
+
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    // kilobytes on Linux and the BSDs
+    return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
@@ -0,0 +1,139 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <iosfwd>
+#include <vector>
+
+#include <glibmm.h>
+
+#include "noncopyable.h"
+#include "../rtgui/threadutils.h"
+
+namespace rtengine
+{
+
+/**
+ * @brief Per-stage instrumentation of the processing pipelines
+ *
+ * Each stage records its wall time, CPU time, the number of threads it could use, how much the resident
+ * set size (RSS) of the process grew while it ran and the peak RSS of the process when it ended. Stages
+ * nest within a thread (e.g. rgbProc within transform); each one also records its depth and its self
+ * time, i.e. without the time of the stages nested in it, and the summary sums the self times so that
+ * nothing is counted twice.
+ * The profiler is always compiled in but disabled by default, in which case a stage costs a single flag
+ * test. It is enabled by enable() (the -T switch of rawtherapee-cli)
+ * or by the RT_PROFILE environment variable holding the output file name; RT_PROFILE_FORMAT=chrome
+ * selects Chrome trace events (chrome://tracing, Perfetto) instead of the default JSON.
+ *
+ * CPU time and RSS are process wide, so they also account for the concurrent work (e.g. the
+ * loader and saver stages of the pipelined batch mode), and the RSS figures aren't the allocations of
+ * the stage itself. Only the last maxRecords stages are kept, the
+ * older ones are counted as dropped in the output.
+ */
+class PipelineProfiler final :
+    public NonCopyable
+{
+public:
+    enum class Format {
+        JSON,
+        CHROME_TRACE
+    };
+
+    /// Records a stage from its construction to stop() or its destruction
+    class Stage final :
+        public NonCopyable
+    {
+    public:
+        Stage (const char* pipeline, const char* name);
+        ~Stage ();
+
+        void stop ();
+
+    private:
+        const char* const pipeline;
+        const char* const name;
+        bool running;
+        Stage* parent;              // the stage of the same thread this one is nested in
+        int depth;
+        std::int64_t wallStart;
+        std::int64_t cpuStart;
+        std::int64_t rssStart;
+        std::int64_t childWallTime; // of the stages nested in this one
+        std::int64_t childCpuTime;
+        int threads;
+    };
+
+    static PipelineProfiler& getInstance();
+
+    ~PipelineProfiler();
+
+    bool isEnabled() const
+    {
+        return enabled;
+    }
+
+    void enable (const Glib::ustring& fileName, Format format);
+
+    /// Writes all the stages recorded so far to the output file
+    void flush ();
+
+private:
+    static constexpr std::size_t maxRecords = 100000;
+
+    struct Record {
+        const char* pipeline;
+        const char* name;
+        unsigned int thread;
+        int depth;
+        std::int64_t wallStart;
+        std::int64_t wallTime;
+        std::int64_t cpuTime;
+        std::int64_t selfWallTime;
+        std::int64_t selfCpuTime;
+        int threads;
+        std::int64_t rssDelta;
+        std::uint64_t peakRss;
+    };
+
+    PipelineProfiler();
+
+    void add (const Record& record);
+    void writeJson (std::ostream& stream) const;
+    void writeChromeTrace (std::ostream& stream) const;
+
+    static std::int64_t getWallTime ();
+    static std::int64_t getCpuTime ();
+    static std::int64_t getRss ();
+    static std::uint64_t getPeakRss ();
+
+    std::atomic<bool> enabled;
+    Glib::ustring fileName;
+    Format format;
+    std::int64_t origin;
+
+    MyMutex mutex;
+    std::deque<Record> records;
+    std::size_t droppedRecords;
+    std::vector<Glib::Threads::Thread*> threadIds;
+    bool dirty;
+};
+
+}
@@ -0,0 +1,128 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "previewpyramid.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+
+// Each destination sample becomes the mean of the factor x factor block of source samples it covers
+void downsample (float** src, float** dst, int dstWidth, int dstHeight, int factor)
+{
+    const float norm = 1.f / (factor * factor);
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 16)
+#endif
+
+    for (int i = 0; i < dstHeight; ++i) {
+        float* const out = dst[i];
+
+        for (int j = 0; j < dstWidth; ++j) {
+            out[j] = 0.f;
+        }
+
+        for (int m = 0; m < factor; ++m) {
+            const float* in = src[i * factor + m];
+
+            for (int j = 0; j < dstWidth; ++j, in += factor) {
+                float sum = 0.f;
+
+                for (int n = 0; n < factor; ++n) {
+                    sum += in[n];
+                }
+
+                out[j] += sum;
+            }
+        }
+
+        for (int j = 0; j < dstWidth; ++j) {
+            out[j] *= norm;
+        }
+    }
+}
+
+}
+
+namespace rtengine
+{
+
+PreviewPyramid::Planes::Planes (int width, int height) :
+    width (width),
+    height (height)
+{
+    for (auto& plane : rgb) {
+        plane (width, height);
+    }
+}
+
+PreviewPyramid::Level PreviewPyramid::get (int skip, array2D<float>& red, array2D<float>& green, array2D<float>& blue, int width, int height)
+{
+    int shift = 0;
+
+    while (shift < maxShift && skip % (2 << shift) == 0 && (width >> (shift + 1)) > 0 && (height >> (shift + 1)) > 0) {
+        ++shift;
+    }
+
+    if (shift < minShift) {
+        return {0, width, height, red, green, blue};
+    }
+
+    if (levels.size() <= static_cast<std::size_t> (shift - minShift)) {
+        levels.resize (shift - minShift + 1);
+    }
+
+    if (!levels[shift - minShift]) {
+        // build from the finest level available below the requested one
+        int srcShift = shift - 1;
+
+        while (srcShift >= minShift && !levels[srcShift - minShift]) {
+            --srcShift;
+        }
+
+        float** src[3] = {red, green, blue};
+
+        if (srcShift >= minShift) {
+            for (int c = 0; c < 3; ++c) {
+                src[c] = levels[srcShift - minShift]->rgb[c];
+            }
+        } else {
+            srcShift = 0;
+        }
+
+        std::unique_ptr<Planes> level (new Planes (width >> shift, height >> shift));
+
+        for (int c = 0; c < 3; ++c) {
+            downsample (src[c], level->rgb[c], level->width, level->height, 1 << (shift - srcShift));
+        }
+
+        levels[shift - minShift] = std::move (level);
+    }
+
+    Planes& level = *levels[shift - minShift];
+    return {shift, level.width, level.height, level.rgb[0], level.rgb[1], level.rgb[2]};
+}
+
+void PreviewPyramid::invalidate ()
+{
+    levels.clear();
+}
+
+}
@@ -0,0 +1,72 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "array2D.h"
+#include "noncopyable.h"
+
+namespace rtengine
+{
+
+/**
+ * @brief Mip pyramid of the demosaiced red, green and blue planes
+ *
+ * Level k holds the means of the 2^k x 2^k blocks of the planes, so that a subsampled preview can
+ * be summed from a level instead of from the full resolution data. Levels are built on first use,
+ * each one from the finest level already available, and all of them are dropped by invalidate()
+ * whenever the planes change. The 1/2 level is not kept: it would cost a quarter of the full
+ * planes for a 4x saving.
+ */
+class PreviewPyramid final :
+    public NonCopyable
+{
+public:
+    static constexpr int minShift = 2;
+    static constexpr int maxShift = 6;
+
+    struct Level {
+        int shift;
+        int width;
+        int height;
+        float** red;
+        float** green;
+        float** blue;
+    };
+
+    /// Returns the coarsest level usable for a subsampling of 'skip' (a power of two dividing it),
+    /// or the planes themselves (shift 0) if there is none
+    Level get (int skip, array2D<float>& red, array2D<float>& green, array2D<float>& blue, int width, int height);
+
+    void invalidate ();
+
+private:
+    struct Planes {
+        Planes (int width, int height);
+
+        int width;
+        int height;
+        std::array<array2D<float>, 3> rgb;
+    };
+
+    std::vector<std::unique_ptr<Planes>> levels; // levels[k - minShift] holds level k
+};
+
+}
@@ -0,0 +1,275 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <memory>
+
+#include <glib/gstdio.h>
+
+#include "profileindex.h"
+#include "utils.h"
+#include "../rtgui/options.h"
+
+namespace
+{
+
+const char* const indexMagic = "RTPIv1";
+
+struct Directory {
+    Glib::ustring path;
+    std::int64_t modified;
+};
+
+bool getModified(const Glib::ustring& path, std::int64_t& modified, std::int64_t* size = nullptr)
+{
+    GStatBuf st;
+
+    if (g_stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+
+    modified = st.st_mtime;
+
+    if (size) {
+        *size = st.st_size;
+    }
+
+    return true;
+}
+
+std::uint32_t readBigEndian32(const unsigned char* data)
+{
+    return (std::uint32_t(data[0]) << 24) | (std::uint32_t(data[1]) << 16) | (std::uint32_t(data[2]) << 8) | data[3];
+}
+
+void readIccHeader(rtengine::ProfileIndex::Entry& entry)
+{
+    entry.deviceClass = 0;
+    entry.colorSpace = 0;
+
+    FILE* const file = g_fopen(entry.path.c_str(), "rb");
+
+    if (!file) {
+        return;
+    }
+
+    unsigned char header[40];
+
+    if (fread(header, 1, sizeof(header), file) == sizeof(header) && !memcmp(header + 36, "acsp", 4)) {
+        entry.deviceClass = readBigEndian32(header + 12);
+        entry.colorSpace = readBigEndian32(header + 16);
+    }
+
+    fclose(file);
+}
+
+Glib::ustring getIndexFileName(const Glib::ustring& dirName, const std::vector<Glib::ustring>& extensions, bool recursive, bool readIccHeaders)
+{
+    if (options.cacheBaseDir.empty()) {
+        return Glib::ustring();
+    }
+
+    Glib::ustring key = dirName;
+
+    for (const auto& extension : extensions) {
+        key += '\n' + extension;
+    }
+
+    key += recursive ? "\nrecursive" : "\nflat";
+    key += readIccHeaders ? "\nicc" : "\nplain";
+
+    return Glib::build_filename(options.cacheBaseDir, "profileindex", Glib::Checksum::compute_checksum(Glib::Checksum::CHECKSUM_MD5, key) + ".rtpi");
+}
+
+// The index is a text file: the magic, then one "D <mtime> <path>" line per scanned directory,
+// then one "F <mtime> <size> <class> <space> <path>" line per file, paths last as they may hold spaces
+bool loadIndex(const Glib::ustring& indexFileName, std::vector<rtengine::ProfileIndex::Entry>& entries)
+{
+    std::unique_ptr<FILE, int (*)(FILE*)> file(g_fopen(indexFileName.c_str(), "rb"), fclose);
+
+    if (!file) {
+        return false;
+    }
+
+    char line[4096];
+
+    if (!fgets(line, sizeof(line), file.get()) || strncmp(line, indexMagic, strlen(indexMagic))) {
+        return false;
+    }
+
+    bool hasDirectory = false;
+
+    while (fgets(line, sizeof(line), file.get())) {
+        const std::size_t length = strlen(line);
+
+        if (!length || line[length - 1] != '\n') {
+            return false;
+        }
+
+        line[length - 1] = '\0';
+
+        long long modified, size;
+        unsigned int deviceClass, colorSpace;
+        int pathPos = 0;
+
+        if (line[0] == 'D' && sscanf(line, "D %lld %n", &modified, &pathPos) == 1 && pathPos > 0) {
+            std::int64_t current;
+
+            // a directory which changed invalidates the whole index
+            if (!getModified(line + pathPos, current) || current != modified) {
+                return false;
+            }
+
+            hasDirectory = true;
+        } else if (line[0] == 'F' && sscanf(line, "F %lld %lld %u %u %n", &modified, &size, &deviceClass, &colorSpace, &pathPos) == 4 && pathPos > 0) {
+            rtengine::ProfileIndex::Entry entry;
+            entry.path = line + pathPos;
+            entry.fileName = Glib::path_get_basename(entry.path);
+            entry.modified = modified;
+            entry.size = size;
+            entry.deviceClass = deviceClass;
+            entry.colorSpace = colorSpace;
+            entries.push_back(entry);
+        } else {
+            return false;
+        }
+    }
+
+    return hasDirectory;
+}
+
+void saveIndex(const Glib::ustring& indexFileName, const std::vector<Directory>& directories, const std::vector<rtengine::ProfileIndex::Entry>& entries)
+{
+    if (g_mkdir_with_parents(Glib::path_get_dirname(indexFileName).c_str(), 0755)) {
+        return;
+    }
+
+    const Glib::ustring tempName = indexFileName + ".tmp";
+    FILE* const file = g_fopen(tempName.c_str(), "wb");
+
+    if (!file) {
+        return;
+    }
+
+    bool ok = fprintf(file, "%s\n", indexMagic) > 0;
+
+    for (const auto& directory : directories) {
+        ok = ok && fprintf(file, "D %lld %s\n", static_cast<long long>(directory.modified), directory.path.c_str()) > 0;
+    }
+
+    for (const auto& entry : entries) {
+        ok = ok && fprintf(file, "F %lld %lld %u %u %s\n", static_cast<long long>(entry.modified), static_cast<long long>(entry.size), entry.deviceClass, entry.colorSpace, entry.path.c_str()) > 0;
+    }
+
+    ok = !fclose(file) && ok;
+
+    if (!ok || g_rename(tempName.c_str(), indexFileName.c_str())) {
+        g_remove(tempName.c_str());
+    }
+}
+
+}
+
+std::vector<rtengine::ProfileIndex::Entry> rtengine::ProfileIndex::list(const Glib::ustring& dirName, const std::vector<Glib::ustring>& extensions, bool recursive, bool readIccHeaders)
+{
+    std::vector<Entry> entries;
+
+    if (dirName.empty()) {
+        return entries;
+    }
+
+    const Glib::ustring indexFileName = getIndexFileName(dirName, extensions, recursive, readIccHeaders);
+
+    if (!indexFileName.empty()) {
+        if (loadIndex(indexFileName, entries)) {
+            return entries;
+        }
+
+        entries.clear();
+    }
+
+    const std::int64_t scanTime = std::time(nullptr);
+    std::vector<Directory> directories;
+    std::deque<Glib::ustring> pending = {dirName};
+
+    while (!pending.empty()) {
+        const Glib::ustring directoryName = pending.back();
+        pending.pop_back();
+
+        Directory directory{directoryName, 0};
+
+        if (!getModified(directoryName, directory.modified)) {
+            continue;
+        }
+
+        try {
+            Glib::Dir dir(directoryName);
+
+            for (const std::string& name : dir) {
+                const Glib::ustring fileName(name);
+                const Glib::ustring path = Glib::build_filename(directoryName, fileName);
+
+                if (Glib::file_test(path, Glib::FILE_TEST_IS_DIR)) {
+                    if (recursive) {
+                        pending.push_front(path);
+                    }
+
+                    continue;
+                }
+
+                const Glib::ustring extension = getFileExtension(fileName);
+
+                if (std::find(extensions.begin(), extensions.end(), extension) == extensions.end() || !Glib::file_test(path, Glib::FILE_TEST_IS_REGULAR)) {
+                    continue;
+                }
+
+                Entry entry{path, fileName, 0, 0, 0, 0};
+
+                if (!getModified(path, entry.modified, &entry.size)) {
+                    continue;
+                }
+
+                if (readIccHeaders) {
+                    readIccHeader(entry);
+                }
+
+                entries.push_back(entry);
+            }
+        } catch (Glib::Exception&) {
+            continue;
+        }
+
+        directories.push_back(directory);
+    }
+
+    // A directory modified during the second of the scan could change again without its mtime
+    // moving, so such a listing is not stored and the next run scans again
+    bool stable = !directories.empty() && !indexFileName.empty();
+
+    for (const auto& directory : directories) {
+        stable = stable && directory.modified < scanTime;
+    }
+
+    if (stable) {
+        saveIndex(indexFileName, directories, entries);
+    }
+
+    return entries;
+}
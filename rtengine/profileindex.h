@@ -0,0 +1,56 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glibmm.h>
+
+namespace rtengine
+{
+
+/**
+ * @brief Persistent listing of a profile directory
+ *
+ * Listing a profile directory costs a stat per file, plus reading the header of every ICC profile,
+ * which adds up for large collections on network mounts. The result of a scan is stored in the
+ * "profileindex" cache directory and reused as long as the modification times of the scanned
+ * directories are unchanged, which only costs a stat per directory. The profiles themselves are
+ * left to be loaded on first use.
+ */
+class ProfileIndex final
+{
+public:
+    struct Entry {
+        Glib::ustring path;
+        Glib::ustring fileName;
+        std::int64_t modified;
+        std::int64_t size;
+        // From the ICC header when requested, 0 if the file doesn't look like an ICC profile
+        std::uint32_t deviceClass;
+        std::uint32_t colorSpace;
+    };
+
+    /**
+     * Returns the regular files of dirName, in scan order, whose lowercase extension is one of extensions.
+     * Subdirectories are scanned breadth first when recursive is set.
+     */
+    static std::vector<Entry> list(const Glib::ustring& dirName, const std::vector<Glib::ustring>& extensions, bool recursive, bool readIccHeaders);
+};
+
+}
@@ -18,6 +18,8 @@
  */
 #include <cmath>
 #include <iostream>
+#include <mutex>
+#include <sstream>
 
 #include "rtengine.h"
 #include "rawimagesource.h"
@@ -33,6 +35,7 @@
 #include "dcp.h"
 #include "rt_math.h"
 #include "improcfun.h"
+#include "demosaiccache.h"
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -725,7 +728,16 @@ void RawImageSource::getImage (const ColorTemp &ctemp, int tran, Imagefloat* ima
 
     const bool doClip = (chmax[0] >= clmax[0] || chmax[1] >= clmax[1] || chmax[2] >= clmax[2]) && !hrp.hrenabled;
 
-    float area = skip * skip;
+    const bool fromPlanes = ri->getSensorType() == ST_BAYER || ri->getSensorType() == ST_FUJI_XTRANS || ri->get_colors() == 1;
+    // subsampled previews are summed from the coarsest pyramid level which fits the skip, whose samples are means of 2^shift x 2^shift blocks
+    PreviewPyramid::Level level {0, W, H, red, green, blue};
+
+    if (fromPlanes && skip > 1) {
+        level = pyramid.get(skip, red, green, blue, W, H);
+    }
+
+    const int levelSkip = skip >> level.shift;
+    float area = fromPlanes ? levelSkip * levelSkip : skip * skip;
     rm /= area;
     gm /= area;
     bm /= area;
@@ -750,17 +762,20 @@ void RawImageSource::getImage (const ColorTemp &ctemp, int tran, Imagefloat* ima
                 i = maxy - skip - 1;    // avoid trouble
             }
 
-            if (ri->getSensorType() == ST_BAYER || ri->getSensorType() == ST_FUJI_XTRANS || ri->get_colors() == 1) {
+            if (fromPlanes) {
+                const int li = i >> level.shift;
+
                 for (int j = 0, jx = sx1; j < imwidth; j++, jx += skip) {
                     jx = std::min(jx, maxx - skip - 1); // avoid trouble
+                    const int lj = jx >> level.shift;
 
                     float rtot = 0.f, gtot = 0.f, btot = 0.f;
 
-                    for (int m = 0; m < skip; m++)
-                        for (int n = 0; n < skip; n++) {
-                            rtot += red[i + m][jx + n];
-                            gtot += green[i + m][jx + n];
-                            btot += blue[i + m][jx + n];
+                    for (int m = 0; m < levelSkip; m++)
+                        for (int n = 0; n < levelSkip; n++) {
+                            rtot += level.red[li + m][lj + n];
+                            gtot += level.green[li + m][lj + n];
+                            btot += level.blue[li + m][lj + n];
                         }
 
                     rtot *= rm;
@@ -2025,6 +2040,21 @@ void RawImageSource::preprocess  (const RAWParams &raw, const LensProfParams &le
         ImProcFunctions::getAutoExp (aehist, aehistcompr, getDefGain(), clip, dirpyrdenoiseExpComp, brightness, contrast, black, hlcompr, hlcomprthresh);
     }
 
+    // everything above which changes rawData, used by demosaic() to key the demosaic cache
+    std::ostringstream key;
+    key.precision(17);
+    key << currFrame << '|' << ri->getSensorType() << '|'
+        << raw.bayersensor.black0 << ' ' << raw.bayersensor.black1 << ' ' << raw.bayersensor.black2 << ' ' << raw.bayersensor.black3 << ' ' << raw.bayersensor.twogreen << '|'
+        << raw.bayersensor.greenthresh << ' ' << raw.bayersensor.linenoise << '|'
+        << raw.xtranssensor.blackred << ' ' << raw.xtranssensor.blackgreen << ' ' << raw.xtranssensor.blackblue << '|'
+        << (rid ? rid->get_filename() : std::string()) << '|'
+        << (rif ? rif->get_filename() : std::string()) << ' ' << raw.ff_BlurRadius << ' ' << raw.ff_BlurType << ' ' << raw.ff_AutoClipControl << ' ' << raw.ff_clipControl << '|'
+        << raw.ca_autocorrect << ' ' << raw.cared << ' ' << raw.cablue << '|'
+        << raw.expos << ' ' << raw.preser << '|'
+        << raw.hotPixelFilter << ' ' << raw.deadPixelFilter << ' ' << raw.hotdeadpix_thresh << '|'
+        << lensProf.useVign << ' ' << lensProf.lcpFile << ' ' << coarse.rotate << ' ' << coarse.hflip << ' ' << coarse.vflip;
+    preprocessKey = key.str();
+
     t2.set();
 
     if( settings->verbose ) {
@@ -2045,6 +2075,37 @@ void RawImageSource::demosaic(const RAWParams &raw)
     MyTime t1, t2;
     t1.set();
 
+    pyramid.invalidate();
+
+    // pixelshift keeps state between calls, its output is not cached
+    DemosaicCache& demosaicCache = DemosaicCache::getInstance();
+    std::string cacheKey;
+
+    if (demosaicCache.isEnabled() && !(ri->getSensorType() == ST_BAYER && raw.bayersensor.method == RAWParams::BayerSensor::methodstring[RAWParams::BayerSensor::pixelshift])) {
+        std::ostringstream inputs;
+        inputs.precision(17);
+        inputs << preprocessKey << '|';
+
+        if (ri->getSensorType() == ST_BAYER) {
+            inputs << raw.bayersensor.method << ' ' << raw.bayersensor.ccSteps << ' ' << raw.bayersensor.dcb_iterations << ' ' << raw.bayersensor.dcb_enhance << ' ' << raw.bayersensor.lmmse_iterations;
+        } else if (ri->getSensorType() == ST_FUJI_XTRANS) {
+            inputs << raw.xtranssensor.method << ' ' << raw.xtranssensor.ccSteps;
+        }
+
+        cacheKey = DemosaicCache::getKey(fileName, inputs.str());
+    }
+
+    if (!cacheKey.empty() && demosaicCache.load(cacheKey, W, H, red, green, blue)) {
+        rgbSourceModified = false;
+
+        if (settings->verbose) {
+            t2.set();
+            printf("Demosaicing: loaded from cache - %d usec\n", t2.etime(t1));
+        }
+
+        return;
+    }
+
     if (ri->getSensorType() == ST_BAYER) {
         if ( raw.bayersensor.method == RAWParams::BayerSensor::methodstring[RAWParams::BayerSensor::hphd] ) {
             hphd_demosaic ();
@@ -2091,6 +2152,10 @@ void RawImageSource::demosaic(const RAWParams &raw)
         nodemosaic(true);
     }
 
+    if (!cacheKey.empty() && !isCancelled()) {
+        demosaicCache.store(cacheKey, W, H, red, green, blue);
+    }
+
     t2.set();
 
 
@@ -2386,6 +2451,8 @@ void RawImageSource::retinex(ColorManagementParams cmp, const RetinexParams &deh
         printf ("Applying Retinex\n");
     }
 
+    pyramid.invalidate();
+
     LUTf lutToneireti;
     lutToneireti(65536);
 
@@ -2785,6 +2852,8 @@ void RawImageSource::flushRawData()
 
 void RawImageSource::flushRGB()
 {
+    pyramid.invalidate();
+
     if (green) {
         green(0, 0);
     }
@@ -2807,6 +2876,7 @@ void RawImageSource::HLRecovery_Global(ToneCurveParams hrp)
             }
 
             HLRecovery_inpaint (red, green, blue);
+            pyramid.invalidate();
             rgbSourceModified = true;
         }
     }
@@ -4020,6 +4090,8 @@ void RawImageSource::colorSpaceConversion_ (Imagefloat* im, ColorManagementParam
                 camera_icc_type = CAMERA_ICC_TYPE_LEAF;
             } else if (strstr(copyright, "Phase One A/S") != nullptr) {
                 camera_icc_type = CAMERA_ICC_TYPE_PHASE_ONE;
+                static std::once_flag phaseOneCurvesInitialized;
+                std::call_once(phaseOneCurvesInitialized, init);
             } else if (strstr(copyright, "Nikon Corporation") != nullptr) {
                 camera_icc_type = CAMERA_ICC_TYPE_NIKON;
             }
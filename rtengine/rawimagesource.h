@@ -22,6 +22,7 @@
 #include "imagesource.h"
 #include "dcp.h"
 #include "array2D.h"
+#include "previewpyramid.h"
 #include "curves.h"
 #include "color.h"
 #include "iimage.h"
@@ -90,7 +91,10 @@ protected:
     array2D<float> red;
     // the interpolated blue plane:
     array2D<float> blue;
+    // subsampled copies of the interpolated planes, for the zoomed out previews
+    PreviewPyramid pyramid;
     bool rawDirty;
+    std::string preprocessKey; // inputs of the last preprocess() call, part of the demosaic cache key
     float psRedBrightness[4];
     float psGreenBrightness[4];
     float psBlueBrightness[4];
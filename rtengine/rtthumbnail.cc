@@ -24,6 +24,7 @@
 #include "curves.h"
 #include <glibmm.h>
 #include "improcfun.h"
+#include "histogramengine.h"
 #include "colortemp.h"
 #include "mytime.h"
 #include "utils.h"
@@ -1217,12 +1218,9 @@ IImage8* Thumbnail::processImage (const procparams::ProcParams& params, int rhei
 
     // luminance histogram update
     if(params.labCurve.contrast != 0) {
-        hist16.clear();
-
-        for (int i = 0; i < fh; i++)
-            for (int j = 0; j < fw; j++) {
-                hist16[(int)((labView->L[i][j]))]++;
-            }
+        HistogramEngine histograms;
+        histograms.requestL (hist16, hist16.getSize());
+        histograms.compute (labView, nullptr, 0, 0, fw, fh, false);
     }
 
     // luminance processing
@@ -1735,45 +1733,35 @@ unsigned char* Thumbnail::getGrayscaleHistEQ (int trim_width)
     return tmpdata;
 }
 
-bool Thumbnail::writeImage (const Glib::ustring& fname, int format)
+bool Thumbnail::writeImage (std::string& data)
 {
 
     if (!thumbImg) {
         return false;
     }
 
-    Glib::ustring fullFName = fname + ".rtti";
-
-    FILE* f = g_fopen (fullFName.c_str (), "wb");
-
-    if (!f) {
-        return false;
-    }
-
-    fwrite (thumbImg->getType(), sizeof (char), strlen(thumbImg->getType()), f);
-    fputc ('\n', f);
+    data = thumbImg->getType();
+    data += '\n';
     guint32 w = guint32(thumbImg->getWidth());
     guint32 h = guint32(thumbImg->getHeight());
-    fwrite (&w, sizeof (guint32), 1, f);
-    fwrite (&h, sizeof (guint32), 1, f);
+    data.append (reinterpret_cast<const char*>(&w), sizeof (guint32));
+    data.append (reinterpret_cast<const char*>(&h), sizeof (guint32));
 
     if (thumbImg->getType() == sImage8) {
         Image8 *image = static_cast<Image8*>(thumbImg);
-        image->writeData(f);
+        image->writeData(data);
     } else if (thumbImg->getType() == sImage16) {
         Image16 *image = static_cast<Image16*>(thumbImg);
-        image->writeData(f);
+        image->writeData(data);
     } else if (thumbImg->getType() == sImagefloat) {
         Imagefloat *image = static_cast<Imagefloat*>(thumbImg);
-        image->writeData(f);
+        image->writeData(data);
     }
 
-    //thumbImg->writeData(f);
-    fclose (f);
     return true;
 }
 
-bool Thumbnail::readImage (const Glib::ustring& fname)
+bool Thumbnail::readImage (const std::string& data)
 {
 
     if (thumbImg) {
@@ -1781,65 +1769,60 @@ bool Thumbnail::readImage (const Glib::ustring& fname)
         thumbImg = nullptr;
     }
 
-    Glib::ustring fullFName = fname + ".rtti";
-
-    if (!Glib::file_test (fullFName, Glib::FILE_TEST_EXISTS)) {
-        return false;
-    }
-
-    FILE* f = g_fopen (fullFName.c_str (), "rb");
+    const std::size_t typeLength = data.find ('\n');
 
-    if (!f) {
+    if (typeLength == std::string::npos || data.size () < typeLength + 1 + 2 * sizeof (guint32)) {
         return false;
     }
 
-    char imgType[31];  // 30 -> arbitrary size, but should be enough for all image type's name
-    fgets(imgType, 30, f);
-    imgType[strlen(imgType) - 1] = '\0'; // imgType has a \n trailing character, so we overwrite it by the \0 char
+    const std::string imgType = data.substr (0, typeLength);
+    const char* pos = data.data () + typeLength + 1;
 
     guint32 width, height;
-    fread (&width, 1, sizeof (guint32), f);
-    fread (&height, 1, sizeof (guint32), f);
+    memcpy (&width, pos, sizeof (guint32));
+    memcpy (&height, pos + sizeof (guint32), sizeof (guint32));
+    pos += 2 * sizeof (guint32);
+
+    const std::size_t pixels = std::size_t(width) * height * 3;
+    const std::size_t available = data.data () + data.size () - pos;
 
     bool success = false;
 
-    if (!strcmp(imgType, sImage8)) {
-        Image8 *image = new Image8(width, height);
-        image->readData(f);
-        thumbImg = image;
-        success = true;
-    } else if (!strcmp(imgType, sImage16)) {
-        Image16 *image = new Image16(width, height);
-        image->readData(f);
-        thumbImg = image;
-        success = true;
-    } else if (!strcmp(imgType, sImagefloat)) {
-        Imagefloat *image = new Imagefloat(width, height);
-        image->readData(f);
-        thumbImg = image;
-        success = true;
+    if (imgType == sImage8) {
+        if (available >= pixels * sizeof (unsigned char)) {
+            Image8 *image = new Image8(width, height);
+            image->readData(pos);
+            thumbImg = image;
+            success = true;
+        }
+    } else if (imgType == sImage16) {
+        if (available >= pixels * sizeof (unsigned short)) {
+            Image16 *image = new Image16(width, height);
+            image->readData(pos);
+            thumbImg = image;
+            success = true;
+        }
+    } else if (imgType == sImagefloat) {
+        if (available >= pixels * sizeof (float)) {
+            Imagefloat *image = new Imagefloat(width, height);
+            image->readData(pos);
+            thumbImg = image;
+            success = true;
+        }
     } else {
-        printf("readImage: Unsupported image type \"%s\"!\n", imgType);
+        printf("readImage: Unsupported image type \"%s\"!\n", imgType.c_str());
     }
 
-    fclose(f);
     return success;
 }
 
-bool Thumbnail::readData  (const Glib::ustring& fname)
+bool Thumbnail::readData  (const Glib::KeyFile& keyFile)
 {
     setlocale(LC_NUMERIC, "C"); // to set decimal point to "."
-    Glib::KeyFile keyFile;
 
     try {
         MyMutex::MyLock thmbLock(thumbMutex);
 
-        try {
-            keyFile.load_from_file (fname);
-        } catch (Glib::Error&) {
-            return false;
-        }
-
         if (keyFile.has_group ("LiveThumbData")) {
             if (keyFile.has_key ("LiveThumbData", "CamWBRed")) {
                 camwbRed            = keyFile.get_double ("LiveThumbData", "CamWBRed");
@@ -1899,43 +1882,38 @@ bool Thumbnail::readData  (const Glib::ustring& fname)
 
             if (keyFile.has_key ("LiveThumbData", "ColorMatrix")) {
                 std::vector<double> cm = keyFile.get_double_list ("LiveThumbData", "ColorMatrix");
-                int ix = 0;
 
-                for (int i = 0; i < 3; i++)
-                    for (int j = 0; j < 3; j++) {
-                        colorMatrix[i][j] = cm[ix++];
-                    }
+                if (cm.size () >= 9) {
+                    int ix = 0;
+
+                    for (int i = 0; i < 3; i++)
+                        for (int j = 0; j < 3; j++) {
+                            colorMatrix[i][j] = cm[ix++];
+                        }
+                }
             }
         }
 
         return true;
     } catch (Glib::Error &err) {
         if (options.rtSettings.verbose) {
-            printf("Thumbnail::readData / Error code %d while reading values from \"%s\":\n%s\n", err.code(), fname.c_str(), err.what().c_str());
+            printf("Thumbnail::readData / Error code %d while reading values:\n%s\n", err.code(), err.what().c_str());
         }
     } catch (...) {
         if (options.rtSettings.verbose) {
-            printf("Thumbnail::readData / Unknown exception while trying to load \"%s\"!\n", fname.c_str());
+            printf("Thumbnail::readData / Unknown exception while reading values!\n");
         }
     }
 
     return false;
 }
 
-bool Thumbnail::writeData  (const Glib::ustring& fname)
+bool Thumbnail::writeData  (Glib::KeyFile& keyFile)
 {
     MyMutex::MyLock thmbLock(thumbMutex);
 
-    Glib::ustring keyData;
-
     try {
 
-        Glib::KeyFile keyFile;
-
-        try {
-            keyFile.load_from_file (fname);
-        } catch (Glib::Error&) {}
-
         keyFile.set_double  ("LiveThumbData", "CamWBRed", camwbRed);
         keyFile.set_double  ("LiveThumbData", "CamWBGreen", camwbGreen);
         keyFile.set_double  ("LiveThumbData", "CamWBBlue", camwbBlue);
@@ -1953,109 +1931,72 @@ bool Thumbnail::writeData  (const Glib::ustring& fname)
         Glib::ArrayHandle<double> cm ((double*)colorMatrix, 9, Glib::OWNERSHIP_NONE);
         keyFile.set_double_list ("LiveThumbData", "ColorMatrix", cm);
 
-        keyData = keyFile.to_data ();
+        return true;
 
     } catch (Glib::Error& err) {
         if (options.rtSettings.verbose) {
-            printf("Thumbnail::writeData / Error code %d while reading values from \"%s\":\n%s\n", err.code(), fname.c_str(), err.what().c_str());
+            printf("Thumbnail::writeData / Error code %d while writing values:\n%s\n", err.code(), err.what().c_str());
         }
     } catch (...) {
         if (options.rtSettings.verbose) {
-            printf("Thumbnail::writeData / Unknown exception while trying to save \"%s\"!\n", fname.c_str());
-        }
-    }
-
-    if (keyData.empty ()) {
-        return false;
-    }
-
-    FILE *f = g_fopen (fname.c_str (), "wt");
-
-    if (!f) {
-        if (options.rtSettings.verbose) {
-            printf("Thumbnail::writeData / Error: unable to open file \"%s\" with write access!\n", fname.c_str());
+            printf("Thumbnail::writeData / Unknown exception while writing values!\n");
         }
-
-        return false;
-    } else {
-        fprintf (f, "%s", keyData.c_str ());
-        fclose (f);
     }
 
-    return true;
+    return false;
 }
 
-bool Thumbnail::readEmbProfile  (const Glib::ustring& fname)
+bool Thumbnail::readEmbProfile  (const std::string& data)
 {
 
     embProfileData = nullptr;
     embProfile = nullptr;
     embProfileLength = 0;
 
-    FILE* f = g_fopen (fname.c_str (), "rb");
-    if (f) {
-        if(!fseek (f, 0, SEEK_END)) {
-            int profileLength = ftell (f);
-            if(profileLength > 0) {
-                embProfileLength = profileLength;
-                if(!fseek (f, 0, SEEK_SET)) {
-                    embProfileData = new unsigned char[embProfileLength];
-                    fread (embProfileData, 1, embProfileLength, f);
-                    embProfile = cmsOpenProfileFromMem (embProfileData, embProfileLength);
-                }
-            }
-        }
-        fclose (f);
+    if (!data.empty ()) {
+        embProfileLength = data.size ();
+        embProfileData = new unsigned char[embProfileLength];
+        memcpy (embProfileData, data.data (), embProfileLength);
+        embProfile = cmsOpenProfileFromMem (embProfileData, embProfileLength);
         return embProfile != nullptr;
     }
 
     return false;
 }
 
-bool Thumbnail::writeEmbProfile (const Glib::ustring& fname)
+bool Thumbnail::writeEmbProfile (std::string& data)
 {
 
     if (embProfileData) {
-        FILE* f = g_fopen(fname.c_str (), "wb");
-
-        if (f) {
-            fwrite (embProfileData, 1, embProfileLength, f);
-            fclose (f);
-            return true;
-        }
+        data.assign (reinterpret_cast<const char*>(embProfileData), embProfileLength);
+        return true;
     }
 
     return false;
 }
 
-bool Thumbnail::readAEHistogram  (const Glib::ustring& fname)
+bool Thumbnail::readAEHistogram  (const std::string& data)
 {
 
-    FILE* f = g_fopen (fname.c_str (), "rb");
+    const std::size_t length = (65536 >> aeHistCompression) * sizeof(aeHistogram[0]);
 
-    if (!f) {
+    if (data.size () < length) {
         aeHistogram(0);
     } else {
         aeHistogram(65536 >> aeHistCompression);
-        fread (&aeHistogram[0], 1, (65536 >> aeHistCompression)*sizeof(aeHistogram[0]), f);
-        fclose (f);
+        memcpy (&aeHistogram[0], data.data (), length);
         return true;
     }
 
     return false;
 }
 
-bool Thumbnail::writeAEHistogram (const Glib::ustring& fname)
+bool Thumbnail::writeAEHistogram (std::string& data)
 {
 
     if (aeHistogram) {
-        FILE* f = g_fopen (fname.c_str (), "wb");
-
-        if (f) {
-            fwrite (&aeHistogram[0], 1, (65536 >> aeHistCompression)*sizeof(aeHistogram[0]), f);
-            fclose (f);
-            return true;
-        }
+        data.assign (reinterpret_cast<const char*>(&aeHistogram[0]), (65536 >> aeHistCompression) * sizeof(aeHistogram[0]));
+        return true;
     }
 
     return false;
@@ -89,17 +89,19 @@ public:
     void applyAutoExp (procparams::ProcParams& pparams);
 
     unsigned char* getGrayscaleHistEQ (int trim_width);
-    bool writeImage (const Glib::ustring& fname, int format);
-    bool readImage (const Glib::ustring& fname);
 
-    bool readData  (const Glib::ustring& fname);
-    bool writeData  (const Glib::ustring& fname);
+    // (de)serialization of the cached sections, see CacheIndex in rtgui
+    bool writeImage (std::string& data);
+    bool readImage (const std::string& data);
 
-    bool readEmbProfile  (const Glib::ustring& fname);
-    bool writeEmbProfile (const Glib::ustring& fname);
+    bool readData  (const Glib::KeyFile& keyFile);
+    bool writeData  (Glib::KeyFile& keyFile);
 
-    bool readAEHistogram  (const Glib::ustring& fname);
-    bool writeAEHistogram (const Glib::ustring& fname);
+    bool readEmbProfile  (const std::string& data);
+    bool writeEmbProfile (std::string& data);
+
+    bool readAEHistogram  (const std::string& data);
+    bool writeAEHistogram (std::string& data);
 
     unsigned char* getImage8Data();  // accessor to the 8bit image if it is one, which should be the case for the "Inspector" mode.
 
@@ -37,6 +37,7 @@ public:
     int             leveldnaut;             // level of auto denoise
     int             leveldnliss;            // level of auto multi zone
     int             leveldnautsimpl;            // STD or EXPERT
+    int             resizeBoxPrefilter;         // downscale factor from which the Lanczos resize is preceded by a box filter, 0 = never
 
     Glib::ustring   printerProfile;         ///< ICC profile name used for soft-proofing a printer output
     RenderingIntent printerIntent;          ///< Colorimetric intent used with the above profile
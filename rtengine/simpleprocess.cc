@@ -20,6 +20,7 @@
 #include "colortemp.h"
 #include "imagesource.h"
 #include "improcfun.h"
+#include "histogramengine.h"
 #include "curves.h"
 #include "iccstore.h"
 #include "clutstore.h"
@@ -29,6 +30,8 @@
 #include "rawimagesource.h"
 #include "../rtgui/multilangmgr.h"
 #include "mytime.h"
+#include "tiledlabprocessor.h"
+#include "pipelineprofiler.h"
 #undef THREAD_PRIORITY_NORMAL
 
 namespace rtengine
@@ -37,6 +40,35 @@ extern const Settings* settings;
 
 namespace {
 
+// approximate number of pixels of the bands the Lab operators are run on in processImage
+const int labBandPixels = 4 * 1024 * 1024;
+
+// spatial support of the CBDL pyramid: 5x5 kernels spaced by 1, 2, 4, 8, 16 and 32 pixels,
+// plus some context for the artifact removal done when gamutlab is set
+const int cbdlHalo = 2 * (1 + 2 + 4 + 8 + 16 + 32) + 32;
+
+// spatial support of gaussianBlur(), truncated at 4 sigma
+int blurHalo(double sigma)
+{
+    return ceil(4.0 * sigma) + 1;
+}
+
+int sharpeningHalo(const SharpeningParams &sharpenParam)
+{
+    if (sharpenParam.method == "rld") {
+        // two blurs per iteration
+        return 2 * sharpenParam.deconviter * blurHalo(sharpenParam.deconvradius);
+    }
+
+    int halo = blurHalo(sharpenParam.radius) + 2; // + 2 for the halo control window
+
+    if (sharpenParam.edgesonly) {
+        halo += blurHalo(sharpenParam.edges_radius);
+    }
+
+    return halo;
+}
+
 template <typename T>
 void adjust_radius(const T &default_param, double scale_factor, T &param)
 {
@@ -44,6 +76,145 @@ void adjust_radius(const T &default_param, double scale_factor, T &param)
     param = default_param + delta;
 }
 
+// Where the fast export brings the image down to the output size, in pipeline order
+enum class ResizePoint {
+    BEFORE_DENOISE, // right after the geometric transformations
+    BEFORE_LAB,     // after the RGB denoise, before the conversion to Lab
+    OUTPUT          // at the end, like the normal export
+};
+
+// How a tool copes with running on the image downscaled by the fast export
+enum class ScaleSupport {
+    ANY,            // sized relatively to the image, or told the scale through the preview's 'skip'
+    ADJUSTED,       // its spatial parameters are scaled by adjust()
+    FULL_RESOLUTION // needs the original pixels
+};
+
+// A tool with a spatial extent, as seen by the fast export planner. The per pixel tools run the same
+// at any scale and are not listed.
+struct ScaledTool {
+    ResizePoint position; // the last resize point before the tool
+    bool (*enabled)(const procparams::ProcParams &params);
+    ScaleSupport (*support)(const procparams::ProcParams &params);
+    void (*adjust)(procparams::ProcParams &params, double scale_factor);
+};
+
+void adjustDenoise(procparams::ProcParams &params, double scale_factor)
+{
+    params.dirpyrDenoise.luma *= scale_factor;
+    //params.dirpyrDenoise.Ldetail += (100 - params.dirpyrDenoise.Ldetail) * scale_factor;
+    auto &lcurve = params.dirpyrDenoise.lcurve;
+    for (size_t i = 2; i < lcurve.size(); i += 4) {
+        lcurve[i] *= min(scale_factor * 2, 1.0);
+    }
+    const char *medmethods[] = { "soft", "33", "55soft", "55", "77", "99", "1515", "2525" };
+    if (params.dirpyrDenoise.median) {
+        auto &key = params.dirpyrDenoise.methodmed == "RGB" ? params.dirpyrDenoise.rgbmethod : params.dirpyrDenoise.medmethod;
+        for (int i = 1; i < int(sizeof(medmethods)/sizeof(const char *)); ++i) {
+            if (key == medmethods[i]) {
+                int j = i - int(1.0 / scale_factor);
+                if (j < 0) {
+                    params.dirpyrDenoise.median = false;
+                } else {
+                    key = medmethods[j];
+                }
+                break;
+            }
+        }
+    }
+}
+
+void adjustSharpening(procparams::ProcParams &params, double scale_factor)
+{
+    // the post-resize sharpening is meant for the output pixels
+    if (params.prsharpening.enabled) {
+        params.sharpening = params.prsharpening;
+    } else {
+        const procparams::ProcParams defaults;
+        adjust_radius(defaults.sharpening.radius, scale_factor, params.sharpening.radius);
+        adjust_radius(defaults.sharpening.deconvradius, scale_factor, params.sharpening.deconvradius);
+    }
+}
+
+const ScaledTool scaledTools[] = {
+    { // RGB denoise; the automatic chroma modes measure the noise of the original pixels
+        ResizePoint::BEFORE_DENOISE,
+        [](const procparams::ProcParams &params) { return params.dirpyrDenoise.enabled; },
+        [](const procparams::ProcParams &params) -> ScaleSupport {
+            const bool manual = (settings->leveldnautsimpl == 1 && params.dirpyrDenoise.Cmethod == "MAN") || (settings->leveldnautsimpl == 0 && params.dirpyrDenoise.C2method == "MANU");
+            return manual ? ScaleSupport::ADJUSTED : ScaleSupport::FULL_RESOLUTION;
+        },
+        adjustDenoise
+    },
+    { // contrast by detail levels
+        ResizePoint::BEFORE_LAB,
+        [](const procparams::ProcParams &params) { return params.dirpyrequalizer.enabled; },
+        [](const procparams::ProcParams &) { return ScaleSupport::ANY; },
+        nullptr
+    },
+    { // shadows/highlights, whose radius is relative to the image unless in HQ mode
+        ResizePoint::BEFORE_LAB,
+        [](const procparams::ProcParams &params) { return params.sh.enabled; },
+        [](const procparams::ProcParams &) { return ScaleSupport::ANY; },
+        nullptr
+    },
+    { // edge preserving decomposition tone mapping
+        ResizePoint::BEFORE_LAB,
+        [](const procparams::ProcParams &params) { return params.epd.enabled; },
+        [](const procparams::ProcParams &) { return ScaleSupport::ADJUSTED; },
+        [](procparams::ProcParams &params, double scale_factor) { params.epd.scale *= scale_factor; }
+    },
+    { // impulse denoise, of no use once the pixels are averaged enough
+        ResizePoint::BEFORE_LAB,
+        [](const procparams::ProcParams &params) { return params.impulseDenoise.enabled; },
+        [](const procparams::ProcParams &) { return ScaleSupport::ADJUSTED; },
+        [](procparams::ProcParams &params, double scale_factor) {
+            params.impulseDenoise.thresh *= scale_factor;
+            if (scale_factor < 0.5) {
+                params.impulseDenoise.enabled = false;
+            }
+        }
+    },
+    { // defringe
+        ResizePoint::BEFORE_LAB,
+        [](const procparams::ProcParams &params) { return params.defringe.enabled; },
+        [](const procparams::ProcParams &) { return ScaleSupport::ADJUSTED; },
+        [](procparams::ProcParams &params, double scale_factor) {
+            adjust_radius(procparams::ProcParams().defringe.radius, scale_factor, params.defringe.radius);
+        }
+    },
+    { // edge sharpening, a fixed kernel
+        ResizePoint::BEFORE_LAB,
+        [](const procparams::ProcParams &params) { return params.sharpenEdge.enabled; },
+        [](const procparams::ProcParams &) { return ScaleSupport::FULL_RESOLUTION; },
+        nullptr
+    },
+    { // microcontrast, a fixed kernel
+        ResizePoint::BEFORE_LAB,
+        [](const procparams::ProcParams &params) { return params.sharpenMicro.enabled; },
+        [](const procparams::ProcParams &) { return ScaleSupport::FULL_RESOLUTION; },
+        nullptr
+    },
+    { // sharpening
+        ResizePoint::BEFORE_LAB,
+        [](const procparams::ProcParams &params) { return params.sharpening.enabled || params.prsharpening.enabled; },
+        [](const procparams::ProcParams &) { return ScaleSupport::ADJUSTED; },
+        adjustSharpening
+    },
+    { // wavelet levels
+        ResizePoint::BEFORE_LAB,
+        [](const procparams::ProcParams &params) { return params.wavelet.enabled; },
+        [](const procparams::ProcParams &) { return ScaleSupport::ANY; },
+        nullptr
+    },
+    { // CIECAM02
+        ResizePoint::BEFORE_LAB,
+        [](const procparams::ProcParams &params) { return params.colorappearance.enabled; },
+        [](const procparams::ProcParams &) { return ScaleSupport::ANY; },
+        nullptr
+    }
+};
+
 
 class ImageProcessor {
 public:
@@ -60,6 +231,8 @@ public:
         imgsrc(nullptr),
         fw(-1),
         fh(-1),
+        resize_point(ResizePoint::OUTPUT),
+        skip(1),
         pp(0, 0, 0, 0, 0)
     {
     }
@@ -96,8 +269,13 @@ private:
             return nullptr;
         }
         stage_transform();
-        stage_early_resize();
+        if (resize_point == ResizePoint::BEFORE_DENOISE) {
+            stage_early_resize();
+        }
         stage_denoise();
+        if (resize_point == ResizePoint::BEFORE_LAB) {
+            stage_early_resize();
+        }
         return stage_finish();
     }
 
@@ -113,6 +291,7 @@ private:
         ii = job->initialImage;
 
         if (!ii) {
+            PipelineProfiler::Stage loadStage("export", "load");
             ii = InitialImage::load (job->fname, job->isRaw, &errorCode);
 
             if (errorCode) {
@@ -164,9 +343,15 @@ private:
         ipf_p.reset(new ImProcFunctions(&params, true));
         ImProcFunctions &ipf = *(ipf_p.get());
 
+        if (job->fast) {
+            plan_early_resize();
+        }
+
         pp = PreviewProps(0, 0, fw, fh, 1);
         imgsrc->setCurrentFrame(params.raw.bayersensor.imageNum);
+        PipelineProfiler::Stage preprocessStage("export", "preprocess");
         imgsrc->preprocess( params.raw, params.lensProf, params.coarse, params.dirpyrDenoise.enabled);
+        preprocessStage.stop();
 
         if (params.toneCurve.autoexp) {// this enabled HLRecovery
             LUTu histRedRaw(256), histGreenRaw(256), histBlueRaw(256);
@@ -182,13 +367,16 @@ private:
             pl->setProgress (0.20);
         }
 
+        PipelineProfiler::Stage demosaicStage("export", "demosaic");
         imgsrc->demosaic( params.raw);
+        demosaicStage.stop();
 
         if (pl) {
             pl->setProgress (0.30);
         }
 
         if(params.retinex.enabled) { //enabled Retinex
+            PipelineProfiler::Stage retinexStage("export", "retinex");
             LUTf cdcurve (65536, 0);
             LUTf mapcurve (65536, 0);
             LUTu dummy;
@@ -227,6 +415,7 @@ private:
             currWB.update(rm, gm, bm, params.wb.equal, params.wb.tempBias);
         }
 
+        PipelineProfiler::Stage denoiseAnalysisStage("export", "denoise analysis");
         calclum = nullptr ;
         params.dirpyrDenoise.getCurves(noiseLCurve, noiseCCurve);
         autoNR = (float) settings->nrauto;//
@@ -693,8 +882,12 @@ private:
             //end evaluate noise
         }
 
+        denoiseAnalysisStage.stop();
+
+        PipelineProfiler::Stage getImageStage("export", "raw to rgb");
         baseImg = new Imagefloat (fw, fh);
         imgsrc->getImage (currWB, tr, baseImg, pp, params.toneCurve, params.icm, params.raw);
+        getImageStage.stop();
 
         if (pl) {
             pl->setProgress (0.50);
@@ -730,6 +923,7 @@ private:
 
     void stage_denoise()
     {
+        PipelineProfiler::Stage profilerStage("export", "denoise");
         procparams::ProcParams& params = job->pparams;
         //ImProcFunctions ipf (&params, true);
         ImProcFunctions &ipf = *(ipf_p.get());
@@ -795,6 +989,7 @@ private:
 
     void stage_transform()
     {
+        PipelineProfiler::Stage profilerStage("export", "transform");
         procparams::ProcParams& params = job->pparams;
         //ImProcFunctions ipf (&params, true);
         ImProcFunctions &ipf = *(ipf_p.get());
@@ -829,10 +1024,12 @@ private:
             const int H = baseImg->getHeight();
             LabImage labcbdl(W, H);
             ipf.rgb2lab(*baseImg, labcbdl, params.icm.working);
-            ipf.dirpyrequalizer (&labcbdl, 1);
+            ipf.dirpyrequalizer (&labcbdl, skip);
             ipf.lab2rgb(labcbdl, *baseImg, params.icm.working);
         }
 
+        PipelineProfiler::Stage rgbProcStage("export", "rgbProc");
+
         // update blurmap
         SHMap* shmap = nullptr;
 
@@ -845,7 +1042,7 @@ private:
                 shradius *= radius / 1800.0;
             }
 
-            shmap->update (baseImg, shradius, ipf.lumimul, params.sh.hq, 1);
+            shmap->update (baseImg, shradius, ipf.lumimul, params.sh.hq, skip);
         }
 
         // RGB processing
@@ -929,6 +1126,8 @@ private:
 
         ipf.rgbProc (baseImg, labView, nullptr, curve1, curve2, curve, shmap, params.toneCurve.saturation, rCurve, gCurve, bCurve, satLimit , satLimitOpacity, ctColorCurve, ctOpacityCurve, opautili, clToningcurve, cl2Toningcurve, customToneCurve1, customToneCurve2, customToneCurvebw1, customToneCurvebw2, rrm, ggm, bbm, autor, autog, autob, expcomp, hlcompr, hlcomprthresh, dcpProf, as, histToneCurve);
 
+        rgbProcStage.stop();
+
         if (settings->verbose) {
             printf("Output image / Auto B&W coefs:   R=%.2f   G=%.2f   B=%.2f\n", autor, autog, autob);
         }
@@ -968,28 +1167,9 @@ private:
 
 
         if(params.labCurve.contrast != 0) { //only use hist16 for contrast
-            hist16.clear();
-
-#ifdef _OPENMP
-#pragma omp parallel
-#endif
-            {
-                LUTu hist16thr (hist16.getSize());  // one temporary lookup table per thread
-                hist16thr.clear();
-#ifdef _OPENMP
-#pragma omp for schedule(static) nowait
-#endif
-
-                for (int i = 0; i < fh; i++)
-                    for (int j = 0; j < fw; j++) {
-                        hist16thr[(int)((labView->L[i][j]))]++;
-                    }
-
-#pragma omp critical
-                {
-                    hist16 += hist16thr;
-                }
-            }
+            HistogramEngine histograms;
+            histograms.requestL (hist16, hist16.getSize());
+            histograms.compute (labView, nullptr, 0, 0, fw, fh);
         }
 
         bool utili;
@@ -1002,52 +1182,85 @@ private:
         CurveFactory::complexsgnCurve (autili, butili, ccutili, cclutili, params.labCurve.acurve, params.labCurve.bcurve, params.labCurve.cccurve,
                                        params.labCurve.lccurve, curve1, curve2, satcurve, lhskcurve, 1);
 
-        ipf.chromiLuminanceCurve (nullptr, 1, labView, labView, curve1, curve2, satcurve, lhskcurve, clcurve, lumacurve, utili, autili, butili, ccutili, cclutili, clcutili, dummy, dummy);
+        // The Lab operators up to CBDL are run band by band, so that their temporary buffers do not
+        // scale with the size of the image (see TiledLabProcessor)
+        TiledLabProcessor labProcessor(labBandPixels);
+        const bool cieOff = (params.colorappearance.enabled && !settings->autocielab) || !params.colorappearance.enabled;
 
-        if((params.colorappearance.enabled && !params.colorappearance.tonecie) || (!params.colorappearance.enabled)) {
-            ipf.EPDToneMap(labView, 5, 1);
-        }
+        labProcessor.addLocal([&](LabImage* band) {
+            ipf.chromiLuminanceCurve (nullptr, 1, band, band, curve1, curve2, satcurve, lhskcurve, clcurve, lumacurve, utili, autili, butili, ccutili, cclutili, clcutili, dummy, dummy);
+        }, 0);
 
+        if(params.epd.enabled && ((params.colorappearance.enabled && !params.colorappearance.tonecie) || (!params.colorappearance.enabled))) {
+            labProcessor.addGlobal([&](LabImage* lab) {
+                ipf.EPDToneMap(lab, 5, 1);
+            });
+        }
 
-        ipf.vibrance(labView);
+        labProcessor.addLocal([&](LabImage* band) {
+            ipf.vibrance(band);
+        }, 0);
 
-        if((params.colorappearance.enabled && !settings->autocielab) || (!params.colorappearance.enabled)) {
-            ipf.impulsedenoise (labView);
+        if(cieOff && params.impulseDenoise.enabled) {
+            labProcessor.addLocal([&](LabImage* band) {
+                ipf.impulsedenoise (band);
+            }, blurHalo(max(2.0, params.impulseDenoise.thresh / 20.0 - 1.0)) + 4);
         }
 
         // for all treatments Defringe, Sharpening, Contrast detail ,Microcontrast they are activated if "CIECAM" function are disabled
 
-        if((params.colorappearance.enabled && !settings->autocielab) || (!params.colorappearance.enabled)) {
-            ipf.defringe (labView);
+        double defringeChroma = 0.0;
+
+        if(cieOff && params.defringe.enabled) {
+            const int halfwin = ceil(2 * params.defringe.radius) + 1;
+            labProcessor.addAnalysed([&](LabImage* band, int firstRow, int lastRow) {
+                defringeChroma += ipf.defringeChromaSum (band, firstRow, lastRow);
+            }, [&](LabImage* band) {
+                ipf.defringe (band, defringeChroma / (double(fw) * fh));
+            }, blurHalo(params.defringe.radius) + halfwin);
         }
 
         if (params.sharpenEdge.enabled) {
-            ipf.MLsharpen(labView);
+            labProcessor.addLocal([&](LabImage* band) {
+                ipf.MLsharpen(band);
+            }, 2 * params.sharpenEdge.passes + 2);
         }
 
-        if (params.sharpenMicro.enabled) {
-            if((params.colorappearance.enabled && !settings->autocielab) ||  (!params.colorappearance.enabled)) {
-                ipf.MLmicrocontrast (labView);    //!params.colorappearance.sharpcie
-            }
+        if (params.sharpenMicro.enabled && cieOff) {
+            labProcessor.addLocal([&](LabImage* band) {
+                ipf.MLmicrocontrast (band);    //!params.colorappearance.sharpcie
+            }, 4);
         }
 
-        if(((params.colorappearance.enabled && !settings->autocielab) || (!params.colorappearance.enabled)) && params.sharpening.enabled) {
+        if(cieOff && params.sharpening.enabled) {
+            labProcessor.addLocal([&](LabImage* band) {
+                float **buffer = new float*[band->H];
 
-            float **buffer = new float*[fh];
+                for (int i = 0; i < band->H; i++) {
+                    buffer[i] = new float[band->W];
+                }
 
-            for (int i = 0; i < fh; i++) {
-                buffer[i] = new float[fw];
-            }
+                ipf.sharpening (band, (float**)buffer, params.sharpening);
 
-            ipf.sharpening (labView, (float**)buffer, params.sharpening);
+                for (int i = 0; i < band->H; i++) {
+                    delete [] buffer[i];
+                }
 
-            for (int i = 0; i < fh; i++) {
-                delete [] buffer[i];
-            }
+                delete [] buffer;
+            }, sharpeningHalo(params.sharpening));
+        }
 
-            delete [] buffer;
+        // directional pyramid wavelet
+        if(params.dirpyrequalizer.cbdlMethod == "aft" && cieOff && params.dirpyrequalizer.enabled) {
+            labProcessor.addLocal([&](LabImage* band) {
+                ipf.dirpyrequalizer (band, skip);    //TODO: this is the luminance tonecurve, not the RGB one
+            }, cbdlHalo);
         }
 
+        PipelineProfiler::Stage labStage("export", "lab ops");
+        labProcessor.run(labView);
+        labStage.stop();
+
         WaveletParams WaveParams = params.wavelet;
         WavCurve wavCLVCurve;
         WavOpacityCurveRG waOpacityCurveRG;
@@ -1057,20 +1270,13 @@ private:
 
         params.wavelet.getCurves(wavCLVCurve, waOpacityCurveRG, waOpacityCurveBY, waOpacityCurveW, waOpacityCurveWL );
 
-
-        // directional pyramid wavelet
-        if(params.dirpyrequalizer.cbdlMethod == "aft") {
-            if((params.colorappearance.enabled && !settings->autocielab)  || !params.colorappearance.enabled) {
-                ipf.dirpyrequalizer (labView, 1);    //TODO: this is the luminance tonecurve, not the RGB one
-            }
-        }
-
         bool wavcontlutili = false;
 
         CurveFactory::curveWavContL(wavcontlutili, params.wavelet.wavclCurve, wavclCurve,/* hist16C, dummy,*/ 1);
 
         if(params.wavelet.enabled) {
-            ipf.ip_wavelet(labView, labView, 2, WaveParams, wavCLVCurve, waOpacityCurveRG, waOpacityCurveBY, waOpacityCurveW,  waOpacityCurveWL, wavclCurve, wavcontlutili, 1);
+            PipelineProfiler::Stage waveletStage("export", "wavelet");
+            ipf.ip_wavelet(labView, labView, 2, WaveParams, wavCLVCurve, waOpacityCurveRG, waOpacityCurveBY, waOpacityCurveW,  waOpacityCurveWL, wavclCurve, wavcontlutili, skip);
         }
 
         wavCLVCurve.Reset();
@@ -1100,6 +1306,7 @@ private:
             1);
 
         if(params.colorappearance.enabled) {
+            PipelineProfiler::Stage ciecamStage("export", "ciecam");
             double adap;
             float fnum = imgsrc->getMetaData()->getFNumber  ();// F number
             float fiso = imgsrc->getMetaData()->getISOSpeed () ;// ISO
@@ -1123,18 +1330,18 @@ private:
             if (params.sharpening.enabled) {
                 if(settings->ciecamfloat) {
                     float d;
-                    ipf.ciecam_02float (cieView, float(adap), begh, endh, 1, 2, labView, &params, customColCurve1, customColCurve2, customColCurve3, dummy, dummy, CAMBrightCurveJ, CAMBrightCurveQ, CAMMean, 5, 1, true, d, 1, 1);
+                    ipf.ciecam_02float (cieView, float(adap), begh, endh, 1, 2, labView, &params, customColCurve1, customColCurve2, customColCurve3, dummy, dummy, CAMBrightCurveJ, CAMBrightCurveQ, CAMMean, 5, 1, true, d, skip, 1);
                 } else {
                     double dd;
-                    ipf.ciecam_02 (cieView, adap, begh, endh, 1, 2, labView, &params, customColCurve1, customColCurve2, customColCurve3, dummy, dummy, CAMBrightCurveJ, CAMBrightCurveQ, CAMMean, 5, 1, true, dd, 1, 1);
+                    ipf.ciecam_02 (cieView, adap, begh, endh, 1, 2, labView, &params, customColCurve1, customColCurve2, customColCurve3, dummy, dummy, CAMBrightCurveJ, CAMBrightCurveQ, CAMMean, 5, 1, true, dd, skip, 1);
                 }
             } else {
                 if(settings->ciecamfloat) {
                     float d;
-                    ipf.ciecam_02float (cieView, float(adap), begh, endh, 1, 2, labView, &params, customColCurve1, customColCurve2, customColCurve3, dummy, dummy, CAMBrightCurveJ, CAMBrightCurveQ, CAMMean, 5, 1, true, d, 1, 1);
+                    ipf.ciecam_02float (cieView, float(adap), begh, endh, 1, 2, labView, &params, customColCurve1, customColCurve2, customColCurve3, dummy, dummy, CAMBrightCurveJ, CAMBrightCurveQ, CAMMean, 5, 1, true, d, skip, 1);
                 } else {
                     double dd;
-                    ipf.ciecam_02 (cieView, adap, begh, endh, 1, 2, labView, &params, customColCurve1, customColCurve2, customColCurve3, dummy, dummy, CAMBrightCurveJ, CAMBrightCurveQ, CAMMean, 5, 1, true, dd, 1, 1);
+                    ipf.ciecam_02 (cieView, adap, begh, endh, 1, 2, labView, &params, customColCurve1, customColCurve2, customColCurve3, dummy, dummy, CAMBrightCurveJ, CAMBrightCurveQ, CAMMean, 5, 1, true, dd, skip, 1);
                 }
             }
         }
@@ -1186,6 +1393,7 @@ private:
         }
 
         if (labResize) { // resize lab data
+            PipelineProfiler::Stage resizeStage("export", "resize");
             // resize image
             tmplab = new LabImage(imw, imh);
             ipf.Lanczos (labView, tmplab, tmpScale);
@@ -1221,6 +1429,7 @@ private:
         bool customGamma = false;
         bool useLCMS = false;
         bool bwonly = params.blackwhite.enabled && !params.colorToning.enabled && !autili && !butili ;
+        PipelineProfiler::Stage outputStage("export", "output conversion");
 
         if(params.icm.gamma != "default" || params.icm.freegamma) { // if select gamma output between BT709, sRGB, linear, low, high, 2.2 , 1.8
 
@@ -1249,6 +1458,7 @@ private:
 
         delete labView;
         labView = nullptr;
+        outputStage.stop();
 
 
 
@@ -1270,6 +1480,7 @@ private:
         }
 
         if (tmpScale != 1.0 && params.resize.method == "Nearest") { // resize rgb data (gamma applied)
+            PipelineProfiler::Stage resizeStage("export", "resize");
             Image16* tempImage = new Image16 (imw, imh);
             ipf.resize (readyImg, tempImage, tmpScale);
             delete readyImg;
@@ -1346,6 +1557,7 @@ private:
 
     void stage_early_resize()
     {
+        PipelineProfiler::Stage profilerStage("export", "early resize");
         procparams::ProcParams& params = job->pparams;
         //ImProcFunctions ipf (&params, true);
         ImProcFunctions &ipf = *(ipf_p.get());
@@ -1384,7 +1596,8 @@ private:
             tmplab = std::move(resized);
         }
 
-        adjust_procparams(scale_factor);
+        params.resize.enabled = false;
+        params.crop.enabled = false;
 
         fw = imw;
         fh = imh;
@@ -1394,62 +1607,42 @@ private:
         ipf.lab2rgb(*tmplab, *baseImg, params.icm.working);
     }
 
-    void adjust_procparams(double scale_factor)
+    // Chooses where the fast export downscales the image: as early as the enabled tools allow, their
+    // parameters being adjusted to the scale they will run at
+    void plan_early_resize()
     {
         procparams::ProcParams &params = job->pparams;
-        procparams::ProcParams defaultparams;
 
-        params.resize.enabled = false;
-        params.crop.enabled = false;
+        int imw, imh;
+        const double scale_factor = ipf_p->resizeScale(&params, fw, fh, imw, imh);
 
-        if (params.prsharpening.enabled) {
-            params.sharpening = params.prsharpening;
-        } else {
-            adjust_radius(defaultparams.sharpening.radius, scale_factor,
-                          params.sharpening.radius);
-        }
-        params.impulseDenoise.thresh *= scale_factor;
-        if (scale_factor < 0.5) {
-            params.impulseDenoise.enabled = false;
-        }
-        params.wavelet.strength *= scale_factor;
-        params.dirpyrDenoise.luma *= scale_factor;
-        //params.dirpyrDenoise.Ldetail += (100 - params.dirpyrDenoise.Ldetail) * scale_factor;
-        auto &lcurve = params.dirpyrDenoise.lcurve;
-        for (size_t i = 2; i < lcurve.size(); i += 4) {
-            lcurve[i] *= min(scale_factor * 2, 1.0);
-        }
-        noiseLCurve.Set(lcurve);
-        const char *medmethods[] = { "soft", "33", "55soft", "55", "77", "99" };
-        if (params.dirpyrDenoise.median) {
-            auto &key = params.dirpyrDenoise.methodmed == "RGB" ? params.dirpyrDenoise.rgbmethod : params.dirpyrDenoise.medmethod;
-            for (int i = 1; i < int(sizeof(medmethods)/sizeof(const char *)); ++i) {
-                if (key == medmethods[i]) {
-                    int j = i - int(1.0 / scale_factor);
-                    if (j < 0) {
-                        params.dirpyrDenoise.median = false;
-                    } else {
-                        key = medmethods[j];
-                    }
-                    break;
-                }
+        if (scale_factor >= 1.0) {
+            // processing an upscaled image would only be slower
+            resize_point = ResizePoint::OUTPUT;
+            return;
+        }
+
+        resize_point = ResizePoint::BEFORE_DENOISE;
+
+        for (const auto &tool : scaledTools) {
+            if (tool.position >= resize_point && tool.enabled(params) && tool.support(params) == ScaleSupport::FULL_RESOLUTION) {
+                resize_point = static_cast<ResizePoint>(static_cast<int>(tool.position) + 1);
             }
         }
 
-        params.epd.scale *= scale_factor;
-        //params.epd.edgeStopping *= scale_factor;
+        if (resize_point == ResizePoint::OUTPUT) {
+            return;
+        }
 
-        const double dirpyreq_scale = min(scale_factor * 1.5, 1.0);
-        for (int i = 0; i < 6; ++i) {
-            adjust_radius(defaultparams.dirpyrequalizer.mult[i], dirpyreq_scale,
-                          params.dirpyrequalizer.mult[i]);
+        for (const auto &tool : scaledTools) {
+            if (tool.position >= resize_point && tool.enabled(params) && tool.support(params) == ScaleSupport::ADJUSTED) {
+                tool.adjust(params, scale_factor);
+            }
         }
-        params.dirpyrequalizer.threshold *= scale_factor;
 
-        adjust_radius(defaultparams.defringe.radius, scale_factor,
-                      params.defringe.radius);
-        adjust_radius(defaultparams.sh.radius, scale_factor, params.sh.radius);
+        skip = max(1, static_cast<int>(1.0 / scale_factor + 0.5));
 
+        // the demosaicing still runs on the full image, but its finest details will not survive the resize
         if (params.raw.xtranssensor.method ==
             procparams::RAWParams::XTransSensor::methodstring[
                 procparams::RAWParams::XTransSensor::threePass]) {
@@ -1476,6 +1669,10 @@ private:
     int fw;
     int fh;
 
+    // where the fast export resizes, and the matching scale of the preview for the multi-scale tools
+    ResizePoint resize_point;
+    int skip;
+
     int tr;
     PreviewProps pp;
 
@@ -1542,6 +1739,7 @@ private:
 
 IImage16* processImage (ProcessingJob* pjob, int& errorCode, ProgressListener* pl, bool tunnelMetaData, bool flush)
 {
+    PipelineProfiler::Stage profilerStage("export", "total");
     ImageProcessor proc(pjob, errorCode, pl, tunnelMetaData, flush);
     return proc();
 }
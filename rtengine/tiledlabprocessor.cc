@@ -0,0 +1,177 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include "tiledlabprocessor.h"
+#include "labimage.h"
+
+namespace
+{
+
+void copyRows (const rtengine::LabImage* src, int srcRow, rtengine::LabImage* dst, int dstRow, int rows)
+{
+    const size_t rowSize = src->W * sizeof(float);
+
+#ifdef _OPENMP
+    #pragma omp parallel for if (rows > 64)
+#endif
+
+    for (int i = 0; i < rows; ++i) {
+        memcpy(dst->L[dstRow + i], src->L[srcRow + i], rowSize);
+        memcpy(dst->a[dstRow + i], src->a[srcRow + i], rowSize);
+        memcpy(dst->b[dstRow + i], src->b[srcRow + i], rowSize);
+    }
+}
+
+}
+
+namespace rtengine
+{
+
+TiledLabProcessor::TiledLabProcessor (int bandPixels) :
+    bandPixels(bandPixels)
+{
+}
+
+void TiledLabProcessor::addLocal (const Apply& apply, int halo)
+{
+    steps.push_back({Analyse(), apply, std::max(halo, 0), false});
+}
+
+void TiledLabProcessor::addGlobal (const Apply& apply)
+{
+    steps.push_back({Analyse(), apply, 0, true});
+}
+
+void TiledLabProcessor::addAnalysed (const Analyse& analyse, const Apply& apply, int halo)
+{
+    steps.push_back({analyse, apply, std::max(halo, 0), false});
+}
+
+void TiledLabProcessor::run (LabImage* lab)
+{
+    std::vector<const Step*> chain;
+
+    for (const auto& step : steps) {
+        if (step.global) {
+            runChain(lab, chain);
+            step.apply(lab);
+        } else {
+            if (step.analyse) {
+                // the statistic has to be gathered on the output of the previous operators
+                runChain(lab, chain);
+                runAnalysis(lab, step);
+            }
+
+            chain.push_back(&step);
+        }
+    }
+
+    runChain(lab, chain);
+}
+
+int TiledLabProcessor::getBandRows (int width, int halo) const
+{
+    // keep the halo overhead reasonable, and never let a band be thinner than its halo:
+    // runChain() relies on the upper halo of a band never reaching rows already written back
+    return std::max({bandPixels / std::max(width, 1), 4 * halo, 32});
+}
+
+void TiledLabProcessor::runChain (LabImage* lab, std::vector<const Step*>& chain)
+{
+    if (chain.empty()) {
+        return;
+    }
+
+    int halo = 0;
+
+    for (const auto step : chain) {
+        halo += step->halo;
+    }
+
+    const int W = lab->W;
+    const int H = lab->H;
+    const int bandRows = getBandRows(W, halo);
+
+    if (bandRows >= H) {
+        for (const auto step : chain) {
+            step->apply(lab);
+        }
+
+        chain.clear();
+        return;
+    }
+
+    // The result of a band is written back only once the next band has been read, as the
+    // upper halo of the latter overlaps the rows written by the former.
+    std::unique_ptr<LabImage> pending;
+    int pendingRow = 0;
+    int pendingOffset = 0;
+    int pendingRows = 0;
+
+    for (int y = 0; y < H; y += bandRows) {
+        const int rows = std::min(bandRows, H - y);
+        const int top = std::max(y - halo, 0);
+        const int bottom = std::min(y + rows + halo, H);
+
+        std::unique_ptr<LabImage> band(new LabImage(W, bottom - top));
+        copyRows(lab, top, band.get(), 0, bottom - top);
+
+        if (pending) {
+            copyRows(pending.get(), pendingOffset, lab, pendingRow, pendingRows);
+        }
+
+        for (const auto step : chain) {
+            step->apply(band.get());
+        }
+
+        pending = std::move(band);
+        pendingRow = y;
+        pendingOffset = y - top;
+        pendingRows = rows;
+    }
+
+    copyRows(pending.get(), pendingOffset, lab, pendingRow, pendingRows);
+
+    chain.clear();
+}
+
+void TiledLabProcessor::runAnalysis (LabImage* lab, const Step& step)
+{
+    const int W = lab->W;
+    const int H = lab->H;
+    const int bandRows = getBandRows(W, step.halo);
+
+    if (bandRows >= H) {
+        step.analyse(lab, 0, H);
+        return;
+    }
+
+    for (int y = 0; y < H; y += bandRows) {
+        const int rows = std::min(bandRows, H - y);
+        const int top = std::max(y - step.halo, 0);
+        const int bottom = std::min(y + rows + step.halo, H);
+
+        LabImage band(W, bottom - top);
+        copyRows(lab, top, &band, 0, bottom - top);
+        step.analyse(&band, y - top, y - top + rows);
+    }
+}
+
+}
@@ -0,0 +1,78 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "noncopyable.h"
+
+namespace rtengine
+{
+
+class LabImage;
+
+/**
+ * @brief Runs a chain of Lab operators on overlapping horizontal bands of the image
+ *
+ * Each operator declares its spatial support (the halo, in pixels). Consecutive local operators
+ * are chained and run on bands which are enlarged by the sum of their halos, so that the rows
+ * written back to the image are the same as if the chain had been run on the whole frame.
+ * The temporary buffers the operators allocate internally thus scale with the band size instead
+ * of the image size.
+ *
+ * Operators which need the whole image (e.g. because they normalise by a global statistic) are
+ * either run on the full frame, or, when they provide an analysis function, get a read-only
+ * banded analysis pass before their banded application.
+ */
+class TiledLabProcessor :
+    public NonCopyable
+{
+public:
+    using Apply = std::function<void (LabImage* band)>;
+    /// Accumulates statistics over the rows [firstRow, lastRow[ of the band, the other rows only being context
+    using Analyse = std::function<void (LabImage* band, int firstRow, int lastRow)>;
+
+    /// @param bandPixels approximate number of pixels of a band, halos excluded
+    explicit TiledLabProcessor (int bandPixels);
+
+    /// Adds an operator reading at most 'halo' pixels around the one it writes
+    void addLocal (const Apply& apply, int halo);
+    /// Adds an operator which has to see the whole image at once
+    void addGlobal (const Apply& apply);
+    /// Adds a local operator which needs a statistic of the whole image, gathered by 'analyse' beforehand
+    void addAnalysed (const Analyse& analyse, const Apply& apply, int halo);
+
+    void run (LabImage* lab);
+
+private:
+    struct Step {
+        Analyse analyse;
+        Apply apply;
+        int halo;
+        bool global;
+    };
+
+    int getBandRows (int width, int halo) const;
+    void runChain (LabImage* lab, std::vector<const Step*>& chain);
+    void runAnalysis (LabImage* lab, const Step& step);
+
+    const int bandPixels;
+    std::vector<Step> steps;
+};
+
+}
@@ -0,0 +1,179 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "waveletcache.h"
+#include "../rtgui/options.h"
+
+namespace
+{
+
+constexpr std::uint64_t fnvOffset = 14695981039346656037ULL;
+constexpr std::uint64_t fnvPrime = 1099511628211ULL;
+
+// FNV-1a of the rows, computed in parallel and then chained in row order. The whole plane is
+// read, so that any upstream change, even a local one, gives another fingerprint
+std::uint64_t getFingerprint (const float* data, int width, int height)
+{
+    std::vector<std::uint64_t> rowHashes(height);
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+
+    for (int i = 0; i < height; ++i) {
+        const float* row = data + static_cast<std::size_t>(i) * width;
+        std::uint64_t hash = fnvOffset;
+
+        for (int j = 0; j < width; ++j) {
+            std::uint32_t bits;
+            memcpy(&bits, row + j, sizeof(bits));
+            hash = (hash ^ bits) * fnvPrime;
+        }
+
+        rowHashes[i] = hash;
+    }
+
+    std::uint64_t hash = fnvOffset;
+
+    for (const auto rowHash : rowHashes) {
+        hash = (hash ^ rowHash) * fnvPrime;
+    }
+
+    return hash;
+}
+
+}
+
+rtengine::WaveletCache& rtengine::WaveletCache::getInstance()
+{
+    static WaveletCache instance;
+    return instance;
+}
+
+rtengine::WaveletCache::WaveletCache() :
+    totalBytes(0),
+    hook(*this),
+    entries(std::numeric_limits<unsigned long>::max(), &hook)
+{
+}
+
+rtengine::wavelet_decomposition* rtengine::WaveletCache::decompose (float* src, int width, int height, int maxlvl, int subsampling, int skipcrop, int numThreads, int Daub4Len)
+{
+    const std::size_t maxBytes = std::size_t(std::max(options.waveletCacheSize, 0)) << 20;
+
+    if (!maxBytes) {
+        return new wavelet_decomposition(src, width, height, maxlvl, subsampling, skipcrop, numThreads, Daub4Len);
+    }
+
+    const Key key {
+        getFingerprint(src, width, height),
+        std::uint64_t(width),
+        std::uint64_t(height),
+        std::uint64_t(maxlvl),
+        std::uint64_t(subsampling),
+        std::uint64_t(skipcrop),
+        std::uint64_t(Daub4Len)
+    };
+
+    Entry cached;
+
+    {
+        MyMutex::MyLock lock(mutex);
+        entries.get(key, cached);
+    }
+
+    if (cached) {
+        // the copy is made outside the lock, the entry is kept alive by 'cached' even if it gets dropped meanwhile
+        wavelet_decomposition* const copy = cached->clone(numThreads);
+
+        if (!copy->memoryAllocationFailed) {
+            return copy;
+        }
+
+        delete copy;
+        clear();
+    }
+
+    wavelet_decomposition* decomposition = new wavelet_decomposition(src, width, height, maxlvl, subsampling, skipcrop, numThreads, Daub4Len);
+
+    if (decomposition->memoryAllocationFailed) {
+        // give the memory of the kept decompositions back and try again
+        delete decomposition;
+        clear();
+        return new wavelet_decomposition(src, width, height, maxlvl, subsampling, skipcrop, numThreads, Daub4Len);
+    }
+
+    if (decomposition->memory_size() <= maxBytes) {
+        const Entry copy(decomposition->clone(1));
+
+        if (copy->memoryAllocationFailed) {
+            clear();
+        } else {
+            MyMutex::MyLock lock(mutex);
+            add(key, copy);
+        }
+    }
+
+    return decomposition;
+}
+
+void rtengine::WaveletCache::clear ()
+{
+    MyMutex::MyLock lock(mutex);
+    entries.clear();
+}
+
+void rtengine::WaveletCache::add (const Key& key, const Entry& entry)
+{
+    const std::size_t maxBytes = std::size_t(std::max(options.waveletCacheSize, 0)) << 20;
+
+    entries.set(key, entry);
+    totalBytes += entry->memory_size();
+
+    // the hook takes the sizes of the discarded entries off the total
+    entries.evictWhile([this, maxBytes]() {
+        return totalBytes > maxBytes;
+    });
+}
+
+rtengine::WaveletCache::Hook::Hook (WaveletCache& parent) :
+    parent(parent)
+{
+}
+
+void rtengine::WaveletCache::Hook::onDiscard (const Key& key, const Entry& entry)
+{
+    parent.totalBytes -= entry->memory_size();
+}
+
+void rtengine::WaveletCache::Hook::onDisplace (const Key& key, const Entry& entry)
+{
+    // the entry has been replaced, the size of the new one is accounted for by add()
+    parent.totalBytes -= entry->memory_size();
+}
+
+void rtengine::WaveletCache::Hook::onRemove (const Key& key, const Entry& entry)
+{
+    parent.totalBytes -= entry->memory_size();
+}
+
+void rtengine::WaveletCache::Hook::onDestroy ()
+{
+}
@@ -0,0 +1,88 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "cache.h"
+#include "cplx_wavelet_dec.h"
+#include "noncopyable.h"
+
+namespace rtengine
+{
+
+/**
+ * @brief In-memory cache of wavelet decompositions
+ *
+ * The wavelet tools edit the coefficients of their decompositions and reconstruct the image from them,
+ * which consumes the decomposition. While a slider is dragged, the planes they decompose stay the same
+ * from one update to the next, only what is done with the coefficients changes. This cache keeps an
+ * unmodified copy of the decompositions, keyed by a fingerprint of the decomposed plane and by the
+ * decomposition parameters, and hands out copies of it: copying the coefficients is much cheaper
+ * than filtering the plane again at each level.
+ *
+ * The total size of the kept decompositions is capped by options.waveletCacheSize (in MiB, 0 disables
+ * the cache), the least recently used ones being dropped first. When a decomposition can't be
+ * allocated, the cache is emptied and the allocation retried.
+ */
+class WaveletCache final :
+    public NonCopyable
+{
+public:
+    static WaveletCache& getInstance();
+
+    /// Same as new wavelet_decomposition(src, width, height, maxlvl, subsampling, skipcrop, numThreads, Daub4Len),
+    /// from the cache when the same plane has been decomposed the same way before
+    wavelet_decomposition* decompose (float* src, int width, int height, int maxlvl, int subsampling, int skipcrop, int numThreads, int Daub4Len = 6);
+
+    /// Drops all the kept decompositions
+    void clear ();
+
+private:
+    using Key = std::vector<std::uint64_t>;
+    using Entry = std::shared_ptr<const wavelet_decomposition>;
+
+    class Hook final :
+        public Cache<Key, Entry>::Hook
+    {
+    public:
+        explicit Hook (WaveletCache& parent);
+
+        void onDiscard (const Key& key, const Entry& entry) override;
+        void onDisplace (const Key& key, const Entry& entry) override;
+        void onRemove (const Key& key, const Entry& entry) override;
+        void onDestroy () override;
+
+    private:
+        WaveletCache& parent;
+    };
+
+    WaveletCache();
+
+    void add (const Key& key, const Entry& entry);
+
+    MyMutex mutex;
+    std::size_t totalBytes;
+
+    Hook hook;
+    Cache<Key, Entry> entries;
+};
+
+}
@@ -0,0 +1,517 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <memory>
+
+#include "widekernels.h"
+#include "color.h"
+#include "cpufeatures.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RT_WIDE_KERNELS
+#endif
+
+#ifdef RT_WIDE_KERNELS
+
+namespace
+{
+
+// The kernels below are written once against GCC vector extensions and instantiated with 16, 8 and 1 lane(s).
+// They are forced inline into the entry points, which carry the target attributes.
+#define WIDE_INLINE inline __attribute__((always_inline))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+
+#ifndef __clang__
+// the helpers returning wide vectors are never called out of line, their ABI doesn't matter
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+typedef float vfloat8 __attribute__((vector_size(32)));
+typedef int vint8 __attribute__((vector_size(32)));
+typedef float vfloat16 __attribute__((vector_size(64)));
+typedef int vint16 __attribute__((vector_size(64)));
+
+template<typename V>
+struct Lanes;
+
+template<>
+struct Lanes<float> {
+    static constexpr int count = 1;
+};
+
+template<>
+struct Lanes<vfloat8> {
+    static constexpr int count = 8;
+    typedef vint8 mask;
+};
+
+template<>
+struct Lanes<vfloat16> {
+    static constexpr int count = 16;
+    typedef vint16 mask;
+};
+
+template<typename V>
+WIDE_INLINE V loadu(const float* src)
+{
+    V result;
+    memcpy(&result, src, sizeof(V));
+    return result;
+}
+
+template<typename V>
+WIDE_INLINE void storeu(float* dst, const V& value)
+{
+    memcpy(dst, &value, sizeof(V));
+}
+
+template<typename V>
+WIDE_INLINE V broadcast(float value)
+{
+    return V{} + value;
+}
+
+template<typename V>
+WIDE_INLINE V select(bool condition, const V& ifTrue, const V& ifFalse)
+{
+    return condition ? ifTrue : ifFalse;
+}
+
+template<typename V>
+WIDE_INLINE V select(const typename Lanes<V>::mask& condition, const V& ifTrue, const V& ifFalse)
+{
+    typedef typename Lanes<V>::mask M;
+    return reinterpret_cast<V>((reinterpret_cast<M>(ifTrue) & condition) | (reinterpret_cast<M>(ifFalse) & ~condition));
+}
+
+template<typename V>
+WIDE_INLINE V gatherColumn(float** src, int row, int col)
+{
+    float lanes[Lanes<V>::count];
+
+    for (int k = 0; k < Lanes<V>::count; ++k) {
+        lanes[k] = src[row + k][col];
+    }
+
+    return loadu<V>(lanes);
+}
+
+// Rows [row, row + N) of gaussHorizontalSse() from gauss.cc, tmp holds W * N floats
+template<typename V>
+WIDE_INLINE void gaussHorizontalRows(float** src, float** dst, int W, int row, const rtengine::widekernels::RecursiveGaussCoefficients& c, float* tmp)
+{
+    constexpr int N = Lanes<V>::count;
+
+    const V Bv = broadcast<V>(c.B);
+    const V b1v = broadcast<V>(c.b1);
+    const V b2v = broadcast<V>(c.b2);
+    const V b3v = broadcast<V>(c.b3);
+
+    V Tv = gatherColumn<V>(src, row, 0);
+    V Tm3v = Tv * (Bv + b1v + b2v + b3v);
+    storeu(&tmp[0], Tm3v);
+
+    V Tm2v = gatherColumn<V>(src, row, 1) * Bv + Tm3v * b1v + Tv * (b2v + b3v);
+    storeu(&tmp[N], Tm2v);
+
+    V Rv = gatherColumn<V>(src, row, 2) * Bv + Tm2v * b1v + Tm3v * b2v + Tv * b3v;
+    storeu(&tmp[2 * N], Rv);
+
+    for (int j = 3; j < W; ++j) {
+        Tv = Rv;
+        Rv = gatherColumn<V>(src, row, j) * Bv + Tv * b1v + Tm2v * b2v + Tm3v * b3v;
+        storeu(&tmp[j * N], Rv);
+        Tm3v = Tm2v;
+        Tm2v = Tv;
+    }
+
+    Tv = gatherColumn<V>(src, row, W - 1);
+
+    const V temp2Wp1 = Tv + c.M[2][0] * (Rv - Tv) + c.M[2][1] * (Tm2v - Tv) + c.M[2][2] * (Tm3v - Tv);
+    const V temp2W = Tv + c.M[1][0] * (Rv - Tv) + c.M[1][1] * (Tm2v - Tv) + c.M[1][2] * (Tm3v - Tv);
+
+    Rv = Tv + c.M[0][0] * (Rv - Tv) + c.M[0][1] * (Tm2v - Tv) + c.M[0][2] * (Tm3v - Tv);
+    storeu(&tmp[(W - 1) * N], Rv);
+
+    Tm2v = Bv * Tm2v + b1v * Rv + b2v * temp2W + b3v * temp2Wp1;
+    storeu(&tmp[(W - 2) * N], Tm2v);
+
+    Tm3v = Bv * Tm3v + b1v * Tm2v + b2v * Rv + b3v * temp2W;
+    storeu(&tmp[(W - 3) * N], Tm3v);
+
+    Tv = Rv;
+    Rv = Tm3v;
+    Tm3v = Tv;
+
+    for (int j = W - 4; j >= 0; --j) {
+        Tv = Rv;
+        Rv = loadu<V>(&tmp[j * N]) * Bv + Tv * b1v + Tm2v * b2v + Tm3v * b3v;
+        storeu(&tmp[j * N], Rv);
+        Tm3v = Tm2v;
+        Tm2v = Tv;
+    }
+
+    for (int k = 0; k < N; ++k) {
+        float* const out = dst[row + k];
+
+        for (int j = 0; j < W; ++j) {
+            out[j] = tmp[j * N + k];
+        }
+    }
+}
+
+// Columns [col, col + N) of gaussVerticalSse() from gauss.cc, tmp holds H * N floats
+template<typename V>
+WIDE_INLINE void gaussVerticalColumns(float** src, float** dst, int H, int col, const rtengine::widekernels::RecursiveGaussCoefficients& c, float* tmp)
+{
+    constexpr int N = Lanes<V>::count;
+
+    const V Bv = broadcast<V>(c.B);
+    const V b1v = broadcast<V>(c.b1);
+    const V b2v = broadcast<V>(c.b2);
+    const V b3v = broadcast<V>(c.b3);
+
+    V Tv = loadu<V>(&src[0][col]);
+    V Tm3v = Tv * (Bv + b1v + b2v + b3v);
+    storeu(&tmp[0], Tm3v);
+
+    V Tm2v = loadu<V>(&src[1][col]) * Bv + Tm3v * b1v + Tv * (b2v + b3v);
+    storeu(&tmp[N], Tm2v);
+
+    V Rv = loadu<V>(&src[2][col]) * Bv + Tm2v * b1v + Tm3v * b2v + Tv * b3v;
+    storeu(&tmp[2 * N], Rv);
+
+    for (int j = 3; j < H; ++j) {
+        Tv = Rv;
+        Rv = loadu<V>(&src[j][col]) * Bv + Tv * b1v + Tm2v * b2v + Tm3v * b3v;
+        storeu(&tmp[j * N], Rv);
+        Tm3v = Tm2v;
+        Tm2v = Tv;
+    }
+
+    Tv = loadu<V>(&src[H - 1][col]);
+
+    const V temp2Hp1 = Tv + c.M[2][0] * (Rv - Tv) + c.M[2][1] * (Tm2v - Tv) + c.M[2][2] * (Tm3v - Tv);
+    const V temp2H = Tv + c.M[1][0] * (Rv - Tv) + c.M[1][1] * (Tm2v - Tv) + c.M[1][2] * (Tm3v - Tv);
+
+    Rv = Tv + c.M[0][0] * (Rv - Tv) + c.M[0][1] * (Tm2v - Tv) + c.M[0][2] * (Tm3v - Tv);
+    storeu(&dst[H - 1][col], Rv);
+
+    Tm2v = Bv * Tm2v + b1v * Rv + b2v * temp2H + b3v * temp2Hp1;
+    storeu(&dst[H - 2][col], Tm2v);
+
+    Tm3v = Bv * Tm3v + b1v * Tm2v + b2v * Rv + b3v * temp2H;
+    storeu(&dst[H - 3][col], Tm3v);
+
+    Tv = Rv;
+    Rv = Tm3v;
+    Tm3v = Tv;
+
+    for (int j = H - 4; j >= 0; --j) {
+        Tv = Rv;
+        Rv = loadu<V>(&tmp[j * N]) * Bv + Tv * b1v + Tm2v * b2v + Tm3v * b3v;
+        storeu(&dst[j][col], Rv);
+        Tm3v = Tm2v;
+        Tm2v = Tv;
+    }
+}
+
+// Columns [col, col + N) of the vertical pass of boxblur() from boxblur.h
+template<typename V>
+WIDE_INLINE void boxblurVerticalColumns(const float* temp, float** dst, int rady, int W, int H, int col)
+{
+    const V onev = broadcast<V>(1.f);
+    V lenv = broadcast<V>(rady + 1);
+    V tempv = loadu<V>(&temp[col]);
+
+    for (int i = 1; i <= rady; ++i) {
+        tempv += loadu<V>(&temp[i * W + col]);
+    }
+
+    tempv /= lenv;
+    storeu(&dst[0][col], tempv);
+
+    for (int row = 1; row <= rady; ++row) {
+        const V lenp1v = lenv + onev;
+        tempv = (tempv * lenv + loadu<V>(&temp[(row + rady) * W + col])) / lenp1v;
+        storeu(&dst[row][col], tempv);
+        lenv = lenp1v;
+    }
+
+    const V rlenv = onev / lenv;
+
+    for (int row = rady + 1; row < H - rady; ++row) {
+        tempv += (loadu<V>(&temp[(row + rady) * W + col]) - loadu<V>(&temp[(row - rady - 1) * W + col])) * rlenv;
+        storeu(&dst[row][col], tempv);
+    }
+
+    for (int row = H - rady; row < H; ++row) {
+        const V lenm1v = lenv - onev;
+        tempv = (tempv * lenv - loadu<V>(&temp[(row - rady - 1) * W + col])) / lenm1v;
+        storeu(&dst[row][col], tempv);
+        lenv = lenm1v;
+    }
+}
+
+template<typename V>
+WIDE_INLINE V f2xyz(const V& f)
+{
+    constexpr float epsilonExpInv3 = 0.20689655f; // 6.0f/29.0f;
+    constexpr float kappaInv = 0.0011070565f; // 27.0f/24389.0f;  // inverse of kappa
+
+    return select<V>(f > epsilonExpInv3, f * f * f, (116.f * f - 16.f) * kappaInv);
+}
+
+// Pixels [i, i + N) of Color::Lab2XYZ()
+template<typename V>
+WIDE_INLINE void lab2XYZPixels(const float* L, const float* a, const float* b, float* x, float* y, float* z, int i)
+{
+    const float kappa = rtengine::Color::kappa;
+    const float epskap = rtengine::Color::epskap;
+
+    const V LL = loadu<V>(&L[i]) / 327.68f;
+    const V fy = 0.00862069f * LL + 0.137932f; // (L+16)/116
+    const V fx = (0.002f / 327.68f) * loadu<V>(&a[i]) + fy;
+    const V fz = fy - (0.005f / 327.68f) * loadu<V>(&b[i]);
+
+    storeu(&x[i], (65535.f * rtengine::Color::D50x) * f2xyz(fx));
+    storeu(&z[i], (65535.f * rtengine::Color::D50z) * f2xyz(fz));
+    storeu(&y[i], 65535.f * select<V>(LL > epskap, fy * fy * fy, LL / kappa));
+}
+
+template<typename V>
+WIDE_INLINE void gaussHorizontalImpl(float** src, float** dst, int W, int H, const rtengine::widekernels::RecursiveGaussCoefficients& coeffs)
+{
+    constexpr int N = Lanes<V>::count;
+    const std::unique_ptr<float[]> tmp(new float[W * N]);
+
+#ifdef _OPENMP
+    #pragma omp for nowait
+#endif
+
+    for (int i = 0; i < H - (N - 1); i += N) {
+        gaussHorizontalRows<V>(src, dst, W, i, coeffs, tmp.get());
+    }
+
+#ifdef _OPENMP
+    #pragma omp single
+#endif
+    {
+        int i = H - H % N;
+
+        for (; i < H - 7; i += 8) {
+            gaussHorizontalRows<vfloat8>(src, dst, W, i, coeffs, tmp.get());
+        }
+
+        for (; i < H; ++i) {
+            gaussHorizontalRows<float>(src, dst, W, i, coeffs, tmp.get());
+        }
+    }
+}
+
+template<typename V>
+WIDE_INLINE void gaussVerticalImpl(float** src, float** dst, int W, int H, const rtengine::widekernels::RecursiveGaussCoefficients& coeffs)
+{
+    constexpr int N = Lanes<V>::count;
+    const std::unique_ptr<float[]> tmp(new float[H * N]);
+
+#ifdef _OPENMP
+    #pragma omp for nowait
+#endif
+
+    for (int i = 0; i < W - (N - 1); i += N) {
+        gaussVerticalColumns<V>(src, dst, H, i, coeffs, tmp.get());
+    }
+
+#ifdef _OPENMP
+    #pragma omp single
+#endif
+    {
+        int i = W - W % N;
+
+        for (; i < W - 7; i += 8) {
+            gaussVerticalColumns<vfloat8>(src, dst, H, i, coeffs, tmp.get());
+        }
+
+        for (; i < W; ++i) {
+            gaussVerticalColumns<float>(src, dst, H, i, coeffs, tmp.get());
+        }
+    }
+}
+
+template<typename V>
+WIDE_INLINE void boxblurVerticalImpl(const float* temp, float** dst, int rady, int W, int H)
+{
+    constexpr int N = Lanes<V>::count;
+    const int end = W - W % 8;
+
+#ifdef _OPENMP
+    #pragma omp for
+#endif
+
+    for (int col = 0; col < end; col += N) {
+        if (col + N <= end) {
+            boxblurVerticalColumns<V>(temp, dst, rady, W, H, col);
+        } else {
+            boxblurVerticalColumns<vfloat8>(temp, dst, rady, W, H, col);
+        }
+    }
+}
+
+template<typename V>
+WIDE_INLINE void lab2XYZImpl(const float* L, const float* a, const float* b, float* x, float* y, float* z, int n)
+{
+    constexpr int N = Lanes<V>::count;
+    int i = 0;
+
+    for (; i < n - (N - 1); i += N) {
+        lab2XYZPixels<V>(L, a, b, x, y, z, i);
+    }
+
+    for (; i < n; ++i) {
+        lab2XYZPixels<float>(L, a, b, x, y, z, i);
+    }
+}
+
+TARGET_AVX2 void gaussHorizontalAvx2(float** src, float** dst, int W, int H, const rtengine::widekernels::RecursiveGaussCoefficients& coeffs)
+{
+    gaussHorizontalImpl<vfloat8>(src, dst, W, H, coeffs);
+}
+
+TARGET_AVX512 void gaussHorizontalAvx512(float** src, float** dst, int W, int H, const rtengine::widekernels::RecursiveGaussCoefficients& coeffs)
+{
+    gaussHorizontalImpl<vfloat16>(src, dst, W, H, coeffs);
+}
+
+TARGET_AVX2 void gaussVerticalAvx2(float** src, float** dst, int W, int H, const rtengine::widekernels::RecursiveGaussCoefficients& coeffs)
+{
+    gaussVerticalImpl<vfloat8>(src, dst, W, H, coeffs);
+}
+
+TARGET_AVX512 void gaussVerticalAvx512(float** src, float** dst, int W, int H, const rtengine::widekernels::RecursiveGaussCoefficients& coeffs)
+{
+    gaussVerticalImpl<vfloat16>(src, dst, W, H, coeffs);
+}
+
+TARGET_AVX2 void boxblurVerticalAvx2(const float* temp, float** dst, int rady, int W, int H)
+{
+    boxblurVerticalImpl<vfloat8>(temp, dst, rady, W, H);
+}
+
+TARGET_AVX512 void boxblurVerticalAvx512(const float* temp, float** dst, int rady, int W, int H)
+{
+    boxblurVerticalImpl<vfloat16>(temp, dst, rady, W, H);
+}
+
+TARGET_AVX2 void lab2XYZAvx2(const float* L, const float* a, const float* b, float* x, float* y, float* z, int n)
+{
+    lab2XYZImpl<vfloat8>(L, a, b, x, y, z, n);
+}
+
+TARGET_AVX512 void lab2XYZAvx512(const float* L, const float* a, const float* b, float* x, float* y, float* z, int n)
+{
+    lab2XYZImpl<vfloat16>(L, a, b, x, y, z, n);
+}
+
+}
+
+#endif
+
+bool rtengine::widekernels::gaussHorizontal(float** src, float** dst, int W, int H, const RecursiveGaussCoefficients& coeffs)
+{
+#ifdef RT_WIDE_KERNELS
+
+    switch (getSimdLevel()) {
+        case SimdLevel::AVX512:
+            gaussHorizontalAvx512(src, dst, W, H, coeffs);
+            return true;
+
+        case SimdLevel::AVX2:
+            gaussHorizontalAvx2(src, dst, W, H, coeffs);
+            return true;
+
+        default:
+            break;
+    }
+
+#endif
+    return false;
+}
+
+bool rtengine::widekernels::gaussVertical(float** src, float** dst, int W, int H, const RecursiveGaussCoefficients& coeffs)
+{
+#ifdef RT_WIDE_KERNELS
+
+    switch (getSimdLevel()) {
+        case SimdLevel::AVX512:
+            gaussVerticalAvx512(src, dst, W, H, coeffs);
+            return true;
+
+        case SimdLevel::AVX2:
+            gaussVerticalAvx2(src, dst, W, H, coeffs);
+            return true;
+
+        default:
+            break;
+    }
+
+#endif
+    return false;
+}
+
+bool rtengine::widekernels::boxblurVertical(const float* temp, float** dst, int rady, int W, int H)
+{
+#ifdef RT_WIDE_KERNELS
+
+    switch (getSimdLevel()) {
+        case SimdLevel::AVX512:
+            boxblurVerticalAvx512(temp, dst, rady, W, H);
+            return true;
+
+        case SimdLevel::AVX2:
+            boxblurVerticalAvx2(temp, dst, rady, W, H);
+            return true;
+
+        default:
+            break;
+    }
+
+#endif
+    return false;
+}
+
+bool rtengine::widekernels::lab2XYZ(const float* L, const float* a, const float* b, float* x, float* y, float* z, int n)
+{
+#ifdef RT_WIDE_KERNELS
+
+    switch (getSimdLevel()) {
+        case SimdLevel::AVX512:
+            lab2XYZAvx512(L, a, b, x, y, z, n);
+            return true;
+
+        case SimdLevel::AVX2:
+            lab2XYZAvx2(L, a, b, x, y, z, n);
+            return true;
+
+        default:
+            break;
+    }
+
+#endif
+    return false;
+}
@@ -0,0 +1,53 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+namespace rtengine
+{
+
+/**
+ * @brief Runtime dispatched wide vector variants of hot loops
+ *
+ * The kernels are compiled for AVX2+FMA (8 floats) and AVX-512 (16 floats) through function target
+ * attributes, whatever the flags of the build, and the variant is picked through getSimdLevel().
+ * Each entry point returns false without doing anything when the CPU has no suitable variant, in
+ * which case the caller runs its own SSE2 or scalar code.
+ *
+ * The blur kernels contain orphaned OpenMP worksharing constructs like the code they replace, so
+ * they have to be called by all the threads of the team or by none.
+ */
+namespace widekernels
+{
+
+/// Young-van Vliet recursive gaussian coefficients, with the boundary matrix of Triggs and Sdika
+struct RecursiveGaussCoefficients {
+    float B, b1, b2, b3;
+    float M[3][3];
+};
+
+bool gaussHorizontal(float** src, float** dst, int W, int H, const RecursiveGaussCoefficients& coeffs);
+bool gaussVertical(float** src, float** dst, int W, int H, const RecursiveGaussCoefficients& coeffs);
+
+/// Vertical pass of boxblur() over the columns [0, W - W % 8), the remaining ones are left to the caller
+bool boxblurVertical(const float* temp, float** dst, int rady, int W, int H);
+
+/// Color::Lab2XYZ() over a row of n pixels
+bool lab2XYZ(const float* L, const float* a, const float* b, float* x, float* y, float* z, int n);
+
+}
+
+}
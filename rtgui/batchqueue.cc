@@ -36,10 +36,162 @@
 #include "rtimage.h"
 #include <sys/time.h>
 
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 using namespace std;
 using namespace rtengine;
 
-BatchQueue::BatchQueue (FileCatalog* aFileCatalog) : processing(nullptr), fileCatalog(aFileCatalog), sequence(0), listener(nullptr)
+namespace
+{
+
+std::uint64_t physicalMemory ()
+{
+#ifdef WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+
+    if (GlobalMemoryStatusEx(&status)) {
+        return status.ullTotalPhys;
+    }
+
+#elif defined(_SC_PHYS_PAGES)
+    const long pages = sysconf(_SC_PHYS_PAGES);
+    const long pageSize = sysconf(_SC_PAGE_SIZE);
+
+    if (pages > 0 && pageSize > 0) {
+        return static_cast<std::uint64_t>(pages) * pageSize;
+    }
+
+#endif
+    return std::uint64_t(4) << 30;
+}
+
+std::uint64_t memoryBudget ()
+{
+    if (options.batchQueueMemory > 0) {
+        return static_cast<std::uint64_t>(options.batchQueueMemory) << 20;
+    }
+
+    return physicalMemory() / 2;
+}
+
+// Coarse estimate of the memory needed to develop an entry, from the size of the image and the enabled
+// tools: the raw data, the demosaiced and working RGB planes and the Lab image alive at the same time
+// (see simpleprocess.cc), plus the full size buffers of the heaviest tools
+void estimateMemory (const BatchQueueEntry* entry, std::uint64_t& processing, std::uint64_t& output)
+{
+    const procparams::ProcParams& params = entry->params;
+    int w = 0, h = 0;
+
+    if (entry->thumbnail) {
+        entry->thumbnail->getFinalSize (params, w, h);
+    }
+
+    if (w <= 0 || h <= 0) {
+        // unknown until the thumbnail has been processed once: assume a 24 MP image
+        w = 6000;
+        h = 4000;
+    }
+
+    std::uint64_t bytesPerPixel = 4 + 3 * 4 + 3 * 4 + 3 * 4;
+
+    if (params.dirpyrDenoise.enabled) {
+        bytesPerPixel += 24;
+    }
+
+    if (params.retinex.enabled) {
+        bytesPerPixel += 16;
+    }
+
+    if (params.wavelet.enabled) {
+        bytesPerPixel += 16;
+    }
+
+    if (params.colorappearance.enabled) {
+        bytesPerPixel += 24;
+    }
+
+    if (params.epd.enabled) {
+        bytesPerPixel += 12;
+    }
+
+    if (params.sh.enabled) {
+        bytesPerPixel += 4;
+    }
+
+    const std::uint64_t pixels = static_cast<std::uint64_t>(w) * h;
+    processing = pixels * bytesPerPixel;
+
+    double scale = 1.0;
+
+    if (params.resize.enabled) {
+        switch (params.resize.dataspec) {
+            case 1:
+                scale = double(params.resize.width) / w;
+                break;
+
+            case 2:
+                scale = double(params.resize.height) / h;
+                break;
+
+            case 3:
+                scale = std::min(double(params.resize.width) / w, double(params.resize.height) / h);
+                break;
+
+            default:
+                scale = params.resize.scale;
+        }
+    }
+
+    // the 16 bits output image
+    output = static_cast<std::uint64_t>(pixels * scale * scale) * 3 * sizeof(unsigned short);
+}
+
+}
+
+// Forwards the progress of a job to its entry
+class BatchQueue::JobProgress :
+    public rtengine::ProgressListener
+{
+public:
+    JobProgress (BatchQueue* queue, BatchQueueEntry* entry) : queue(queue), entry(entry) {}
+
+    void setProgress (double p)
+    {
+        entry->progress = p;
+
+        // No need to acquire the GUI, setProgressUI will do it
+        const auto func = [](gpointer data) -> gboolean {
+            static_cast<BatchQueue*>(data)->redraw();
+            return FALSE;
+        };
+
+        queue->idle_register.add(func, queue);
+    }
+
+private:
+    BatchQueue* const queue;
+    BatchQueueEntry* const entry;
+};
+
+BatchQueue::BatchQueue (FileCatalog* aFileCatalog) :
+    fileCatalog(aFileCatalog),
+    sequence(0),
+    runningJobs(0),
+    reservedMemory(0),
+    // the threads are never joined, like the former batch processing thread, so that quitting
+    // doesn't wait for the running jobs
+    workers(new Glib::ThreadPool(std::max(options.batchQueueWorkers, 1), false)),
+    encoder(new Glib::ThreadPool(1, false)),
+    listener(nullptr)
 {
 
     location = THLOC_BATCHQUEUE;
@@ -544,64 +696,176 @@ void BatchQueue::openItemInEditor(ThumbBrowserEntryBase* item)
 
 void BatchQueue::startProcessing ()
 {
+    {
+        // the entries which failed are tried again once the queue is (re)started
+        MYWRITERLOCK(l, entryRW);
+
+        for (const auto fdEntry : fd) {
+            static_cast<BatchQueueEntry*> (fdEntry)->failed = false;
+        }
+    }
+
+    startNextJobs ();
+}
+
+// Starts the next entries of the queue, in order, while a worker is free and the memory budget allows
+// it. Called from the GUI thread only.
+void BatchQueue::startNextJobs ()
+{
+    if (listener && !listener->canStartNext ()) {
+        return;
+    }
+
+    const int maxJobs = std::max(options.batchQueueWorkers, 1);
+    const std::uint64_t budget = memoryBudget ();
+    std::vector<BatchQueueEntry*> started;
 
-    if (!processing) {
+    {
         MYWRITERLOCK(l, entryRW);
 
-        if (!fd.empty()) {
-            BatchQueueEntry* next;
+        if (jobMemory.empty()) {
+            sequence = 0;
+        }
+
+        for (const auto fdEntry : fd) {
+            if (runningJobs >= maxJobs) {
+                break;
+            }
+
+            const auto entry = static_cast<BatchQueueEntry*> (fdEntry);
+
+            if (entry->processing || entry->failed) {
+                continue;
+            }
+
+            JobMemory memory;
+            estimateMemory (entry, memory.processing, memory.output);
+
+            // the entries start in the order of the queue, so a large one waits for the memory to be
+            // released instead of being overtaken; one job is always admitted
+            if (!jobMemory.empty() && reservedMemory + memory.processing + memory.output > budget) {
+                break;
+            }
 
-            next = static_cast<BatchQueueEntry*>(fd[0]);
             // tag it as processing and set sequence
-            next->processing = true;
-            next->sequence = sequence = 1;
-            processing = next;
+            entry->processing = true;
+            entry->sequence = ++sequence;
+            ++runningJobs;
+            reservedMemory += memory.processing + memory.output;
+            jobMemory[entry] = memory;
 
             // remove from selection
-            if (processing->selected) {
-                std::vector<ThumbBrowserEntryBase*>::iterator pos = std::find (selected.begin(), selected.end(), processing);
+            if (entry->selected) {
+                std::vector<ThumbBrowserEntryBase*>::iterator pos = std::find (selected.begin(), selected.end(), entry);
 
                 if (pos != selected.end()) {
                     selected.erase (pos);
                 }
 
-                processing->selected = false;
+                entry->selected = false;
             }
 
-            MYWRITERLOCK_RELEASE(l);
+            started.push_back (entry);
+        }
+    }
 
-            // remove button set
-            next->removeButtonSet ();
+    if (started.empty()) {
+        return;
+    }
 
-            // start batch processing
-            rtengine::startBatchProcessing (next->job, this, options.tunnelMetaData);
-            queue_draw ();
-        }
+    workers->set_max_threads (maxJobs);
+
+    for (const auto entry : started) {
+        // remove button set
+        entry->removeButtonSet ();
+
+        workers->push (sigc::bind(sigc::mem_fun(*this, &BatchQueue::processJob), entry));
+    }
+
+    queue_draw ();
+}
+
+void BatchQueue::scheduleNextJobs ()
+{
+    const auto func = [](gpointer data) -> gboolean {
+        static_cast<BatchQueue*>(data)->startNextJobs();
+        return FALSE;
+    };
+
+    idle_register.add(func, this);
+}
+
+// Runs in a worker thread
+void BatchQueue::processJob (BatchQueueEntry* entry)
+{
+#ifdef _OPENMP
+    // share the cores between the jobs running at once, their serial parts filling the gaps
+    const int workerCount = std::max(options.batchQueueWorkers, 1);
+    omp_set_num_threads ((omp_get_num_procs() + workerCount - 1) / workerCount);
+#endif
+
+    int errorCode;
+    JobProgress progress (this, entry);
+    rtengine::IImage16* img = rtengine::processImage (entry->job, errorCode, &progress, options.tunnelMetaData, true);
+
+    if (errorCode) {
+        releaseJob (entry, true);
+        jobFailed (entry, M("MAIN_MSG_CANNOTLOAD"));
+        return;
+    }
+
+    // the full size buffers are gone, only the output image waits for the encoder
+    releaseJob (entry, false);
+    scheduleNextJobs ();
+
+    encoder->push (sigc::bind(sigc::mem_fun(*this, &BatchQueue::saveJob), entry, img));
+}
+
+void BatchQueue::releaseJob (BatchQueueEntry* entry, bool output)
+{
+    MYWRITERLOCK(l, entryRW);
+
+    const auto memory = jobMemory.find (entry);
+
+    if (memory == jobMemory.end()) {
+        return;
+    }
+
+    if (memory->second.processing) {
+        reservedMemory -= memory->second.processing;
+        memory->second.processing = 0;
+        --runningJobs;
+    }
+
+    if (output) {
+        reservedMemory -= memory->second.output;
+        jobMemory.erase (memory);
     }
 }
 
-rtengine::ProcessingJob* BatchQueue::imageReady (rtengine::IImage16* img)
+// Runs in the encoder thread
+void BatchQueue::saveJob (BatchQueueEntry* entry, rtengine::IImage16* img)
 {
 
     // save image img
     Glib::ustring fname;
     SaveFormat saveFormat;
 
-    if (processing->outFileName == "") { // auto file name
-        Glib::ustring s = calcAutoFileNameBase (processing->filename, processing->sequence);
+    if (entry->outFileName == "") { // auto file name
+        Glib::ustring s = calcAutoFileNameBase (entry->filename, entry->sequence);
         saveFormat = options.saveFormatBatch;
         fname = autoCompleteFileName (s, saveFormat.format);
     } else { // use the save-as filename with automatic completion for uniqueness
-        if (processing->forceFormatOpts) {
-            saveFormat = processing->saveFormat;
+        if (entry->forceFormatOpts) {
+            saveFormat = entry->saveFormat;
         } else {
             saveFormat = options.saveFormatBatch;
         }
 
         // The output filename's extension is forced to the current or selected output format,
         // despite what the user have set in the fielneame's field of the "Save as" dialgo box
-        fname = autoCompleteFileName (removeExtension(processing->outFileName), saveFormat.format);
-        //fname = autoCompleteFileName (removeExtension(processing->outFileName), getExtension(processing->outFileName));
+        fname = autoCompleteFileName (removeExtension(entry->outFileName), saveFormat.format);
+        //fname = autoCompleteFileName (removeExtension(entry->outFileName), getExtension(entry->outFileName));
     }
 
     //printf ("fname=%s, %s\n", fname.c_str(), removeExtension(fname).c_str());
@@ -618,83 +882,57 @@ rtengine::ProcessingJob* BatchQueue::imageReady (rtengine::IImage16* img)
         }
 
         img->free ();
+        releaseJob (entry, true);
 
         if (err) {
-            throw Glib::FileError(Glib::FileError::FAILED, M("MAIN_MSG_CANNOTSAVE") + "\n" + fname);
+            jobFailed (entry, M("MAIN_MSG_CANNOTSAVE") + "\n" + fname);
+            return;
         }
 
         if (saveFormat.saveParams) {
             // We keep the extension to avoid overwriting the profile when we have
             // the same output filename with different extension
-            //processing->params.save (removeExtension(fname) + paramFileExtension);
-            processing->params.save (fname + ".out" + paramFileExtension);
+            //entry->params.save (removeExtension(fname) + paramFileExtension);
+            entry->params.save (fname + ".out" + paramFileExtension);
         }
 
-        if (processing->thumbnail) {
-            processing->thumbnail->imageDeveloped ();
-            processing->thumbnail->imageRemovedFromQueue ();
+        if (entry->thumbnail) {
+            entry->thumbnail->imageDeveloped ();
+            entry->thumbnail->imageRemovedFromQueue ();
         }
+    } else {
+        if (img) {
+            img->free ();
+        }
+
+        releaseJob (entry, true);
     }
 
     // save temporary params file name: delete as last thing
-    Glib::ustring processedParams = processing->savedParamsFile;
+    Glib::ustring processedParams = entry->savedParamsFile;
 
     // delete from the queue
     bool queueEmptied = false;
-    bool remove_button_set = false;
 
     {
         MYWRITERLOCK(l, entryRW);
 
-        delete processing;
-        processing = nullptr;
-
-        fd.erase (fd.begin());
-
-        // return next job
-        if (fd.empty()) {
-            queueEmptied = true;
-        } else if (listener && listener->canStartNext ()) {
-            BatchQueueEntry* next = static_cast<BatchQueueEntry*>(fd[0]);
-            // tag it as selected and set sequence
-            next->processing = true;
-            next->sequence = ++sequence;
-            processing = next;
-
-            // remove from selection
-            if (processing->selected) {
-                std::vector<ThumbBrowserEntryBase*>::iterator pos = std::find (selected.begin(), selected.end(), processing);
-
-                if (pos != selected.end()) {
-                    selected.erase (pos);
-                }
+        const auto pos = std::find (fd.begin (), fd.end (), entry);
 
-                processing->selected = false;
-            }
-
-            // remove button set
-            remove_button_set = true;
+        if (pos != fd.end ()) {
+            fd.erase (pos);
         }
-    }
 
-    if (remove_button_set) {
-        // ButtonSet have Cairo::Surface which might be rendered while we're trying to delete them
-        GThreadLock lock;
-        processing->removeButtonSet ();
+        delete entry;
+
+        queueEmptied = fd.empty();
     }
 
     if (saveBatchQueue ()) {
         ::g_remove (processedParams.c_str ());
 
         // Delete all files in directory batch when finished, just to be sure to remove zombies
-        auto isEmpty = false;
-
-        {
-            MYREADERLOCK(l, entryRW);
-            isEmpty = fd.empty();
-        }
-
-        if (isEmpty) {
+        if (queueEmptied) {
 
             const auto batchdir = Glib::build_filename (options.rtdir, "batch");
 
@@ -713,8 +951,7 @@ rtengine::ProcessingJob* BatchQueue::imageReady (rtengine::IImage16* img)
 
     redraw ();
     notifyListener (queueEmptied);
-
-    return processing ? processing->job : nullptr;
+    scheduleNextJobs ();
 }
 
 // Calculates automatic filename of processed batch entry, but just the base name
@@ -886,22 +1123,6 @@ Glib::ustring BatchQueue::autoCompleteFileName (const Glib::ustring& fileName, c
     return "";
 }
 
-void BatchQueue::setProgress (double p)
-{
-
-    if (processing) {
-        processing->progress = p;
-    }
-
-    // No need to acquire the GUI, setProgressUI will do it
-    const auto func = [](gpointer data) -> gboolean {
-        static_cast<BatchQueue*>(data)->redraw();
-        return FALSE;
-    };
-
-    idle_register.add(func, this);
-}
-
 void BatchQueue::buttonPressed (LWButton* button, int actionCode, void* actionData)
 {
 
@@ -955,20 +1176,29 @@ void BatchQueue::redrawNeeded (LWButton* button)
     queue_draw ();
 }
 
-void BatchQueue::error (Glib::ustring msg)
+void BatchQueue::jobFailed (BatchQueueEntry* entry, const Glib::ustring& msg)
 {
+    {
+        MYWRITERLOCK(l, entryRW);
 
-    if (processing && processing->processing) {
-        // restore failed thumb
-        BatchQueueButtonSet* bqbs = new BatchQueueButtonSet (processing);
-        bqbs->setButtonListener (this);
-        processing->addButtonSet (bqbs);
-        processing->processing = false;
-        processing->job = rtengine::ProcessingJob::create(processing->filename, processing->thumbnail->getType() == FT_Raw, processing->params);
-        processing = nullptr;
-        redraw ();
+        // restore failed thumb; the queue stops once the error is notified, until then the
+        // jobs scheduled meanwhile must not pick it up again
+        entry->processing = false;
+        entry->failed = true;
+        entry->job = rtengine::ProcessingJob::create(entry->filename, entry->thumbnail->getType() == FT_Raw, entry->params);
     }
 
+    BatchQueueButtonSet* bqbs = new BatchQueueButtonSet (entry);
+    bqbs->setButtonListener (this);
+    entry->addButtonSet (bqbs);
+    redraw ();
+
+    notifyError (msg);
+}
+
+void BatchQueue::notifyError (const Glib::ustring& msg)
+{
+
     if (listener) {
         NLParams* params = new NLParams;
         params->listener = listener;
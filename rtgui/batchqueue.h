@@ -18,6 +18,8 @@
 #ifndef _BATCHQUEUE_
 #define _BATCHQUEUE_
 
+#include <cstdint>
+#include <map>
 #include <gtkmm.h>
 #include "threadutils.h"
 #include "batchqueueentry.h"
@@ -39,7 +41,6 @@ class FileCatalog;
 
 class BatchQueue final :
     public ThumbBrowserBase,
-    public rtengine::BatchProcessingListener,
     public LWButtonListener
 {
 public:
@@ -62,9 +63,6 @@ public:
         return (!fd.empty());
     }
 
-    rtengine::ProcessingJob* imageReady (rtengine::IImage16* img);
-    void error (Glib::ustring msg);
-    void setProgress (double p);
     void rightClicked (ThumbBrowserEntryBase* entry);
     void doubleClicked (ThumbBrowserEntryBase* entry);
     bool keyPressed (GdkEventKey* event);
@@ -91,11 +89,35 @@ protected:
     Glib::ustring getTempFilenameForParams( const Glib::ustring &filename );
     bool saveBatchQueue ();
     void notifyListener (bool queueEmptied);
+    void notifyError (const Glib::ustring& msg);
+
+    // The entries are processed by up to options.batchQueueWorkers jobs at once, as long as their
+    // estimated memory fits in the budget; the results are then saved one by one by the encoder.
+    class JobProgress;
+
+    struct JobMemory {
+        std::uint64_t processing;
+        std::uint64_t output;
+    };
+
+    void startNextJobs ();
+    void processJob (BatchQueueEntry* entry);
+    void saveJob (BatchQueueEntry* entry, rtengine::IImage16* img);
+    void jobFailed (BatchQueueEntry* entry, const Glib::ustring& msg);
+    void releaseJob (BatchQueueEntry* entry, bool output);
+    void scheduleNextJobs ();
 
-    BatchQueueEntry* processing;  // holds the currently processed image
     FileCatalog* fileCatalog;
     int sequence; // holds the current sequence index
 
+    // guarded by entryRW
+    int runningJobs;
+    std::uint64_t reservedMemory;
+    std::map<const BatchQueueEntry*, JobMemory> jobMemory;
+
+    Glib::ThreadPool* workers;
+    Glib::ThreadPool* encoder;
+
     Glib::ustring nameTemplate;
 
     MyImageMenuItem* cancel;
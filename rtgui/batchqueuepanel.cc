@@ -312,6 +312,9 @@ void BatchQueuePanel::addBatchQueueJobs ( std::vector<BatchQueueEntry*> &entries
 
     if (stop->get_active () && autoStart->get_active ()) {
         startBatchProc ();
+    } else if (start->get_active ()) {
+        // the queue may have been too short to keep all the workers busy
+        batchQueue->startProcessing ();
     }
 }
 
@@ -33,153 +33,148 @@ CacheImageData::CacheImageData ()
 /*
  * Load the General, DateTime, ExifInfo, File info and ExtraRawInfo sections of the image data file
  */
-int CacheImageData::load (const Glib::ustring& fname)
+int CacheImageData::load (const Glib::KeyFile& keyFile)
 {
     setlocale(LC_NUMERIC, "C"); // to set decimal point to "."
 
-    Glib::KeyFile keyFile;
-
     try {
-        if (keyFile.load_from_file (fname)) {
+        if (keyFile.has_group ("General")) {
+            if (keyFile.has_key ("General", "MD5")) {
+                md5         = keyFile.get_string ("General", "MD5");
+            }
 
-            if (keyFile.has_group ("General")) {
-                if (keyFile.has_key ("General", "MD5")) {
-                    md5         = keyFile.get_string ("General", "MD5");
-                }
+            if (keyFile.has_key ("General", "Version")) {
+                version     = keyFile.get_string ("General", "Version");
+            }
 
-                if (keyFile.has_key ("General", "Version")) {
-                    version     = keyFile.get_string ("General", "Version");
-                }
+            if (keyFile.has_key ("General", "Supported")) {
+                supported   = keyFile.get_boolean ("General", "Supported");
+            }
 
-                if (keyFile.has_key ("General", "Supported")) {
-                    supported   = keyFile.get_boolean ("General", "Supported");
-                }
+            if (keyFile.has_key ("General", "Format")) {
+                format      = (ThFileType)keyFile.get_integer ("General", "Format");
+            }
 
-                if (keyFile.has_key ("General", "Format")) {
-                    format      = (ThFileType)keyFile.get_integer ("General", "Format");
-                }
+            if (keyFile.has_key ("General", "Rank")) {
+                rankOld     = keyFile.get_integer ("General", "Rank");
+            }
 
-                if (keyFile.has_key ("General", "Rank")) {
-                    rankOld     = keyFile.get_integer ("General", "Rank");
-                }
+            if (keyFile.has_key ("General", "InTrash")) {
+                inTrashOld  = keyFile.get_boolean ("General", "InTrash");
+            }
 
-                if (keyFile.has_key ("General", "InTrash")) {
-                    inTrashOld  = keyFile.get_boolean ("General", "InTrash");
-                }
+            if (keyFile.has_key ("General", "RecentlySaved")) {
+                recentlySaved = keyFile.get_boolean ("General", "RecentlySaved");
+            }
+        }
 
-                if (keyFile.has_key ("General", "RecentlySaved")) {
-                    recentlySaved = keyFile.get_boolean ("General", "RecentlySaved");
-                }
+        timeValid = keyFile.has_group ("DateTime");
+
+        if (timeValid) {
+            if (keyFile.has_key ("DateTime", "Year")) {
+                year    = keyFile.get_integer ("DateTime", "Year");
             }
 
-            timeValid = keyFile.has_group ("DateTime");
+            if (keyFile.has_key ("DateTime", "Month")) {
+                month   = keyFile.get_integer ("DateTime", "Month");
+            }
 
-            if (timeValid) {
-                if (keyFile.has_key ("DateTime", "Year")) {
-                    year    = keyFile.get_integer ("DateTime", "Year");
-                }
+            if (keyFile.has_key ("DateTime", "Day")) {
+                day     = keyFile.get_integer ("DateTime", "Day");
+            }
 
-                if (keyFile.has_key ("DateTime", "Month")) {
-                    month   = keyFile.get_integer ("DateTime", "Month");
-                }
+            if (keyFile.has_key ("DateTime", "Hour")) {
+                hour    = keyFile.get_integer ("DateTime", "Hour");
+            }
 
-                if (keyFile.has_key ("DateTime", "Day")) {
-                    day     = keyFile.get_integer ("DateTime", "Day");
-                }
+            if (keyFile.has_key ("DateTime", "Min")) {
+                min     = keyFile.get_integer ("DateTime", "Min");
+            }
 
-                if (keyFile.has_key ("DateTime", "Hour")) {
-                    hour    = keyFile.get_integer ("DateTime", "Hour");
-                }
+            if (keyFile.has_key ("DateTime", "Sec")) {
+                sec     = keyFile.get_integer ("DateTime", "Sec");
+            }
+        }
 
-                if (keyFile.has_key ("DateTime", "Min")) {
-                    min     = keyFile.get_integer ("DateTime", "Min");
-                }
+        exifValid = false;
 
-                if (keyFile.has_key ("DateTime", "Sec")) {
-                    sec     = keyFile.get_integer ("DateTime", "Sec");
-                }
+        if (keyFile.has_group ("ExifInfo")) {
+            exifValid = true;
+
+            if (keyFile.has_key ("ExifInfo", "Valid")) {
+                exifValid = keyFile.get_boolean ("ExifInfo", "Valid");
             }
 
-            exifValid = false;
+            if (exifValid) {
+                if (keyFile.has_key ("ExifInfo", "FNumber")) {
+                    fnumber     = keyFile.get_double ("ExifInfo", "FNumber");
+                }
 
-            if (keyFile.has_group ("ExifInfo")) {
-                exifValid = true;
+                if (keyFile.has_key ("ExifInfo", "Shutter")) {
+                    shutter     = keyFile.get_double ("ExifInfo", "Shutter");
+                }
 
-                if (keyFile.has_key ("ExifInfo", "Valid")) {
-                    exifValid = keyFile.get_boolean ("ExifInfo", "Valid");
+                if (keyFile.has_key ("ExifInfo", "FocalLen")) {
+                    focalLen    = keyFile.get_double ("ExifInfo", "FocalLen");
                 }
 
-                if (exifValid) {
-                    if (keyFile.has_key ("ExifInfo", "FNumber")) {
-                        fnumber     = keyFile.get_double ("ExifInfo", "FNumber");
-                    }
-
-                    if (keyFile.has_key ("ExifInfo", "Shutter")) {
-                        shutter     = keyFile.get_double ("ExifInfo", "Shutter");
-                    }
-
-                    if (keyFile.has_key ("ExifInfo", "FocalLen")) {
-                        focalLen    = keyFile.get_double ("ExifInfo", "FocalLen");
-                    }
-
-                    if (keyFile.has_key ("ExifInfo", "FocalLen35mm")) {
-                        focalLen35mm = keyFile.get_double ("ExifInfo", "FocalLen35mm");
-                    } else {
-                        focalLen35mm = focalLen;    // prevent crashes on old files
-                    }
-
-                    if (keyFile.has_key ("ExifInfo", "FocusDist")) {
-                        focusDist = keyFile.get_double ("ExifInfo", "FocusDist");
-                    } else {
-                        focusDist = 0;
-                    }
-
-                    if (keyFile.has_key ("ExifInfo", "ISO")) {
-                        iso         = keyFile.get_integer ("ExifInfo", "ISO");
-                    }
-
-                    if (keyFile.has_key ("ExifInfo", "ExpComp")) {
-                        expcomp     = keyFile.get_string ("ExifInfo", "ExpComp");
-                    }
+                if (keyFile.has_key ("ExifInfo", "FocalLen35mm")) {
+                    focalLen35mm = keyFile.get_double ("ExifInfo", "FocalLen35mm");
+                } else {
+                    focalLen35mm = focalLen;    // prevent crashes on old files
                 }
 
-                if (keyFile.has_key ("ExifInfo", "Lens")) {
-                    lens        = keyFile.get_string ("ExifInfo", "Lens");
+                if (keyFile.has_key ("ExifInfo", "FocusDist")) {
+                    focusDist = keyFile.get_double ("ExifInfo", "FocusDist");
+                } else {
+                    focusDist = 0;
                 }
 
-                if (keyFile.has_key ("ExifInfo", "CameraMake")) {
-                    camMake     = keyFile.get_string ("ExifInfo", "CameraMake");
+                if (keyFile.has_key ("ExifInfo", "ISO")) {
+                    iso         = keyFile.get_integer ("ExifInfo", "ISO");
                 }
 
-                if (keyFile.has_key ("ExifInfo", "CameraModel")) {
-                    camModel    = keyFile.get_string ("ExifInfo", "CameraModel");
+                if (keyFile.has_key ("ExifInfo", "ExpComp")) {
+                    expcomp     = keyFile.get_string ("ExifInfo", "ExpComp");
                 }
             }
 
-            if (keyFile.has_group ("FileInfo")) {
-                if (keyFile.has_key ("FileInfo", "Filetype")) {
-                    filetype    = keyFile.get_string ("FileInfo", "Filetype");
-                }
+            if (keyFile.has_key ("ExifInfo", "Lens")) {
+                lens        = keyFile.get_string ("ExifInfo", "Lens");
             }
 
-            if (format == FT_Raw && keyFile.has_group ("ExtraRawInfo")) {
-                if (keyFile.has_key ("ExtraRawInfo", "ThumbImageType")) {
-                    thumbImgType    = keyFile.get_integer ("ExtraRawInfo", "ThumbImageType");
-                }
-            } else {
-                rotate = 0;
-                thumbImgType = 0;
+            if (keyFile.has_key ("ExifInfo", "CameraMake")) {
+                camMake     = keyFile.get_string ("ExifInfo", "CameraMake");
+            }
+
+            if (keyFile.has_key ("ExifInfo", "CameraModel")) {
+                camModel    = keyFile.get_string ("ExifInfo", "CameraModel");
             }
+        }
 
-            return 0;
+        if (keyFile.has_group ("FileInfo")) {
+            if (keyFile.has_key ("FileInfo", "Filetype")) {
+                filetype    = keyFile.get_string ("FileInfo", "Filetype");
+            }
         }
+
+        if (format == FT_Raw && keyFile.has_group ("ExtraRawInfo")) {
+            if (keyFile.has_key ("ExtraRawInfo", "ThumbImageType")) {
+                thumbImgType    = keyFile.get_integer ("ExtraRawInfo", "ThumbImageType");
+            }
+        } else {
+            rotate = 0;
+            thumbImgType = 0;
+        }
+
+        return 0;
     } catch (Glib::Error &err) {
         if (options.rtSettings.verbose) {
-            printf("CacheImageData::load / Error code %d while reading values from \"%s\":\n%s\n", err.code(), fname.c_str(), err.what().c_str());
+            printf("CacheImageData::load / Error code %d while reading values:\n%s\n", err.code(), err.what().c_str());
         }
     } catch (...) {
         if (options.rtSettings.verbose) {
-            printf("CacheImageData::load / Unknown exception while trying to load \"%s\"!\n", fname.c_str());
+            printf("CacheImageData::load / Unknown exception while reading values!\n");
         }
     }
 
@@ -189,18 +184,10 @@ int CacheImageData::load (const Glib::ustring& fname)
 /*
  * Save the General, DateTime, ExifInfo, File info and ExtraRawInfo sections of the image data file
  */
-int CacheImageData::save (const Glib::ustring& fname)
+int CacheImageData::save (Glib::KeyFile& keyFile)
 {
 
-    Glib::ustring keyData;
-
-    try {
-
-    Glib::KeyFile keyFile;
-
     try {
-        keyFile.load_from_file (fname);
-    } catch (Glib::Error&) {}
 
     keyFile.set_string  ("General", "MD5", md5);
     keyFile.set_string  ("General", "Version", RTVERSION);
@@ -247,34 +234,17 @@ int CacheImageData::save (const Glib::ustring& fname)
         keyFile.set_integer ("ExtraRawInfo", "ThumbImageType", thumbImgType);
     }
 
-    keyData = keyFile.to_data ();
+    return 0;
 
     } catch (Glib::Error &err) {
         if (options.rtSettings.verbose) {
-            printf("CacheImageData::save / Error code %d while reading values from \"%s\":\n%s\n", err.code(), fname.c_str(), err.what().c_str());
+            printf("CacheImageData::save / Error code %d while writing values:\n%s\n", err.code(), err.what().c_str());
         }
     } catch (...) {
         if (options.rtSettings.verbose) {
-            printf("CacheImageData::save / Unknown exception while trying to save \"%s\"!\n", fname.c_str());
+            printf("CacheImageData::save / Unknown exception while writing values!\n");
         }
     }
 
-    if (keyData.empty ()) {
-        return 1;
-    }
-
-    FILE *f = g_fopen (fname.c_str (), "wt");
-
-    if (!f) {
-        if (options.rtSettings.verbose) {
-            printf("CacheImageData::save / Error: unable to open file \"%s\" with write access!\n", fname.c_str());
-        }
-
-        return 1;
-    } else {
-        fprintf (f, "%s", keyData.c_str ());
-        fclose (f);
-        return 0;
-    }
+    return 1;
 }
-
@@ -73,8 +73,9 @@ public:
 
     CacheImageData ();
 
-    int load (const Glib::ustring& fname);
-    int save (const Glib::ustring& fname);
+    // read from / write to the data section of the cache entry, see CacheManager
+    int load (const Glib::KeyFile& keyFile);
+    int save (Glib::KeyFile& keyFile);
 
     Glib::ustring getCamera() const
     {
@@ -0,0 +1,494 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "cacheindex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include <glib/gstdio.h>
+#include <glibmm.h>
+
+#include "options.h"
+
+namespace
+{
+
+constexpr char fileMagic[8] = {'R', 'T', 'C', 'I', 'v', '1', '\n', '\0'};
+constexpr guint32 recordMagic = 0x52435452;
+// erases a whole entry, eraseSection | section erases a single section
+constexpr guint8 eraseRecord = 0xff;
+constexpr guint8 eraseSection = 0x80;
+
+// magic, type, modification time, size, path length, payload length
+constexpr std::size_t recordHeaderSize = sizeof(guint32) + sizeof(guint8) + 2 * sizeof(gint64) + 2 * sizeof(guint32);
+
+// superseded records are only reclaimed once they outweigh the live ones by that much
+constexpr gint64 minDeadBytes = 4 << 20;
+
+template<typename T>
+void put (std::string& buffer, T value)
+{
+    buffer.append (reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+T get (const char*& data)
+{
+    T value;
+    memcpy (&value, data, sizeof(T));
+    data += sizeof(T);
+    return value;
+}
+
+bool writeRecord (FILE* f, const std::string& path, const CacheIndex::Stamp& stamp, guint8 type, const char* payload, guint32 length)
+{
+    std::string header;
+    header.reserve (recordHeaderSize);
+    put (header, recordMagic);
+    put (header, type);
+    put (header, stamp.modified);
+    put (header, stamp.size);
+    put (header, guint32(path.size ()));
+    put (header, length);
+
+    return fwrite (header.data (), 1, header.size (), f) == header.size ()
+           && fwrite (path.data (), 1, path.size (), f) == path.size ()
+           && fwrite (payload, 1, length, f) == length;
+}
+
+}
+
+bool CacheIndex::getStamp (const Glib::ustring& fname, Stamp& stamp)
+{
+    GStatBuf st;
+
+    if (g_stat (fname.c_str (), &st) != 0) {
+        return false;
+    }
+
+    stamp.modified = st.st_mtime;
+    stamp.size = st.st_size;
+    return true;
+}
+
+CacheIndex::CacheIndex () :
+    file (nullptr),
+    fileLength (0),
+    mapping (nullptr),
+    mapData (nullptr),
+    mapLength (0),
+    serial (0)
+{
+}
+
+CacheIndex::~CacheIndex ()
+{
+    close ();
+}
+
+void CacheIndex::open (const Glib::ustring& indexFileName)
+{
+    close ();
+
+    fileName = indexFileName;
+
+    if (scan ()) {
+        file = g_fopen (fileName.c_str (), "ab");
+    } else if (!rewrite (entries)) {
+        // missing, damaged or unreadable index: start from scratch
+        entries.clear ();
+
+        if (!rewrite (entries) && options.rtSettings.verbose) {
+            std::cerr << "Failed to create the cache index '" << fileName << "'" << std::endl;
+        }
+    }
+}
+
+void CacheIndex::close ()
+{
+    unmap ();
+
+    if (file) {
+        fclose (file);
+        file = nullptr;
+    }
+
+    fileLength = 0;
+    entries.clear ();
+    serial = 0;
+}
+
+bool CacheIndex::read (const Glib::ustring& fname, const Stamp& stamp, Section section, std::string& payload)
+{
+    const auto iterator = entries.find (fname);
+
+    if (iterator == entries.end () || !(iterator->second.stamp == stamp)) {
+        return false;
+    }
+
+    const Location& location = iterator->second.sections[static_cast<std::size_t>(section)];
+
+    if (location.offset < 0 || !map (location.offset + location.length)) {
+        return false;
+    }
+
+    payload.assign (mapData + location.offset, location.length);
+    return true;
+}
+
+void CacheIndex::write (const Glib::ustring& fname, const Stamp& stamp, Section section, const std::string& payload)
+{
+    gint64 offset;
+
+    if (!append (fname, stamp, static_cast<guint8>(section), payload.data (), payload.size (), offset)) {
+        return;
+    }
+
+    Entry& entry = entries[fname];
+
+    if (!(entry.stamp == stamp)) {
+        entry = Entry ();
+        entry.stamp = stamp;
+    }
+
+    entry.sections[static_cast<std::size_t>(section)] = {offset, guint32(payload.size ())};
+    entry.serial = ++serial;
+}
+
+void CacheIndex::erase (const Glib::ustring& fname)
+{
+    const auto iterator = entries.find (fname);
+
+    if (iterator == entries.end ()) {
+        return;
+    }
+
+    gint64 offset;
+    append (fname, {0, 0}, eraseRecord, nullptr, 0, offset);
+    entries.erase (iterator);
+}
+
+void CacheIndex::erase (const Glib::ustring& fname, Section section)
+{
+    const auto iterator = entries.find (fname);
+
+    if (iterator == entries.end () || iterator->second.sections[static_cast<std::size_t>(section)].offset < 0) {
+        return;
+    }
+
+    gint64 offset;
+    append (fname, iterator->second.stamp, eraseSection | static_cast<guint8>(section), nullptr, 0, offset);
+    iterator->second.sections[static_cast<std::size_t>(section)] = Location ();
+}
+
+void CacheIndex::rename (const Glib::ustring& oldfname, const Glib::ustring& newfname, const Stamp& newStamp)
+{
+    const auto iterator = entries.find (oldfname);
+
+    if (iterator == entries.end ()) {
+        return;
+    }
+
+    const Entry entry = iterator->second;
+
+    erase (newfname);
+
+    for (std::size_t i = 0; i < sectionCount; ++i) {
+        const Section section = static_cast<Section>(i);
+        std::string payload;
+
+        if (read (oldfname, entry.stamp, section, payload)) {
+            write (newfname, newStamp, section, payload);
+        }
+    }
+
+    erase (oldfname);
+}
+
+void CacheIndex::clear (bool keepData)
+{
+    if (keepData) {
+        for (auto& entry : entries) {
+            for (std::size_t i = 0; i < sectionCount; ++i) {
+                if (static_cast<Section>(i) != Section::DATA) {
+                    entry.second.sections[i] = Location ();
+                }
+            }
+        }
+    } else {
+        entries.clear ();
+    }
+
+    if (!rewrite (entries) && options.rtSettings.verbose) {
+        std::cerr << "Failed to rewrite the cache index '" << fileName << "'" << std::endl;
+    }
+}
+
+void CacheIndex::compact (std::size_t maxEntries)
+{
+    std::unordered_map<std::string, Entry> kept;
+
+    if (entries.size () > maxEntries) {
+        std::vector<std::pair<guint64, const std::string*>> order;
+        order.reserve (entries.size ());
+
+        for (const auto& entry : entries) {
+            order.emplace_back (entry.second.serial, &entry.first);
+        }
+
+        std::nth_element (order.begin (), order.begin () + maxEntries, order.end (), std::greater<std::pair<guint64, const std::string*>> ());
+        order.resize (maxEntries);
+
+        for (const auto& entry : order) {
+            kept.emplace (*entry.second, entries[*entry.second]);
+        }
+    } else {
+        kept = entries;
+    }
+
+    gint64 liveBytes = sizeof(fileMagic);
+
+    for (const auto& entry : kept) {
+        for (const auto& location : entry.second.sections) {
+            if (location.offset >= 0) {
+                liveBytes += recordHeaderSize + entry.first.size () + location.length;
+            }
+        }
+    }
+
+    if (kept.size () == entries.size () && fileLength - liveBytes <= std::max (liveBytes, minDeadBytes)) {
+        return;
+    }
+
+    if (!rewrite (kept) && options.rtSettings.verbose) {
+        std::cerr << "Failed to compact the cache index '" << fileName << "'" << std::endl;
+    }
+}
+
+std::size_t CacheIndex::size () const
+{
+    return entries.size ();
+}
+
+bool CacheIndex::scan ()
+{
+    entries.clear ();
+    serial = 0;
+    fileLength = 0;
+
+    if (!map (0) || mapLength < gint64(sizeof(fileMagic)) || memcmp (mapData, fileMagic, sizeof(fileMagic))) {
+        return false;
+    }
+
+    gint64 position = sizeof(fileMagic);
+
+    while (position + gint64(recordHeaderSize) <= mapLength) {
+        const char* data = mapData + position;
+
+        if (get<guint32> (data) != recordMagic) {
+            break;
+        }
+
+        const guint8 type = get<guint8> (data);
+        Stamp stamp;
+        stamp.modified = get<gint64> (data);
+        stamp.size = get<gint64> (data);
+        const guint32 pathLength = get<guint32> (data);
+        const guint32 payloadLength = get<guint32> (data);
+
+        const gint64 payloadOffset = position + recordHeaderSize + pathLength;
+
+        if (payloadOffset + payloadLength > mapLength || (type != eraseRecord && (type & ~eraseSection) >= sectionCount)) {
+            break;
+        }
+
+        const std::string path (data, pathLength);
+
+        if (type == eraseRecord) {
+            entries.erase (path);
+        } else if (type & eraseSection) {
+            const auto iterator = entries.find (path);
+
+            if (iterator != entries.end () && iterator->second.stamp == stamp) {
+                iterator->second.sections[type & ~eraseSection] = Location ();
+            }
+        } else {
+            Entry& entry = entries[path];
+
+            if (!(entry.stamp == stamp)) {
+                entry = Entry ();
+                entry.stamp = stamp;
+            }
+
+            entry.sections[type] = {payloadOffset, payloadLength};
+            entry.serial = ++serial;
+        }
+
+        position = payloadOffset + payloadLength;
+    }
+
+    fileLength = position;
+
+    // a truncated or damaged tail is dropped by rewriting the valid records
+    return position == mapLength;
+}
+
+bool CacheIndex::map (gint64 end)
+{
+    if (mapping && end <= mapLength) {
+        return true;
+    }
+
+    if (file) {
+        fflush (file);
+    }
+
+    unmap ();
+
+    mapping = g_mapped_file_new (fileName.c_str (), FALSE, nullptr);
+
+    if (!mapping) {
+        return false;
+    }
+
+    mapData = g_mapped_file_get_contents (mapping);
+    mapLength = g_mapped_file_get_length (mapping);
+
+    return end <= mapLength;
+}
+
+void CacheIndex::unmap ()
+{
+    if (mapping) {
+        g_mapped_file_unref (mapping);
+        mapping = nullptr;
+    }
+
+    mapData = nullptr;
+    mapLength = 0;
+}
+
+bool CacheIndex::append (const std::string& path, const Stamp& stamp, guint8 type, const char* payload, guint32 length, gint64& payloadOffset)
+{
+    if (!file) {
+        return false;
+    }
+
+    if (!writeRecord (file, path, stamp, type, payload, length)) {
+        // stop writing, the damaged tail gets dropped when the index is opened again
+        fclose (file);
+        file = nullptr;
+
+        if (options.rtSettings.verbose) {
+            std::cerr << "Failed to write to the cache index '" << fileName << "'" << std::endl;
+        }
+
+        return false;
+    }
+
+    payloadOffset = fileLength + recordHeaderSize + path.size ();
+    fileLength = payloadOffset + length;
+    return true;
+}
+
+bool CacheIndex::rewrite (const std::unordered_map<std::string, Entry>& kept)
+{
+    // keep the LRU order of the entries in the new file
+    std::vector<std::pair<guint64, const std::string*>> order;
+    order.reserve (kept.size ());
+
+    for (const auto& entry : kept) {
+        order.emplace_back (entry.second.serial, &entry.first);
+    }
+
+    std::sort (order.begin (), order.end ());
+
+    const Glib::ustring tempName = fileName + ".tmp";
+    FILE* out = g_fopen (tempName.c_str (), "wb");
+
+    if (!out) {
+        return false;
+    }
+
+    bool success = fwrite (fileMagic, 1, sizeof(fileMagic), out) == sizeof(fileMagic);
+    gint64 length = sizeof(fileMagic);
+
+    std::unordered_map<std::string, Entry> moved;
+    guint64 newSerial = 0;
+
+    for (auto item = order.begin (); success && item != order.end (); ++item) {
+        const std::string& path = *item->second;
+        Entry entry = kept.at (path);
+        bool empty = true;
+
+        for (std::size_t i = 0; i < sectionCount; ++i) {
+            Location& location = entry.sections[i];
+
+            if (location.offset < 0) {
+                continue;
+            }
+
+            if (!map (location.offset + location.length)
+                    || !writeRecord (out, path, entry.stamp, i, mapData + location.offset, location.length)) {
+                success = false;
+                break;
+            }
+
+            location.offset = length + recordHeaderSize + path.size ();
+            length = location.offset + location.length;
+            empty = false;
+        }
+
+        if (!empty) {
+            entry.serial = ++newSerial;
+            moved.emplace (path, entry);
+        }
+    }
+
+    success = fclose (out) == 0 && success;
+
+    if (success) {
+        unmap ();
+
+        if (file) {
+            fclose (file);
+            file = nullptr;
+        }
+
+        success = g_rename (tempName.c_str (), fileName.c_str ()) == 0;
+    }
+
+    if (!success) {
+        g_remove (tempName.c_str ());
+
+        if (!file && scan ()) {
+            file = g_fopen (fileName.c_str (), "ab");
+        }
+
+        return false;
+    }
+
+    entries = std::move (moved);
+    serial = newSerial;
+    fileLength = length;
+    file = g_fopen (fileName.c_str (), "ab");
+
+    return file != nullptr;
+}
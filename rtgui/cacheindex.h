@@ -0,0 +1,121 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+#include <glib.h>
+#include <glibmm/ustring.h>
+
+#include "../rtengine/noncopyable.h"
+
+/**
+ * @brief Single file index of the thumbnail cache
+ *
+ * Holds the cached sections of every image (CacheImageData and LiveThumbData key file, thumbnail
+ * pixels, auto exposure histogram and embedded profile) in one append-only file, so that opening a
+ * folder costs a few sequential reads of a memory mapped file instead of opening four files per image.
+ *
+ * Records are keyed by the image's path and validated against its modification time and size:
+ * writing a section with a different stamp drops the other sections of that path. Superseded
+ * and erased records stay in the file until compact() rewrites it.
+ *
+ * The class is not thread safe, CacheManager serializes the accesses.
+ */
+class CacheIndex final :
+    public rtengine::NonCopyable
+{
+public:
+    enum class Section {
+        DATA,
+        IMAGE,
+        AE_HISTOGRAM,
+        EMBEDDED_PROFILE
+    };
+
+    struct Stamp {
+        gint64 modified;
+        gint64 size;
+
+        bool operator == (const Stamp& other) const
+        {
+            return modified == other.modified && size == other.size;
+        }
+    };
+
+    /// Returns false if the file can't be stat'ed
+    static bool getStamp (const Glib::ustring& fname, Stamp& stamp);
+
+    CacheIndex ();
+    ~CacheIndex ();
+
+    /// Opens (or creates) the index file and scans its records
+    void open (const Glib::ustring& indexFileName);
+    void close ();
+
+    bool read (const Glib::ustring& fname, const Stamp& stamp, Section section, std::string& payload);
+    void write (const Glib::ustring& fname, const Stamp& stamp, Section section, const std::string& payload);
+
+    /// Drops all sections of fname
+    void erase (const Glib::ustring& fname);
+    void erase (const Glib::ustring& fname, Section section);
+    /// Moves all sections of oldfname to newfname, which gets the given stamp
+    void rename (const Glib::ustring& oldfname, const Glib::ustring& newfname, const Stamp& newStamp);
+    /// Drops every section but DATA (keepData = true) or everything
+    void clear (bool keepData);
+
+    /// Keeps the maxEntries most recently written entries and rewrites the file if it holds too many superseded records
+    void compact (std::size_t maxEntries);
+
+    std::size_t size () const;
+
+private:
+    static constexpr std::size_t sectionCount = 4;
+
+    struct Location {
+        Location (gint64 offset = -1, guint32 length = 0) : offset (offset), length (length) {}
+
+        gint64 offset; // of the payload, -1 if the section is missing
+        guint32 length;
+    };
+
+    struct Entry {
+        Entry () : stamp {0, 0}, serial (0) {}
+
+        Stamp stamp;
+        Location sections[sectionCount];
+        guint64 serial; // order of the last write, for the LRU
+    };
+
+    bool scan ();
+    bool map (gint64 end);
+    void unmap ();
+    bool append (const std::string& path, const Stamp& stamp, guint8 type, const char* payload, guint32 length, gint64& payloadOffset);
+    bool rewrite (const std::unordered_map<std::string, Entry>& kept);
+
+    Glib::ustring fileName;
+    FILE* file;
+    gint64 fileLength;
+    GMappedFile* mapping;
+    const char* mapData;
+    gint64 mapLength;
+
+    std::unordered_map<std::string, Entry> entries;
+    guint64 serial;
+};
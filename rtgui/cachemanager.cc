@@ -38,6 +38,9 @@ namespace
 
 constexpr int cacheDirMode = 0777;
 constexpr const char* cacheDirs[] = { "profiles", "images", "aehistograms", "embprofiles", "data" };
+// images, aehistograms, embprofiles and data are only kept to clear the files of older versions,
+// these sections now live in the index file
+constexpr const char* indexFileName = "thumbnails.rtci";
 
 }
 
@@ -55,14 +58,14 @@ void CacheManager::init ()
     baseDir = options.cacheBaseDir;
 
     auto error = g_mkdir_with_parents (baseDir.c_str(), cacheDirMode);
-
-    for (const auto& cacheDir : cacheDirs) {
-        error |= g_mkdir_with_parents (Glib::build_filename (baseDir, cacheDir).c_str(), cacheDirMode);
-    }
+    error |= g_mkdir_with_parents (Glib::build_filename (baseDir, "profiles").c_str(), cacheDirMode);
 
     if (error != 0 && options.rtSettings.verbose) {
         std::cerr << "Failed to create all cache directories: " << g_strerror(errno) << std::endl;
     }
+
+    MyMutex::MyLock indexLock (indexMutex);
+    index.open (Glib::build_filename (baseDir, indexFileName));
 }
 
 Thumbnail* CacheManager::getEntry (const Glib::ustring& fname)
@@ -86,21 +89,12 @@ Thumbnail* CacheManager::getEntry (const Glib::ustring& fname)
         }
     }
 
-    // build path name
-    const auto md5 = getMD5 (fname);
-
-    if (md5.empty ()) {
-        return nullptr;
-    }
-
-    const auto cacheName = getCacheFileName ("data", fname, ".txt", md5);
-
     // let's see if we have it in the cache
     {
+        Glib::KeyFile keyFile;
         CacheImageData imageData;
 
-        const auto error = imageData.load (cacheName);
-        if (error == 0 && imageData.supported) {
+        if (loadEntryData (fname, keyFile) && imageData.load (keyFile) == 0 && imageData.supported && !imageData.md5.empty ()) {
 
             thumbnail.reset (new Thumbnail (this, fname, &imageData));
             if (!thumbnail->isSupported ()) {
@@ -112,6 +106,12 @@ Thumbnail* CacheManager::getEntry (const Glib::ustring& fname)
     // if not, create a new one
     if (!thumbnail) {
 
+        const auto md5 = getMD5 (fname);
+
+        if (md5.empty ()) {
+            return nullptr;
+        }
+
         thumbnail.reset (new Thumbnail (this, fname, md5));
         if (!thumbnail->isSupported ()) {
             thumbnail.reset ();
@@ -181,17 +181,21 @@ void CacheManager::renameEntry (const std::string& oldfilename, const std::strin
 
     const auto newmd5 = getMD5 (newfilename);
 
-    auto error = g_rename (getCacheFileName ("profiles", oldfilename, paramFileExtension, oldmd5).c_str (), getCacheFileName ("profiles", newfilename, paramFileExtension, newmd5).c_str ());
-    error |= g_rename (getCacheFileName ("images", oldfilename, ".rtti", oldmd5).c_str (), getCacheFileName ("images", newfilename, ".rtti", newmd5).c_str ());
-    error |= g_rename (getCacheFileName ("images", oldfilename, ".cust16", oldmd5).c_str (), getCacheFileName ("images", newfilename, ".cust16", newmd5).c_str ());
-    error |= g_rename (getCacheFileName ("images", oldfilename, ".cust", oldmd5).c_str (), getCacheFileName ("images", newfilename, ".cust", newmd5).c_str ());
-    error |= g_rename (getCacheFileName ("images", oldfilename, ".jpg", oldmd5).c_str (), getCacheFileName ("images", newfilename, ".jpg", newmd5).c_str ());
-    error |= g_rename (getCacheFileName ("aehistograms", oldfilename, "", oldmd5).c_str (), getCacheFileName ("aehistograms", newfilename, "", newmd5).c_str ());
-    error |= g_rename (getCacheFileName ("embprofiles", oldfilename, ".icc", oldmd5).c_str (), getCacheFileName ("embprofiles", newfilename, ".icc", newmd5).c_str ());
-    error |= g_rename (getCacheFileName ("data", oldfilename, ".txt", oldmd5).c_str (), getCacheFileName ("data", newfilename, ".txt", newmd5).c_str ());
+    const auto error = g_rename (getCacheFileName ("profiles", oldfilename, paramFileExtension, oldmd5).c_str (), getCacheFileName ("profiles", newfilename, paramFileExtension, newmd5).c_str ());
 
     if (error != 0 && options.rtSettings.verbose) {
-        std::cerr << "Failed to rename all files for cache entry '" << oldfilename << "': " << g_strerror(errno) << std::endl;
+        std::cerr << "Failed to rename the cached profile of '" << oldfilename << "': " << g_strerror(errno) << std::endl;
+    }
+
+    {
+        MyMutex::MyLock indexLock (indexMutex);
+        CacheIndex::Stamp stamp;
+
+        if (CacheIndex::getStamp (newfilename, stamp)) {
+            index.rename (oldfilename, newfilename, stamp);
+        } else {
+            index.erase (oldfilename);
+        }
     }
 
     // check if it is opened
@@ -205,6 +209,8 @@ void CacheManager::renameEntry (const std::string& oldfilename, const std::strin
     openEntries.erase (iterator);
     openEntries.emplace (newfilename, thumbnail);
 
+    // keep the lock, so that closeThumbnail can't delete the thumbnail meanwhile;
+    // writing back to the cache only takes indexMutex
     thumbnail->setFileName (newfilename);
     thumbnail->updateCache ();
     thumbnail->saveThumbnail ();
@@ -232,6 +238,9 @@ void CacheManager::clearAll () const
     for (const auto& cacheDir : cacheDirs) {
         deleteDir (cacheDir);
     }
+
+    MyMutex::MyLock indexLock (indexMutex);
+    index.clear (false);
 }
 
 void CacheManager::clearImages () const
@@ -241,6 +250,9 @@ void CacheManager::clearImages () const
     deleteDir ("images");
     deleteDir ("aehistograms");
     deleteDir ("embprofiles");
+
+    MyMutex::MyLock indexLock (indexMutex);
+    index.clear (true);
 }
 
 void CacheManager::clearProfiles () const
@@ -270,27 +282,87 @@ void CacheManager::deleteDir (const Glib::ustring& dirName) const
 
 void CacheManager::deleteFiles (const Glib::ustring& fname, const std::string& md5, bool purgeData, bool purgeProfile) const
 {
-    if (md5.empty ()) {
+    {
+        MyMutex::MyLock indexLock (indexMutex);
+
+        if (purgeData) {
+            index.erase (fname);
+        } else {
+            index.erase (fname, CacheIndex::Section::IMAGE);
+            index.erase (fname, CacheIndex::Section::AE_HISTOGRAM);
+            index.erase (fname, CacheIndex::Section::EMBEDDED_PROFILE);
+        }
+    }
+
+    if (!purgeProfile || md5.empty ()) {
         return;
     }
 
-    auto error = g_remove (getCacheFileName ("images", fname, ".rtti", md5).c_str ());
-    error |= g_remove (getCacheFileName ("images", fname, ".cust16", md5).c_str ());
-    error |= g_remove (getCacheFileName ("images", fname, ".cust", md5).c_str ());
-    error |= g_remove (getCacheFileName ("images", fname, ".jpg", md5).c_str ());
-    error |= g_remove (getCacheFileName ("aehistograms", fname, "", md5).c_str ());
-    error |= g_remove (getCacheFileName ("embprofiles", fname, ".icc", md5).c_str ());
+    const auto error = g_remove (getCacheFileName ("profiles", fname, paramFileExtension, md5).c_str ());
 
-    if (purgeData) {
-        error |= g_remove (getCacheFileName ("data", fname, ".txt", md5).c_str ());
+    if (error != 0 && options.rtSettings.verbose) {
+        std::cerr << "Failed to delete the cached profile of '" << fname << "': " << g_strerror(errno) << std::endl;
     }
+}
 
-    if (purgeProfile) {
-        error |= g_remove (getCacheFileName ("profiles", fname, paramFileExtension, md5).c_str ());
+bool CacheManager::loadEntryData (const Glib::ustring& fname, Glib::KeyFile& keyFile) const
+{
+    std::string data;
+
+    if (!loadEntrySection (fname, CacheIndex::Section::DATA, data)) {
+        return false;
     }
 
-    if (error != 0 && options.rtSettings.verbose) {
-        std::cerr << "Failed to delete all files for cache entry '" << fname << "': " << g_strerror(errno) << std::endl;
+    try {
+        return keyFile.load_from_data (data);
+    } catch (Glib::Error&) {}
+
+    return false;
+}
+
+void CacheManager::updateEntryData (const Glib::ustring& fname, const std::function<bool (Glib::KeyFile&)>& update) const
+{
+    MyMutex::MyLock lock (indexMutex);
+
+    CacheIndex::Stamp stamp;
+
+    if (!CacheIndex::getStamp (fname, stamp)) {
+        return;
+    }
+
+    // the data section is shared by CacheImageData and rtengine::Thumbnail, each updating its own groups
+    try {
+        Glib::KeyFile keyFile;
+        std::string data;
+
+        if (index.read (fname, stamp, CacheIndex::Section::DATA, data)) {
+            keyFile.load_from_data (data);
+        }
+
+        if (update (keyFile)) {
+            index.write (fname, stamp, CacheIndex::Section::DATA, keyFile.to_data ());
+        }
+    } catch (Glib::Error&) {}
+}
+
+bool CacheManager::loadEntrySection (const Glib::ustring& fname, CacheIndex::Section section, std::string& payload) const
+{
+    MyMutex::MyLock lock (indexMutex);
+
+    payload.clear ();
+
+    CacheIndex::Stamp stamp;
+    return CacheIndex::getStamp (fname, stamp) && index.read (fname, stamp, section, payload);
+}
+
+void CacheManager::saveEntrySection (const Glib::ustring& fname, CacheIndex::Section section, const std::string& payload) const
+{
+    MyMutex::MyLock lock (indexMutex);
+
+    CacheIndex::Stamp stamp;
+
+    if (CacheIndex::getStamp (fname, stamp)) {
+        index.write (fname, stamp, section, payload);
     }
 }
 
@@ -342,48 +414,7 @@ Glib::ustring CacheManager::getCacheFileName (const Glib::ustring& subDir,
 
 void CacheManager::applyCacheSizeLimitation () const
 {
-    using FNameMTime = std::pair<Glib::ustring, Glib::TimeVal>;
-    std::vector<FNameMTime> files;
-
-    try {
-
-        const auto dirName = Glib::build_filename (baseDir, "data");
-        const auto dir = Gio::File::create_for_path (dirName);
-
-        auto enumerator = dir->enumerate_children ("standard::name,time::modified");
-
-        while (auto file = enumerator->next_file ()) {
-            files.emplace_back (file->get_name (), file->modification_time ());
-        }
-
-    } catch (Glib::Exception&) {}
-
-    if (files.size () <= options.maxCacheEntries) {
-        return;
-    }
-
-    std::sort (files.begin (), files.end (), [] (const FNameMTime& lhs, const FNameMTime& rhs)
-    {
-        return lhs.second < rhs.second;
-    });
-
-    auto cacheEntries = files.size ();
-
-    for (auto entry = files.begin (); cacheEntries-- > options.maxCacheEntries; ++entry) {
-
-        const auto& name = entry->first;
-
-        constexpr auto md5_size = 32;
-        const auto name_size = name.size();
-
-        if (name_size < md5_size + 5) {
-            continue;
-        }
-
-        const auto fname = name.substr (0, name_size - md5_size - 5);
-        const auto md5 = name.substr (name_size - md5_size - 4, md5_size);
-
-        deleteFiles (fname, md5, true, false);
-    }
+    // drops the least recently written entries and reclaims the superseded records
+    MyMutex::MyLock indexLock (indexMutex);
+    index.compact (options.maxCacheEntries);
 }
-
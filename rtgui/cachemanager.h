@@ -19,13 +19,15 @@
 #ifndef _CACHEMANAGER_
 #define _CACHEMANAGER_
 
+#include <functional>
 #include <string>
 #include <map>
 
-#include <glibmm/ustring.h>
+#include <glibmm.h>
 
 #include "../rtengine/noncopyable.h"
 
+#include "cacheindex.h"
 #include "threadutils.h"
 
 class Thumbnail;
@@ -38,6 +40,9 @@ private:
     Entries openEntries;
     Glib::ustring    baseDir;
     mutable MyMutex  mutex;
+    // guards the index only, so that it can be used while a Thumbnail is locked
+    mutable MyMutex  indexMutex;
+    mutable CacheIndex index;
 
     void deleteDir   (const Glib::ustring& dirName) const;
     void deleteFiles (const Glib::ustring& fname, const std::string& md5, bool purgeData, bool purgeProfile) const;
@@ -61,6 +66,12 @@ public:
     void clearProfiles () const;
     void clearFromCache (const Glib::ustring& fname, bool purge) const;
 
+    // sections of the thumbnail cache, a missing entry or section reads as empty
+    bool loadEntryData (const Glib::ustring& fname, Glib::KeyFile& keyFile) const;
+    void updateEntryData (const Glib::ustring& fname, const std::function<bool (Glib::KeyFile&)>& update) const;
+    bool loadEntrySection (const Glib::ustring& fname, CacheIndex::Section section, std::string& payload) const;
+    void saveEntrySection (const Glib::ustring& fname, CacheIndex::Section section, const std::string& payload) const;
+
     static std::string getMD5 (const Glib::ustring& fname);
 
     Glib::ustring    getCacheFileName (const Glib::ustring& subDir,
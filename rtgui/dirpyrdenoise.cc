@@ -211,6 +211,8 @@ DirPyrDenoise::DirPyrDenoise () : FoldableToolPanel(this, "dirpyrdenoise", M("TP
     medmethod->append (M("TP_DIRPYRDENOISE_5X5"));
     medmethod->append (M("TP_DIRPYRDENOISE_7X7"));
     medmethod->append (M("TP_DIRPYRDENOISE_9X9"));
+    medmethod->append (M("TP_DIRPYRDENOISE_15X15"));
+    medmethod->append (M("TP_DIRPYRDENOISE_25X25"));
     medmethod->set_active (0);
     medmethod->set_tooltip_text (M("TP_DIRPYRDENOISE_MET_TOOLTIP"));
     medmethodconn = medmethod->signal_changed().connect ( sigc::mem_fun(*this, &DirPyrDenoise::medmethodChanged) );
@@ -562,6 +564,10 @@ void DirPyrDenoise::read (const ProcParams* pp, const ParamsEdited* pedited)
         medmethod->set_active (4);
     } else if (pp->dirpyrDenoise.medmethod == "99") {
         medmethod->set_active (5);
+    } else if (pp->dirpyrDenoise.medmethod == "1515") {
+        medmethod->set_active (6);
+    } else if (pp->dirpyrDenoise.medmethod == "2525") {
+        medmethod->set_active (7);
     }
 
     medmethodChanged();
@@ -595,7 +601,7 @@ void DirPyrDenoise::read (const ProcParams* pp, const ParamsEdited* pedited)
         }
 
         if (!pedited->dirpyrDenoise.medmethod) {
-            medmethod->set_active (6);
+            medmethod->set_active (8);
         }
 
         if (!pedited->dirpyrDenoise.methodmed) {
@@ -695,7 +701,7 @@ void DirPyrDenoise::write (ProcParams* pp, ParamsEdited* pedited)
         pedited->dirpyrDenoise.Cmethod  = Cmethod->get_active_row_number() != 4;
         pedited->dirpyrDenoise.C2method  = C2method->get_active_row_number() != 3;
         pedited->dirpyrDenoise.smethod  = smethod->get_active_row_number() != 2;
-        pedited->dirpyrDenoise.medmethod  = medmethod->get_active_row_number() != 6;
+        pedited->dirpyrDenoise.medmethod  = medmethod->get_active_row_number() != 8;
         pedited->dirpyrDenoise.rgbmethod  = rgbmethod->get_active_row_number() != 2;
         pedited->dirpyrDenoise.methodmed  = methodmed->get_active_row_number() != 5;
         pedited->dirpyrDenoise.luma     = luma->getEditedState ();
@@ -789,6 +795,10 @@ void DirPyrDenoise::write (ProcParams* pp, ParamsEdited* pedited)
         pp->dirpyrDenoise.medmethod = "77";
     } else if (medmethod->get_active_row_number() == 5) {
         pp->dirpyrDenoise.medmethod = "99";
+    } else if (medmethod->get_active_row_number() == 6) {
+        pp->dirpyrDenoise.medmethod = "1515";
+    } else if (medmethod->get_active_row_number() == 7) {
+        pp->dirpyrDenoise.medmethod = "2525";
     }
 
     if (rgbmethod->get_active_row_number() == 0) {
@@ -90,7 +90,7 @@ void FileBrowserEntry::refreshThumbnailImage ()
         return;
     }
 
-    thumbImageUpdater->add (this, &updatepriority, false, this);
+    thumbImageUpdater->add (this, false, this);
 }
 
 void FileBrowserEntry::refreshQuickThumbnailImage ()
@@ -102,7 +102,7 @@ void FileBrowserEntry::refreshQuickThumbnailImage ()
 
     // Only make a (slow) processed preview if the picture has been edited at all
     bool upgrade_to_processed = (!options.internalThumbIfUntouched || thumbnail->isPParamsValid());
-    thumbImageUpdater->add(this, &updatepriority, upgrade_to_processed, this);
+    thumbImageUpdater->add(this, upgrade_to_processed, this);
 }
 
 void FileBrowserEntry::calcThumbnailSize ()
@@ -29,8 +29,11 @@
 #include <iostream>
 #include <tiffio.h>
 #include "rtwindow.h"
+#include <algorithm>
 #include <cstring>
 #include <cstdlib>
+#include <deque>
+#include <functional>
 #include <locale.h>
 #include "options.h"
 #include "../rtengine/icons.h"
@@ -38,6 +41,8 @@
 #include "rtimage.h"
 #include "version.h"
 #include "extprog.h"
+#include "../rtengine/noncopyable.h"
+#include "../rtengine/pipelineprofiler.h"
 
 #ifndef WIN32
 #include <glibmm/fileutils.h>
@@ -86,6 +91,179 @@ Glib::ustring fname_to_utf8 (const char* fname)
 
 bool fast_export = false;
 
+/* One image travelling through the command line batch converter */
+struct BatchJob {
+    Glib::ustring inputFile;
+    Glib::ustring outputFile;
+    rtengine::procparams::ProcParams params;
+    rtengine::InitialImage* ii = nullptr;
+    rtengine::ProcessingJob* job = nullptr;
+    rtengine::IImage16* resultImage = nullptr;
+};
+
+/* Hand-off queue between two stages of the batch pipeline. pop() blocks until an item is
+ * available or the producer has closed the queue. */
+class BatchJobQueue :
+    public rtengine::NonCopyable
+{
+public:
+    void push (BatchJob* job)
+    {
+        Glib::Threads::Mutex::Lock lock(mutex);
+        jobs.push_back(job);
+        cond.signal();
+    }
+
+    BatchJob* pop ()
+    {
+        Glib::Threads::Mutex::Lock lock(mutex);
+
+        while (jobs.empty() && !closed) {
+            cond.wait(mutex);
+        }
+
+        if (jobs.empty()) {
+            return nullptr;
+        }
+
+        BatchJob* job = jobs.front();
+        jobs.pop_front();
+        return job;
+    }
+
+    void close ()
+    {
+        Glib::Threads::Mutex::Lock lock(mutex);
+        closed = true;
+        cond.broadcast();
+    }
+
+private:
+    Glib::Threads::Mutex mutex;
+    Glib::Threads::Cond cond;
+    std::deque<BatchJob*> jobs;
+    bool closed = false;
+};
+
+/* Runs the load / process / save stages of the command line batch converter.
+ *
+ * With a depth of 1, each file goes through the three stages before the next one is read.
+ * With a larger depth, the next files are decoded in a loader thread and the previous results
+ * are encoded in a saver thread while the current one is being processed. At most 'depth' images
+ * are in flight at once (from the start of their decoding to the end of their encoding), which
+ * bounds the number of full size buffers alive at the same time. */
+class BatchPipeline :
+    public rtengine::NonCopyable
+{
+public:
+    using LoadStage = std::function<BatchJob* (const Glib::ustring&)>;
+    using ProcessStage = std::function<bool (BatchJob*)>;
+    using SaveStage = std::function<void (BatchJob*)>;
+
+    BatchPipeline (unsigned int depth, const LoadStage& load, const ProcessStage& process, const SaveStage& save) :
+        depth(std::max(depth, 1u)),
+        freeSlots(this->depth),
+        load(load),
+        process(process),
+        save(save),
+        inputFiles(nullptr)
+    {
+    }
+
+    void run (const std::vector<Glib::ustring>& files)
+    {
+        if (depth == 1) {
+            for (const auto& file : files) {
+                BatchJob* job = load(file);
+
+                if (job && process(job)) {
+                    save(job);
+                }
+
+                delete job;
+            }
+
+            return;
+        }
+
+        inputFiles = &files;
+        Glib::Threads::Thread* loader = Glib::Threads::Thread::create(sigc::mem_fun(*this, &BatchPipeline::loadThread));
+        Glib::Threads::Thread* saver = Glib::Threads::Thread::create(sigc::mem_fun(*this, &BatchPipeline::saveThread));
+
+        // the processing stage runs in the calling thread, it is the one using all the cores
+        while (BatchJob* job = loaded.pop()) {
+            if (process(job)) {
+                processed.push(job);
+            } else {
+                delete job;
+                releaseSlot();
+            }
+        }
+
+        processed.close();
+        loader->join();
+        saver->join();
+        inputFiles = nullptr;
+    }
+
+private:
+    void loadThread ()
+    {
+        for (const auto& file : *inputFiles) {
+            acquireSlot();
+            BatchJob* job = load(file);
+
+            if (job) {
+                loaded.push(job);
+            } else {
+                releaseSlot();
+            }
+        }
+
+        loaded.close();
+    }
+
+    void saveThread ()
+    {
+        while (BatchJob* job = processed.pop()) {
+            save(job);
+            delete job;
+            releaseSlot();
+        }
+    }
+
+    void acquireSlot ()
+    {
+        Glib::Threads::Mutex::Lock lock(slotMutex);
+
+        while (freeSlots == 0) {
+            slotCond.wait(slotMutex);
+        }
+
+        --freeSlots;
+    }
+
+    void releaseSlot ()
+    {
+        Glib::Threads::Mutex::Lock lock(slotMutex);
+        ++freeSlots;
+        slotCond.signal();
+    }
+
+    const unsigned int depth;
+    unsigned int freeSlots;
+    Glib::Threads::Mutex slotMutex;
+    Glib::Threads::Cond slotCond;
+
+    const LoadStage load;
+    const ProcessStage process;
+    const SaveStage save;
+
+    const std::vector<Glib::ustring>* inputFiles;
+    BatchJobQueue loaded;
+    BatchJobQueue processed;
+};
+
 }
 
 /* Process line command options
@@ -305,6 +483,7 @@ int processLineParams( int argc, char **argv )
     int compression = 92;
     int subsampling = 3;
     int bits = -1;
+    unsigned int pipelineDepth = 1;
     std::string outputType = "";
     unsigned errors = 0;
 
@@ -442,6 +621,36 @@ int processLineParams( int argc, char **argv )
                 fast_export = true;
                 break;
 
+            case 'P':
+                if (currParam.length() == 2) {
+                    std::cerr << "Error: the -P switch requires a mandatory value!" << std::endl;
+                    deleteProcParams(processingParams);
+                    return -3;
+                }
+
+                pipelineDepth = atoi(currParam.substr(2).c_str());
+
+                if (pipelineDepth < 1 || pipelineDepth > 16) {
+                    std::cerr << "Error: the value accompanying the -P switch has to be in the [1-16] range!" << std::endl;
+                    deleteProcParams(processingParams);
+                    return -3;
+                }
+
+                break;
+
+            case 'T':
+                if (iArg + 1 < argc) {
+                    iArg++;
+                    const bool chromeTrace = currParam.length() > 2 && currParam.at(2) == 'c';
+                    rtengine::PipelineProfiler::getInstance().enable(fname_to_utf8(argv[iArg]), chromeTrace ? rtengine::PipelineProfiler::Format::CHROME_TRACE : rtengine::PipelineProfiler::Format::JSON);
+                } else {
+                    std::cerr << "Error: the -T switch requires the name of the report file!" << std::endl;
+                    deleteProcParams(processingParams);
+                    return -3;
+                }
+
+                break;
+
             case 'c': // MUST be last option
                 while (iArg + 1 < argc) {
                     iArg++;
@@ -554,7 +763,7 @@ int processLineParams( int argc, char **argv )
                 std::cout << std::endl;
 #endif
                 std::cout << "Options:" << std::endl;
-                std::cout << "  " << Glib::path_get_basename(argv[0]) << "[-o <output>|-O <output>] [-q] [-a] [-s|-S] [-p <one.pp3> [-p <two.pp3> ...] ] [-d] [ -j[1-100] [-js<1-3>] | [-b<8|16>] [-t[z] | [-n]] ] [-Y] [-f] -c <input>" << std::endl;
+                std::cout << "  " << Glib::path_get_basename(argv[0]) << "[-o <output>|-O <output>] [-q] [-a] [-s|-S] [-p <one.pp3> [-p <two.pp3> ...] ] [-d] [ -j[1-100] [-js<1-3>] | [-b<8|16>] [-t[z] | [-n]] ] [-Y] [-f] [-P<1-16>] [-T[c] <report>] -c <input>" << std::endl;
                 std::cout << std::endl;
                 std::cout << "  -c <files>       Specify one or more input files or directory." << std::endl;
                 std::cout << "                   When specifying directories, Rawtherapee will look for images files that comply with the" << std::endl;
@@ -593,6 +802,12 @@ int processLineParams( int argc, char **argv )
                 std::cout << "                   Compression is hard-coded to 6." << std::endl;
                 std::cout << "  -Y               Overwrite output if present." << std::endl;
                 std::cout << "  -f               Use the custom fast-export processing pipeline." << std::endl;
+                std::cout << "  -P<1-16>         Number of images in flight when converting several files (default value: 1)." << std::endl;
+                std::cout << "                   With a value above 1, the next files are decoded and the previous results are" << std::endl;
+                std::cout << "                   saved while the current one is processed. Each image in flight needs its own" << std::endl;
+                std::cout << "                   memory, so keep this value low for large files; 3 is usually enough." << std::endl;
+                std::cout << "  -T[c] <report>   Write the time, CPU time and peak memory of each processing stage to <report>." << std::endl;
+                std::cout << "                   JSON by default, or Chrome trace format with 'c' (open it in chrome://tracing)." << std::endl;
                 std::cout << std::endl;
                 std::cout << "Your " << pparamsExt << " files can be incomplete, RawTherapee will build the final values as follows:" << std::endl;
                 std::cout << "  1- A new processing profile is created using neutral values," << std::endl;
@@ -673,25 +888,21 @@ int processLineParams( int argc, char **argv )
         }
     }
 
-    for( size_t iFile = 0; iFile < inputFiles.size(); iFile++) {
+    if( outputType.empty() ) {
+        outputType = "jpg";
+    }
 
-        // Has to be reinstanciated at each profile to have a ProcParams object with default values
-        rtengine::procparams::ProcParams currentParams;
+    // the stages may run in different threads, so each one counts its own errors
+    unsigned loadErrors = 0, processErrors = 0, saveErrors = 0;
 
-        Glib::ustring inputFile = inputFiles[iFile];
+    auto loadStage = [&](const Glib::ustring& inputFile) -> BatchJob* {
         std::cout << "Processing: " << inputFile << std::endl;
 
-        rtengine::InitialImage* ii = nullptr;
-        rtengine::ProcessingJob* job = nullptr;
         int errorCode;
         bool isRaw = false;
 
         Glib::ustring outputFile;
 
-        if( outputType.empty() ) {
-            outputType = "jpg";
-        }
-
         if( outputPath.empty() ) {
             Glib::ustring s = inputFile;
             Glib::ustring::size_type ext = s.find_last_of('.');
@@ -712,12 +923,12 @@ int processLineParams( int argc, char **argv )
 
         if( inputFile == outputFile) {
             std::cerr << "Cannot overwrite: " << inputFile << std::endl;
-            continue;
+            return nullptr;
         }
 
         if( !overwriteFiles && Glib::file_test( outputFile , Glib::FILE_TEST_EXISTS ) ) {
             std::cerr << outputFile  << " already exists: use -Y option to overwrite. This image has been skipped." << std::endl;
-            continue;
+            return nullptr;
         }
 
         // Load the image
@@ -728,14 +939,21 @@ int processLineParams( int argc, char **argv )
             isRaw = false;
         }
 
-        ii = rtengine::InitialImage::load ( inputFile, isRaw, &errorCode, nullptr );
+        rtengine::InitialImage* ii = rtengine::InitialImage::load ( inputFile, isRaw, &errorCode, nullptr );
 
         if (!ii) {
-            errors++;
+            loadErrors++;
             std::cerr << "Error loading file: " << inputFile << std::endl;
-            continue;
+            return nullptr;
         }
 
+        // Has to be reinstanciated at each profile to have a ProcParams object with default values
+        BatchJob* batchJob = new BatchJob;
+        batchJob->inputFile = inputFile;
+        batchJob->outputFile = outputFile;
+        batchJob->ii = ii;
+        rtengine::procparams::ProcParams& currentParams = batchJob->params;
+
         if (useDefault) {
             if (isRaw) {
                 if (options.defProfRaw == DEFPROFILE_DYNAMIC) {
@@ -784,30 +1002,46 @@ int processLineParams( int argc, char **argv )
 
         if( sideProcParams && !sideCarFound && skipIfNoSidecar ) {
             delete ii;
-            errors++;
+            delete batchJob;
+            loadErrors++;
             std::cerr << "Error: no sidecar procparams found for: " << inputFile << std::endl;
-            continue;
+            return nullptr;
         }
 
-        job = rtengine::ProcessingJob::create (ii, currentParams, fast_export);
+        batchJob->job = rtengine::ProcessingJob::create (ii, currentParams, fast_export);
 
-        if( !job ) {
-            errors++;
+        if( !batchJob->job ) {
+            loadErrors++;
             std::cerr << "Error creating processing for: " << inputFile << std::endl;
             ii->decreaseRef();
-            continue;
+            delete batchJob;
+            return nullptr;
         }
 
+        return batchJob;
+    };
+
+    auto processStage = [&](BatchJob* batchJob) -> bool {
+        int errorCode;
+
         // Process image
-        rtengine::IImage16* resultImage = rtengine::processImage (job, errorCode, nullptr, options.tunnelMetaData);
+        batchJob->resultImage = rtengine::processImage (batchJob->job, errorCode, nullptr, options.tunnelMetaData);
 
-        if( !resultImage ) {
-            errors++;
-            std::cerr << "Error processing: " << inputFile << std::endl;
-            rtengine::ProcessingJob::destroy( job );
-            continue;
+        if( !batchJob->resultImage ) {
+            processErrors++;
+            std::cerr << "Error processing: " << batchJob->inputFile << std::endl;
+            rtengine::ProcessingJob::destroy( batchJob->job );
+            return false;
         }
 
+        return true;
+    };
+
+    auto saveStage = [&](BatchJob* batchJob) {
+        int errorCode;
+        rtengine::IImage16* resultImage = batchJob->resultImage;
+        const Glib::ustring& outputFile = batchJob->outputFile;
+
         // save image to disk
         if( outputType == "jpg" ) {
             errorCode = resultImage->saveAsJPEG( outputFile, compression, subsampling );
@@ -820,18 +1054,22 @@ int processLineParams( int argc, char **argv )
         }
 
         if(errorCode) {
-            errors++;
+            saveErrors++;
             std::cerr << "Error saving to: " << outputFile << std::endl;
         } else {
             if( copyParamsFile ) {
                 Glib::ustring outputProcessingParams = outputFile + paramFileExtension;
-                currentParams.save( outputProcessingParams );
+                batchJob->params.save( outputProcessingParams );
             }
         }
 
-        ii->decreaseRef();
+        batchJob->ii->decreaseRef();
         resultImage->free();
-    }
+    };
+
+    BatchPipeline pipeline(std::min<size_t>(pipelineDepth, inputFiles.size()), loadStage, processStage, saveStage);
+    pipeline.run(inputFiles);
+    errors += loadErrors + processErrors + saveErrors;
 
     if (imgParams) {
         imgParams->deleteInstance();
@@ -438,6 +438,11 @@ void Options::setDefaults ()
 #else
     clutCacheSize = 1;
 #endif
+    demosaicCacheSize = 0;
+    waveletCacheSize = 256;
+    idleRenderDelay = 1000;
+    batchQueueWorkers = 2;
+    batchQueueMemory = 0;
     filledProfile = false;
     maxInspectorBuffers = 2; //  a rather conservative value for low specced systems...
     serializeTiffRead = true;
@@ -648,6 +653,7 @@ void Options::setDefaults ()
     rtSettings.leveldnaut = 0;
     rtSettings.leveldnliss = 0;
     rtSettings.leveldnautsimpl = 0;
+    rtSettings.resizeBoxPrefilter = 0;
 
     rtSettings.printerProfile = Glib::ustring();
     rtSettings.printerIntent = rtengine::RI_RELATIVE;
@@ -1228,10 +1234,34 @@ int Options::readFromFile (Glib::ustring fname)
                     rtSettings.leveldnautsimpl = keyFile.get_integer ("Performance", "SIMPLNRAUT");
                 }
 
+                if (keyFile.has_key ("Performance", "ResizeBoxPrefilter")) {
+                    rtSettings.resizeBoxPrefilter = keyFile.get_integer ("Performance", "ResizeBoxPrefilter");
+                }
+
                 if (keyFile.has_key ("Performance", "ClutCacheSize")) {
                     clutCacheSize              = keyFile.get_integer ("Performance", "ClutCacheSize");
                 }
 
+                if (keyFile.has_key ("Performance", "DemosaicCacheSize")) {
+                    demosaicCacheSize          = keyFile.get_integer ("Performance", "DemosaicCacheSize");
+                }
+
+                if (keyFile.has_key ("Performance", "WaveletCacheSize")) {
+                    waveletCacheSize           = keyFile.get_integer ("Performance", "WaveletCacheSize");
+                }
+
+                if (keyFile.has_key ("Performance", "IdleRenderDelay")) {
+                    idleRenderDelay            = keyFile.get_integer ("Performance", "IdleRenderDelay");
+                }
+
+                if (keyFile.has_key ("Performance", "BatchQueueWorkers")) {
+                    batchQueueWorkers          = keyFile.get_integer ("Performance", "BatchQueueWorkers");
+                }
+
+                if (keyFile.has_key ("Performance", "BatchQueueMemory")) {
+                    batchQueueMemory           = keyFile.get_integer ("Performance", "BatchQueueMemory");
+                }
+
                 if (keyFile.has_key ("Performance", "MaxInspectorBuffers")) {
                     maxInspectorBuffers        = keyFile.get_integer ("Performance", "MaxInspectorBuffers");
                 }
@@ -1999,7 +2029,13 @@ int Options::saveToFile (Glib::ustring fname)
         keyFile.set_integer ("Performance", "LevNRAUT", rtSettings.leveldnaut);
         keyFile.set_integer ("Performance", "LevNRLISS", rtSettings.leveldnliss);
         keyFile.set_integer ("Performance", "SIMPLNRAUT", rtSettings.leveldnautsimpl);
+        keyFile.set_integer ("Performance", "ResizeBoxPrefilter", rtSettings.resizeBoxPrefilter);
         keyFile.set_integer ("Performance", "ClutCacheSize", clutCacheSize);
+        keyFile.set_integer ("Performance", "DemosaicCacheSize", demosaicCacheSize);
+        keyFile.set_integer ("Performance", "WaveletCacheSize", waveletCacheSize);
+        keyFile.set_integer ("Performance", "IdleRenderDelay", idleRenderDelay);
+        keyFile.set_integer ("Performance", "BatchQueueWorkers", batchQueueWorkers);
+        keyFile.set_integer ("Performance", "BatchQueueMemory", batchQueueMemory);
         keyFile.set_integer ("Performance", "MaxInspectorBuffers", maxInspectorBuffers);
         keyFile.set_integer ("Performance", "PreviewDemosaicFromSidecar", prevdemo);
         keyFile.set_boolean ("Performance", "Daubechies", rtSettings.daubech);
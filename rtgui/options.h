@@ -250,6 +250,11 @@ public:
     int rgbDenoiseThreadLimit; // maximum number of threads for the denoising tool ; 0 = use the maximum available
     int maxInspectorBuffers;   // maximum number of buffers (i.e. images) for the Inspector feature
     int clutCacheSize;
+    int demosaicCacheSize;     // maximum size in MiB of the on-disk cache of demosaiced raw data ; 0 = disabled
+    int waveletCacheSize;      // maximum size in MiB of the in-memory cache of wavelet decompositions of the editor ; 0 = disabled
+    int idleRenderDelay;       // time in ms the parameters must be stable before the visible area is rendered at 1:1 in the background ; 0 = disabled
+    int batchQueueWorkers;     // number of images the batch queue develops at once
+    int batchQueueMemory;      // memory budget in MiB of the images developed at once by the batch queue ; 0 = half of the physical memory
     bool filledProfile;  // Used as reminder for the ProfilePanel "mode"
     prevdemo_t prevdemo; // Demosaicing method used for the <100% preview
     bool serializeTiffRead;
@@ -28,7 +28,7 @@
 using namespace std;
 
 ThumbBrowserBase::ThumbBrowserBase ()
-    : location(THLOC_FILEBROWSER), inspector(nullptr), isInspectorActive(false), eventTime(0), lastClicked(nullptr), previewHeight(options.thumbSize), numOfCols(1), arrangement(TB_Horizontal)
+    : location(THLOC_FILEBROWSER), inspector(nullptr), isInspectorActive(false), eventTime(0), lastClicked(nullptr), previewHeight(options.thumbSize), numOfCols(1), arrangement(TB_Horizontal), lastScrollPosition(0), scrollDirection(0)
 {
     inW = -1;
     inH = -1;
@@ -62,6 +62,14 @@ void ThumbBrowserBase::scrollChanged ()
 
     internal.setPosition ((int)(hscroll.get_value()), (int)(vscroll.get_value()));
 
+    // the thumbnails ahead of the scrolling are wanted first
+    const int position = (int)(arrangement == TB_Horizontal ? hscroll.get_value() : vscroll.get_value());
+
+    if (position != lastScrollPosition) {
+        scrollDirection = position > lastScrollPosition ? 1 : -1;
+        lastScrollPosition = position;
+    }
+
     if (!internal.isDirty()) {
         internal.setDirty ();
         internal.queue_draw ();
@@ -834,12 +842,32 @@ bool ThumbBrowserBase::Internal::on_draw(const ::Cairo::RefPtr< Cairo::Context>
     {
         MYWRITERLOCK(l, parent->entryRW);
 
+        // thumbnail updates go to the visible entries first, then to those of the look-ahead band, the
+        // others wait until nothing else is left. The band spans one page on both sides until the user
+        // scrolls; then it spans two pages ahead in the scrolling direction and half a page behind,
+        // where the distances count double
+        const int page = parent->arrangement == ThumbBrowserBase::TB_Horizontal ? w : h;
+        const int lookAhead = parent->scrollDirection ? 2 * page : page;
+        const int lookBehind = parent->scrollDirection ? page / 2 : page;
+        const int behindWeight = parent->scrollDirection ? 2 : 1;
+
         for (size_t i = 0; i < parent->fd.size() && !dirty; i++) { // if dirty meanwhile, cancel and wait for next redraw
-            if (!parent->fd[i]->drawable || !parent->fd[i]->insideWindow (0, 0, w, h)) {
-                parent->fd[i]->updatepriority = false;
+            ThumbBrowserEntryBase* const entry = parent->fd[i];
+
+            if (!entry->drawable) {
+                entry->updatepriority = ThumbBrowserEntryBase::lowestUpdatePriority;
+            } else if (entry->insideWindow (0, 0, w, h)) {
+                entry->updatepriority = 0;
+                entry->draw (cr);
             } else {
-                parent->fd[i]->updatepriority = true;
-                parent->fd[i]->draw (cr);
+                // positive ahead of the scrolling
+                const int distance = entry->distanceToWindow (0, 0, w, h) * (parent->scrollDirection < 0 ? -1 : 1);
+
+                if (distance >= 0) {
+                    entry->updatepriority = distance <= lookAhead ? std::max (distance, 1) : ThumbBrowserEntryBase::lowestUpdatePriority;
+                } else {
+                    entry->updatepriority = -distance <= lookBehind ? -distance * behindWeight : ThumbBrowserEntryBase::lowestUpdatePriority;
+                }
             }
         }
     }
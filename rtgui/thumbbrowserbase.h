@@ -176,6 +176,9 @@ protected:
 
     Arrangement arrangement;
 
+    int lastScrollPosition;
+    int scrollDirection;    // of the last scroll: -1 towards the first entries, +1 towards the last ones, 0 before any
+
     std::set<Glib::ustring> editedFiles;
 
     void arrangeFiles ();
@@ -71,11 +71,13 @@ ThumbBrowserEntryBase::ThumbBrowserEntryBase (const Glib::ustring& fname) :
     italicstyle(false),
     edited(false),
     recentlysaved(false),
-    updatepriority(false),
+    updatepriority(lowestUpdatePriority),
     withFilename(WFNAME_NONE)
 {
 }
 
+constexpr int ThumbBrowserEntryBase::lowestUpdatePriority;
+
 ThumbBrowserEntryBase::~ThumbBrowserEntryBase ()
 {
     delete[] preview;
@@ -587,6 +589,15 @@ bool ThumbBrowserEntryBase::insideWindow (int x, int y, int w, int h)
     return !(ofsX + startx > x + w || ofsX + startx + exp_width < x || ofsY + starty > y + h || ofsY + starty + exp_height < y);
 }
 
+int ThumbBrowserEntryBase::distanceToWindow (int x, int y, int w, int h) const
+{
+
+    const int dx = std::max (std::max (x - (ofsX + startx + exp_width), ofsX + startx - (x + w)), 0);
+    const int dy = std::max (std::max (y - (ofsY + starty + exp_height), ofsY + starty - (y + h)), 0);
+    const bool before = ofsY + starty + exp_height < y || ofsX + startx + exp_width < x;
+    return before ? -std::max (dx, dy) : std::max (dx, dy);
+}
+
 std::vector<Glib::RefPtr<Gdk::Pixbuf> > ThumbBrowserEntryBase::getIconsOnImageArea()
 {
     return std::vector<Glib::RefPtr<Gdk::Pixbuf> >();
@@ -19,6 +19,8 @@
 #ifndef _THUMBNAILBROWSERENTRYBASE_
 #define _THUMBNAILBROWSERENTRYBASE_
 
+#include <atomic>
+#include <limits>
 #include <gtkmm.h>
 #include "lwbuttonset.h"
 #include "thumbnail.h"
@@ -110,7 +112,10 @@ public:
     bool italicstyle;
     bool edited;
     bool recentlysaved;
-    bool updatepriority;
+    // order of the thumbnail image updates, set when drawing: 0 for visible entries, the distance
+    // in pixels to the visible area inside the look-ahead band, lowestUpdatePriority elsewhere
+    std::atomic<int> updatepriority;
+    static constexpr int lowestUpdatePriority = std::numeric_limits<int>::max();
     eWithFilename withFilename;
 
     explicit ThumbBrowserEntryBase   (const Glib::ustring& fname);
@@ -167,6 +172,7 @@ public:
     bool inside             (int x, int y);
     void getPosInImgSpace   (int x, int y, rtengine::Coord2D &coord);
     bool insideWindow       (int x, int y, int w, int h);
+    int distanceToWindow    (int x, int y, int w, int h) const; // negative before the window (above or left of it)
     void setPosition        (int x, int y, int w, int h);
     void setOffset (int x, int y);
 
@@ -17,6 +17,7 @@
  *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <iterator>
 #include <set>
 #include "thumbimageupdater.h"
 #include <gtkmm.h>
@@ -36,19 +37,17 @@ class ThumbImageUpdater::Impl :
 public:
 
     struct Job {
-        Job(ThumbBrowserEntryBase* tbe, bool* priority, bool upgrade,
+        Job(ThumbBrowserEntryBase* tbe, bool upgrade,
             ThumbImageUpdateListener* listener):
             tbe_(tbe),
     /*pparams_(pparams),
     height_(height), */
-            priority_(priority),
             upgrade_(upgrade),
             listener_(listener)
         {}
 
         Job():
             tbe_(nullptr),
-            priority_(nullptr),
             upgrade_(false),
             listener_(nullptr)
         {}
@@ -56,7 +55,6 @@ public:
         ThumbBrowserEntryBase* tbe_;
         /*rtengine::procparams::ProcParams pparams_;
         int height_;*/
-        bool* priority_;
         bool upgrade_;
         ThumbImageUpdateListener* listener_;
     };
@@ -103,31 +101,22 @@ public:
                 return;
             }
 
-            JobList::iterator i;
+            // the priorities follow the browser's viewport, so they are read
+            // again for each job: take the entry closest to the visible area,
+            // then none upgrade jobs, then the oldest job
+            JobList::iterator i = jobs_.begin();
+            int priority = i->tbe_->updatepriority;
 
-            // see if any priority jobs exist
-            for ( i = jobs_.begin(); i != jobs_.end(); ++i) {
-                if ( *(i->priority_) ) {
-                    DEBUG("processing(priority) %s", i->tbe_->thumbnail->getFileName().c_str());
-                    break;
-                }
-            }
+            for ( JobList::iterator k = std::next(i); k != jobs_.end() && (priority != 0 || i->upgrade_); ++k) {
+                const int kPriority = k->tbe_->updatepriority;
 
-            // see if any none upgrade jobs exist
-            if ( i == jobs_.end() ) {
-                for ( i = jobs_.begin(); i != jobs_.end(); ++i) {
-                    if ( !i->upgrade_ ) {
-                        DEBUG("processing(not-upgrade) %s", i->tbe_->thumbnail->getFileName().c_str());
-                        break;
-                    }
+                if ( kPriority < priority || (kPriority == priority && i->upgrade_ && !k->upgrade_) ) {
+                    i = k;
+                    priority = kPriority;
                 }
             }
 
-            // if none, then use first
-            if ( i == jobs_.end() ) {
-                i = jobs_.begin();
-                DEBUG("processing(first) %s", i->tbe_->thumbnail->getFileName().c_str());
-            }
+            DEBUG("processing(priority %d) %s", priority, i->tbe_->thumbnail->getFileName().c_str());
 
             // copy found job
             j = *i;
@@ -182,7 +171,7 @@ ThumbImageUpdater::ThumbImageUpdater():
 }
 
 void
-ThumbImageUpdater::add(ThumbBrowserEntryBase* tbe, bool* priority, bool upgrade, ThumbImageUpdateListener* l)
+ThumbImageUpdater::add(ThumbBrowserEntryBase* tbe, bool upgrade, ThumbImageUpdateListener* l)
 {
     // nobody listening?
     if ( l == nullptr ) {
@@ -199,17 +188,16 @@ ThumbImageUpdater::add(ThumbBrowserEntryBase* tbe, bool* priority, bool upgrade,
                 i->listener_ == l &&
                 i->upgrade_ == upgrade ) {
             DEBUG("updating job %s", tbe->shortname.c_str());
-            // we have one, update queue entry, will be picked up by thread when processed
+            // we have one, will be picked up by thread when processed
             /*i->pparams_ = params;
             i->height_ = height; */
-            i->priority_ = priority;
             return;
         }
     }
 
     // create a new job and append to queue
     DEBUG("queing job %s", tbe->shortname.c_str());
-    impl_->jobs_.push_back(Impl::Job(tbe, priority, upgrade, l));
+    impl_->jobs_.push_back(Impl::Job(tbe, upgrade, l));
 
     DEBUG("adding run request %s", tbe->shortname.c_str());
     impl_->threadPool_->push(sigc::mem_fun(*impl_, &ThumbImageUpdater::Impl::processNextJob));
@@ -63,15 +63,15 @@ public:
      * @brief Add an thumbnail image update request.
      *
      * Code will add the request to the queue and, if needed, start a pool
-     * thread to process it.
+     * thread to process it. Queued requests are run in the order given by
+     * the current ThumbBrowserEntryBase::updatepriority of their entries,
+     * so that the visible entries are updated first.
      *
-     * @param t thumbnail
-     * @param params processing params (?)
-     * @param height how big
-     * @param priority if \c true then run as soon as possible
+     * @param tbe entry to update
+     * @param upgrade if \c true then upgrade a quick thumbnail to a processed one
      * @param l listener waiting on update
      */
-    void add(ThumbBrowserEntryBase* tbe, bool* priority, bool upgrade, ThumbImageUpdateListener* l);
+    void add(ThumbBrowserEntryBase* tbe, bool upgrade, ThumbImageUpdateListener* l);
 
     /**
      * @brief Remove jobs associated with listener \c l.
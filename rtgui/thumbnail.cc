@@ -155,7 +155,7 @@ void Thumbnail::_generateThumbnailImage ()
         cfs.supported = true;
         needsReProcessing = true;
 
-        cfs.save (getCacheFileName ("data", ".txt"));
+        saveCacheImageData ();
 
         generateExifDateTimeStrings ();
     }
@@ -472,7 +472,7 @@ void Thumbnail::imageDeveloped ()
 {
 
     cfs.recentlySaved = true;
-    cfs.save (getCacheFileName ("data", ".txt"));
+    saveCacheImageData ();
 
     if (options.saveParamsCache) {
         pparams.save (getCacheFileName ("profiles", paramFileExtension));
@@ -772,7 +772,7 @@ int Thumbnail::infoFromImage (const Glib::ustring& fname, rtengine::RawMetaDataL
 /*
  * Read all thumbnail's data from the cache; build and save them if doesn't exist - NON PROTECTED
  * This includes:
- *  - image's bitmap (*.rtti)
+ *  - image's bitmap
  *  - auto exposure's histogram (full thumbnail only)
  *  - embedded profile (full thumbnail only)
  *  - LiveThumbData section of the data file
@@ -788,14 +788,16 @@ void Thumbnail::_loadThumbnail(bool firstTrial)
     tpp->isRaw = (cfs.format == (int) FT_Raw);
 
     // load supplementary data
-    bool succ = tpp->readData (getCacheFileName ("data", ".txt"));
+    Glib::KeyFile keyFile;
+    bool succ = cachemgr->loadEntryData (fname, keyFile) && tpp->readData (keyFile);
 
     if (succ) {
         tpp->getAutoWBMultipliers(cfs.redAWBMul, cfs.greenAWBMul, cfs.blueAWBMul);
     }
 
     // thumbnail image
-    succ = succ && tpp->readImage (getCacheFileName ("images", ""));
+    std::string payload;
+    succ = succ && cachemgr->loadEntrySection (fname, CacheIndex::Section::IMAGE, payload) && tpp->readImage (payload);
 
     if (!succ && firstTrial) {
         _generateThumbnailImage ();
@@ -815,10 +817,12 @@ void Thumbnail::_loadThumbnail(bool firstTrial)
 
     if ( cfs.thumbImgType == CacheImageData::FULL_THUMBNAIL ) {
         // load aehistogram
-        tpp->readAEHistogram (getCacheFileName ("aehistograms", ""));
+        cachemgr->loadEntrySection (fname, CacheIndex::Section::AE_HISTOGRAM, payload);
+        tpp->readAEHistogram (payload);
 
         // load embedded profile
-        tpp->readEmbProfile (getCacheFileName ("embprofiles", ".icc"));
+        cachemgr->loadEntrySection (fname, CacheIndex::Section::EMBEDDED_PROFILE, payload);
+        tpp->readEmbProfile (payload);
 
         tpp->init ();
     }
@@ -831,7 +835,7 @@ void Thumbnail::_loadThumbnail(bool firstTrial)
 /*
  * Read all thumbnail's data from the cache; build and save them if doesn't exist - MUTEX PROTECTED
  * This includes:
- *  - image's bitmap (*.rtti)
+ *  - image's bitmap
  *  - auto exposure's histogram (full thumbnail only)
  *  - embedded profile (full thumbnail only)
  *  - LiveThumbData section of the data file
@@ -845,7 +849,7 @@ void Thumbnail::loadThumbnail (bool firstTrial)
 /*
  * Save thumbnail's data to the cache - NON PROTECTED
  * This includes:
- *  - image's bitmap (*.rtti)
+ *  - image's bitmap
  *  - auto exposure's histogram (full thumbnail only)
  *  - embedded profile (full thumbnail only)
  *  - LiveThumbData section of the data file
@@ -857,30 +861,33 @@ void Thumbnail::_saveThumbnail ()
         return;
     }
 
-    if (g_remove (getCacheFileName ("images", ".rtti").c_str ()) != 0) {
-        // No file deleted, so we try to deleted obsolete files, if any
-        g_remove (getCacheFileName ("images", ".cust").c_str ());
-        g_remove (getCacheFileName ("images", ".cust16").c_str ());
-        g_remove (getCacheFileName ("images", ".jpg").c_str ());
-    }
+    // sections are always written, an empty one replaces the section of a previous thumbnail
 
     // save thumbnail image
-    tpp->writeImage (getCacheFileName ("images", ""), 1);
+    std::string payload;
+    tpp->writeImage (payload);
+    cachemgr->saveEntrySection (fname, CacheIndex::Section::IMAGE, payload);
 
     // save aehistogram
-    tpp->writeAEHistogram (getCacheFileName ("aehistograms", ""));
+    payload.clear ();
+    tpp->writeAEHistogram (payload);
+    cachemgr->saveEntrySection (fname, CacheIndex::Section::AE_HISTOGRAM, payload);
 
     // save embedded profile
-    tpp->writeEmbProfile (getCacheFileName ("embprofiles", ".icc"));
+    payload.clear ();
+    tpp->writeEmbProfile (payload);
+    cachemgr->saveEntrySection (fname, CacheIndex::Section::EMBEDDED_PROFILE, payload);
 
     // save supplementary data
-    tpp->writeData (getCacheFileName ("data", ".txt"));
+    cachemgr->updateEntryData (fname, [this] (Glib::KeyFile& keyFile) {
+        return tpp->writeData (keyFile);
+    });
 }
 
 /*
  * Save thumbnail's data to the cache - MUTEX PROTECTED
  * This includes:
- *  - image's bitmap (*.rtti)
+ *  - image's bitmap
  *  - auto exposure's histogram (full thumbnail only)
  *  - embedded profile (full thumbnail only)
  *  - LiveThumbData section of the data file
@@ -909,7 +916,7 @@ void Thumbnail::updateCache (bool updatePParams, bool updateCacheImageData)
     }
 
     if (updateCacheImageData) {
-        cfs.save (getCacheFileName ("data", ".txt"));
+        saveCacheImageData ();
     }
 }
 
@@ -922,6 +929,13 @@ Thumbnail::~Thumbnail ()
     mutex.unlock();
 }
 
+void Thumbnail::saveCacheImageData ()
+{
+    cachemgr->updateEntryData (fname, [this] (Glib::KeyFile& keyFile) {
+        return cfs.save (keyFile) == 0;
+    });
+}
+
 Glib::ustring Thumbnail::getCacheFileName (const Glib::ustring& subdir, const Glib::ustring& fext) const
 {
     return cachemgr->getCacheFileName (subdir, fname, fext, cfs.md5);
@@ -0,0 +1,629 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glibmm.h>
+#include <giomm.h>
+#include <locale.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "syntheticraw.h"
+
+#include "../../rtengine/cpufeatures.h"
+#include "../../rtengine/curves.h"
+#include "../../rtengine/gauss.h"
+#include "../../rtengine/imagefloat.h"
+#include "../../rtengine/improcfun.h"
+#include "../../rtengine/labimage.h"
+#include "../../rtengine/noncopyable.h"
+#include "../../rtengine/rtengine.h"
+#include "../../rtgui/options.h"
+
+// referenced by the rtgui sources linked in
+Glib::ustring argv0;
+Glib::ustring creditsPath;
+Glib::ustring licensePath;
+Glib::ustring argv1;
+
+namespace
+{
+
+using rtbench::Sensor;
+
+/* One microbenchmark. prepare(), reset() and release() are not timed, only run() is. */
+class Benchmark :
+    public rtengine::NonCopyable
+{
+public:
+    explicit Benchmark (const std::string& name) :
+        name(name)
+    {
+    }
+
+    virtual ~Benchmark () {}
+
+    const std::string& getName () const
+    {
+        return name;
+    }
+
+    virtual void prepare (int width, int height) = 0;
+    /// Restores the input modified by run()
+    virtual void reset () {}
+    virtual void run () = 0;
+    virtual void release () = 0;
+
+private:
+    const std::string name;
+};
+
+class DemosaicBenchmark :
+    public Benchmark
+{
+public:
+    DemosaicBenchmark (const std::string& name, Sensor sensor, const char* method) :
+        Benchmark(name),
+        sensor(sensor)
+    {
+        if (sensor == Sensor::XTRANS) {
+            raw.xtranssensor.method = method;
+        } else {
+            raw.bayersensor.method = method;
+        }
+    }
+
+    void prepare (int width, int height) override
+    {
+        source.reset(new rtbench::SyntheticRawSource(width, height, sensor));
+    }
+
+    void reset () override
+    {
+        source->resetMosaic();
+    }
+
+    void run () override
+    {
+        source->demosaic(raw);
+    }
+
+    void release () override
+    {
+        source.reset();
+    }
+
+private:
+    const Sensor sensor;
+    rtengine::procparams::RAWParams raw;
+    std::unique_ptr<rtbench::SyntheticRawSource> source;
+};
+
+/* Base of the benchmarks working on a processed image: keeps a pristine copy of the input to restore it before each run. */
+template<typename Image>
+class ImageBenchmark :
+    public Benchmark
+{
+public:
+    explicit ImageBenchmark (const std::string& name) :
+        Benchmark(name)
+    {
+    }
+
+    void prepare (int width, int height) override
+    {
+        original.reset(new Image(width, height));
+        image.reset(new Image(width, height));
+        rtbench::fillImage(original.get());
+    }
+
+    void reset () override
+    {
+        copy(original.get(), image.get());
+    }
+
+    void release () override
+    {
+        original.reset();
+        image.reset();
+    }
+
+protected:
+    rtengine::procparams::ProcParams params;
+    std::unique_ptr<Image> original;
+    std::unique_ptr<Image> image;
+
+private:
+    static void copy (rtengine::Imagefloat* src, rtengine::Imagefloat* dst)
+    {
+        src->copyData(dst);
+    }
+
+    static void copy (rtengine::LabImage* src, rtengine::LabImage* dst)
+    {
+        dst->CopyFrom(src);
+    }
+};
+
+class DenoiseBenchmark :
+    public ImageBenchmark<rtengine::Imagefloat>
+{
+public:
+    DenoiseBenchmark () :
+        ImageBenchmark("denoise"),
+        tileData(1024, 0.f)
+    {
+        params.dirpyrDenoise.enabled = true;
+        params.dirpyrDenoise.luma = 30;
+        params.dirpyrDenoise.Ldetail = 50;
+        params.dirpyrDenoise.chroma = 15;
+        params.dirpyrDenoise.Cmethod = "MAN";
+        params.dirpyrDenoise.C2method = "MANU";
+    }
+
+    void run () override
+    {
+        rtengine::ImProcFunctions ipf(&params);
+        rtengine::NoiseCurve noiseLCurve;
+        rtengine::NoiseCurve noiseCCurve;
+        params.dirpyrDenoise.getCurves(noiseLCurve, noiseCCurve);
+        noiseLCurve.Reset();
+        float chaut, redaut, blueaut, maxredaut, maxblueaut, nresi, highresi;
+        ipf.RGB_denoise(2, image.get(), image.get(), nullptr, tileData.data(), tileData.data(), tileData.data(), true, params.dirpyrDenoise, 0.0, noiseLCurve, noiseCCurve, chaut, redaut, blueaut, maxredaut, maxblueaut, nresi, highresi);
+    }
+
+private:
+    std::vector<float> tileData;
+};
+
+class WaveletBenchmark :
+    public ImageBenchmark<rtengine::LabImage>
+{
+public:
+    WaveletBenchmark () :
+        ImageBenchmark("wavelet")
+    {
+        params.wavelet.enabled = true;
+        params.wavelet.expcontrast = true;
+
+        for (int i = 0; i < 4; ++i) {
+            params.wavelet.c[i] = 20;
+        }
+    }
+
+    void run () override
+    {
+        rtengine::ImProcFunctions ipf(&params);
+        rtengine::WavCurve wavCLVCurve;
+        rtengine::WavOpacityCurveRG waOpacityCurveRG;
+        rtengine::WavOpacityCurveBY waOpacityCurveBY;
+        rtengine::WavOpacityCurveW waOpacityCurveW;
+        rtengine::WavOpacityCurveWL waOpacityCurveWL;
+        params.wavelet.getCurves(wavCLVCurve, waOpacityCurveRG, waOpacityCurveBY, waOpacityCurveW, waOpacityCurveWL);
+        LUTf wavclCurve(65536, 0);
+        bool wavcontlutili = false;
+        rtengine::CurveFactory::curveWavContL(wavcontlutili, params.wavelet.wavclCurve, wavclCurve, 1);
+        ipf.ip_wavelet(image.get(), image.get(), 2, params.wavelet, wavCLVCurve, waOpacityCurveRG, waOpacityCurveBY, waOpacityCurveW, waOpacityCurveWL, wavclCurve, wavcontlutili, 1);
+    }
+};
+
+class GaussBenchmark :
+    public ImageBenchmark<rtengine::LabImage>
+{
+public:
+    GaussBenchmark (const std::string& name, double sigma) :
+        ImageBenchmark(name),
+        sigma(sigma)
+    {
+    }
+
+    void reset () override
+    {
+    }
+
+    void run () override
+    {
+#ifdef _OPENMP
+        #pragma omp parallel
+#endif
+        gaussianBlur(original->L, image->L, original->W, original->H, sigma);
+    }
+
+private:
+    const double sigma;
+};
+
+class LanczosBenchmark :
+    public ImageBenchmark<rtengine::LabImage>
+{
+public:
+    LanczosBenchmark () :
+        ImageBenchmark("lanczos")
+    {
+    }
+
+    void prepare (int width, int height) override
+    {
+        ImageBenchmark::prepare(width, height);
+        resized.reset(new rtengine::LabImage(static_cast<int>(width * scale), static_cast<int>(height * scale)));
+    }
+
+    void reset () override
+    {
+    }
+
+    void run () override
+    {
+        rtengine::ImProcFunctions ipf(&params);
+        ipf.Lanczos(original.get(), resized.get(), scale);
+    }
+
+    void release () override
+    {
+        ImageBenchmark::release();
+        resized.reset();
+    }
+
+private:
+    static constexpr float scale = 0.35f;
+    std::unique_ptr<rtengine::LabImage> resized;
+};
+
+constexpr float LanczosBenchmark::scale;
+
+class TransformBenchmark :
+    public ImageBenchmark<rtengine::Imagefloat>
+{
+public:
+    TransformBenchmark () :
+        ImageBenchmark("transform")
+    {
+        // rotation and distortion at full scale take the high quality path
+        params.rotate.degree = 2.5;
+        params.distortion.amount = 0.05;
+    }
+
+    void reset () override
+    {
+    }
+
+    void run () override
+    {
+        rtengine::ImProcFunctions ipf(&params);
+        const int width = original->getWidth();
+        const int height = original->getHeight();
+        ipf.transform(original.get(), image.get(), 0, 0, 0, 0, width, height, width, height, 0.0, 0.0, 0.f, 0.0, 0, true);
+    }
+};
+
+class EPDBenchmark :
+    public ImageBenchmark<rtengine::LabImage>
+{
+public:
+    EPDBenchmark () :
+        ImageBenchmark("epd")
+    {
+        params.epd.enabled = true;
+    }
+
+    void run () override
+    {
+        rtengine::ImProcFunctions ipf(&params);
+        ipf.EPDToneMap(image.get(), 5, 1);
+    }
+};
+
+std::vector<std::unique_ptr<Benchmark>> createBenchmarks ()
+{
+    using Bayer = rtengine::procparams::RAWParams::BayerSensor;
+    using XTrans = rtengine::procparams::RAWParams::XTransSensor;
+
+    std::vector<std::unique_ptr<Benchmark>> benchmarks;
+
+    // pixelshift needs several frames, "none" is the same code as "mono"
+    for (int method = 0; method < Bayer::numMethods; ++method) {
+        if (method != Bayer::pixelshift && method != Bayer::none) {
+            benchmarks.emplace_back(new DemosaicBenchmark(std::string("demosaic-bayer-") + Bayer::methodstring[method], Sensor::BAYER, Bayer::methodstring[method]));
+        }
+    }
+
+    const struct {
+        XTrans::eMethod method;
+        const char* name;
+    } xtransMethods[] = {
+        {XTrans::threePass, "3pass"},
+        {XTrans::onePass, "1pass"},
+        {XTrans::fast, "fast"},
+        {XTrans::mono, "mono"}
+    };
+
+    for (const auto& method : xtransMethods) {
+        benchmarks.emplace_back(new DemosaicBenchmark(std::string("demosaic-xtrans-") + method.name, Sensor::XTRANS, XTrans::methodstring[method.method]));
+    }
+
+    benchmarks.emplace_back(new DenoiseBenchmark);
+    benchmarks.emplace_back(new WaveletBenchmark);
+    benchmarks.emplace_back(new GaussBenchmark("gauss-small", 2.0));
+    benchmarks.emplace_back(new GaussBenchmark("gauss-large", 40.0));
+    benchmarks.emplace_back(new LanczosBenchmark);
+    benchmarks.emplace_back(new TransformBenchmark);
+    benchmarks.emplace_back(new EPDBenchmark);
+
+    return benchmarks;
+}
+
+bool matches (const std::string& name, const std::vector<std::string>& filters)
+{
+    if (filters.empty()) {
+        return true;
+    }
+
+    for (const auto& filter : filters) {
+        if (name.find(filter) != std::string::npos) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::vector<std::string> split (const std::string& list)
+{
+    std::vector<std::string> items;
+    std::istringstream stream(list);
+    std::string item;
+
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+
+    return items;
+}
+
+bool parseNumbers (const std::string& list, std::vector<int>& numbers)
+{
+    numbers.clear();
+
+    for (const auto& item : split(list)) {
+        char* end;
+        const long value = std::strtol(item.c_str(), &end, 10);
+
+        if (*end || value < 1) {
+            return false;
+        }
+
+        numbers.push_back(value);
+    }
+
+    return !numbers.empty();
+}
+
+int getMaxThreads ()
+{
+#ifdef _OPENMP
+    return omp_get_num_procs();
+#else
+    return 1;
+#endif
+}
+
+void setThreads (int threads)
+{
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+#endif
+}
+
+// 1, 2, 4 ... and the number of processors
+std::vector<int> getDefaultThreads ()
+{
+    std::vector<int> threads;
+    const int maxThreads = getMaxThreads();
+
+    for (int count = 1; count < maxThreads; count *= 2) {
+        threads.push_back(count);
+    }
+
+    threads.push_back(maxThreads);
+    return threads;
+}
+
+double runOnce (Benchmark& benchmark)
+{
+    benchmark.reset();
+
+    const auto start = std::chrono::steady_clock::now();
+    benchmark.run();
+    const auto stop = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+void printUsage (const char* name)
+{
+    std::cout << "Usage: " << name << " [-s <sizes>] [-t <threads>] [-r <runs>] [-b <benchmarks>] [-o <report>] [-l]" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Runs the RawTherapee processing microbenchmarks on synthetic Bayer and X-Trans images." << std::endl;
+    std::cout << "No input file nor network access is needed, the images are the same on every machine." << std::endl;
+    std::cout << std::endl;
+    std::cout << "  -s <sizes>       Comma separated image sizes, in megapixels (default value: 2,12,24)." << std::endl;
+    std::cout << "  -t <threads>     Comma separated thread counts (default value: 1,2,4 ... up to the number of processors)." << std::endl;
+    std::cout << "  -r <runs>        Number of timed runs of each benchmark (default value: 3)." << std::endl;
+    std::cout << "  -b <benchmarks>  Comma separated parts of the names of the benchmarks to run (default: all of them)." << std::endl;
+    std::cout << "  -o <report>      Write the report to <report> instead of the standard output." << std::endl;
+    std::cout << "  -l               List the benchmarks and exit." << std::endl;
+    std::cout << std::endl;
+    std::cout << "The report is tab separated, one line per benchmark, size and thread count:" << std::endl;
+    std::cout << "  benchmark, width, height, threads, best and median time in ms, megapixels per second and" << std::endl;
+    std::cout << "  speedup over the smallest thread count. Lines starting with '#' describe the machine." << std::endl;
+}
+
+}
+
+int main (int argc, char** argv)
+{
+    setlocale(LC_ALL, "");
+    setlocale(LC_NUMERIC, "C");
+
+    Gio::init();
+
+    std::vector<int> sizes = {2, 12, 24};
+    std::vector<int> threads = getDefaultThreads();
+    int runs = 3;
+    std::vector<std::string> filters;
+    std::string reportFile;
+    bool listOnly = false;
+
+    for (int iArg = 1; iArg < argc; ++iArg) {
+        const std::string arg(argv[iArg]);
+        const bool hasValue = iArg + 1 < argc;
+
+        if (arg == "-s" && hasValue) {
+            if (!parseNumbers(argv[++iArg], sizes)) {
+                std::cerr << "Error: invalid list of sizes \"" << argv[iArg] << "\"" << std::endl;
+                return -1;
+            }
+        } else if (arg == "-t" && hasValue) {
+            if (!parseNumbers(argv[++iArg], threads)) {
+                std::cerr << "Error: invalid list of thread counts \"" << argv[iArg] << "\"" << std::endl;
+                return -1;
+            }
+        } else if (arg == "-r" && hasValue) {
+            runs = std::atoi(argv[++iArg]);
+
+            if (runs < 1) {
+                std::cerr << "Error: the number of runs has to be at least 1" << std::endl;
+                return -1;
+            }
+        } else if (arg == "-b" && hasValue) {
+            filters = split(argv[++iArg]);
+        } else if (arg == "-o" && hasValue) {
+            reportFile = argv[++iArg];
+        } else if (arg == "-l") {
+            listOnly = true;
+        } else {
+            printUsage(argv[0]);
+            return arg == "-h" ? 0 : -1;
+        }
+    }
+
+    std::vector<std::unique_ptr<Benchmark>> benchmarks = createBenchmarks();
+
+    if (listOnly) {
+        for (const auto& benchmark : benchmarks) {
+            std::cout << benchmark->getName() << std::endl;
+        }
+
+        return 0;
+    }
+
+    // the defaults of the options, not the user's, so that the results don't depend on the machine setup
+    options.rtSettings.verbose = false;
+    rtengine::init(&options.rtSettings, RTBENCH_DATA_DIR, Glib::get_tmp_dir(), false);
+
+    std::ofstream file;
+
+    if (!reportFile.empty()) {
+        file.open(reportFile);
+
+        if (!file) {
+            std::cerr << "Error: can't write \"" << reportFile << "\"" << std::endl;
+            return -2;
+        }
+    }
+
+    std::ostream& report = reportFile.empty() ? std::cout : file;
+    report << "# rtbench 1" << std::endl;
+    report << "# version\t" << versionString << std::endl;
+    report << "# compiler\t" <<
+#ifdef __VERSION__
+           __VERSION__
+#else
+           "unknown"
+#endif
+           << std::endl;
+    report << "# simd\t" << rtengine::getSimdLevelName(rtengine::getSimdLevel()) << std::endl;
+    report << "# processors\t" << getMaxThreads() << std::endl;
+    report << "# runs\t" << runs << std::endl;
+    report << "benchmark\twidth\theight\tthreads\tbest_ms\tmedian_ms\tmpix_per_s\tspeedup" << std::endl;
+    report << std::fixed;
+
+    for (const int size : sizes) {
+        // 3:2 sensor, even dimensions multiple of 6 so that both CFA patterns tile exactly
+        const int height = std::max(static_cast<int>(std::sqrt(size * 1e6 / 1.5)) / 6 * 6, 48);
+        const int width = height * 3 / 2 / 6 * 6;
+
+        for (const auto& benchmark : benchmarks) {
+            if (!matches(benchmark->getName(), filters)) {
+                continue;
+            }
+
+            std::cerr << benchmark->getName() << " " << width << "x" << height << std::endl;
+            setThreads(getMaxThreads());
+            benchmark->prepare(width, height);
+            // warm up: first touch of the buffers, FFTW plans, lookup tables
+            runOnce(*benchmark);
+
+            double reference = 0.0;
+
+            for (const int count : threads) {
+                setThreads(count);
+                std::vector<double> times;
+
+                for (int run = 0; run < runs; ++run) {
+                    times.push_back(runOnce(*benchmark));
+                }
+
+                std::sort(times.begin(), times.end());
+                const double best = times.front();
+                const double median = times[times.size() / 2];
+
+                if (reference == 0.0) {
+                    reference = best;
+                }
+
+                report << benchmark->getName() << '\t' << width << '\t' << height << '\t' << count << '\t'
+                       << std::setprecision(2) << best << '\t' << median << '\t'
+                       << width * static_cast<double>(height) / (1000.0 * best) << '\t'
+                       << std::setprecision(3) << reference / best << std::endl;
+            }
+
+            benchmark->release();
+        }
+    }
+
+    setThreads(getMaxThreads());
+    rtengine::cleanup();
+
+    return 0;
+}
@@ -0,0 +1,223 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "syntheticraw.h"
+
+#include "../../rtengine/iccmatrices.h"
+#include "../../rtengine/imagefloat.h"
+#include "../../rtengine/labimage.h"
+
+namespace
+{
+
+// Fuji X-Trans layout, 0 = red, 1 = green, 2 = blue
+constexpr int xtransPattern[6][6] = {
+    {1, 1, 0, 1, 1, 2},
+    {1, 1, 2, 1, 1, 0},
+    {2, 0, 1, 0, 2, 1},
+    {1, 1, 2, 1, 1, 0},
+    {1, 1, 0, 1, 1, 2},
+    {0, 2, 1, 2, 0, 1}
+};
+
+// RGGB
+constexpr unsigned bayerPattern = 0x94949494;
+
+std::uint32_t hash (std::uint32_t x, std::uint32_t y, std::uint32_t c)
+{
+    std::uint32_t h = x * 0x9E3779B1u ^ y * 0x85EBCA77u ^ c * 0xC2B2AE3Du;
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return h;
+}
+
+// triangle wave with period 1 and range [0, 1], cheaper and more portable than sin()
+float triangle (float t)
+{
+    return std::fabs(t - std::floor(t) - 0.5f) * 2.f;
+}
+
+}
+
+float rtbench::scene (int channel, int x, int y, int width, int height)
+{
+    const float u = static_cast<float>(x) / width;
+    const float v = static_cast<float>(y) / height;
+
+    // smooth gradients, a bit different per channel to get colors
+    float value = 0.15f + 0.35f * (channel == 0 ? u : channel == 1 ? 0.5f * (u + v) : v);
+
+    // zone plate in the upper left quarter, its frequency reaches the Nyquist limit of the sensor
+    if (u < 0.5f && v < 0.5f) {
+        const float dx = x - 0.25f * width;
+        const float dy = y - 0.25f * height;
+        value += 0.3f * triangle((dx * dx + dy * dy) / (0.5f * width));
+    }
+
+    // saturated patches with hard edges in the lower right quarter
+    if (u >= 0.5f && v >= 0.5f && ((x / 64 + y / 64) & 1)) {
+        value = (x / 64 + y / 128 + channel) % 3 ? 0.05f : 0.9f;
+    }
+
+    // fine oblique stripes in the upper right quarter
+    if (u >= 0.5f && v < 0.5f) {
+        value += 0.2f * triangle((x + 2 * y) / 3.5f);
+    }
+
+    // photon noise like grain everywhere
+    value += (static_cast<int>(hash(x, y, channel) & 0xffff) - 32768) * (0.02f / 32768.f);
+
+    return std::max(value, 0.f) * 65535.f;
+}
+
+void rtbench::fillImage (rtengine::Imagefloat* image)
+{
+    const int width = image->getWidth();
+    const int height = image->getHeight();
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            image->r(y, x) = scene(0, x, y, width, height);
+            image->g(y, x) = scene(1, x, y, width, height);
+            image->b(y, x) = scene(2, x, y, width, height);
+        }
+    }
+}
+
+void rtbench::fillImage (rtengine::LabImage* image)
+{
+    const int width = image->W;
+    const int height = image->H;
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const float r = scene(0, x, y, width, height);
+            const float g = scene(1, x, y, width, height);
+            const float b = scene(2, x, y, width, height);
+            // rough opponent transform, enough to get plausible L, a and b ranges
+            image->L[y][x] = std::min(0.5f * (0.3f * r + 0.6f * g + 0.1f * b), 32768.f);
+            image->a[y][x] = 0.25f * (r - g);
+            image->b[y][x] = 0.25f * (g - b);
+        }
+    }
+}
+
+rtbench::SyntheticRawImage::SyntheticRawImage (int width, int height, Sensor sensor) :
+    RawImage("")
+{
+    this->width = raw_width = iwidth = width;
+    this->height = raw_height = iheight = height;
+    top_margin = left_margin = 0;
+    fuji_width = 0;
+    shrink = 0;
+    colors = 3;
+    is_raw = 1;
+    is_foveon = 0;
+    dng_version = 0;
+    zero_is_bad = 0;
+    black = 0;
+    maximum = 65535;
+    memset(cblack, 0, sizeof(cblack));
+    strcpy(make, "RawTherapee");
+    strcpy(model, "Synthetic");
+
+    if (sensor == Sensor::XTRANS) {
+        filters = 9;
+
+        for (int row = 0; row < 6; ++row) {
+            for (int col = 0; col < 6; ++col) {
+                xtrans[row][col] = xtrans_abs[row][col] = xtransPattern[row][col];
+            }
+        }
+    } else {
+        filters = bayerPattern;
+    }
+
+    prefilters = filters;
+
+    for (int c = 0; c < 4; ++c) {
+        cam_mul[c] = pre_mul[c] = 1.f;
+
+        for (int i = 0; i < 3; ++i) {
+            rgb_cam[i][c] = i == c ? 1.f : 0.f;
+        }
+    }
+}
+
+rtbench::SyntheticRawSource::SyntheticRawSource (int width, int height, Sensor sensor) :
+    mosaic(width, height)
+{
+    ri = new SyntheticRawImage(width, height, sensor);
+    riFrames[0] = ri;
+    numFrames = 1;
+    W = width;
+    H = height;
+    border = sensor == Sensor::XTRANS ? 7 : 4;
+
+    for (int c = 0; c < 4; ++c) {
+        c_white[c] = 65535.f;
+        scale_mul[c] = 1.f;
+    }
+
+    // the camera space is sRGB
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            imatrices.rgb_cam[i][j] = imatrices.cam_rgb[i][j] = i == j ? 1.0 : 0.0;
+            imatrices.xyz_cam[i][j] = xyz_sRGB[i][j];
+            imatrices.cam_xyz[i][j] = sRGB_xyz[i][j];
+        }
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const int channel = sensor == Sensor::XTRANS ? ri->XTRANSFC(y, x) : ri->FC(y, x);
+            mosaic[y][x] = scene(channel, x, y, width, height);
+        }
+    }
+
+    rawData(W, H);
+    red(W, H);
+    green(W, H);
+    blue(W, H);
+    resetMosaic();
+}
+
+void rtbench::SyntheticRawSource::resetMosaic ()
+{
+    for (int y = 0; y < H; ++y) {
+        memcpy(rawData[y], mosaic[y], W * sizeof(float));
+    }
+}
@@ -0,0 +1,82 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "../../rtengine/array2D.h"
+#include "../../rtengine/procparams.h"
+#include "../../rtengine/rawimage.h"
+#include "../../rtengine/rawimagesource.h"
+
+namespace rtengine
+{
+class Imagefloat;
+class LabImage;
+}
+
+namespace rtbench
+{
+
+enum class Sensor {
+    BAYER,
+    XTRANS
+};
+
+/**
+ * @brief Deterministic test scene
+ *
+ * Smooth gradients, a zone plate, hard edges and pixel level noise, so that the demosaicers and the
+ * detail dependent tools take their real code paths. Only integer hashing and IEEE arithmetic are used,
+ * the scene is the same on every machine.
+ */
+float scene (int channel, int x, int y, int width, int height);
+
+void fillImage (rtengine::Imagefloat* image);
+void fillImage (rtengine::LabImage* image);
+
+/**
+ * @brief Raw image without a file behind it
+ *
+ * Carries the CFA layout, white level and identity color matrices of an imaginary camera, which is
+ * all RawImageSource needs to demosaic.
+ */
+class SyntheticRawImage :
+    public rtengine::RawImage
+{
+public:
+    SyntheticRawImage (int width, int height, Sensor sensor);
+};
+
+/**
+ * @brief RawImageSource fed with a synthetic mosaic instead of a decoded file
+ *
+ * rawData holds the mosaic as it would be after preprocess(), so demosaic() runs exactly the
+ * code used on real files.
+ */
+class SyntheticRawSource :
+    public rtengine::RawImageSource
+{
+public:
+    SyntheticRawSource (int width, int height, Sensor sensor);
+
+    /// Restores the mosaic, some demosaicers modify rawData in place
+    void resetMosaic ();
+
+private:
+    array2D<float> mosaic;
+};
+
+}